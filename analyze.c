@@ -0,0 +1,678 @@
+/*
+ *  analyze.c
+ *  Contains the program analyzer
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyze.h"
+#include "functional.h"
+#include "prefetch.h"
+#include "vector.h"
+
+/* Producers tracked: R0 - R15, then V0 - V7 */
+#define NUM_PRODUCERS (16 + APEX_VECTOR_REGS)
+
+static const APEX_Instruction *
+instruction_at(const APEX_CPU *cpu, int pc)
+{
+  int index = get_code_index(pc);
+  if (pc < 4000 || pc % 4 != 0 || index >= cpu->code_memory_size)
+  {
+    return NULL;
+  }
+  return &cpu->code_memory[index];
+}
+
+static int
+is_branch(int op)
+{
+  return op == OP_BZ || op == OP_BNZ;
+}
+
+/* Instructions after which Fetch does not simply go on with pc + 4 */
+static int
+ends_block(int op)
+{
+  return is_branch(op) || op == OP_JUMP || op == OP_HALT || op == OP_LOOP ||
+         op == OP_CALL || op == OP_RET;
+}
+
+static void
+count_size(long *sizes, long size)
+{
+  sizes[size > APEX_ANALYSIS_BLOCK_SIZES ? APEX_ANALYSIS_BLOCK_SIZES
+                                         : size - 1]++;
+}
+
+static void
+count_distance(long *distances, long distance)
+{
+  distances[distance > APEX_ANALYSIS_DISTANCES ? APEX_ANALYSIS_DISTANCES
+                                               : distance - 1]++;
+}
+
+/*
+ * Leaders are the first instruction, branch and CALL targets, the end of
+ * a LOOP body and the instructions after a control transfer; JUMP and RET
+ * targets are only known at run time.
+ */
+static void
+analyze_code(APEX_Analysis *analysis, const APEX_CPU *cpu)
+{
+  int size = cpu->code_memory_size;
+  unsigned char *leader = calloc(size + 1, 1);
+  if (!leader)
+  {
+    return;
+  }
+
+  leader[0] = 1;
+  for (int i = 0; i < size; ++i)
+  {
+    const APEX_Instruction *ins = &cpu->code_memory[i];
+    int pc = 4000 + 4 * i;
+    int target = -1;
+
+    analysis->names[ins->op] = ins->opcode;
+    analysis->static_ops[ins->op]++;
+
+    if (is_branch(ins->op) || ins->op == OP_CALL ||
+        (ins->op == OP_LOOP && ins->imm > 4))
+    {
+      target = get_code_index(pc + ins->imm);
+    }
+    if (target >= 0 && target < size && (pc + ins->imm) % 4 == 0)
+    {
+      leader[target] = 1;
+    }
+    if (ends_block(ins->op))
+    {
+      leader[i + 1] = 1;
+    }
+  }
+
+  long block = 0;
+  for (int i = 0; i < size; ++i)
+  {
+    if (leader[i] && block > 0)
+    {
+      count_size(analysis->static_block_sizes, block);
+      analysis->static_blocks++;
+      block = 0;
+    }
+    block++;
+  }
+  if (block > 0)
+  {
+    count_size(analysis->static_block_sizes, block);
+    analysis->static_blocks++;
+  }
+  free(leader);
+}
+
+APEX_Analysis *
+analysis_create(const APEX_CPU *cpu, int interval)
+{
+  APEX_Analysis *analysis = calloc(1, sizeof(*analysis));
+  if (!analysis)
+  {
+    return NULL;
+  }
+
+  analysis->interval = interval;
+  analysis->memory_size = cpu->data_memory_size;
+  analysis->executed = calloc(cpu->code_memory_size, sizeof(long));
+  analysis->taken = calloc(cpu->code_memory_size, sizeof(long));
+  analysis->word_interval = calloc(cpu->data_memory_size, sizeof(int));
+  analysis->line_interval =
+      calloc(cpu->data_memory_size / APEX_DCACHE_LINE_WORDS + 1, sizeof(int));
+  if (!analysis->executed || !analysis->taken || !analysis->word_interval ||
+      !analysis->line_interval)
+  {
+    analysis_destroy(analysis);
+    return NULL;
+  }
+
+  analyze_code(analysis, cpu);
+  return analysis;
+}
+
+void analysis_destroy(APEX_Analysis *analysis)
+{
+  if (!analysis)
+  {
+    return;
+  }
+  free(analysis->executed);
+  free(analysis->taken);
+  free(analysis->word_interval);
+  free(analysis->line_interval);
+  free(analysis->sets);
+  free(analysis);
+}
+
+/* Words from address accessed in the current interval */
+static void
+touch(APEX_Analysis *analysis, int address, int words)
+{
+  int mark = analysis->set_count + 1;
+
+  for (int w = address; w < address + words; ++w)
+  {
+    int line = w / APEX_DCACHE_LINE_WORDS;
+    if (analysis->word_interval[w] != mark)
+    {
+      analysis->footprint_words += analysis->word_interval[w] == 0;
+      analysis->word_interval[w] = mark;
+      analysis->current.words++;
+    }
+    if (analysis->line_interval[line] != mark)
+    {
+      analysis->footprint_lines += analysis->line_interval[line] == 0;
+      analysis->line_interval[line] = mark;
+      analysis->current.lines++;
+    }
+  }
+}
+
+static void
+close_interval(APEX_Analysis *analysis)
+{
+  if (analysis->set_count == analysis->set_capacity)
+  {
+    int capacity = analysis->set_capacity ? 2 * analysis->set_capacity : 64;
+    APEX_WorkingSet *sets =
+        realloc(analysis->sets, capacity * sizeof(APEX_WorkingSet));
+    if (!sets)
+    {
+      return;
+    }
+    analysis->sets = sets;
+    analysis->set_capacity = capacity;
+  }
+
+  analysis->current.end = analysis->instructions;
+  analysis->sets[analysis->set_count++] = analysis->current;
+  memset(&analysis->current, 0, sizeof(analysis->current));
+}
+
+/*
+ * Executes the instructions the functional executor leaves to the
+ * pipeline, as one core with no other writer: CPUID gives 0. LOOP only
+ * falls through, the run loop takes care of its body. CALL and RET go
+ * where they always do; the return address stack only decides how long
+ * it takes. Returns the next pc or -1 on an access out of range.
+ */
+static int
+execute_extra(APEX_FuncState *state, int *vregs, int vlen, int *reservation,
+              const APEX_Instruction *ins, int pc, APEX_FuncRecord *record)
+{
+  int *regs = state->regs;
+  int words = 1;
+
+  memset(record, 0, sizeof(*record));
+  record->pc = pc;
+  record->op = ins->op;
+  record->next_pc = pc + 4;
+
+  switch (ins->op)
+  {
+  case OP_LL:
+  case OP_VLOAD:
+  case OP_VSTORE:
+    record->address = regs[ins->rs1] + ins->imm;
+    break;
+  case OP_SC:
+    record->address = regs[ins->rs2];
+    break;
+  }
+  if (ins->op == OP_VLOAD || ins->op == OP_VSTORE)
+  {
+    words = vlen;
+  }
+  if (record->address < 0 || record->address + words > state->memory_size)
+  {
+    return -1;
+  }
+
+  switch (ins->op)
+  {
+  case OP_LL:
+    regs[ins->rd] = state->memory[record->address];
+    *reservation = record->address;
+    break;
+  case OP_SC:
+    record->result = *reservation == record->address;
+    if (record->result)
+    {
+      state->memory[record->address] = regs[ins->rs1];
+    }
+    regs[ins->rd] = record->result;
+    *reservation = -1;
+    break;
+  case OP_CPUID:
+    regs[ins->rd] = 0;
+    break;
+  case OP_CALL:
+    regs[ins->rd] = pc + 4;
+    record->next_pc = pc + ins->imm;
+    break;
+  case OP_RET:
+    record->next_pc = regs[ins->rs1];
+    break;
+  case OP_VLOAD:
+    memcpy(&vregs[ins->rd * APEX_MAX_VLEN], &state->memory[record->address],
+           vlen * sizeof(int));
+    break;
+  case OP_VSTORE:
+    memcpy(&state->memory[record->address], &vregs[ins->rd * APEX_MAX_VLEN],
+           vlen * sizeof(int));
+    break;
+  case OP_VADD:
+    vector_add(&vregs[ins->rd * APEX_MAX_VLEN], &vregs[ins->rs1 * APEX_MAX_VLEN],
+               &vregs[ins->rs2 * APEX_MAX_VLEN], vlen);
+    break;
+  case OP_VSUB:
+    vector_sub(&vregs[ins->rd * APEX_MAX_VLEN], &vregs[ins->rs1 * APEX_MAX_VLEN],
+               &vregs[ins->rs2 * APEX_MAX_VLEN], vlen);
+    break;
+  case OP_VMUL:
+    vector_mul(&vregs[ins->rd * APEX_MAX_VLEN], &vregs[ins->rs1 * APEX_MAX_VLEN],
+               &vregs[ins->rs2 * APEX_MAX_VLEN], vlen);
+    break;
+  }
+  return record->next_pc;
+}
+
+/* Producers an instruction reads, R0 - R15 as 0 - 15 and V0 - V7 as 16 - 23 */
+static int
+sources(const APEX_Instruction *ins, int *producers)
+{
+  switch (ins->op)
+  {
+  case OP_STR:
+    producers[0] = ins->rs1;
+    producers[1] = ins->rs2;
+    producers[2] = ins->rs3;
+    return 3;
+  case OP_STORE:
+  case OP_LDR:
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_AND:
+  case OP_OR:
+  case OP_EXOR:
+  case OP_SC:
+    producers[0] = ins->rs1;
+    producers[1] = ins->rs2;
+    return 2;
+  case OP_LOAD:
+  case OP_ADDL:
+  case OP_SUBL:
+  case OP_JUMP:
+  case OP_LL:
+  case OP_VLOAD:
+  case OP_LOOP:
+  case OP_RET:
+    producers[0] = ins->rs1;
+    return 1;
+  case OP_VSTORE:
+    producers[0] = ins->rs1;
+    producers[1] = 16 + ins->rd;
+    return 2;
+  case OP_VADD:
+  case OP_VSUB:
+  case OP_VMUL:
+    producers[0] = 16 + ins->rs1;
+    producers[1] = 16 + ins->rs2;
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+/* Producer an instruction writes, -1 if none */
+static int
+destination(const APEX_Instruction *ins)
+{
+  switch (ins->op)
+  {
+  case OP_MOVC:
+  case OP_LOAD:
+  case OP_LDR:
+  case OP_ADD:
+  case OP_ADDL:
+  case OP_SUB:
+  case OP_SUBL:
+  case OP_MUL:
+  case OP_AND:
+  case OP_OR:
+  case OP_EXOR:
+  case OP_LL:
+  case OP_SC:
+  case OP_CPUID:
+  case OP_CALL:
+    return ins->rd;
+  case OP_VLOAD:
+  case OP_VADD:
+  case OP_VSUB:
+  case OP_VMUL:
+    return 16 + ins->rd;
+  default:
+    return -1;
+  }
+}
+
+static int
+is_load(int op)
+{
+  return op == OP_LOAD || op == OP_LDR || op == OP_LL || op == OP_VLOAD;
+}
+
+static int
+sets_flag(int op)
+{
+  return op == OP_ADD || op == OP_SUB || op == OP_ADDL || op == OP_SUBL ||
+         op == OP_MUL;
+}
+
+/*
+ * Runs the program from pc 4000 on the data memory of the CPU until HALT
+ * or limit instructions (none if 0) and counts what it commits
+ */
+void analysis_run(APEX_Analysis *analysis, APEX_CPU *cpu, long limit)
+{
+  APEX_FuncState state;
+  APEX_FuncRecord record;
+  long producer[NUM_PRODUCERS] = {0}; // Instruction number of the last write
+  int from_load[NUM_PRODUCERS] = {0};
+  long flag_producer = 0;
+  int reservation = -1;
+  int loop_start = 0;
+  int loop_end = 0;
+  int loop_remaining = 0;
+  long block = 0;
+  int pc = 4000;
+
+  memset(&state, 0, sizeof(state));
+  state.memory = cpu->data_memory;
+  state.memory_size = cpu->data_memory_size;
+  memset(cpu->vregs, 0, sizeof(int) * APEX_VECTOR_REGS * APEX_MAX_VLEN);
+
+  analysis->stop = APEX_ANALYSIS_LIMIT;
+  while (limit <= 0 || analysis->instructions < limit)
+  {
+    const APEX_Instruction *ins = instruction_at(cpu, pc);
+    if (!ins)
+    {
+      analysis->stop = APEX_ANALYSIS_END;
+      analysis->stop_pc = pc;
+      break;
+    }
+
+    long n = analysis->instructions + 1;
+    int next;
+    if (ins->op == OP_LL || ins->op == OP_SC || ins->op == OP_CPUID ||
+        ins->op == OP_LOOP || ins->op == OP_CALL || ins->op == OP_RET ||
+        (ins->op >= OP_VLOAD && ins->op <= OP_VMUL))
+    {
+      next = execute_extra(&state, cpu->vregs, cpu->vlen, &reservation, ins,
+                           pc, &record);
+    }
+    else
+    {
+      next = functional_step(&state, ins, pc, &record);
+    }
+    if (next < 0)
+    {
+      analysis->stop = APEX_ANALYSIS_FAULT;
+      analysis->stop_pc = pc;
+      break;
+    }
+    analysis->instructions = n;
+    analysis->ops[ins->op]++;
+
+    /* Dependencies */
+    int reads[3];
+    int count = sources(ins, reads);
+    for (int i = 0; i < count; ++i)
+    {
+      if (producer[reads[i]])
+      {
+        count_distance(analysis->raw, n - producer[reads[i]]);
+        if (from_load[reads[i]])
+        {
+          count_distance(analysis->raw_load, n - producer[reads[i]]);
+        }
+      }
+    }
+    if (is_branch(ins->op) && flag_producer)
+    {
+      count_distance(analysis->raw_flag, n - flag_producer);
+    }
+    int written = destination(ins);
+    if (written >= 0)
+    {
+      producer[written] = n;
+      from_load[written] = is_load(ins->op);
+    }
+    if (sets_flag(ins->op))
+    {
+      flag_producer = n;
+    }
+
+    /* Working set */
+    switch (ins->op)
+    {
+    case OP_LOAD:
+    case OP_LDR:
+    case OP_STORE:
+    case OP_STR:
+    case OP_LL:
+    case OP_SC:
+      touch(analysis, record.address, 1);
+      break;
+    case OP_VLOAD:
+    case OP_VSTORE:
+      touch(analysis, record.address, cpu->vlen);
+      break;
+    }
+
+    /* Branches */
+    int index = get_code_index(pc);
+    analysis->executed[index]++;
+    if (next != pc + 4)
+    {
+      analysis->taken[index]++;
+    }
+
+    /* Hardware loop, as Fetch runs it */
+    if (ins->op == OP_LOOP && ins->imm > 4)
+    {
+      loop_start = pc + 4;
+      loop_end = pc + ins->imm;
+      loop_remaining = state.regs[ins->rs1] > 1 ? state.regs[ins->rs1] : 1;
+    }
+    else if (next != pc + 4 && ins->op != OP_CALL && ins->op != OP_RET &&
+             (next < loop_start || next >= loop_end))
+    {
+      loop_remaining = 0;
+    }
+    else if (pc == loop_end - 4 && next == pc + 4 && loop_remaining > 1)
+    {
+      next = loop_start;
+      loop_remaining--;
+    }
+
+    /* Basic blocks */
+    block++;
+    if (ends_block(ins->op) || next != pc + 4)
+    {
+      count_size(analysis->block_sizes, block);
+      analysis->blocks++;
+      block = 0;
+    }
+
+    if (n % analysis->interval == 0)
+    {
+      close_interval(analysis);
+    }
+
+    if (ins->op == OP_HALT)
+    {
+      analysis->stop = APEX_ANALYSIS_HALT;
+      break;
+    }
+    pc = next;
+  }
+
+  if (block > 0)
+  {
+    count_size(analysis->block_sizes, block);
+    analysis->blocks++;
+  }
+  if (analysis->instructions % analysis->interval != 0)
+  {
+    close_interval(analysis);
+  }
+
+  /* The final state is the one the program left */
+  memcpy(cpu->regs, state.regs, sizeof(cpu->regs));
+  cpu->zFlag = state.zflag;
+  cpu->ins_completed = analysis->instructions;
+}
+
+static void
+write_string(FILE *out, const char *s)
+{
+  fputc('"', out);
+  for (; *s; ++s)
+  {
+    if (*s == '"' || *s == '\\')
+    {
+      fputc('\\', out);
+    }
+    if ((unsigned char)*s < 0x20)
+    {
+      fprintf(out, "\\u%04x", *s);
+    }
+    else
+    {
+      fputc(*s, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/* {"1": n, ..., "<last>+": n} */
+static void
+write_histogram(FILE *out, const long *counts, int buckets)
+{
+  fprintf(out, "{");
+  for (int i = 0; i < buckets; ++i)
+  {
+    fprintf(out, "\"%d\": %ld, ", i + 1, counts[i]);
+  }
+  fprintf(out, "\"%d+\": %ld}", buckets + 1, counts[buckets]);
+}
+
+static void
+write_mix(FILE *out, const APEX_Analysis *analysis, const long *ops)
+{
+  const char *separator = "";
+
+  fprintf(out, "{");
+  for (int op = 0; op < NUM_OPCODES; ++op)
+  {
+    if (ops[op] > 0)
+    {
+      fprintf(out, "%s", separator);
+      write_string(out, analysis->names[op]);
+      fprintf(out, ": %ld", ops[op]);
+      separator = ", ";
+    }
+  }
+  fprintf(out, "}");
+}
+
+void analysis_write_json(const APEX_Analysis *analysis, const APEX_CPU *cpu,
+                         const char *program, FILE *out)
+{
+  static const char *stops[] = {"halt", "limit", "fault", "end"};
+
+  fprintf(out, "{\n  \"program\": ");
+  write_string(out, program);
+
+  fprintf(out, ",\n  \"static\": {\n");
+  fprintf(out, "    \"instructions\": %d,\n", cpu->code_memory_size);
+  fprintf(out, "    \"opcode_mix\": ");
+  write_mix(out, analysis, analysis->static_ops);
+  fprintf(out, ",\n    \"basic_blocks\": %ld,\n", analysis->static_blocks);
+  fprintf(out, "    \"block_sizes\": ");
+  write_histogram(out, analysis->static_block_sizes, APEX_ANALYSIS_BLOCK_SIZES);
+  fprintf(out, "\n  },\n");
+
+  fprintf(out, "  \"dynamic\": {\n");
+  fprintf(out, "    \"instructions\": %ld,\n", analysis->instructions);
+  fprintf(out, "    \"stop\": \"%s\",\n", stops[analysis->stop]);
+  if (analysis->stop == APEX_ANALYSIS_FAULT ||
+      analysis->stop == APEX_ANALYSIS_END)
+  {
+    fprintf(out, "    \"stop_pc\": %d,\n", analysis->stop_pc);
+  }
+  fprintf(out, "    \"opcode_mix\": ");
+  write_mix(out, analysis, analysis->ops);
+
+  fprintf(out, ",\n    \"raw_distance\": {\n      \"all\": ");
+  write_histogram(out, analysis->raw, APEX_ANALYSIS_DISTANCES);
+  fprintf(out, ",\n      \"load\": ");
+  write_histogram(out, analysis->raw_load, APEX_ANALYSIS_DISTANCES);
+  fprintf(out, ",\n      \"zero_flag\": ");
+  write_histogram(out, analysis->raw_flag, APEX_ANALYSIS_DISTANCES);
+  fprintf(out, "\n    },\n");
+
+  fprintf(out, "    \"branches\": [");
+  const char *separator = "";
+  for (int i = 0; i < cpu->code_memory_size; ++i)
+  {
+    const APEX_Instruction *ins = &cpu->code_memory[i];
+    if (!is_branch(ins->op) || analysis->executed[i] == 0)
+    {
+      continue;
+    }
+    fprintf(out, "%s\n      {\"pc\": %d, \"opcode\": ", separator, 4000 + 4 * i);
+    write_string(out, ins->opcode);
+    fprintf(out, ", \"executed\": %ld, \"taken\": %ld, \"taken_rate\": %.4f}",
+            analysis->executed[i], analysis->taken[i],
+            (double)analysis->taken[i] / analysis->executed[i]);
+    separator = ",";
+  }
+  fprintf(out, "%s],\n", *separator ? "\n    " : "");
+
+  fprintf(out, "    \"basic_blocks\": %ld,\n", analysis->blocks);
+  fprintf(out, "    \"mean_block_size\": %.2f,\n",
+          analysis->blocks ? (double)analysis->instructions / analysis->blocks
+                           : 0.0);
+  fprintf(out, "    \"block_sizes\": ");
+  write_histogram(out, analysis->block_sizes, APEX_ANALYSIS_BLOCK_SIZES);
+
+  fprintf(out, ",\n    \"working_set\": {\n");
+  fprintf(out, "      \"interval\": %d,\n", analysis->interval);
+  fprintf(out, "      \"line_words\": %d,\n", APEX_DCACHE_LINE_WORDS);
+  fprintf(out, "      \"footprint_words\": %ld,\n", analysis->footprint_words);
+  fprintf(out, "      \"footprint_lines\": %ld,\n", analysis->footprint_lines);
+  fprintf(out, "      \"intervals\": [");
+  for (int i = 0; i < analysis->set_count; ++i)
+  {
+    const APEX_WorkingSet *set = &analysis->sets[i];
+    fprintf(out, "%s\n        {\"end\": %ld, \"words\": %ld, \"lines\": %ld}",
+            i ? "," : "", set->end, set->words, set->lines);
+  }
+  fprintf(out, "%s]\n    }\n  }\n}\n", analysis->set_count ? "\n      " : "");
+}
@@ -0,0 +1,100 @@
+#ifndef _APEX_ANALYZE_H_
+#define _APEX_ANALYZE_H_
+/**
+ *  analyze.h
+ *  Contains the program analyzer of analyze mode. The code memory is
+ *  analyzed as it is, then the program runs on the functional executor
+ *  and every committed instruction is counted:
+ *
+ *  The opcode mix, statically and dynamically.
+ *  RAW dependency distances, the number of instructions from the producer
+ *  of each register or zero flag read to its reader, for all producers
+ *  and for loads. Short distances are the Decode stalls of the pipeline.
+ *  The executions and taken branches of each BZ and BNZ.
+ *  Basic block sizes: statically between leaders, dynamically between
+ *  control transfers.
+ *  The data working set: the words and cache lines accessed in each
+ *  interval of instructions and in all.
+ *
+ *  The results are written as JSON.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define APEX_ANALYSIS_DEFAULT_INTERVAL 10000
+
+/* Distances 1 to APEX_ANALYSIS_DISTANCES, and longer ones */
+#define APEX_ANALYSIS_DISTANCES 16
+
+/* Block sizes 1 to APEX_ANALYSIS_BLOCK_SIZES, and larger ones */
+#define APEX_ANALYSIS_BLOCK_SIZES 32
+
+/* Why the dynamic analysis stopped */
+enum
+{
+  APEX_ANALYSIS_HALT,
+  APEX_ANALYSIS_LIMIT,
+  APEX_ANALYSIS_FAULT, // Memory access out of range
+  APEX_ANALYSIS_END,   // pc left the code memory
+};
+
+/* Data working set of one interval */
+typedef struct APEX_WorkingSet
+{
+  long end; // Instructions committed at the end of the interval
+  long words;
+  long lines;
+} APEX_WorkingSet;
+
+typedef struct APEX_Analysis
+{
+  int interval;
+  const char *names[NUM_OPCODES]; // Mnemonic of each opcode in the program
+
+  /* Static */
+  long static_ops[NUM_OPCODES];
+  long static_blocks;
+  long static_block_sizes[APEX_ANALYSIS_BLOCK_SIZES + 1];
+
+  /* Dynamic */
+  long instructions;
+  int stop;
+  int stop_pc;
+  long ops[NUM_OPCODES];
+  long raw[APEX_ANALYSIS_DISTANCES + 1];
+  long raw_load[APEX_ANALYSIS_DISTANCES + 1];
+  long raw_flag[APEX_ANALYSIS_DISTANCES + 1];
+
+  /* Executions and taken ones of the instruction at each code index */
+  long *executed;
+  long *taken;
+
+  long blocks;
+  long block_sizes[APEX_ANALYSIS_BLOCK_SIZES + 1];
+
+  /* Interval + 1 each word and line was last accessed in, 0 if never */
+  int *word_interval;
+  int *line_interval;
+  long memory_size;
+  long footprint_words;
+  long footprint_lines;
+  APEX_WorkingSet current; // Interval in progress
+  APEX_WorkingSet *sets;
+  int set_count;
+  int set_capacity;
+} APEX_Analysis;
+
+APEX_Analysis *analysis_create(const APEX_CPU *cpu, int interval);
+
+void analysis_destroy(APEX_Analysis *analysis);
+
+void analysis_run(APEX_Analysis *analysis, APEX_CPU *cpu, long limit);
+
+void analysis_write_json(const APEX_Analysis *analysis, const APEX_CPU *cpu,
+                         const char *program, FILE *out);
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ *  apex.c
+ *  Contains the embeddable simulator API on top of the APEX cpu
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex.h"
+#include "cpu.h"
+
+/* Code memory shared by all CPUs created on it */
+struct APEX_Program
+{
+  APEX_Instruction *code_memory;
+  int code_memory_size;
+  APEX_Mapping code_image; // Set when code memory is a mapped program image
+};
+
+APEX_Program *
+apex_program_load(const char *filename)
+{
+  if (!filename)
+  {
+    return NULL;
+  }
+
+  APEX_Program *program = calloc(1, sizeof(*program));
+  if (!program)
+  {
+    return NULL;
+  }
+
+  if (is_program_image(filename))
+  {
+    program->code_memory = load_program_image(filename,
+                                              &program->code_memory_size,
+                                              &program->code_image);
+  }
+  else
+  {
+    program->code_memory = create_code_memory(filename,
+                                              &program->code_memory_size);
+  }
+
+  if (!program->code_memory)
+  {
+    free(program);
+    return NULL;
+  }
+  return program;
+}
+
+int apex_program_size(const APEX_Program *program)
+{
+  return program->code_memory_size;
+}
+
+void apex_program_free(APEX_Program *program)
+{
+  if (!program)
+  {
+    return;
+  }
+
+  if (program->code_image.base)
+  {
+    release_mapping(&program->code_image);
+  }
+  else
+  {
+    free(program->code_memory);
+  }
+  free(program);
+}
+
+APEX_CPU *
+apex_create(const APEX_Program *program, int cycles)
+{
+  APEX_CPU *cpu = APEX_cpu_create(program->code_memory,
+                                  program->code_memory_size, 1,
+                                  cycles > 0 ? cycles : 0);
+  if (cpu)
+  {
+    cpu->quiet = 1;
+  }
+  return cpu;
+}
+
+void apex_reset(APEX_CPU *cpu)
+{
+  APEX_cpu_reset(cpu);
+}
+
+void apex_destroy(APEX_CPU *cpu)
+{
+  if (cpu)
+  {
+    APEX_cpu_stop(cpu);
+  }
+}
+
+void apex_set_latency(APEX_CPU *cpu, int mul_latency, int mem_latency)
+{
+  cpu->mul_latency = mul_latency > 1 ? mul_latency : 1;
+  cpu->mem_latency = mem_latency > 1 ? mem_latency : 1;
+}
+
+static int
+status(const APEX_CPU *cpu)
+{
+  if (cpu->isComplete > 0)
+  {
+    return APEX_HALTED;
+  }
+  return cpu->isComplete < 0 ? APEX_FAULT : APEX_RUNNING;
+}
+
+/*
+ * Idle cycles of a multi-cycle operation are simulated at once, but never
+ * past the last cycle of the call. The architectural state does not change
+ * in them, so no stop condition is missed.
+ */
+static int
+run(APEX_CPU *cpu, APEX_Condition stop, void *arg, int cycles)
+{
+  long target = (long)cpu->clock + (cycles > 0 ? cycles : 0);
+  if (target > INT_MAX)
+  {
+    target = INT_MAX;
+  }
+  cpu->skip_until = (int)target - 1;
+
+  while (!cpu->isComplete && cpu->clock < target)
+  {
+    APEX_cpu_step(cpu);
+    if (stop && !cpu->isComplete && stop(cpu, arg))
+    {
+      cpu->skip_until = INT_MAX;
+      return APEX_STOPPED;
+    }
+  }
+
+  cpu->skip_until = INT_MAX;
+  return status(cpu);
+}
+
+int apex_step(APEX_CPU *cpu, int cycles)
+{
+  return run(cpu, NULL, NULL, cycles);
+}
+
+int apex_run(APEX_CPU *cpu)
+{
+  while (!cpu->isComplete)
+  {
+    APEX_cpu_step(cpu);
+  }
+  return status(cpu);
+}
+
+int apex_run_until(APEX_CPU *cpu, APEX_Condition stop, void *arg,
+                   int max_cycles)
+{
+  return run(cpu, stop, arg, max_cycles);
+}
+
+int apex_get_reg(const APEX_CPU *cpu, int reg)
+{
+  return reg >= 0 && reg < 16 ? cpu->regs[reg] : 0;
+}
+
+void apex_set_reg(APEX_CPU *cpu, int reg, int value)
+{
+  if (reg >= 0 && reg < 16)
+  {
+    cpu->regs[reg] = value;
+  }
+}
+
+long apex_memory_size(const APEX_CPU *cpu)
+{
+  return cpu->data_memory_size;
+}
+
+int apex_read_memory(const APEX_CPU *cpu, long address, int *words,
+                     long count)
+{
+  if (address < 0 || count < 0 || address + count > cpu->data_memory_size)
+  {
+    return -1;
+  }
+  memcpy(words, &cpu->data_memory[address], count * sizeof(int));
+  return 0;
+}
+
+int apex_write_memory(APEX_CPU *cpu, long address, const int *words,
+                      long count)
+{
+  if (address < 0 || count < 0 || address + count > cpu->data_memory_size)
+  {
+    return -1;
+  }
+  memcpy(&cpu->data_memory[address], words, count * sizeof(int));
+  return 0;
+}
+
+int apex_load_memory(APEX_CPU *cpu, const int *words, long count)
+{
+  if (count < 0)
+  {
+    return -1;
+  }
+
+  if (count > cpu->data_memory_size || cpu->data_image.base)
+  {
+    long size = count > cpu->data_memory_size ? count : cpu->data_memory_size;
+    int *memory = calloc(size, sizeof(int));
+    if (!memory)
+    {
+      return -1;
+    }
+    if (cpu->data_image.base)
+    {
+      release_mapping(&cpu->data_image);
+    }
+    else
+    {
+      free(cpu->data_memory);
+    }
+    cpu->data_memory = memory;
+    cpu->data_memory_size = size;
+  }
+  else
+  {
+    memset(&cpu->data_memory[count], 0,
+           (cpu->data_memory_size - count) * sizeof(int));
+  }
+
+  memcpy(cpu->data_memory, words, count * sizeof(int));
+  return 0;
+}
+
+void apex_get_stats(const APEX_CPU *cpu, APEX_Stats *stats)
+{
+  stats->cycles = cpu->clock;
+  stats->instructions = cpu->ins_completed;
+  stats->pc = cpu->pc;
+  stats->status = status(cpu);
+  memcpy(stats->busy_cycles, cpu->busy_cycles, sizeof(stats->busy_cycles));
+  stats->skipped_cycles = cpu->skipped_cycles;
+}
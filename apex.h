@@ -0,0 +1,95 @@
+#ifndef _APEX_H_
+#define _APEX_H_
+/**
+ *  apex.h
+ *  Contains the embeddable simulator API, built as libapex.a and
+ *  libapex.so. A program is loaded once and any number of independent
+ *  CPUs are created on it, stepped, inspected and reset in process.
+ *  CPUs print nothing, only apex_program_load() reports assembler and
+ *  image errors on stderr.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+
+#define APEX_API_VERSION 1
+
+typedef struct APEX_Program APEX_Program;
+typedef struct APEX_CPU APEX_CPU;
+
+/* Status returned by the stepping functions */
+enum
+{
+  APEX_FAULT = -1,  // Program jumped outside code memory
+  APEX_RUNNING = 0, // Cycles of the call are used up
+  APEX_HALTED = 1,  // Program completed, or the CPU's cycle limit is reached
+  APEX_STOPPED = 2  // Condition of apex_run_until became true
+};
+
+/* Counters of a CPU since it was created or reset */
+typedef struct APEX_Stats
+{
+  int cycles;
+  int instructions; // Instructions leaving Writeback
+  int pc;           // Next instruction fetched
+  int status;       // APEX_RUNNING, APEX_HALTED or APEX_FAULT
+  int busy_cycles[7];
+  int skipped_cycles;
+} APEX_Stats;
+
+/* Stop condition of apex_run_until, checked after every cycle */
+typedef int (*APEX_Condition)(const APEX_CPU *cpu, void *arg);
+
+/*
+ * Assembly file or program image, NULL on error after printing the errors
+ * to stderr. Must outlive its CPUs.
+ */
+APEX_Program *apex_program_load(const char *filename);
+
+int apex_program_size(const APEX_Program *program);
+
+void apex_program_free(APEX_Program *program);
+
+/* A CPU at reset running the program, cycles is its limit (0 for none) */
+APEX_CPU *apex_create(const APEX_Program *program, int cycles);
+
+/* Back to the reset state with zeroed data memory, latencies are kept */
+void apex_reset(APEX_CPU *cpu);
+
+void apex_destroy(APEX_CPU *cpu);
+
+void apex_set_latency(APEX_CPU *cpu, int mul_latency, int mem_latency);
+
+/* Simulates up to `cycles` clock cycles */
+int apex_step(APEX_CPU *cpu, int cycles);
+
+/* Simulates until the program completes */
+int apex_run(APEX_CPU *cpu);
+
+/* Simulates until stop returns non-zero or max_cycles are used up */
+int apex_run_until(APEX_CPU *cpu, APEX_Condition stop, void *arg,
+                   int max_cycles);
+
+/*
+ * Register file and data memory (word addressed). Writes are seen by
+ * instructions that read their operands afterwards. Memory accesses out
+ * of range return -1.
+ */
+int apex_get_reg(const APEX_CPU *cpu, int reg);
+
+void apex_set_reg(APEX_CPU *cpu, int reg, int value);
+
+long apex_memory_size(const APEX_CPU *cpu);
+
+int apex_read_memory(const APEX_CPU *cpu, long address, int *words,
+                     long count);
+
+int apex_write_memory(APEX_CPU *cpu, long address, const int *words,
+                      long count);
+
+/* Replaces data memory with `count` words and zeroes the rest, grows it if needed */
+int apex_load_memory(APEX_CPU *cpu, const int *words, long count);
+
+void apex_get_stats(const APEX_CPU *cpu, APEX_Stats *stats);
+
+#endif
@@ -0,0 +1,644 @@
+/*
+ *  batch.c
+ *  Contains the lock-step batch engine
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+#include "shadow.h"
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads the data image paths of the lanes, one per line */
+static int
+read_list(APEX_Batch *batch, const char *list)
+{
+  FILE *fp = fopen(list, "r");
+  char line[4096];
+  int capacity = 0;
+
+  if (!fp)
+  {
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0')
+    {
+      continue;
+    }
+
+    if (batch->lanes == capacity)
+    {
+      capacity = capacity ? 2 * capacity : 64;
+      char **images = realloc(batch->images, capacity * sizeof(char *));
+      if (!images)
+      {
+        fclose(fp);
+        return -1;
+      }
+      batch->images = images;
+    }
+    batch->images[batch->lanes] = strdup(line);
+    if (!batch->images[batch->lanes++])
+    {
+      fclose(fp);
+      return -1;
+    }
+  }
+
+  fclose(fp);
+  return batch->lanes > 0 ? 0 : -1;
+}
+
+/* Loads the image of a lane, and transposes it into lane memory if set */
+static int
+load_lane(APEX_Batch *batch, int lane, long min_words, int transpose)
+{
+  APEX_Mapping mapping = {NULL, 0};
+  long words;
+  int *memory = load_data_image(batch->images[lane], min_words, &words,
+                                &mapping);
+  if (!memory)
+  {
+    return -1;
+  }
+
+  batch->lane_words[lane] = words;
+  if (transpose)
+  {
+    for (long i = 0; i < words; ++i)
+    {
+      batch->memory[i * batch->lanes + lane] = memory[i];
+    }
+  }
+
+  if (mapping.base)
+  {
+    release_mapping(&mapping);
+  }
+  else
+  {
+    free(memory);
+  }
+  return 0;
+}
+
+/*
+ * Starts a round led by the first lane without a result. The lanes are
+ * reset to the state of the freshly initialized leader, in a solo round
+ * only the leader runs.
+ */
+static int
+start_round(APEX_Batch *batch, APEX_CPU *cpu)
+{
+  int lanes = batch->lanes;
+
+  batch->leader = -1;
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    batch->active[lane] = 0;
+    if (batch->done[lane] || (batch->solo && batch->leader >= 0))
+    {
+      continue;
+    }
+    if (batch->leader < 0)
+    {
+      batch->leader = lane;
+    }
+    if (batch->solo)
+    {
+      continue;
+    }
+    batch->active[lane] = 1;
+
+    if (load_lane(batch, lane, cpu->data_memory_size, 1) < 0)
+    {
+      return -1;
+    }
+    for (int r = 0; r < 16; ++r)
+    {
+      batch->regs[r * lanes + lane] = cpu->regs[r];
+    }
+    batch->zflag[lane] = cpu->zFlag;
+  }
+
+  batch->pc = cpu->pc;
+  batch->last_pc = -1;
+  batch->broken = 0;
+  batch->rounds++;
+  return APEX_cpu_load_data_image(cpu, batch->images[batch->leader]);
+}
+
+APEX_Batch *
+batch_create(APEX_CPU *cpu, const char *list)
+{
+  APEX_Batch *batch = calloc(1, sizeof(*batch));
+  if (!batch)
+  {
+    return NULL;
+  }
+  batch->start = now();
+
+  if (read_list(batch, list) < 0)
+  {
+    fprintf(stderr, "APEX_Error : Unable to read batch list %s\n", list);
+    batch_destroy(batch);
+    return NULL;
+  }
+
+  int lanes = batch->lanes;
+  batch->lane_words = calloc(lanes, sizeof(long));
+  if (!batch->lane_words)
+  {
+    batch_destroy(batch);
+    return NULL;
+  }
+
+  /* Lanes get the memory size a run of their image alone would have */
+  batch->words = cpu->data_memory_size;
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    if (load_lane(batch, lane, cpu->data_memory_size, 0) < 0)
+    {
+      batch_destroy(batch);
+      return NULL;
+    }
+    if (batch->lane_words[lane] > batch->words)
+    {
+      batch->words = batch->lane_words[lane];
+    }
+  }
+
+  batch->regs = calloc(16 * (size_t)lanes, sizeof(int));
+  batch->zflag = calloc(lanes, sizeof(int));
+  batch->memory = calloc(batch->words * (size_t)lanes, sizeof(int));
+  batch->address = calloc(lanes, sizeof(int));
+  batch->next_pc = calloc(lanes, sizeof(int));
+  batch->active = calloc(lanes, 1);
+  batch->done = calloc(lanes, 1);
+  batch->final_regs = calloc(16 * (size_t)lanes, sizeof(int));
+  batch->cycles = calloc(lanes, sizeof(int));
+  batch->instructions = calloc(lanes, sizeof(int));
+  if (!batch->regs || !batch->zflag || !batch->memory || !batch->address ||
+      !batch->next_pc || !batch->active || !batch->done ||
+      !batch->final_regs || !batch->cycles || !batch->instructions ||
+      start_round(batch, cpu) < 0)
+  {
+    batch_destroy(batch);
+    return NULL;
+  }
+  return batch;
+}
+
+void batch_destroy(APEX_Batch *batch)
+{
+  if (!batch)
+  {
+    return;
+  }
+  for (int lane = 0; lane < batch->lanes; ++lane)
+  {
+    free(batch->images[lane]);
+  }
+  free(batch->images);
+  free(batch->lane_words);
+  free(batch->regs);
+  free(batch->zflag);
+  free(batch->memory);
+  free(batch->address);
+  free(batch->next_pc);
+  free(batch->active);
+  free(batch->done);
+  free(batch->final_regs);
+  free(batch->cycles);
+  free(batch->instructions);
+  free(batch);
+}
+
+/*
+ * Register operations of all lanes. The loops run over every lane, the
+ * registers of a lane are only used while it follows the leader, so no
+ * mask is needed here and the compiler turns each loop into vector
+ * instructions.
+ */
+static void
+alu_kernel(int op, int *rd, const int *a, const int *b, int imm, int *zflag,
+           int lanes)
+{
+  switch (op)
+  {
+  case OP_MOVC:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = imm;
+    }
+    return;
+  case OP_ADD:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] + b[l];
+    }
+    break;
+  case OP_SUB:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] - b[l];
+    }
+    break;
+  case OP_MUL:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] * b[l];
+    }
+    break;
+  case OP_ADDL:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] + imm;
+    }
+    break;
+  case OP_SUBL:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] - imm;
+    }
+    break;
+  case OP_AND:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] & b[l];
+    }
+    return;
+  case OP_OR:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] | b[l];
+    }
+    return;
+  default:
+    for (int l = 0; l < lanes; ++l)
+    {
+      rd[l] = a[l] ^ b[l];
+    }
+    return;
+  }
+
+  /* Arithmetic results set the zero flag */
+  for (int l = 0; l < lanes; ++l)
+  {
+    zflag[l] = rd[l] == 0;
+  }
+}
+
+/* Addresses of all lanes, lanes that leave their memory are dropped */
+static void
+address_kernel(APEX_Batch *batch, const int *base, const int *offset, int imm)
+{
+  int lanes = batch->lanes;
+  int *address = batch->address;
+
+  if (offset)
+  {
+    for (int l = 0; l < lanes; ++l)
+    {
+      address[l] = base[l] + offset[l];
+    }
+  }
+  else
+  {
+    for (int l = 0; l < lanes; ++l)
+    {
+      address[l] = base[l] + imm;
+    }
+  }
+
+  for (int l = 0; l < lanes; ++l)
+  {
+    if (address[l] < 0 || address[l] >= batch->lane_words[l])
+    {
+      batch->active[l] = 0;
+      address[l] = 0;
+    }
+  }
+}
+
+/* Lanes whose next instruction differs from the leader's are dropped */
+static void
+follow_kernel(APEX_Batch *batch)
+{
+  int lanes = batch->lanes;
+  int pc = batch->next_pc[batch->leader];
+
+  for (int l = 0; l < lanes; ++l)
+  {
+    batch->active[l] &= batch->next_pc[l] == pc;
+  }
+  batch->pc = pc;
+}
+
+/*
+ * Applies the instruction leaving Execute2 to all lanes. Instructions
+ * leave Execute2 in program order, the wrong path is flushed before it.
+ */
+void batch_execute(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+  APEX_Batch *batch = cpu->batch;
+  int lanes = batch->lanes;
+  int index = get_code_index(stage->pc);
+
+  if (batch->broken)
+  {
+    return;
+  }
+
+  /* The copy of an instruction a stall left in Execute1 repeats it */
+  if (stage->pc != batch->pc && stage->pc == batch->last_pc)
+  {
+    return;
+  }
+  if (stage->pc != batch->pc || stage->pc < 4000 || stage->pc % 4 ||
+      index >= cpu->code_memory_size)
+  {
+    batch->broken = 1;
+    return;
+  }
+
+  const APEX_Instruction *ins = &cpu->code_memory[index];
+  int *regs = batch->regs;
+#define LANE_REG(r) (&regs[(r) * lanes])
+
+  batch->last_pc = stage->pc;
+  batch->pc = stage->pc + 4;
+
+  switch (ins->op)
+  {
+  case OP_LOAD:
+  case OP_LDR:
+    address_kernel(batch, LANE_REG(ins->rs1),
+                   ins->op == OP_LDR ? LANE_REG(ins->rs2) : NULL, ins->imm);
+    for (int l = 0; l < lanes; ++l)
+    {
+      LANE_REG(ins->rd)[l] = batch->memory[(long)batch->address[l] * lanes + l];
+    }
+    break;
+
+  /* Memory is all that is left of a lane with a result, so stores are masked */
+  case OP_STORE:
+  case OP_STR:
+    address_kernel(batch, LANE_REG(ins->rs2),
+                   ins->op == OP_STR ? LANE_REG(ins->rs3) : NULL, ins->imm);
+    for (int l = 0; l < lanes; ++l)
+    {
+      if (batch->active[l])
+      {
+        batch->memory[(long)batch->address[l] * lanes + l] =
+            LANE_REG(ins->rs1)[l];
+      }
+    }
+    break;
+
+  case OP_MOVC:
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_ADDL:
+  case OP_SUBL:
+  case OP_AND:
+  case OP_OR:
+  case OP_EXOR:
+    alu_kernel(ins->op, LANE_REG(ins->rd), LANE_REG(ins->rs1),
+               LANE_REG(ins->rs2), ins->imm, batch->zflag, lanes);
+    break;
+
+  case OP_BZ:
+  case OP_BNZ:
+    for (int l = 0; l < lanes; ++l)
+    {
+      int taken = (batch->zflag[l] != 0) == (ins->op == OP_BZ);
+      batch->next_pc[l] = taken ? stage->pc + ins->imm : stage->pc + 4;
+    }
+    follow_kernel(batch);
+    break;
+
+  case OP_JUMP:
+    for (int l = 0; l < lanes; ++l)
+    {
+      batch->next_pc[l] = LANE_REG(ins->rs1)[l] + ins->imm;
+    }
+    follow_kernel(batch);
+    break;
+
+  /* Lanes keep no reservations, they are run on their own */
+  case OP_LL:
+  case OP_SC:
+  case OP_CPUID:
+  case OP_VLOAD:
+  case OP_VSTORE:
+  case OP_VADD:
+  case OP_VSUB:
+  case OP_VMUL:
+  case OP_LOOP:
+  case OP_CALL:
+  case OP_RET:
+    batch->broken = 1;
+    return;
+
+  default:
+    break;
+  }
+#undef LANE_REG
+
+  /* The pipeline simulates the leader, it cannot fault alone */
+  if (!batch->active[batch->leader])
+  {
+    batch->broken = 1;
+  }
+}
+
+/* The leader's lane ended in the state the pipeline ended in */
+static int
+matches_pipeline(APEX_CPU *cpu)
+{
+  APEX_Batch *batch = cpu->batch;
+  int lanes = batch->lanes;
+  int leader = batch->leader;
+
+  if (batch->broken || !cpu->shadow || cpu->shadow->broken)
+  {
+    return 0;
+  }
+  for (int r = 0; r < 16; ++r)
+  {
+    if (batch->regs[r * lanes + leader] != cpu->regs[r])
+    {
+      return 0;
+    }
+  }
+  for (long i = 0; i < batch->lane_words[leader]; ++i)
+  {
+    if (batch->memory[i * lanes + leader] != cpu->data_memory[i])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Ends a round. The leader has the pipeline's final state, the lanes
+ * that followed it all the way share its cycle count.
+ */
+static void
+end_round(APEX_CPU *cpu)
+{
+  APEX_Batch *batch = cpu->batch;
+  int lanes = batch->lanes;
+  int leader = batch->leader;
+
+  /*
+   * The lanes executed every instruction that left Execute2. Unless the
+   * program completed before the cycle limit, some of them were still on
+   * their way to the registers. The remaining lanes are likely to run
+   * into the limit as well, so they are simulated one at a time.
+   */
+  int drained = cpu->cycles == 0 || cpu->clock < cpu->cycles;
+  if (!drained)
+  {
+    batch->solo = 1;
+  }
+  if (!drained || !matches_pipeline(cpu))
+  {
+    memset(batch->active, 0, lanes);
+  }
+
+  for (int r = 0; r < 16; ++r)
+  {
+    batch->regs[r * lanes + leader] = cpu->regs[r];
+  }
+  for (long i = 0; i < batch->lane_words[leader]; ++i)
+  {
+    batch->memory[i * lanes + leader] = cpu->data_memory[i];
+  }
+  batch->active[leader] = 1;
+
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    if (batch->active[lane])
+    {
+      for (int r = 0; r < 16; ++r)
+      {
+        batch->final_regs[lane * 16 + r] = batch->regs[r * lanes + lane];
+      }
+      batch->cycles[lane] = cpu->clock;
+      batch->instructions[lane] = cpu->ins_completed;
+      batch->lane_cycles += cpu->clock;
+      batch->done[lane] = 1;
+    }
+  }
+}
+
+/* Simulates the next round in a pipeline of its own on the same code memory */
+static int
+run_round(APEX_CPU *first)
+{
+  APEX_Batch *batch = first->batch;
+  APEX_CPU *cpu = APEX_cpu_create(first->code_memory, first->code_memory_size,
+                                  1, first->cycles);
+  if (!cpu)
+  {
+    return -1;
+  }
+  cpu->mul_latency = first->mul_latency;
+  cpu->mem_latency = first->mem_latency;
+  cpu->vlen = first->vlen;
+  cpu->vector_lanes = first->vector_lanes;
+  cpu->ras_depth = first->ras_depth;
+  cpu->quiet = first->quiet;
+
+  int result = -1;
+  if (start_round(batch, cpu) == 0 &&
+      (batch->solo || (cpu->shadow = shadow_create(cpu))))
+  {
+    cpu->batch = batch->solo ? NULL : batch;
+    APEX_cpu_simulate(cpu);
+    cpu->batch = batch;
+    end_round(cpu);
+    cpu->batch = NULL;
+    result = 0;
+  }
+  APEX_cpu_stop(cpu);
+  return result;
+}
+
+static int
+write_lane(APEX_Batch *batch, int lane)
+{
+  char filename[4096];
+  int *memory = malloc(batch->lane_words[lane] * sizeof(int));
+  if (!memory)
+  {
+    return -1;
+  }
+  for (long i = 0; i < batch->lane_words[lane]; ++i)
+  {
+    memory[i] = batch->memory[i * batch->lanes + lane];
+  }
+  snprintf(filename, sizeof(filename), "%s%d", batch->out_prefix, lane);
+  int result = write_data_image(filename, memory, batch->lane_words[lane]);
+  free(memory);
+  return result;
+}
+
+/*
+ * Called once the first round's pipeline is done. Rounds are run until
+ * every lane has a result, then the final state of every lane is printed.
+ */
+void batch_finish(APEX_CPU *cpu)
+{
+  APEX_Batch *batch = cpu->batch;
+  int lanes = batch->lanes;
+
+  end_round(cpu);
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    if (!batch->done[lane] && run_round(cpu) < 0)
+    {
+      fprintf(stderr, "APEX_Error : Unable to simulate lane %d\n", lane);
+      break;
+    }
+  }
+  batch->seconds = now() - batch->start;
+
+  printf("=============== STATE OF BATCH LANES ==========\n");
+  for (int lane = 0; lane < lanes; ++lane)
+  {
+    printf("|    LANE[%d]\t     |    Cycles = %d\t    |    Instructions = %d\t    |    REG =",
+           lane, batch->cycles[lane], batch->instructions[lane]);
+    for (int r = 0; r < 16; ++r)
+    {
+      printf(" %d", batch->final_regs[lane * 16 + r]);
+    }
+    printf("\n");
+
+    if (batch->out_prefix && write_lane(batch, lane) < 0)
+    {
+      fprintf(stderr, "APEX_Error : Unable to write data memory of lane %d\n",
+              lane);
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef _APEX_BATCH_H_
+#define _APEX_BATCH_H_
+/**
+ *  batch.h
+ *  Contains the lock-step batch engine. One program runs over many data
+ *  images. The pipeline simulates one image, the leader, and every
+ *  instruction it executes is applied to the architectural state of all
+ *  remaining images at once. Images whose control flow stays with the
+ *  leader share its cycle count; the others are run again in a later
+ *  round under a new leader.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+typedef struct APEX_Batch
+{
+  const char *out_prefix; // Final data memory of lane i goes to <prefix><i>
+
+  int lanes;
+  char **images;    // Data image of each lane
+  long *lane_words; // Data memory words of each lane
+  long words;       // Data memory words of the largest lane
+
+  /* Architectural state, element [x * lanes + lane] holds x of a lane */
+  int *regs;   // 16 registers
+  int *zflag;  // 1 element
+  int *memory; // `words` data memory words
+
+  int *address;          // Per lane scratch for memory accesses
+  int *next_pc;          // Per lane scratch for branch targets
+  unsigned char *active; // Lane follows the leader of this round
+  int leader;
+  int pc; // Next instruction the leader executes
+  int last_pc;
+  int broken; // Leader left the lanes, they are run again
+  int solo;   // Rounds run the leader alone
+
+  /* Results of each lane */
+  unsigned char *done;
+  int *final_regs; // [lane * 16 + r]
+  int *cycles;
+  int *instructions;
+
+  /* Statistics */
+  int rounds;
+  long lane_cycles;
+  double seconds;
+  double start;
+} APEX_Batch;
+
+APEX_Batch *batch_create(APEX_CPU *cpu, const char *list);
+
+void batch_destroy(APEX_Batch *batch);
+
+void batch_execute(APEX_CPU *cpu, const CPU_Stage *stage);
+
+void batch_finish(APEX_CPU *cpu);
+
+#endif
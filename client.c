@@ -0,0 +1,216 @@
+/*
+ *  client.c
+ *  Command line client of the simulation server. Takes the arguments of
+ *  apex_sim after the socket path and prints the same final state.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "apex.h"
+#include "image.h"
+#include "protocol.h"
+
+/* Words of data memory printed with the final state */
+#define DISPLAY_WORDS 100
+
+/* Returns the value of a "--name=value" option, or NULL if arg is not it */
+static const char*
+option_value(const char* arg, const char* name)
+{
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+    return arg + len + 1;
+  }
+  return NULL;
+}
+
+static int
+connect_server(const char* socket_path)
+{
+  struct sockaddr_un address;
+
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 &&
+      connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Same layout as display() and print_stats() of apex_sim */
+static void
+print_result(const APEX_Result* result, const int* memory, int show_stats,
+             int mul_latency, int mem_latency)
+{
+  printf("(apex) >> Simulation Complete\n");
+  printf("=============== STATE OF ARCHITECTURAL REGISTER FILE ==========\n");
+  for (int i = 0; i < 16; i++) {
+    printf("|    REG[%d]\t     |    Value = %d\t    |     Status = %s\t     |\n",
+           i, result->regs[i],
+           (result->regs_valid >> i) & 1 ? "VALID" : "INVALID");
+  }
+
+  printf("============== STATE OF DATA MEMORY =============\n");
+  for (unsigned int i = 0; i < result->memory_words; i++) {
+    printf("|    MEM[%d]\t     |    Value = %d\t     |\n", i, memory[i]);
+  }
+
+  if (show_stats) {
+    printf("=============== SIMULATION STATISTICS ==========\n");
+    printf("|    Cycles\t\t     |    %d\n", result->cycles);
+    printf("|    Instructions\t     |    %d\n", result->instructions);
+    if (mul_latency > 1) {
+      printf("|    MUL busy cycles\t     |    %d\n", result->mul_busy_cycles);
+    }
+    if (mem_latency > 1) {
+      printf("|    Memory busy cycles\t     |    %d\n", result->mem_busy_cycles);
+    }
+    printf("|    Skipped idle cycles     |    %d\n", result->skipped_cycles);
+    printf("|    Load stall cycles\t     |    %d\n", result->load_stall_cycles);
+    printf("|    Taken branches\t     |    %d\n", result->taken_branches);
+    printf("|    Branch flush cycles     |    %d\n",
+           result->branch_flush_cycles);
+    printf("|    Branch stall cycles     |    %d\n",
+           result->branch_stall_cycles);
+  }
+}
+
+static const char*
+status_message(int status)
+{
+  switch (status) {
+  case APEX_RESULT_UNKNOWN_PROGRAM:
+    return "program is not cached";
+  case APEX_RESULT_BAD_PROGRAM:
+    return "program could not be loaded";
+  case APEX_RESULT_BAD_REQUEST:
+    return "request was rejected, only simulate mode runs on the server";
+  case APEX_RESULT_NO_MEMORY:
+    return "server is out of memory";
+  }
+  return "unknown error";
+}
+
+int
+main(int argc, char const* argv[])
+{
+  APEX_Request request;
+  APEX_Result result;
+  char path[PATH_MAX];
+  const char* data_image = NULL;
+  int show_stats = 0;
+  int mul_latency = 1;
+  int mem_latency = 1;
+
+  if (argc < 5) {
+    fprintf(stderr,
+            "APEX_Help : Usage %s <socket> <input_file> <simulate|display> "
+            "<cycles> [--stats] [--data-image=<file>] "
+            "[--mul-latency=<cycles>] [--mem-latency=<cycles>]\n",
+            argv[0]);
+    exit(1);
+  }
+
+  for (int i = 5; i < argc; ++i) {
+    const char* value;
+    if (strcmp(argv[i], "--stats") == 0) {
+      show_stats = 1;
+    } else if ((value = option_value(argv[i], "--data-image"))) {
+      data_image = value;
+    } else if ((value = option_value(argv[i], "--mul-latency"))) {
+      mul_latency = atoi(value);
+    } else if ((value = option_value(argv[i], "--mem-latency"))) {
+      mem_latency = atoi(value);
+    } else {
+      fprintf(stderr, "APEX_Error : Unknown option %s\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  /* The server resolves paths from its own working directory */
+  if (!realpath(argv[2], path)) {
+    fprintf(stderr, "APEX_Error : Unable to find %s\n", argv[2]);
+    exit(1);
+  }
+
+  memset(&request, 0, sizeof(request));
+  request.magic = APEX_REQUEST_MAGIC;
+  request.version = APEX_PROTOCOL_VERSION;
+  request.flags = APEX_REQUEST_HASH | APEX_REQUEST_PATH;
+  if (show_stats) {
+    request.flags |= APEX_REQUEST_STATS;
+  }
+  request.simulate = strcmp(argv[3], "simulate") == 0;
+  request.cycles = atoi(argv[4]);
+  request.mul_latency = mul_latency;
+  request.mem_latency = mem_latency;
+  request.result_words = DISPLAY_WORDS;
+  request.path_length = strlen(path);
+  if (protocol_hash_file(path, &request.program_hash) < 0) {
+    fprintf(stderr, "APEX_Error : Unable to read %s\n", path);
+    exit(1);
+  }
+
+  APEX_Mapping mapping = {NULL, 0};
+  long words = 0;
+  int* data = NULL;
+  if (data_image) {
+    data = load_data_image(data_image, 0, &words, &mapping);
+    if (!data) {
+      fprintf(stderr, "APEX_Error : Unable to load data image %s\n",
+              data_image);
+      exit(1);
+    }
+  }
+  request.data_words = words;
+
+  int fd = connect_server(argv[1]);
+  if (fd < 0) {
+    fprintf(stderr, "APEX_Error : Unable to connect to %s\n", argv[1]);
+    exit(1);
+  }
+
+  if (protocol_write(fd, &request, sizeof(request)) < 0 ||
+      protocol_write(fd, path, request.path_length) < 0 ||
+      protocol_write(fd, data, words * sizeof(int)) < 0 ||
+      protocol_read(fd, &result, sizeof(result)) < 0 ||
+      result.magic != APEX_RESULT_MAGIC ||
+      result.memory_words > DISPLAY_WORDS) {
+    fprintf(stderr, "APEX_Error : Lost connection to %s\n", argv[1]);
+    exit(1);
+  }
+  if (mapping.base) {
+    release_mapping(&mapping);
+  }
+
+  int memory[DISPLAY_WORDS];
+  if (protocol_read(fd, memory, result.memory_words * sizeof(int)) < 0) {
+    fprintf(stderr, "APEX_Error : Lost connection to %s\n", argv[1]);
+    exit(1);
+  }
+  close(fd);
+
+  if (result.status < APEX_FAULT) {
+    fprintf(stderr, "APEX_Error : %s\n", status_message(result.status));
+    exit(1);
+  }
+
+  print_result(&result, memory, show_stats, mul_latency, mem_latency);
+  return 0;
+}
@@ -5,19 +5,110 @@
  *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
  *  State University of New York, Binghamton
  */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "batch.h"
 #include "cpu.h"
+#include "debugger.h"
+#include "digest.h"
+#include "loop.h"
+#include "lsq.h"
+#include "memo.h"
+#include "mmio.h"
+#include "multicore.h"
+#include "prefetch.h"
+#include "report.h"
+#include "shadow.h"
+#include "smt.h"
+#include "steady.h"
+#include "trace.h"
+#include "vector.h"
+#include "vpred.h"
 
-/* Set this flag to 1 to enable debug messages */
-int ENABLE_DEBUG_MESSAGES = 1;
+/*
+ * The pipeline is written once and compiled into several variants, each
+ * with a set of features. A stage gets the features of its variant as the
+ * constant `variant` and is inlined into it, so the checks of a feature
+ * the variant leaves out fold to 0 and its code is dropped. The first
+ * step picks the variant with the fewest features the CPU needs.
+ */
+#define VARIANT_DISPLAY 0x01      // Stage contents printed every cycle
+#define VARIANT_TRACE 0x02        // Trace recorded or replayed
+#define VARIANT_EARLY_BRANCH 0x04 // Zero flag forwarded to Decode
+#define VARIANT_MODELS 0x08       // Store queue, SMT, cores, caches, observers
+#define VARIANT_COUNTERS 0x10     // Branch and load stall statistics
+#define VARIANT_ALL 0x1f
+
+#define VARIANT_FUNCTION static inline __attribute__((always_inline))
+
+#define DEBUG_MESSAGES(cpu) ((variant & VARIANT_DISPLAY) && (cpu)->debug_messages)
+#define TRACE_IN(cpu) ((variant & VARIANT_TRACE) && (cpu)->trace_in)
+#define TRACE_OUT(cpu) ((variant & VARIANT_TRACE) && (cpu)->trace_out)
+#define EARLY_BRANCH(cpu) ((variant & VARIANT_EARLY_BRANCH) && (cpu)->early_branch)
+#define MODEL(cpu, model) ((variant & VARIANT_MODELS) && (cpu)->model)
+#define COUNT(counter) ((variant & VARIANT_COUNTERS) ? (void)(counter) : (void)0)
+
+/*
+ * Puts the pipeline, registers and counters in their power-on state.
+ * Code memory, data memory contents and settings are left as they are.
+ */
+static void
+reset_pipeline(APEX_CPU *cpu)
+{
+  /* Initialize PC, Registers and all pipeline stages */
+  cpu->clock = 0;
+  cpu->pc = 4000;
+  cpu->isBranchOrJumpTaken = 0;
+  cpu->isForwarded = 0;
+  cpu->branchPcValue = 0;
+  memset(cpu->regs, 0, sizeof(int) * 16);
+  memset(cpu->regs_valid, 1, sizeof(int) * 16);
+  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
+  memset(cpu->forwardedValues, 0, sizeof(cpu->forwardedValues));
+
+  cpu->bnzcounter = -1;
+  cpu->zcounter = -1;
+  cpu->zFlag = -1;
+  cpu->isComplete = 0;
+  cpu->z_tag = 0;
+  cpu->z_done_tag = 0;
+  cpu->z_done_value = cpu->zFlag;
+  cpu->taken_branches = 0;
+  cpu->branch_flush_cycles = 0;
+  cpu->branch_stall_cycles = 0;
+
+  cpu->ins_completed = 0;
+  cpu->fetch_seq = 0;
+  cpu->hold_stage = -1;
+  cpu->hold_until = 0;
+  cpu->events.count = 0;
+  memset(cpu->busy_cycles, 0, sizeof(cpu->busy_cycles));
+  cpu->skipped_cycles = 0;
+  cpu->load_stall_cycles = 0;
+  cpu->load_stall_clock = 0;
+  cpu->reservation = -1;
+  cpu->loop_start = 0;
+  cpu->loop_end = 0;
+  cpu->loop_remaining = 0;
+  memset(cpu->ras, 0, sizeof(cpu->ras));
+  cpu->ras_top = 0;
+  cpu->ras_hits = 0;
+  cpu->ras_misses = 0;
+  cpu->ras_overflows = 0;
+  memset(cpu->vregs, 0, sizeof(int) * APEX_VECTOR_REGS * APEX_MAX_VLEN);
+  cpu->vector_instructions = 0;
+  cpu->vector_elements = 0;
+  cpu->step = NULL;
 
-int bnzcounter = -1;
-int zcounter = -1;
-int zFlag = -1;
-int isComplete = 0;
+  /* Make all stages busy except Fetch stage, initally to start the pipeline */
+  for (int i = 1; i < NUM_STAGES; ++i)
+  {
+    cpu->stage[i].busy = 1;
+  }
+}
 
 /*
  * This function creates and initializes APEX cpu.
@@ -28,38 +119,90 @@ int isComplete = 0;
 APEX_CPU *
 APEX_cpu_init(const char *filename, const int command, const int cycles)
 {
+  APEX_Mapping mapping = {NULL, 0};
+  APEX_Instruction *code_memory;
+  int code_memory_size;
+
   if (!filename)
   {
     return NULL;
   }
 
-  APEX_CPU *cpu = malloc(sizeof(*cpu));
-  if (!cpu)
+  /* Map a program image in place, or parse input file and create code memory */
+  if (is_program_image(filename))
+  {
+    code_memory = load_program_image(filename, &code_memory_size, &mapping);
+  }
+  else
+  {
+    code_memory = create_code_memory(filename, &code_memory_size);
+  }
+
+  if (!code_memory)
   {
     return NULL;
   }
 
-  /* Initialize PC, Registers and all pipeline stages */
-  cpu->pc = 4000;
-  cpu->isBranchOrJumpTaken = 0;
-  memset(cpu->regs, 0, sizeof(int) * 16);
-  memset(cpu->regs_valid, 1, sizeof(int) * 16);
-  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
-  memset(cpu->data_memory, 0, sizeof(int) * 4000);
+  APEX_CPU *cpu = APEX_cpu_create(code_memory, code_memory_size, command,
+                                  cycles);
+  if (!cpu)
+  {
+    if (mapping.base)
+    {
+      release_mapping(&mapping);
+    }
+    else
+    {
+      free(code_memory);
+    }
+    return NULL;
+  }
 
-  /* Parse input file and create code memory */
-  cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
+  cpu->code_image = mapping;
+  cpu->owns_code = 1;
+  return cpu;
+}
 
-  cpu->isSimulate = command;
-  cpu->cycles = cycles;
+/*
+ * Creates an APEX cpu running code memory it does not own, which has to
+ * outlive it. Many cpus can share one code memory.
+ */
+APEX_CPU *
+APEX_cpu_create(APEX_Instruction *code_memory, int code_memory_size,
+                const int command, const int cycles)
+{
+  APEX_CPU *cpu = calloc(1, sizeof(*cpu));
+  if (!cpu)
+  {
+    return NULL;
+  }
 
-  if (!cpu->code_memory)
+  cpu->data_memory_size = 4000;
+  cpu->data_memory = calloc(cpu->data_memory_size, sizeof(int));
+  cpu->vregs = calloc(APEX_VECTOR_REGS * APEX_MAX_VLEN, sizeof(int));
+  if (!cpu->data_memory || !cpu->vregs)
   {
+    free(cpu->data_memory);
+    free(cpu->vregs);
     free(cpu);
     return NULL;
   }
 
-  if (ENABLE_DEBUG_MESSAGES)
+  cpu->code_memory = code_memory;
+  cpu->code_memory_size = code_memory_size;
+  cpu->isSimulate = command;
+  cpu->debug_messages = !command;
+  cpu->cycles = cycles;
+  cpu->mul_latency = 1;
+  cpu->mem_latency = 1;
+  cpu->vlen = APEX_DEFAULT_VLEN;
+  cpu->vector_lanes = APEX_DEFAULT_VECTOR_LANES;
+  cpu->ras_depth = APEX_RAS_DEFAULT_DEPTH;
+  cpu->skip_until = INT_MAX;
+  reset_pipeline(cpu);
+
+  /* Code memory listing is only part of the display output */
+  if (cpu->debug_messages)
   {
     fprintf(stderr,
             "APEX_CPU : Initialized APEX CPU, loaded %d instructions\n",
@@ -78,13 +221,44 @@ APEX_cpu_init(const char *filename, const int command, const int cycles)
     }
   }
 
-  /* Make all stages busy except Fetch stage, initally to start the pipeline */
-  for (int i = 1; i < NUM_STAGES; ++i)
+  return cpu;
+}
+
+/*
+ * Starts the program over on the same code memory with zeroed data memory.
+ * Settings are kept, attached traces and fast paths are not rewound.
+ */
+void APEX_cpu_reset(APEX_CPU *cpu)
+{
+  reset_pipeline(cpu);
+  if (cpu->lsq)
   {
-    cpu->stage[i].busy = 1;
+    lsq_reset(cpu->lsq);
+  }
+  if (cpu->prefetch)
+  {
+    prefetch_reset(cpu->prefetch);
+  }
+  if (cpu->mmio)
+  {
+    mmio_reset(cpu->mmio);
+  }
+  if (cpu->vpred)
+  {
+    vpred_reset(cpu->vpred);
   }
 
-  return cpu;
+  if (cpu->data_image.base)
+  {
+    int *memory = calloc(cpu->data_memory_size, sizeof(int));
+    if (memory)
+    {
+      release_mapping(&cpu->data_image);
+      cpu->data_memory = memory;
+      return;
+    }
+  }
+  memset(cpu->data_memory, 0, cpu->data_memory_size * sizeof(int));
 }
 
 /*
@@ -95,10 +269,82 @@ APEX_cpu_init(const char *filename, const int command, const int cycles)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
-  free(cpu->code_memory);
+  digest_close(cpu->digest, cpu);
+  trace_writer_close(cpu->trace_out);
+  trace_reader_close(cpu->trace_in);
+  steady_destroy(cpu->steady);
+  memo_destroy(cpu->memo);
+  shadow_destroy(cpu->shadow);
+  batch_destroy(cpu->batch);
+  lsq_destroy(cpu->lsq);
+  loop_buffer_destroy(cpu->loop_buffer);
+  prefetch_destroy(cpu->prefetch);
+  mmio_destroy(cpu->mmio);
+  vpred_destroy(cpu->vpred);
+  debugger_destroy(cpu->debugger);
+  report_destroy(cpu->report);
+  if (cpu->smt)
+  {
+    smt_switch(cpu, 0);
+  }
+  smt_destroy(cpu->smt);
+  if (cpu->multicore && cpu->core == 0)
+  {
+    multicore_destroy(cpu->multicore);
+  }
+
+  if (cpu->code_image.base)
+  {
+    release_mapping(&cpu->code_image);
+  }
+  else if (cpu->owns_code)
+  {
+    free(cpu->code_memory);
+  }
+
+  if (cpu->data_image.base)
+  {
+    release_mapping(&cpu->data_image);
+  }
+  else
+  {
+    free(cpu->data_memory);
+  }
+
+  free(cpu->vregs);
   free(cpu);
 }
 
+/*
+ * Replaces the zeroed data memory with the contents of a data image.
+ * Large images are used in place through a copy-on-write mapping.
+ */
+int APEX_cpu_load_data_image(APEX_CPU *cpu, const char *filename)
+{
+  APEX_Mapping mapping = {NULL, 0};
+  long words;
+  int *memory = load_data_image(filename, cpu->data_memory_size, &words,
+                                &mapping);
+  if (!memory)
+  {
+    return -1;
+  }
+
+  if (cpu->data_image.base)
+  {
+    release_mapping(&cpu->data_image);
+  }
+  else
+  {
+    free(cpu->data_memory);
+  }
+
+  cpu->data_memory = memory;
+  cpu->data_memory_size = words;
+  cpu->data_image = mapping;
+  return 0;
+}
+
 /* Converts the PC(4000 series) into
  * array index for code memory
  *
@@ -127,27 +373,53 @@ print_instruction(CPU_Stage *stage)
   }
 
   if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "MUL") == 0 || strcmp(stage->opcode, "AND") == 0 ||
-      strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0)
+      strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0 || strcmp(stage->opcode, "SC") == 0)
   {
     printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
   }
 
-  if (strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "LOAD") == 0)
+  if (strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "LOAD") == 0 ||
+      strcmp(stage->opcode, "LL") == 0)
   {
     printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
   }
 
-  if (strcmp(stage->opcode, "MOVC") == 0)
+  if (strcmp(stage->opcode, "MOVC") == 0 || strcmp(stage->opcode, "CALL") == 0)
   {
     printf("%s,R%d,#%d ", stage->opcode, stage->rd, stage->imm);
   }
 
+  if (strcmp(stage->opcode, "RET") == 0)
+  {
+    printf("%s,R%d ", stage->opcode, stage->rs1);
+  }
+
+  if (strcmp(stage->opcode, "CPUID") == 0)
+  {
+    printf("%s,R%d ", stage->opcode, stage->rd);
+  }
+
   if (strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0)
   {
     printf("%s,#%d", stage->opcode, stage->imm);
   }
 
-  if (strcmp(stage->opcode, "JUMP") == 0)
+  if (strcmp(stage->opcode, "VLOAD") == 0)
+  {
+    printf("%s,V%d,R%d,#%d ", stage->opcode, stage->vd, stage->rs1, stage->imm);
+  }
+
+  if (strcmp(stage->opcode, "VSTORE") == 0)
+  {
+    printf("%s,V%d,R%d,#%d ", stage->opcode, stage->vs1, stage->rs1, stage->imm);
+  }
+
+  if (strcmp(stage->opcode, "VADD") == 0 || strcmp(stage->opcode, "VSUB") == 0 || strcmp(stage->opcode, "VMUL") == 0)
+  {
+    printf("%s,V%d,V%d,V%d ", stage->opcode, stage->vd, stage->vs1, stage->vs2);
+  }
+
+  if (strcmp(stage->opcode, "JUMP") == 0 || strcmp(stage->opcode, "LOOP") == 0)
   {
     printf("%s,R%d,#%d", stage->opcode, stage->rs1, stage->imm);
   }
@@ -170,7 +442,7 @@ print_instruction(CPU_Stage *stage)
  *
  */
 static void
-print_stage_content(char *name, CPU_Stage *stage)
+print_stage_content(const char *name, CPU_Stage *stage)
 {
   if (strcmp(stage->opcode, "") == 0)
   {
@@ -185,112 +457,1088 @@ print_stage_content(char *name, CPU_Stage *stage)
   printf("\n");
 }
 
+static const char *stage_names[NUM_STAGES] = {
+    "Fetch", "Decode/RF", "Execute1", "Execute2", "Memory1", "Memory2", "Writeback"};
+
 /*
- *  Fetch Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * Branches, stores and HALT write no register. Their instruction fields
+ * read as R0, which they would otherwise forward over and keep invalid
+ * behind them.
  */
-int fetch(APEX_CPU *cpu)
+static void
+drop_destination(CPU_Stage *stage)
 {
-  CPU_Stage *stage = &cpu->stage[F];
+  switch (stage->op)
+  {
+  case OP_BZ:
+  case OP_BNZ:
+  case OP_JUMP:
+  case OP_LOOP:
+  case OP_STORE:
+  case OP_STR:
+  case OP_HALT:
+    stage->rd = -1;
+    break;
+  }
+}
 
-  if (stage->flush || cpu->isBranchOrJumpTaken)
+/* Latch content of an empty slot inserted behind a busy stage */
+static void
+insert_bubble(CPU_Stage *stage)
+{
+  memset(stage, 0, sizeof(CPU_Stage));
+  stage->rd = -1;
+  stage->stalled = 1;
+}
+
+/*
+ * Called by a stage about to start an operation that takes `latency`
+ * cycles. Returns 1 if the stage has to stay busy; the simulation loop
+ * then keeps it and the stages before it frozen until the completion
+ * event, while bubbles drain into the stages after it. Returns 0 when
+ * the operation can proceed, which includes its final cycle.
+ */
+static int
+begin_multicycle(APEX_CPU *cpu, int stage_index, int latency)
+{
+  if (cpu->hold_stage == stage_index)
   {
+    cpu->hold_stage = -1;
+    return 0;
+  }
 
-    cpu->stage[DRF] = cpu->stage[F];
+  if (latency <= 1)
+  {
+    return 0;
+  }
+
+  cpu->hold_stage = stage_index;
+  cpu->hold_until = cpu->clock + latency - 1;
+  event_schedule(&cpu->events, cpu->hold_until, stage_index);
+  cpu->busy_cycles[stage_index]++;
+  insert_bubble(&cpu->stage[stage_index + 1]);
+  return 1;
+}
+
+static int
+is_memory_instruction(const char *opcode)
+{
+  return strcmp(opcode, "LOAD") == 0 || strcmp(opcode, "LDR") == 0 ||
+         strcmp(opcode, "STORE") == 0 || strcmp(opcode, "STR") == 0 ||
+         strcmp(opcode, "LL") == 0 || strcmp(opcode, "SC") == 0 ||
+         strcmp(opcode, "VLOAD") == 0 || strcmp(opcode, "VSTORE") == 0;
+}
+
+static int
+is_vector_instruction(int op)
+{
+  return op >= OP_VLOAD && op <= OP_VMUL;
+}
+
+/* Cycles a vector instruction takes for its elements in Execute1 or Memory1 */
+static int
+vector_beats(const APEX_CPU *cpu)
+{
+  return (cpu->vlen + cpu->vector_lanes - 1) / cpu->vector_lanes;
+}
+
+/*
+ * Moves the vector register numbers of a fetched instruction out of the
+ * scalar fields, which are left to the base register of VLOAD and VSTORE
+ */
+static void
+vector_operands(CPU_Stage *stage)
+{
+  stage->vd = -1;
+  stage->vs1 = -1;
+  stage->vs2 = -1;
+  switch (stage->op)
+  {
+  case OP_VLOAD:
+    stage->vd = stage->rd;
+    break;
+  case OP_VSTORE:
+    stage->vs1 = stage->rd;
+    break;
+  default:
+    stage->vd = stage->rd;
+    stage->vs1 = stage->rs1;
+    stage->vs2 = stage->rs2;
+    stage->rs1 = -1;
+    stage->rs2 = -1;
+    break;
+  }
+  stage->rd = -1;
+}
 
-    if (ENABLE_DEBUG_MESSAGES)
+/*
+ * Vector results are chained from Memory2. An instruction in Decode waits
+ * while an older one of its context writing a vector register it reads is
+ * in Execute1 to Memory1; stalled latches hold bubbles.
+ */
+VARIANT_FUNCTION int
+vector_hazard(const APEX_CPU *cpu, const CPU_Stage *stage, const unsigned variant)
+{
+  for (int i = EX1; i <= MEM1; ++i)
+  {
+    const CPU_Stage *older = &cpu->stage[i];
+    if (is_vector_instruction(older->op) && !older->stalled && older->vd >= 0 &&
+        (older->vd == stage->vs1 || older->vd == stage->vs2) &&
+        (!MODEL(cpu, smt) || older->thread == stage->thread))
     {
-      print_stage_content("Fetch", stage);
+      return 1;
     }
   }
-  else if (!stage->busy && !stage->stalled)
+  return 0;
+}
+
+static int *
+vector_register(APEX_CPU *cpu, int v)
+{
+  return &cpu->vregs[v * APEX_MAX_VLEN];
+}
+
+/*
+ * The result is produced by the memory access in Memory2, so Decode waits
+ * for it. The store queue forwards plain loads from Memory1.
+ */
+VARIANT_FUNCTION int
+waits_for_memory(const APEX_CPU *cpu, const char *opcode, const unsigned variant)
+{
+  if (strcmp(opcode, "LL") == 0 || strcmp(opcode, "SC") == 0)
   {
-    /* Store current PC in fetch latch */
-    stage->pc = cpu->pc;
-    //printf("HERE\n");
+    return 1;
+  }
+  return !MODEL(cpu, lsq) &&
+         (strcmp(opcode, "LOAD") == 0 || strcmp(opcode, "LDR") == 0);
+}
 
-    /* Index into code memory using this pc and copy all instruction fields into
-     * fetch latch
-     */
-    APEX_Instruction *current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
+/* Data memory address of a load or store that left Execute1 */
+static int
+data_address(const CPU_Stage *stage)
+{
+  switch (stage->op)
+  {
+  case OP_STORE:
+    return stage->rs2_value + stage->imm;
+  case OP_STR:
+    return stage->rs2_value + stage->rs3_value;
+  case OP_SC:
+    return stage->rs2_value;
+  default:
+    return stage->buffer;
+  }
+}
 
-    //printf("%s\n", stage->opcode );
-    strcpy(stage->opcode, current_ins->opcode);
+/*
+ * Cycles Memory1 takes for an access. With cores, a miss in the L1 data
+ * cache adds its bus transaction; it is made once, when the access starts.
+ * An SC is performed there and then, its result is in the latch. With a
+ * prefetcher, the access waits for lines missing from the data cache.
+ * Device accesses go around the caches.
+ */
+VARIANT_FUNCTION int
+memory_latency(APEX_CPU *cpu, CPU_Stage *stage, const unsigned variant)
+{
+  int latency;
 
-    if (strcmp(stage->opcode, "STR") == 0)
+  if (MODEL(cpu, mmio) && APEX_IS_MMIO(data_address(stage)))
+  {
+    latency = cpu->mmio->latency;
+    return is_vector_instruction(stage->op) ? latency + vector_beats(cpu) - 1
+                                            : latency;
+  }
+
+  /* A vector access moves vector_lanes elements a cycle once it started */
+  if (is_vector_instruction(stage->op))
+  {
+    latency = cpu->mem_latency + vector_beats(cpu) - 1;
+    if (cpu->hold_stage == MEM1)
     {
-      stage->rs1 = current_ins->rs1;
-      stage->rs2 = current_ins->rs2;
-      stage->rs3 = current_ins->rs3;
+      return latency;
     }
-    else
+    if (MODEL(cpu, lsq))
     {
-      stage->rd = current_ins->rd;
-      stage->rs1 = current_ins->rs1;
-      stage->rs2 = current_ins->rs2;
-      stage->imm = current_ins->imm;
-      stage->rd = current_ins->rd;
+      return lsq_vector_access(cpu, latency);
     }
-
-    /* Update PC for next instruction */
-    if (stage->pc < ((cpu->code_memory_size * 4) + 4000))
+    if (MODEL(cpu, multicore))
     {
-      cpu->pc += 4;
+      latency += multicore_access_range(cpu, data_address(stage), cpu->vlen,
+                                        stage->op == OP_VSTORE);
     }
-    else
+    if (MODEL(cpu, prefetch))
     {
-      strcpy(stage->opcode, "");
+      latency += prefetch_access(cpu->prefetch, stage->pc, data_address(stage),
+                                 cpu->vlen, cpu->clock);
     }
+    return latency;
+  }
 
-    /* Copy data from fetch latch to decode latch*/
-    cpu->stage[DRF] = cpu->stage[F];
-
-    if (ENABLE_DEBUG_MESSAGES)
-    {
-      print_stage_content("Fetch", stage);
-    }
+  if (MODEL(cpu, prefetch) && cpu->hold_stage != MEM1)
+  {
+    return cpu->mem_latency + prefetch_access(cpu->prefetch, stage->pc,
+                                              data_address(stage), 1,
+                                              cpu->clock);
   }
-  else
+  if (!MODEL(cpu, multicore) || cpu->hold_stage == MEM1)
   {
-    /* Store current PC in fetch latch */
-    stage->pc = cpu->pc;
-
-    /* Index into code memory using this pc and copy all instruction fields into
-     * fetch latch
-     */
-    APEX_Instruction *current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
-    strcpy(stage->opcode, current_ins->opcode);
-    stage->rd = current_ins->rd;
-    stage->rs1 = current_ins->rs1;
-    stage->rs2 = current_ins->rs2;
-    stage->imm = current_ins->imm;
-    stage->rd = current_ins->rd;
-
-    if (ENABLE_DEBUG_MESSAGES)
-    {
-      print_stage_content("Fetch", stage);
-    }
+    return cpu->mem_latency;
   }
-
-  return 0;
+  if (stage->op == OP_SC)
+  {
+    stage->buffer = multicore_store_conditional(cpu, data_address(stage),
+                                                stage->rs1_value, &latency);
+    return latency;
+  }
+  return multicore_access(cpu, data_address(stage),
+                          stage->op == OP_STORE || stage->op == OP_STR);
 }
 
 /*
- *  Decode Stage of APEX Pipeline
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * Called before `words` words of data memory from address take these
+ * values, by every store of a single core
  */
-
-int decode(APEX_CPU *cpu)
+void APEX_cpu_observe_store(APEX_CPU *cpu, int address, const int *values,
+                            int words)
 {
-  CPU_Stage *stage = &cpu->stage[DRF];
-
+  if (cpu->debugger)
+  {
+    debugger_store(cpu->debugger, address, words);
+  }
+  if (cpu->digest)
+  {
+    digest_store(cpu->digest, cpu, address, values, words);
+  }
+  if (cpu->report)
+  {
+    report_store(cpu->report, cpu, address, words);
+  }
+}
+
+VARIANT_FUNCTION int
+read_data(APEX_CPU *cpu, int address, const unsigned variant)
+{
+  if (MODEL(cpu, mmio) && APEX_IS_MMIO(address))
+  {
+    return mmio_read(cpu->mmio, address);
+  }
+  if (MODEL(cpu, multicore))
+  {
+    return multicore_read(cpu, address);
+  }
+  return cpu->data_memory[address];
+}
+
+VARIANT_FUNCTION void
+write_data(APEX_CPU *cpu, int address, int value, const unsigned variant)
+{
+  if (MODEL(cpu, mmio) && APEX_IS_MMIO(address))
+  {
+    mmio_write(cpu->mmio, address, value);
+  }
+  else if (MODEL(cpu, multicore))
+  {
+    multicore_write(cpu, address, value);
+  }
+  else
+  {
+    if (variant & VARIANT_MODELS)
+    {
+      APEX_cpu_observe_store(cpu, address, &value, 1);
+    }
+    cpu->data_memory[address] = value;
+  }
+}
+
+/*
+ * Memory2 executes vector instructions, in program order with the scalar
+ * loads and stores. Vector registers are read and written nowhere else.
+ */
+VARIANT_FUNCTION void
+execute_vector(APEX_CPU *cpu, CPU_Stage *stage, const unsigned variant)
+{
+  int n = cpu->vlen;
+
+  switch (stage->op)
+  {
+  case OP_VLOAD:
+    stage->mem_address = stage->buffer;
+    if (MODEL(cpu, mmio) && APEX_IS_MMIO(stage->mem_address))
+    {
+      for (int i = 0; i < n; ++i)
+      {
+        vector_register(cpu, stage->vd)[i] =
+            mmio_read(cpu->mmio, stage->mem_address);
+      }
+    }
+    else if (MODEL(cpu, multicore))
+    {
+      for (int i = 0; i < n; ++i)
+      {
+        vector_register(cpu, stage->vd)[i] =
+            read_data(cpu, stage->mem_address + i, variant);
+      }
+    }
+    else
+    {
+      memcpy(vector_register(cpu, stage->vd),
+             &cpu->data_memory[stage->mem_address], n * sizeof(int));
+    }
+    break;
+  case OP_VSTORE:
+    stage->mem_address = stage->buffer;
+    if (MODEL(cpu, mmio) && APEX_IS_MMIO(stage->mem_address))
+    {
+      for (int i = 0; i < n; ++i)
+      {
+        mmio_write(cpu->mmio, stage->mem_address,
+                   vector_register(cpu, stage->vs1)[i]);
+      }
+    }
+    else if (MODEL(cpu, multicore))
+    {
+      for (int i = 0; i < n; ++i)
+      {
+        write_data(cpu, stage->mem_address + i,
+                   vector_register(cpu, stage->vs1)[i], variant);
+      }
+    }
+    else
+    {
+      if (variant & VARIANT_MODELS)
+      {
+        APEX_cpu_observe_store(cpu, stage->mem_address,
+                               vector_register(cpu, stage->vs1), n);
+      }
+      memcpy(&cpu->data_memory[stage->mem_address],
+             vector_register(cpu, stage->vs1), n * sizeof(int));
+    }
+    break;
+  case OP_VADD:
+    vector_add(vector_register(cpu, stage->vd), vector_register(cpu, stage->vs1),
+               vector_register(cpu, stage->vs2), n);
+    break;
+  case OP_VSUB:
+    vector_sub(vector_register(cpu, stage->vd), vector_register(cpu, stage->vs1),
+               vector_register(cpu, stage->vs2), n);
+    break;
+  case OP_VMUL:
+    vector_mul(vector_register(cpu, stage->vd), vector_register(cpu, stage->vs1),
+               vector_register(cpu, stage->vs2), n);
+    break;
+  }
+  cpu->vector_instructions++;
+  cpu->vector_elements += n;
+}
+
+/* Registers read by an instruction, returns their count */
+int stage_sources(const CPU_Stage *stage, int *regs)
+{
+  switch (stage->op)
+  {
+  case OP_STORE:
+    regs[0] = stage->rs1;
+    regs[1] = stage->rs2;
+    return 2;
+  case OP_STR:
+    regs[0] = stage->rs1;
+    regs[1] = stage->rs2;
+    regs[2] = stage->rs3;
+    return 3;
+  case OP_ADDL:
+  case OP_SUBL:
+  case OP_LOAD:
+  case OP_LL:
+  case OP_JUMP:
+  case OP_LOOP:
+  case OP_RET:
+  case OP_VLOAD:
+  case OP_VSTORE:
+    regs[0] = stage->rs1;
+    return 1;
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_AND:
+  case OP_OR:
+  case OP_EXOR:
+  case OP_LDR:
+  case OP_SC:
+    regs[0] = stage->rs1;
+    regs[1] = stage->rs2;
+    return 2;
+  }
+  return 0;
+}
+
+/* A squashed instruction no longer writes its register */
+static void
+release_register(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+  if (stage->rd >= 0 && stage->rd < 16)
+  {
+    cpu->regs_valid[stage->rd] = 16843009;
+  }
+}
+
+/*
+ * A younger instruction of the same context in Execute1 to Memory2 writes
+ * the register of the one in Writeback, which then stays invalid. Emptied
+ * latches read as R0 and are not writers.
+ */
+VARIANT_FUNCTION int
+younger_writer(const APEX_CPU *cpu, const CPU_Stage *stage, const unsigned variant)
+{
+  for (int i = EX1; i <= MEM2; ++i)
+  {
+    if (cpu->stage[i].rd == stage->rd && cpu->stage[i].op != OP_NONE &&
+        (!MODEL(cpu, smt) || cpu->stage[i].thread == stage->thread))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Counts a cycle in which Decode waits for the data of a load */
+VARIANT_FUNCTION void
+count_load_stall(APEX_CPU *cpu, const unsigned variant)
+{
+  if ((variant & VARIANT_COUNTERS) && cpu->load_stall_clock != cpu->clock + 1)
+  {
+    cpu->load_stall_cycles++;
+    cpu->load_stall_clock = cpu->clock + 1;
+  }
+}
+
+/*
+ * A load leaving Memory1 has no data yet, but the instruction after it in
+ * Execute2 lets Decode go on. An instruction reading the load's register
+ * waits there unless that one writes the register too and forwards it.
+ * By the time Decode runs, the Memory2 latch holds the load Memory1 passed
+ * on and the Memory1 latch the instruction after it.
+ */
+VARIANT_FUNCTION int
+memory1_blocks(const APEX_CPU *cpu, const CPU_Stage *stage, const unsigned variant)
+{
+  const CPU_Stage *load = &cpu->stage[MEM2];
+  const CPU_Stage *next = &cpu->stage[MEM1];
+  int regs[3];
+
+  if (load->stalled || load->value_predicted || load->rd < 0 ||
+      !waits_for_memory(cpu, load->opcode, variant) ||
+      (MODEL(cpu, smt) && load->thread != stage->thread) ||
+      (!next->stalled && next->op != OP_NONE && next->rd == load->rd))
+  {
+    return 0;
+  }
+
+  int n = stage_sources(stage, regs);
+  for (int i = 0; i < n; ++i)
+  {
+    if (regs[i] == load->rd)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* ADD, SUB, ADDL, SUBL and MUL set the zero flag */
+static int
+produces_flag(const CPU_Stage *stage)
+{
+  return stage->op == OP_ADD || stage->op == OP_SUB || stage->op == OP_ADDL ||
+         stage->op == OP_SUBL || stage->op == OP_MUL;
+}
+
+/*
+ * Resolves a BZ or BNZ in Decode. It waits there until the youngest older
+ * flag producer passed Execute2; a taken branch flushes only the slot
+ * Fetch is about to fill.
+ */
+VARIANT_FUNCTION void
+resolve_branch(APEX_CPU *cpu, CPU_Stage *stage, const unsigned variant)
+{
+  if (cpu->z_done_tag != cpu->z_tag)
+  {
+    cpu->stage[F].stalled = 1;
+    cpu->stage[DRF].stalled = 1;
+    COUNT(cpu->branch_stall_cycles++);
+    return;
+  }
+
+  /* Neither the branch nor the flushed slot writes a register */
+  stage->rd = -1;
+  stage->resolved = 1;
+  int taken = strcmp(stage->opcode, "BZ") == 0 ? cpu->z_done_value : !cpu->z_done_value;
+
+  /* Fetch went back from the loop buffer, only the exit flushes */
+  if (stage->predicted)
+  {
+    stage->taken = taken;
+    COUNT(cpu->taken_branches += taken);
+    if (taken)
+    {
+      loop_buffer_report(cpu->loop_buffer, stage->pc, DRF - F);
+      return;
+    }
+    cpu->isBranchOrJumpTaken = 1;
+    memset(&cpu->stage[F], 0, sizeof(CPU_Stage));
+    cpu->stage[F].rd = -1;
+    cpu->branchPcValue = stage->pc + 4;
+    cpu->loop_buffer->exits++;
+    COUNT(cpu->branch_flush_cycles += DRF - F);
+    return;
+  }
+
+  if (taken)
+  {
+    cpu->isBranchOrJumpTaken = 1;
+    stage->taken = 1;
+    memset(&cpu->stage[F], 0, sizeof(CPU_Stage));
+    cpu->stage[F].rd = -1;
+    cpu->branchPcValue = stage->pc + stage->imm;
+    COUNT(cpu->taken_branches++);
+    COUNT(cpu->branch_flush_cycles += DRF - F);
+    if (MODEL(cpu, loop_buffer))
+    {
+      loop_buffer_capture(cpu->loop_buffer, stage->pc, stage->pc + stage->imm);
+    }
+  }
+}
+
+/*
+ * Decode passed a LOOP, Fetch is at the start of its body. The LOOP keeps
+ * the loop it replaces in its latch, for when it is squashed. The body
+ * runs at least once.
+ */
+static void
+begin_loop(APEX_CPU *cpu, CPU_Stage *stage)
+{
+  stage->rd = -1;
+  stage->buffer = cpu->loop_remaining;
+  stage->mem_address = cpu->loop_start;
+  stage->rs2_value = cpu->loop_end;
+  if (stage->imm > 4)
+  {
+    cpu->loop_start = stage->pc + 4;
+    cpu->loop_end = stage->pc + stage->imm;
+    cpu->loop_remaining = stage->rs1_value > 1 ? stage->rs1_value : 1;
+  }
+}
+
+/*
+ * Called before Fetch is redirected to `target` and Decode to `oldest` are
+ * squashed, by Execute2 up to Execute1. Iterations Fetch started for the
+ * squashed instructions are given back, a squashed LOOP puts back the loop
+ * it replaced, and the loop is left when the target is outside its body,
+ * unless a CALL or RET goes there. The return address stack goes back to
+ * where it was when the oldest squashed instruction was fetched.
+ */
+VARIANT_FUNCTION void
+rewind_fetch(APEX_CPU *cpu, const CPU_Stage *branch, int target, int oldest,
+             const unsigned variant)
+{
+  const CPU_Stage *first = NULL;
+
+  for (int i = DRF; i <= oldest; ++i)
+  {
+    const CPU_Stage *stage = &cpu->stage[i];
+    if (stage->op == OP_NONE || (i >= EX1 && stage->stalled) ||
+        (MODEL(cpu, smt) && stage->thread != branch->thread))
+    {
+      continue;
+    }
+    first = stage;
+    if (stage->looped)
+    {
+      cpu->loop_remaining++;
+    }
+    if (stage->op == OP_LOOP && i >= EX1)
+    {
+      cpu->loop_remaining = stage->buffer;
+      cpu->loop_start = stage->mem_address;
+      cpu->loop_end = stage->rs2_value;
+    }
+  }
+  if (branch->op != OP_CALL && branch->op != OP_RET &&
+      (target < cpu->loop_start || target >= cpu->loop_end))
+  {
+    cpu->loop_remaining = 0;
+  }
+
+  if (first)
+  {
+    cpu->ras_top = first->ras_top;
+    if (cpu->ras_top > 0)
+    {
+      cpu->ras[(cpu->ras_top - 1) % cpu->ras_depth] = first->ras_entry;
+    }
+  }
+}
+
+/*
+ * Fetch passed a CALL or RET. A CALL goes on at its target and pushes its
+ * return address, a RET at the address it pops; with nothing to pop it
+ * goes on with the next instruction and is flushed in Execute2.
+ */
+static void
+follow_call(APEX_CPU *cpu, CPU_Stage *stage)
+{
+  int target = stage->pc + stage->imm;
+
+  if (stage->op == OP_CALL)
+  {
+    if (cpu->ras_depth > 0)
+    {
+      cpu->ras[cpu->ras_top % cpu->ras_depth] = stage->pc + 4;
+      cpu->ras_top++;
+    }
+
+    /* Execute2 stops the program at a target outside the code */
+    if (target >= 4000 && target < (cpu->code_memory_size * 4) + 4000)
+    {
+      cpu->pc = target;
+    }
+  }
+  else
+  {
+    /* Nothing forwards a RET as a writer of R0 */
+    stage->rd = -1;
+    if (cpu->ras_top > 0)
+    {
+      cpu->ras_top--;
+      cpu->pc = cpu->ras[cpu->ras_top % cpu->ras_depth];
+    }
+  }
+  stage->next_pc = cpu->pc;
+}
+
+/*
+ * Execute2 has the target of a CALL or RET. If Fetch went on anywhere
+ * else, the instructions after it are squashed.
+ */
+VARIANT_FUNCTION void
+resolve_call(APEX_CPU *cpu, CPU_Stage *stage, const unsigned variant)
+{
+  int target = stage->op == OP_CALL ? stage->pc + stage->imm : stage->buffer;
+
+  stage->taken = 1;
+  if (target < 4000 || target >= (cpu->code_memory_size * 4) + 4000)
+  {
+    cpu->isComplete = -1;
+    return;
+  }
+
+  if (stage->op == OP_CALL)
+  {
+    COUNT(cpu->ras_overflows += cpu->ras_depth > 0 &&
+                                stage->ras_top >= cpu->ras_depth);
+  }
+  else if (stage->next_pc == target)
+  {
+    COUNT(cpu->ras_hits++);
+  }
+  else
+  {
+    COUNT(cpu->ras_misses++);
+  }
+  if (stage->next_pc == target)
+  {
+    return;
+  }
+
+  cpu->isBranchOrJumpTaken = 1;
+  CPU_Stage *ex1stage = &cpu->stage[EX1];
+  if (EARLY_BRANCH(cpu) && ex1stage->z_tag == cpu->z_tag && cpu->z_tag > 0)
+  {
+    /* The flushed producer no longer renames the flag */
+    cpu->z_tag--;
+  }
+  rewind_fetch(cpu, stage, target, EX1, variant);
+  if (MODEL(cpu, smt))
+  {
+    smt_squash(cpu, stage->thread);
+  }
+  else
+  {
+    /* Only the instruction in Execute1 passed Decode */
+    int older_writer = 0;
+    for (int i = EX2; i <= MEM2; ++i)
+    {
+      older_writer |= !cpu->stage[i].stalled && cpu->stage[i].rd == ex1stage->rd;
+    }
+    if (!ex1stage->stalled && !older_writer)
+    {
+      release_register(cpu, ex1stage);
+    }
+    memset(&cpu->stage[F], 0, sizeof(CPU_Stage));
+    memset(&cpu->stage[DRF], 0, sizeof(CPU_Stage));
+    memset(ex1stage, 0, sizeof(CPU_Stage));
+  }
+  cpu->branchPcValue = target;
+}
+
+/*
+ * Execute2 resolved a BZ or BNZ Fetch followed back from the loop buffer.
+ * Taken, the instructions after it are right and nothing is flushed;
+ * otherwise the loop is left and they are squashed.
+ */
+VARIANT_FUNCTION void
+follow_prediction(APEX_CPU *cpu, CPU_Stage *stage, int taken, const unsigned variant)
+{
+  if (taken)
+  {
+    stage->taken = 1;
+    COUNT(cpu->taken_branches++);
+    loop_buffer_report(cpu->loop_buffer, stage->pc, EX2 - F);
+    return;
+  }
+
+  cpu->isBranchOrJumpTaken = 1;
+  cpu->loop_buffer->exits++;
+  COUNT(cpu->branch_flush_cycles += EX2 - F);
+  rewind_fetch(cpu, stage, stage->pc + 4, EX1, variant);
+  for (int i = F; i <= EX1; ++i)
+  {
+    release_register(cpu, &cpu->stage[i]);
+    memset(&cpu->stage[i], 0, sizeof(CPU_Stage));
+  }
+  cpu->branchPcValue = stage->pc + 4;
+}
+
+/*
+ * A LOAD or LDR entering Execute2 with a confident entry in the value
+ * predictor forwards the predicted value until Memory2 has its data
+ */
+VARIANT_FUNCTION int
+predict_load(APEX_CPU *cpu, CPU_Stage *stage, const unsigned variant)
+{
+  if (!MODEL(cpu, vpred) || (stage->op != OP_LOAD && stage->op != OP_LDR))
+  {
+    return 0;
+  }
+  stage->value_predicted = vpred_lookup(cpu->vpred, stage->pc, &stage->prediction);
+  return stage->value_predicted;
+}
+
+/* Execute2 or Memory1 forwards the predicted value of a load like a result */
+static void
+forward_prediction(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+  cpu->isForwarded = 1;
+  cpu->stage[DRF].stalled = 0;
+  cpu->stage[F].stalled = 0;
+  cpu->forwardedValues[stage->rd] = stage->prediction;
+  vpred_count_avoided(cpu->vpred, cpu->clock);
+}
+
+/*
+ * Memory2 found the value the load forwarded wrong. Only the instructions
+ * Decode passed read it: the oldest one reading the load's register and
+ * all after it are squashed and fetched again, the older ones go on. An
+ * instruction writing the register ends the search, the ones after it
+ * read its value. A squashed instruction no longer writes its register,
+ * unless an older one still in the pipeline writes it too.
+ */
+VARIANT_FUNCTION void
+value_flush(APEX_CPU *cpu, const CPU_Stage *load, const unsigned variant)
+{
+  int oldest = -1;
+  int regs[3];
+
+  for (int i = MEM1; i >= EX1 && oldest < 0; --i)
+  {
+    const CPU_Stage *stage = &cpu->stage[i];
+    if (stage->stalled)
+    {
+      continue;
+    }
+    int n = stage_sources(stage, regs);
+    for (int r = 0; r < n; ++r)
+    {
+      if (regs[r] == load->rd)
+      {
+        oldest = i;
+      }
+    }
+    if (stage->rd == load->rd)
+    {
+      break;
+    }
+  }
+  if (oldest < 0)
+  {
+    return;
+  }
+
+  int target = cpu->stage[oldest].pc;
+  rewind_fetch(cpu, load, target, oldest, variant);
+  for (int i = oldest; i >= F; --i)
+  {
+    CPU_Stage *stage = &cpu->stage[i];
+
+    /* Copies Decode left behind while it stalled are bubbles */
+    if (i >= EX1 && !stage->stalled)
+    {
+      int older_writer = 0;
+      for (int j = oldest + 1; j <= MEM2; ++j)
+      {
+        older_writer |= !cpu->stage[j].stalled && cpu->stage[j].rd == stage->rd;
+      }
+      if (!older_writer)
+      {
+        release_register(cpu, stage);
+      }
+    }
+    if (i >= DRF && stage->op != OP_NONE && !(i >= EX1 && stage->stalled))
+    {
+      cpu->vpred->squashed++;
+    }
+    memset(stage, 0, sizeof(CPU_Stage));
+    stage->rd = -1;
+  }
+  if (cpu->hold_stage >= F && cpu->hold_stage <= oldest)
+  {
+    cpu->hold_stage = -1;
+  }
+
+  cpu->isBranchOrJumpTaken = 1;
+  cpu->branchPcValue = target;
+  cpu->vpred->flushes++;
+  cpu->vpred->flush_cycles += oldest - F + 1;
+}
+
+/* Appends the instruction leaving writeback to the committed trace */
+static void
+record_trace(APEX_CPU *cpu, CPU_Stage *stage)
+{
+  APEX_TraceRecord record;
+  record.pc = stage->pc;
+  record.taken = stage->taken;
+  record.has_mem = is_memory_instruction(stage->opcode);
+  record.mem_address = record.has_mem ? stage->mem_address : 0;
+  trace_write(cpu->trace_out, &record);
+}
+
+/*
+ * Takes the branch outcome and memory address of the instruction entering
+ * Execute2 from the replayed trace. Only committed instructions reach
+ * Execute2, the wrong path is flushed before it.
+ */
+static void
+replay_trace(APEX_CPU *cpu, CPU_Stage *stage)
+{
+  APEX_TraceRecord record;
+
+  if (!trace_read(cpu->trace_in, &record))
+  {
+    fprintf(stderr, "APEX_CPU : Trace exhausted at pc(%d)\n", stage->pc);
+    cpu->isComplete = 1;
+    return;
+  }
+
+  if (record.pc != stage->pc)
+  {
+    fprintf(stderr, "APEX_CPU : Trace expects pc(%d), pipeline has pc(%d)\n",
+            record.pc, stage->pc);
+    cpu->isComplete = -2;
+    return;
+  }
+
+  stage->taken = record.taken;
+  stage->mem_address = record.mem_address;
+
+  /* Jump target is the pc of the next committed instruction */
+  if (record.taken && cpu->trace_in->has_next)
+  {
+    stage->buffer = cpu->trace_in->next.pc;
+  }
+}
+
+/*
+ *  Fetch Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_FUNCTION int
+fetch_stage(APEX_CPU *cpu, const unsigned variant)
+{
+  CPU_Stage *stage = &cpu->stage[F];
+
+  if (stage->flush || cpu->isBranchOrJumpTaken)
+  {
+
+    cpu->stage[DRF] = cpu->stage[F];
+
+    if (DEBUG_MESSAGES(cpu))
+    {
+      print_stage_content("Fetch", stage);
+    }
+  }
+  else if (!stage->busy && !stage->stalled)
+  {
+    /* Store current PC in fetch latch */
+    stage->pc = cpu->pc;
+    //printf("HERE\n");
+
+    /* Index into code memory using this pc and copy all instruction fields into
+     * fetch latch
+     */
+    APEX_Instruction *current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
+
+    //printf("%s\n", stage->opcode );
+    strcpy(stage->opcode, current_ins->opcode);
+    stage->op = current_ins->op;
+    stage->looped = 0;
+    stage->predicted = 0;
+    stage->value_predicted = 0;
+    stage->ras_top = cpu->ras_top;
+    stage->ras_entry = cpu->ras_top > 0 ? cpu->ras[(cpu->ras_top - 1) % cpu->ras_depth] : 0;
+
+    if (strcmp(stage->opcode, "STR") == 0)
+    {
+      stage->rs1 = current_ins->rs1;
+      stage->rs2 = current_ins->rs2;
+      stage->rs3 = current_ins->rs3;
+    }
+    else
+    {
+      stage->rd = current_ins->rd;
+      stage->rs1 = current_ins->rs1;
+      stage->rs2 = current_ins->rs2;
+      stage->imm = current_ins->imm;
+      stage->rd = current_ins->rd;
+    }
+    drop_destination(stage);
+    if (is_vector_instruction(stage->op))
+    {
+      vector_operands(stage);
+    }
+
+    /* Update PC for next instruction */
+    if (stage->pc < ((cpu->code_memory_size * 4) + 4000))
+    {
+      cpu->pc += 4;
+
+      /* CALL and RET go on at their target and return address */
+      if (stage->op == OP_CALL || stage->op == OP_RET)
+      {
+        follow_call(cpu, stage);
+      }
+
+      /* The end of a hardware loop body goes back to its start */
+      else if (cpu->loop_remaining > 1 && stage->pc == cpu->loop_end - 4)
+      {
+        cpu->pc = cpu->loop_start;
+        cpu->loop_remaining--;
+        stage->looped = cpu->loop_start - 4;
+      }
+      else if (MODEL(cpu, loop_buffer) &&
+               loop_buffer_predict(cpu->loop_buffer, stage->pc) >= 0)
+      {
+        /* Its instructions come next, nothing forwards the branch as R0 */
+        cpu->pc = loop_buffer_predict(cpu->loop_buffer, stage->pc);
+        stage->predicted = 1;
+        stage->rd = -1;
+      }
+    }
+    else
+    {
+      strcpy(stage->opcode, "");
+      stage->op = OP_NONE;
+      if (MODEL(cpu, smt))
+      {
+        smt_stop_fetch(cpu);
+      }
+    }
+
+    stage->seq = ++cpu->fetch_seq;
+
+    /* Copy data from fetch latch to decode latch*/
+    cpu->stage[DRF] = cpu->stage[F];
+
+    if (DEBUG_MESSAGES(cpu))
+    {
+      print_stage_content("Fetch", stage);
+    }
+  }
+  else
+  {
+    /* Store current PC in fetch latch */
+    stage->pc = cpu->pc;
+
+    /* Index into code memory using this pc and copy all instruction fields into
+     * fetch latch
+     */
+    APEX_Instruction *current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
+    strcpy(stage->opcode, current_ins->opcode);
+    stage->op = current_ins->op;
+    stage->rd = current_ins->rd;
+    stage->rs1 = current_ins->rs1;
+    stage->rs2 = current_ins->rs2;
+    stage->imm = current_ins->imm;
+    stage->rd = current_ins->rd;
+    drop_destination(stage);
+    if (is_vector_instruction(stage->op))
+    {
+      vector_operands(stage);
+    }
+
+    if (DEBUG_MESSAGES(cpu))
+    {
+      print_stage_content("Fetch", stage);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ *  Decode Stage of APEX Pipeline
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+VARIANT_FUNCTION int
+decode_stage(APEX_CPU *cpu, const unsigned variant)
+{
+  CPU_Stage *stage = &cpu->stage[DRF];
+
   if (!stage->busy && !stage->stalled)
   {
 
+    /* Only the instructions using a load's register wait for its data */
+    if (MODEL(cpu, lsq))
+    {
+      cpu->stage[F].stalled = 0;
+      if (lsq_blocks(cpu, stage))
+      {
+        cpu->stage[F].stalled = 1;
+        insert_bubble(&cpu->stage[EX1]);
+        count_load_stall(cpu, variant);
+        if (DEBUG_MESSAGES(cpu))
+        {
+          print_stage_content("Decode/RF", stage);
+        }
+        return 0;
+      }
+    }
+
+    if (memory1_blocks(cpu, stage, variant))
+    {
+      cpu->stage[F].stalled = 1;
+      insert_bubble(&cpu->stage[EX1]);
+      count_load_stall(cpu, variant);
+      if (DEBUG_MESSAGES(cpu))
+      {
+        print_stage_content("Decode/RF", stage);
+      }
+      return 0;
+    }
+
     /* Read data from register file for store */
     if (strcmp(stage->opcode, "STORE") == 0)
     {
@@ -305,16 +1553,9 @@ int decode(APEX_CPU *cpu)
       {
         if (cpu->isForwarded && (cpu->stage[EX1].rd != stage->rs1 && cpu->stage[EX1].rd != stage->rs2))
         {
-          if (cpu->regs_valid[stage->rs1] == 0)
-          {
-            stage->rs1_value = cpu->forwardedValues[stage->rs1];
-            stage->rs2_value = cpu->regs[stage->rs2];
-          }
-          else if (cpu->regs_valid[stage->rs2] == 0)
-          {
-            stage->rs1_value = cpu->regs[stage->rs1];
-            stage->rs2_value = cpu->forwardedValues[stage->rs2];
-          }
+          /* Both, the data and the address, can be forwarded */
+          stage->rs1_value = cpu->regs_valid[stage->rs1] == 0 ? cpu->forwardedValues[stage->rs1] : cpu->regs[stage->rs1];
+          stage->rs2_value = cpu->regs_valid[stage->rs2] == 0 ? cpu->forwardedValues[stage->rs2] : cpu->regs[stage->rs2];
           cpu->stage[F].stalled = 0;
           cpu->stage[DRF].stalled = 0;
         }
@@ -340,24 +1581,10 @@ int decode(APEX_CPU *cpu)
       {
         if (cpu->isForwarded && (cpu->stage[EX1].rd != stage->rs1 && cpu->stage[EX1].rd != stage->rs2 && cpu->stage[EX1].rd != stage->rs3))
         {
-          if (cpu->regs_valid[stage->rs1] == 0)
-          {
-            stage->rs1_value = cpu->forwardedValues[stage->rs1];
-            stage->rs2_value = cpu->regs[stage->rs2];
-            stage->rs3_value = cpu->regs[stage->rs3];
-          }
-          else if (cpu->regs_valid[stage->rs2] == 0)
-          {
-            stage->rs1_value = cpu->regs[stage->rs1];
-            stage->rs2_value = cpu->forwardedValues[stage->rs2];
-            stage->rs3_value = cpu->regs[stage->rs3];
-          }
-          else if (cpu->regs_valid[stage->rs3] == 0)
-          {
-            stage->rs1_value = cpu->regs[stage->rs1];
-            stage->rs2_value = cpu->regs[stage->rs2];
-            stage->rs3_value = cpu->forwardedValues[stage->rs3];
-          }
+          /* Any of the three, the data and both address parts, can be forwarded */
+          stage->rs1_value = cpu->regs_valid[stage->rs1] == 0 ? cpu->forwardedValues[stage->rs1] : cpu->regs[stage->rs1];
+          stage->rs2_value = cpu->regs_valid[stage->rs2] == 0 ? cpu->forwardedValues[stage->rs2] : cpu->regs[stage->rs2];
+          stage->rs3_value = cpu->regs_valid[stage->rs3] == 0 ? cpu->forwardedValues[stage->rs3] : cpu->regs[stage->rs3];
           cpu->stage[F].stalled = 0;
           cpu->stage[DRF].stalled = 0;
         }
@@ -376,8 +1603,15 @@ int decode(APEX_CPU *cpu)
       cpu->regs_valid[stage->rd] = 0;
     }
 
+    /* Nor for CPUID and CALL */
+    else if (strcmp(stage->opcode, "CPUID") == 0 || strcmp(stage->opcode, "CALL") == 0)
+    {
+      cpu->regs_valid[stage->rd] = 0;
+    }
+
     else if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "MUL") == 0 || strcmp(stage->opcode, "AND") == 0 ||
-             strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0 || strcmp(stage->opcode, "LDR") == 0)
+             strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0 || strcmp(stage->opcode, "LDR") == 0 ||
+             strcmp(stage->opcode, "SC") == 0)
     {
       if (cpu->regs_valid[stage->rs1] == 16843009 && cpu->regs_valid[stage->rs2] == 16843009)
       {
@@ -389,8 +1623,6 @@ int decode(APEX_CPU *cpu)
       }
       else
       {
-        printf("%d\n", cpu->stage[EX1].rd);
-        printf("%d\n", stage->rs1);
         if (cpu->isForwarded && (cpu->stage[EX1].rd != stage->rs1 && cpu->stage[EX1].rd != stage->rs2))
         {
           if (cpu->regs_valid[stage->rs1] == 0 && cpu->regs_valid[stage->rs2] == 0)
@@ -420,7 +1652,8 @@ int decode(APEX_CPU *cpu)
       }
     }
 
-    else if (strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "LOAD") == 0)
+    else if (strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "LOAD") == 0 ||
+             strcmp(stage->opcode, "LL") == 0)
     {
       if (cpu->regs_valid[stage->rs1] == 16843009)
       {
@@ -449,13 +1682,46 @@ int decode(APEX_CPU *cpu)
       }
     }
 
+    /* VLOAD and VSTORE read their base register like LOAD */
+    else if (is_vector_instruction(stage->op))
+    {
+      int ready = !vector_hazard(cpu, stage, variant);
+      if (ready && stage->rs1 >= 0)
+      {
+        if (cpu->regs_valid[stage->rs1] == 16843009)
+        {
+          stage->rs1_value = cpu->regs[stage->rs1];
+        }
+        else if (cpu->isForwarded && cpu->stage[EX1].rd != stage->rs1)
+        {
+          if (cpu->regs_valid[stage->rs1] == 0)
+          {
+            stage->rs1_value = cpu->forwardedValues[stage->rs1];
+          }
+        }
+        else
+        {
+          ready = 0;
+        }
+      }
+      cpu->stage[F].stalled = !ready;
+      cpu->stage[DRF].stalled = !ready;
+    }
+
+    else if ((strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0) &&
+             EARLY_BRANCH(cpu))
+    {
+      resolve_branch(cpu, stage, variant);
+    }
+
     else if (strcmp(stage->opcode, "BZ") == 0)
     {
       if (strcmp(cpu->stage[EX1].opcode, "ADD") == 0 || strcmp(cpu->stage[EX1].opcode, "SUB") == 0 || strcmp(cpu->stage[EX1].opcode, "MUL") == 0 || strcmp(cpu->stage[EX1].opcode, "ADDL") == 0 || strcmp(cpu->stage[EX1].opcode, "SUBL") == 0)
       {
         cpu->stage[F].stalled = 1;
         cpu->stage[DRF].stalled = 1;
-        zcounter = 1;
+        cpu->zcounter = 1;
+        COUNT(cpu->branch_stall_cycles++);
       }
     }
 
@@ -465,11 +1731,13 @@ int decode(APEX_CPU *cpu)
       {
         cpu->stage[F].stalled = 1;
         cpu->stage[DRF].stalled = 1;
-        bnzcounter = 1;
+        cpu->bnzcounter = 1;
+        COUNT(cpu->branch_stall_cycles++);
       }
     }
 
-    if (strcmp(stage->opcode, "JUMP") == 0)
+    if (strcmp(stage->opcode, "JUMP") == 0 || strcmp(stage->opcode, "LOOP") == 0 ||
+        strcmp(stage->opcode, "RET") == 0)
     {
       if (cpu->regs_valid[stage->rs1] == 16843009)
       {
@@ -496,7 +1764,24 @@ int decode(APEX_CPU *cpu)
       }
     }
 
-    if (strcmp(stage->opcode, "HALT") == 0)
+    /* A trace has no register values, the count of a LOOP is not known */
+    if (strcmp(stage->opcode, "LOOP") == 0 && TRACE_IN(cpu))
+    {
+      fprintf(stderr, "APEX_CPU : Trace replay cannot run LOOP at pc(%d)\n",
+              stage->pc);
+      cpu->isComplete = -2;
+    }
+    else if (strcmp(stage->opcode, "LOOP") == 0 && !stage->stalled)
+    {
+      begin_loop(cpu, stage);
+    }
+
+    /* Other contexts keep fetching */
+    if (strcmp(stage->opcode, "HALT") == 0 && MODEL(cpu, smt))
+    {
+      smt_stop_fetch(cpu);
+    }
+    else if (strcmp(stage->opcode, "HALT") == 0)
     {
       CPU_Stage *fstage = &cpu->stage[F];
       memset(fstage, 0, sizeof(CPU_Stage));
@@ -504,11 +1789,16 @@ int decode(APEX_CPU *cpu)
       cpu->stage[F].pc = 0;
     }
 
+    if (EARLY_BRANCH(cpu) && produces_flag(stage) && !stage->stalled)
+    {
+      stage->z_tag = ++cpu->z_tag;
+    }
+
     /* Copy data from decode latch to execute latch*/
     cpu->stage[EX1] = cpu->stage[DRF];
   } 
 
-  if (ENABLE_DEBUG_MESSAGES)
+  if (DEBUG_MESSAGES(cpu))
   {
     print_stage_content("Decode/RF", stage);
   }
@@ -522,14 +1812,15 @@ int decode(APEX_CPU *cpu)
  *  Note : You are free to edit this function according to your
  * 				 implementation
  */
-int execute1(APEX_CPU *cpu)
+VARIANT_FUNCTION int
+execute1_stage(APEX_CPU *cpu, const unsigned variant)
 {
   CPU_Stage *stage = &cpu->stage[EX1];
 
   if (strcmp(stage->opcode, "BZ") == 0)
   {
-    zcounter--;
-    if (zcounter == 0)
+    cpu->zcounter--;
+    if (cpu->zcounter == 0)
     {
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
@@ -538,8 +1829,8 @@ int execute1(APEX_CPU *cpu)
 
   if (strcmp(stage->opcode, "BNZ") == 0)
   {
-    bnzcounter--;
-    if (bnzcounter == 0)
+    cpu->bnzcounter--;
+    if (cpu->bnzcounter == 0)
     {
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
@@ -549,6 +1840,28 @@ int execute1(APEX_CPU *cpu)
   if (!stage->busy && !stage->stalled)
   {
 
+    if (strcmp(stage->opcode, "MUL") == 0 &&
+        begin_multicycle(cpu, EX1, cpu->mul_latency))
+    {
+      if (DEBUG_MESSAGES(cpu))
+      {
+        print_stage_content("Execute1", stage);
+      }
+      return 0;
+    }
+
+    /* Vector arithmetic takes a cycle per vector_lanes elements, VMUL starts like MUL */
+    if ((stage->op == OP_VADD || stage->op == OP_VSUB || stage->op == OP_VMUL) &&
+        begin_multicycle(cpu, EX1, vector_beats(cpu) - 1 +
+                                       (stage->op == OP_VMUL ? cpu->mul_latency : 1)))
+    {
+      if (DEBUG_MESSAGES(cpu))
+      {
+        print_stage_content("Execute1", stage);
+      }
+      return 0;
+    }
+
     /* Store */
     if (strcmp(stage->opcode, "STORE") == 0)
     {
@@ -559,11 +1872,33 @@ int execute1(APEX_CPU *cpu)
       stage->rd = -1;
     }
 
-    else if (strcmp(stage->opcode, "LOAD") == 0)
+    /* Trace replay models timing only, results are not evaluated */
+    else if (TRACE_IN(cpu))
+    {
+    }
+
+    else if (strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LL") == 0 ||
+             strcmp(stage->opcode, "VLOAD") == 0 || strcmp(stage->opcode, "VSTORE") == 0)
     {
       stage->buffer = stage->rs1_value + stage->imm;
     }
 
+    /* SC keeps its address in rs2_value, Memory2 gives the result */
+    else if (strcmp(stage->opcode, "SC") == 0)
+    {
+    }
+
+    else if (strcmp(stage->opcode, "CPUID") == 0)
+    {
+      stage->buffer = cpu->core;
+    }
+
+    /* CALL writes its return address */
+    else if (strcmp(stage->opcode, "CALL") == 0)
+    {
+      stage->buffer = stage->pc + 4;
+    }
+
     else if (strcmp(stage->opcode, "LDR") == 0)
     {
       stage->buffer = stage->rs1_value + stage->rs2_value;
@@ -616,15 +1951,21 @@ int execute1(APEX_CPU *cpu)
       stage->buffer = stage->rs1_value ^ stage->rs2_value;
     }
 
-    if (strcmp(stage->opcode, "JUMP") == 0)
+    if (strcmp(stage->opcode, "JUMP") == 0 && !TRACE_IN(cpu))
     {
       stage->buffer = stage->rs1_value + stage->imm;
     }
 
+    /* Replay takes the return address from the trace, at its end from Fetch */
+    if (strcmp(stage->opcode, "RET") == 0)
+    {
+      stage->buffer = TRACE_IN(cpu) ? stage->next_pc : stage->rs1_value;
+    }
+
     /* Copy data from Execute latch to Memory latch*/
     cpu->stage[EX2] = cpu->stage[EX1];
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       print_stage_content("Execute1", stage);
     }
@@ -633,7 +1974,7 @@ int execute1(APEX_CPU *cpu)
   {
     stage->rd = -1;
     cpu->stage[EX2] = cpu->stage[EX1];
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       printf("Execute1 : no Operation\n");
       // print_stage_content("Execute1", stage);
@@ -643,13 +1984,25 @@ int execute1(APEX_CPU *cpu)
   return 0;
 }
 
-int execute2(APEX_CPU *cpu)
+VARIANT_FUNCTION int
+execute2_stage(APEX_CPU *cpu, const unsigned variant)
 {
   CPU_Stage *stage = &cpu->stage[EX2];
 
   if (!stage->busy && !stage->stalled)
   {
 
+    if (TRACE_IN(cpu) && strcmp(stage->opcode, "") != 0)
+    {
+      replay_trace(cpu, stage);
+    }
+
+    /* Fetch went back to the start of a LOOP body after this one */
+    if (stage->looped && MODEL(cpu, loop_buffer))
+    {
+      loop_buffer_report(cpu->loop_buffer, stage->looped, EX2 - F + 1);
+    }
+
     /* Store */
     if (strcmp(stage->opcode, "STORE") == 0)
     {
@@ -664,94 +2017,187 @@ int execute2(APEX_CPU *cpu)
     {
       if (stage->buffer == 0)
       {
-        zFlag = 1;
+        cpu->zFlag = 1;
       }
       else
       {
-        zFlag = 0;
+        cpu->zFlag = 0;
+      }
+
+      /* Forward the flag to a branch waiting in Decode */
+      if (EARLY_BRANCH(cpu) && stage->z_tag > cpu->z_done_tag)
+      {
+        cpu->z_done_tag = stage->z_tag;
+        cpu->z_done_value = cpu->zFlag;
       }
     }
 
-    if (strcmp(stage->opcode, "BZ") == 0)
+    if (strcmp(stage->opcode, "BZ") == 0 && !stage->resolved)
     {
-      if (zFlag)
+      if (stage->predicted)
+      {
+        follow_prediction(cpu, stage, TRACE_IN(cpu) ? stage->taken : cpu->zFlag,
+                          variant);
+      }
+      else if (TRACE_IN(cpu) ? stage->taken : cpu->zFlag)
       {
         cpu->isBranchOrJumpTaken = 1;
+        stage->taken = 1;
+        COUNT(cpu->taken_branches++);
+        COUNT(cpu->branch_flush_cycles += EX2 - F);
         CPU_Stage *fstage = &cpu->stage[F];
         CPU_Stage *drfstage = &cpu->stage[DRF];
         CPU_Stage *ex1stage = &cpu->stage[EX1];
-        memset(fstage, 0, sizeof(CPU_Stage));
-        cpu->regs_valid[fstage->rd] = 16843009;
-        memset(&cpu->stage[DRF], 0, sizeof(CPU_Stage));
-        cpu->regs_valid[drfstage->rd] = 16843009;
-        memset(&cpu->stage[EX1], 0, sizeof(CPU_Stage));
-        cpu->regs_valid[ex1stage->rd] = 16843009;
+        rewind_fetch(cpu, stage, stage->pc + stage->imm, EX1, variant);
+        if (MODEL(cpu, smt))
+        {
+          smt_squash(cpu, stage->thread);
+        }
+        else
+        {
+          memset(fstage, 0, sizeof(CPU_Stage));
+          release_register(cpu, fstage);
+          memset(&cpu->stage[DRF], 0, sizeof(CPU_Stage));
+          release_register(cpu, drfstage);
+          memset(&cpu->stage[EX1], 0, sizeof(CPU_Stage));
+          release_register(cpu, ex1stage);
+        }
         cpu->branchPcValue = stage->pc + stage->imm;
+        if (MODEL(cpu, loop_buffer))
+        {
+          loop_buffer_capture(cpu->loop_buffer, stage->pc, stage->pc + stage->imm);
+        }
       }
     }
 
-    if (strcmp(stage->opcode, "BNZ") == 0)
+    if (strcmp(stage->opcode, "BNZ") == 0 && !stage->resolved)
     {
-      if (!zFlag)
+      if (stage->predicted)
+      {
+        follow_prediction(cpu, stage, TRACE_IN(cpu) ? stage->taken : !cpu->zFlag,
+                          variant);
+      }
+      else if (TRACE_IN(cpu) ? stage->taken : !cpu->zFlag)
       {
         cpu->isBranchOrJumpTaken = 1;
+        stage->taken = 1;
+        COUNT(cpu->taken_branches++);
+        COUNT(cpu->branch_flush_cycles += EX2 - F);
         CPU_Stage *fstage = &cpu->stage[F];
         CPU_Stage *drfstage = &cpu->stage[DRF];
         CPU_Stage *ex1stage = &cpu->stage[EX1];
-        cpu->regs_valid[fstage->rd] = 16843009;
-        memset(fstage, 0, sizeof(CPU_Stage));
-        cpu->regs_valid[drfstage->rd] = 16843009;
-        memset(drfstage, 0, sizeof(CPU_Stage));
-        cpu->regs_valid[ex1stage->rd] = 16843009;
-        memset(ex1stage, 0, sizeof(CPU_Stage));
+        rewind_fetch(cpu, stage, stage->pc + stage->imm, EX1, variant);
+        if (MODEL(cpu, smt))
+        {
+          smt_squash(cpu, stage->thread);
+        }
+        else
+        {
+          release_register(cpu, fstage);
+          memset(fstage, 0, sizeof(CPU_Stage));
+          release_register(cpu, drfstage);
+          memset(drfstage, 0, sizeof(CPU_Stage));
+          release_register(cpu, ex1stage);
+          memset(ex1stage, 0, sizeof(CPU_Stage));
+        }
         cpu->branchPcValue = stage->pc + stage->imm;
+        if (MODEL(cpu, loop_buffer))
+        {
+          loop_buffer_capture(cpu->loop_buffer, stage->pc, stage->pc + stage->imm);
+        }
       }
     }
 
     if (strcmp(stage->opcode, "JUMP") == 0)
     {
-      printf("%d", stage->buffer);
       if ((stage->buffer < (cpu->code_memory_size * 4)) - 4 && stage->buffer > 4000)
       {
         cpu->isBranchOrJumpTaken = 1;
+        stage->taken = 1;
         CPU_Stage *fstage = &cpu->stage[F];
         CPU_Stage *drfstage = &cpu->stage[DRF];
         CPU_Stage *ex1stage = &cpu->stage[EX1];
-        memset(fstage, 0, sizeof(CPU_Stage));
-        cpu->regs_valid[drfstage->rd] = 16843009;
-        memset(drfstage, 0, sizeof(CPU_Stage));
-        cpu->regs_valid[ex1stage->rd] = 16843009;
-        memset(ex1stage, 0, sizeof(CPU_Stage));
+        if (EARLY_BRANCH(cpu) && ex1stage->z_tag == cpu->z_tag && cpu->z_tag > 0)
+        {
+          /* The flushed producer no longer renames the flag */
+          cpu->z_tag--;
+        }
+        rewind_fetch(cpu, stage, stage->buffer, EX1, variant);
+        if (MODEL(cpu, smt))
+        {
+          smt_squash(cpu, stage->thread);
+        }
+        else
+        {
+          memset(fstage, 0, sizeof(CPU_Stage));
+          release_register(cpu, drfstage);
+          memset(drfstage, 0, sizeof(CPU_Stage));
+          release_register(cpu, ex1stage);
+          memset(ex1stage, 0, sizeof(CPU_Stage));
+        }
         cpu->branchPcValue = stage->buffer;
       }
       else
       {
-        isComplete = -1;
+        cpu->isComplete = -1;
       }
     }
 
+    if (strcmp(stage->opcode, "CALL") == 0 || strcmp(stage->opcode, "RET") == 0)
+    {
+      resolve_call(cpu, stage, variant);
+    }
+
     if (strcmp(stage->opcode, "HALT") == 0)
     {
     }
 
-    if (strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LDR") == 0)
+    if (predict_load(cpu, stage, variant))
+    {
+      forward_prediction(cpu, stage);
+    }
+    else if (waits_for_memory(cpu, stage->opcode, variant))
     {
       cpu->isForwarded = 0;
-      cpu->stage[DRF].stalled = 1;
-      cpu->stage[F].stalled = 1;
+
+      /* Other contexts do not wait for the load */
+      if (!MODEL(cpu, smt) || cpu->stage[DRF].thread == stage->thread)
+      {
+        cpu->stage[DRF].stalled = 1;
+        cpu->stage[F].stalled = 1;
+        count_load_stall(cpu, variant);
+      }
+    }
+    else if (strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LDR") == 0)
+    {
+      cpu->isForwarded = 1;
+      cpu->stage[DRF].stalled = 0;
+      cpu->stage[F].stalled = 0;
     }
     else
     {
       cpu->isForwarded = 1;
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
-      cpu->forwardedValues[stage->rd] = stage->buffer;
+      if (stage->rd >= 0 && stage->op != OP_NONE)
+      {
+        cpu->forwardedValues[stage->rd] = stage->buffer;
+      }
+    }
+
+    if (MODEL(cpu, shadow) && strcmp(stage->opcode, "") != 0)
+    {
+      shadow_execute(cpu, stage);
+    }
+    if (MODEL(cpu, batch) && strcmp(stage->opcode, "") != 0)
+    {
+      batch_execute(cpu, stage);
     }
 
     /* Copy data from Execute latch to Memory latch*/
     cpu->stage[MEM1] = cpu->stage[EX2];
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       print_stage_content("Execute2", stage);
     }
@@ -759,7 +2205,7 @@ int execute2(APEX_CPU *cpu)
   else
   {
     cpu->stage[MEM1] = cpu->stage[EX2];
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       printf("Execute2 : No operation\n");
     }
@@ -774,13 +2220,26 @@ int execute2(APEX_CPU *cpu)
  *  Note : You are free to edit this function according to your
  * 				 implementation
  */
-int memory1(APEX_CPU *cpu)
+VARIANT_FUNCTION int
+memory1_stage(APEX_CPU *cpu, const unsigned variant)
 {
   CPU_Stage *stage = &cpu->stage[MEM1];
 
   if (!stage->busy && !stage->stalled)
   {
 
+    /* Vector accesses go around the store queue, which drains first */
+    if (is_memory_instruction(stage->opcode) &&
+        (!MODEL(cpu, lsq) || is_vector_instruction(stage->op)) &&
+        begin_multicycle(cpu, MEM1, memory_latency(cpu, stage, variant)))
+    {
+      if (DEBUG_MESSAGES(cpu))
+      {
+        print_stage_content("Memory1", stage);
+      }
+      return 0;
+    }
+
     /* Store */
     if (strcmp(stage->opcode, "STORE") == 0)
     {
@@ -791,36 +2250,63 @@ int memory1(APEX_CPU *cpu)
     {
     }
 
+    /* Loads take their data from the store queue or the memory port */
+    if ((strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LDR") == 0) &&
+        MODEL(cpu, lsq) && !TRACE_IN(cpu))
+    {
+      stage->mem_address = stage->buffer;
+      stage->ready = lsq_load(cpu, stage->mem_address, &stage->buffer);
+    }
+
     if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "MUL") == 0)
     {
       if (stage->buffer == 0)
       {
-        zFlag = 1;
+        cpu->zFlag = 1;
       }
       else
       {
-        zFlag = 0;
+        cpu->zFlag = 0;
       }
     }
 
-    if (strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LDR") == 0)
+    if (stage->value_predicted)
+    {
+      forward_prediction(cpu, stage);
+    }
+    else if (waits_for_memory(cpu, stage->opcode, variant))
     {
       cpu->isForwarded = 0;
-      cpu->stage[DRF].stalled = 1;
-      cpu->stage[F].stalled = 1;
+
+      /* Other contexts do not wait for the load */
+      if (!MODEL(cpu, smt) || cpu->stage[DRF].thread == stage->thread)
+      {
+        cpu->stage[DRF].stalled = 1;
+        cpu->stage[F].stalled = 1;
+        count_load_stall(cpu, variant);
+      }
+    }
+    else if (strcmp(stage->opcode, "LOAD") == 0 || strcmp(stage->opcode, "LDR") == 0)
+    {
+      cpu->isForwarded = 1;
+      cpu->stage[DRF].stalled = 0;
+      cpu->stage[F].stalled = 0;
     }
     else
     {
       cpu->isForwarded = 1;
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
-      cpu->forwardedValues[stage->rd] = stage->buffer;
+      if (stage->rd >= 0 && stage->op != OP_NONE)
+      {
+        cpu->forwardedValues[stage->rd] = stage->buffer;
+      }
     }
 
     /* Copy data from decode latch to execute latch*/
     cpu->stage[MEM2] = cpu->stage[MEM1];
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       print_stage_content("Memory1", stage);
     }
@@ -828,7 +2314,7 @@ int memory1(APEX_CPU *cpu)
   else
   {
     cpu->stage[MEM2] = cpu->stage[MEM1];
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       printf("Memory1 : No operation\n");
     }
@@ -837,25 +2323,60 @@ int memory1(APEX_CPU *cpu)
   return 0;
 }
 
-int memory2(APEX_CPU *cpu)
+VARIANT_FUNCTION int
+memory2_stage(APEX_CPU *cpu, const unsigned variant)
 {
   CPU_Stage *stage = &cpu->stage[MEM2];
 
   if (!stage->busy && !stage->stalled)
   {
 
+    /* A store waits here while the store queue is full */
+    if ((strcmp(stage->opcode, "STORE") == 0 || strcmp(stage->opcode, "STR") == 0) &&
+        MODEL(cpu, lsq) &&
+        begin_multicycle(cpu, MEM2, lsq_full(cpu->lsq) ? lsq_store_wait(cpu) : 1))
+    {
+      if (DEBUG_MESSAGES(cpu))
+      {
+        print_stage_content("Memory2", stage);
+      }
+      return 0;
+    }
+
     /* Store */
-    if (strcmp(stage->opcode, "STORE") == 0)
+    if (strcmp(stage->opcode, "STORE") == 0 && !TRACE_IN(cpu))
     {
-      int mem_address = stage->rs2_value + stage->imm;
-      cpu->data_memory[mem_address] = stage->rs1_value;
+      stage->mem_address = stage->rs2_value + stage->imm;
+      if (MODEL(cpu, lsq))
+      {
+        lsq_store(cpu, stage->mem_address, stage->rs1_value);
+      }
+      else
+      {
+        write_data(cpu, stage->mem_address, stage->rs1_value, variant);
+      }
+      if (MODEL(cpu, shadow))
+      {
+        shadow_store(cpu, stage->mem_address, stage->rs1_value);
+      }
     }
 
     /* Str */
-    if (strcmp(stage->opcode, "STR") == 0)
+    if (strcmp(stage->opcode, "STR") == 0 && !TRACE_IN(cpu))
     {
-      int mem_address = stage->rs2_value + stage->rs3_value;
-      cpu->data_memory[mem_address] = stage->rs1_value;
+      stage->mem_address = stage->rs2_value + stage->rs3_value;
+      if (MODEL(cpu, lsq))
+      {
+        lsq_store(cpu, stage->mem_address, stage->rs1_value);
+      }
+      else
+      {
+        write_data(cpu, stage->mem_address, stage->rs1_value, variant);
+      }
+      if (MODEL(cpu, shadow))
+      {
+        shadow_store(cpu, stage->mem_address, stage->rs1_value);
+      }
     }
 
     /* MOVC */
@@ -863,35 +2384,94 @@ int memory2(APEX_CPU *cpu)
     {
     }
 
-    if (strcmp(stage->opcode, "LOAD") == 0)
+    if (strcmp(stage->opcode, "LOAD") == 0 && !TRACE_IN(cpu) && !MODEL(cpu, lsq))
+    {
+      stage->mem_address = stage->buffer;
+      stage->buffer = read_data(cpu, stage->mem_address, variant);
+    }
+
+    if (strcmp(stage->opcode, "LDR") == 0 && !TRACE_IN(cpu) && !MODEL(cpu, lsq))
+    {
+      stage->mem_address = stage->buffer;
+      stage->buffer = read_data(cpu, stage->mem_address, variant);
+    }
+
+    /* The loaded value trains the value predictor and checks its prediction */
+    if ((stage->op == OP_LOAD || stage->op == OP_LDR) && MODEL(cpu, vpred) &&
+        vpred_train(cpu->vpred, stage->pc, stage->buffer,
+                    stage->value_predicted, stage->prediction))
+    {
+      value_flush(cpu, stage, variant);
+    }
+
+    if (is_vector_instruction(stage->op) && !TRACE_IN(cpu))
     {
-      stage->buffer = cpu->data_memory[stage->buffer];
+      execute_vector(cpu, stage, variant);
+    }
+
+    /* LL reserves its address for the next SC */
+    if (strcmp(stage->opcode, "LL") == 0 && !TRACE_IN(cpu))
+    {
+      stage->mem_address = stage->buffer;
+      if (MODEL(cpu, multicore))
+      {
+        stage->buffer = multicore_load_linked(cpu, stage->mem_address);
+      }
+      else
+      {
+        if (MODEL(cpu, lsq))
+        {
+          lsq_load(cpu, stage->mem_address, &stage->buffer);
+        }
+        else
+        {
+          stage->buffer = cpu->data_memory[stage->mem_address];
+        }
+        cpu->reservation = stage->mem_address;
+      }
     }
 
-    if (strcmp(stage->opcode, "LDR") == 0)
+    /* SC stores only while the reservation holds and writes 1 to rd if it did */
+    if (strcmp(stage->opcode, "SC") == 0 && !TRACE_IN(cpu))
     {
-      stage->buffer = cpu->data_memory[stage->buffer];
+      stage->mem_address = stage->rs2_value;
+      if (!MODEL(cpu, multicore))
+      {
+        stage->buffer = cpu->reservation == stage->mem_address;
+        if (stage->buffer && MODEL(cpu, lsq))
+        {
+          lsq_store(cpu, stage->mem_address, stage->rs1_value);
+        }
+        else if (stage->buffer)
+        {
+          write_data(cpu, stage->mem_address, stage->rs1_value, variant);
+        }
+        cpu->reservation = -1;
+      }
     }
 
     if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "MUL") == 0)
     {
       if (stage->buffer == 0)
       {
-        zFlag = 1;
+        cpu->zFlag = 1;
       }
       else
       {
-        zFlag = 0;
+        cpu->zFlag = 0;
       }
     }
     cpu->isForwarded = 1;
     cpu->stage[DRF].stalled = 0;
     cpu->stage[F].stalled = 0;
-    cpu->forwardedValues[stage->rd] = stage->buffer;
+    if (stage->rd >= 0 && stage->op != OP_NONE)
+    {
+      cpu->forwardedValues[stage->rd] = stage->buffer;
+    }
 
     /* Copy data from decode latch to execute latch*/
     cpu->stage[WB] = cpu->stage[MEM2];
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       print_stage_content("Memory2", stage);
     }
@@ -899,7 +2479,7 @@ int memory2(APEX_CPU *cpu)
   else
   {
     cpu->stage[WB] = cpu->stage[MEM2];
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       printf("Memory2 : No operation\n");
       // print_stage_content("Memory2", stage);
@@ -915,46 +2495,57 @@ int memory2(APEX_CPU *cpu)
  *  Note : You are free to edit this function according to your
  * 				 implementation
  */
-int writeback(APEX_CPU *cpu)
+VARIANT_FUNCTION int
+writeback_stage(APEX_CPU *cpu, const unsigned variant)
 {
   CPU_Stage *stage = &cpu->stage[WB];
 
   if (!stage->busy && !stage->stalled)
   {
 
-    if (strcmp(stage->opcode, "STORE") == 0)
+    /* A load's register is written once its data arrives */
+    if (MODEL(cpu, lsq) && lsq_writeback(cpu, stage))
+    {
+      cpu->stage[DRF].stalled = 0;
+      cpu->stage[F].stalled = 0;
+    }
+
+    else if (strcmp(stage->opcode, "STORE") == 0)
     {
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
     }
 
     /* Update register file */
-    else if (strcmp(stage->opcode, "MOVC") == 0)
+    else if (strcmp(stage->opcode, "MOVC") == 0 || strcmp(stage->opcode, "CPUID") == 0 ||
+             strcmp(stage->opcode, "CALL") == 0)
     {
       cpu->regs[stage->rd] = stage->buffer;
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
-      if (stage->rd != cpu->stage[EX1].rd && stage->rd != cpu->stage[EX2].rd && stage->rd != cpu->stage[MEM1].rd && stage->rd != cpu->stage[MEM2].rd)
+      if (!younger_writer(cpu, stage, variant))
       {
         cpu->regs_valid[stage->rd] = 16843009;
       }
     }
-    else if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "MUL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "LDR") == 0)
+    else if (strcmp(stage->opcode, "ADD") == 0 || strcmp(stage->opcode, "SUB") == 0 || strcmp(stage->opcode, "ADDL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "MUL") == 0 || strcmp(stage->opcode, "SUBL") == 0 || strcmp(stage->opcode, "LDR") == 0 ||
+             strcmp(stage->opcode, "SC") == 0)
     {
       cpu->regs[stage->rd] = stage->buffer;
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
-      if (stage->rd != cpu->stage[EX1].rd && stage->rd != cpu->stage[EX2].rd && stage->rd != cpu->stage[MEM1].rd && stage->rd != cpu->stage[MEM2].rd)
+      if (!younger_writer(cpu, stage, variant))
       {
         cpu->regs_valid[stage->rd] = 16843009;
       }
     }
-    else if (strcmp(stage->opcode, "AND") == 0 || strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0 || strcmp(stage->opcode, "LOAD") == 0)
+    else if (strcmp(stage->opcode, "AND") == 0 || strcmp(stage->opcode, "OR") == 0 || strcmp(stage->opcode, "EX-OR") == 0 || strcmp(stage->opcode, "LOAD") == 0 ||
+             strcmp(stage->opcode, "LL") == 0)
     {
       cpu->regs[stage->rd] = stage->buffer;
       cpu->stage[DRF].stalled = 0;
       cpu->stage[F].stalled = 0;
-      if (stage->rd != cpu->stage[EX1].rd && stage->rd != cpu->stage[EX2].rd && stage->rd != cpu->stage[MEM1].rd && stage->rd != cpu->stage[MEM2].rd)
+      if (!younger_writer(cpu, stage, variant))
       {
         cpu->regs_valid[stage->rd] = 16843009;
       }
@@ -962,29 +2553,36 @@ int writeback(APEX_CPU *cpu)
 
     cpu->ins_completed++;
 
+    if (TRACE_OUT(cpu) && strcmp(stage->opcode, "") != 0)
+    {
+      record_trace(cpu, stage);
+    }
+
+    /*
+     * A RET at the end of the code returns, it does not end the program.
+     * The cycle limit is checked after every cycle.
+     */
     if (cpu->cycles == 0)
     {
-      if (stage->pc == ((cpu->code_memory_size * 4) + 4000) - 4 || strcmp(stage->opcode, "HALT") == 0)
+      if ((stage->pc == ((cpu->code_memory_size * 4) + 4000) - 4 && stage->op != OP_RET) ||
+          strcmp(stage->opcode, "HALT") == 0)
       {
-        isComplete = 1;
+        cpu->isComplete = 1;
       }
     }
-    else
+    else if (strcmp(stage->opcode, "HALT") == 0)
     {
-      if (cpu->clock == cpu->cycles - 1 || strcmp(stage->opcode, "HALT") == 0)
-      {
-        isComplete = 1;
-      }
+      cpu->isComplete = 1;
     }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       print_stage_content("Writeback", stage);
     }
   }
   else
   {
-    if (ENABLE_DEBUG_MESSAGES)
+    if (DEBUG_MESSAGES(cpu))
     {
       printf("Writeback : No operation\n");
     }
@@ -1016,67 +2614,524 @@ void display(APEX_CPU *cpu)
   {
     printf("|    MEM[%d]\t     |    Value = %d\t     |\n", i, cpu->data_memory[i]);
   }
+
+  if (cpu->vector_instructions > 0)
+  {
+    printf("============== STATE OF VECTOR REGISTERS =============\n");
+    for (int v = 0; v < APEX_VECTOR_REGS; v++)
+    {
+      printf("|    VREG[%d]\t     |    Value =", v);
+      for (int i = 0; i < cpu->vlen; i++)
+      {
+        printf(" %d", vector_register(cpu, v)[i]);
+      }
+      printf("\n");
+    }
+  }
+}
+
+/* Prints the latch of every stage, Fetch first */
+void APEX_cpu_print_pipeline(APEX_CPU *cpu)
+{
+  for (int i = F; i < NUM_STAGES; i++)
+  {
+    print_stage_content(stage_names[i], &cpu->stage[i]);
+  }
+}
+
+VARIANT_FUNCTION int
+run_stage(APEX_CPU *cpu, int i, const unsigned variant)
+{
+  switch (i)
+  {
+  case F:
+    return fetch_stage(cpu, variant);
+  case DRF:
+    return decode_stage(cpu, variant);
+  case EX1:
+    return execute1_stage(cpu, variant);
+  case EX2:
+    return execute2_stage(cpu, variant);
+  case MEM1:
+    return memory1_stage(cpu, variant);
+  case MEM2:
+    return memory2_stage(cpu, variant);
+  default:
+    return writeback_stage(cpu, variant);
+  }
+}
+
+/* The stages on their own check every feature at run time */
+int fetch(APEX_CPU *cpu)
+{
+  return fetch_stage(cpu, VARIANT_ALL);
+}
+
+int decode(APEX_CPU *cpu)
+{
+  return decode_stage(cpu, VARIANT_ALL);
+}
+
+int execute1(APEX_CPU *cpu)
+{
+  return execute1_stage(cpu, VARIANT_ALL);
+}
+
+int execute2(APEX_CPU *cpu)
+{
+  return execute2_stage(cpu, VARIANT_ALL);
+}
+
+int memory1(APEX_CPU *cpu)
+{
+  return memory1_stage(cpu, VARIANT_ALL);
+}
+
+int memory2(APEX_CPU *cpu)
+{
+  return memory2_stage(cpu, VARIANT_ALL);
+}
+
+int writeback(APEX_CPU *cpu)
+{
+  return writeback_stage(cpu, VARIANT_ALL);
+}
+
+static void
+print_stats(APEX_CPU *cpu)
+{
+  printf("=============== SIMULATION STATISTICS ==========\n");
+  printf("|    Cycles\t\t     |    %d\n", cpu->clock);
+  printf("|    Instructions\t     |    %d\n", cpu->ins_completed);
+  if (cpu->trace_out)
+  {
+    printf("|    Trace records\t     |    %ld\n", cpu->trace_out->records);
+  }
+  if (cpu->mul_latency > 1)
+  {
+    printf("|    MUL busy cycles\t     |    %d\n", cpu->busy_cycles[EX1]);
+  }
+  if (cpu->mem_latency > 1 || cpu->prefetch || cpu->mmio)
+  {
+    printf("|    Memory busy cycles\t     |    %d\n", cpu->busy_cycles[MEM1]);
+  }
+  printf("|    Skipped idle cycles     |    %d\n", cpu->skipped_cycles);
+  printf("|    Load stall cycles\t     |    %d\n", cpu->load_stall_cycles);
+  printf("|    Taken branches\t     |    %d\n", cpu->taken_branches);
+  printf("|    Branch flush cycles     |    %d\n", cpu->branch_flush_cycles);
+  printf("|    Branch stall cycles     |    %d\n", cpu->branch_stall_cycles);
+  if (cpu->ras_hits + cpu->ras_misses + cpu->ras_overflows > 0)
+  {
+    printf("|    RAS hits\t\t     |    %ld of %ld returns\n", cpu->ras_hits,
+           cpu->ras_hits + cpu->ras_misses);
+    printf("|    RAS misses\t\t     |    %ld\n", cpu->ras_misses);
+    printf("|    RAS overflows\t     |    %ld\n", cpu->ras_overflows);
+    printf("|    Return flush cycles     |    %ld\n",
+           cpu->ras_misses * (EX2 - F));
+  }
+  if (cpu->vector_instructions > 0)
+  {
+    printf("|    Vector instructions     |    %ld\n", cpu->vector_instructions);
+    printf("|    Vector elements\t     |    %ld\n", cpu->vector_elements);
+  }
+  if (cpu->lsq)
+  {
+    APEX_Lsq *lsq = cpu->lsq;
+    printf("|    Store queue forwards    |    %ld\n", lsq->forwarded_loads);
+    printf("|    Deferred loads\t     |    %ld\n", lsq->deferred_loads);
+    printf("|    Store queue full cycles |    %d\n", cpu->busy_cycles[MEM2]);
+    printf("|    Store drain cycles\t     |    %d\n", lsq->drain_cycles);
+  }
+  if (cpu->smt)
+  {
+    smt_print_stats(cpu);
+  }
+  if (cpu->multicore)
+  {
+    multicore_print_stats(cpu->multicore);
+  }
+  if (cpu->loop_buffer)
+  {
+    loop_buffer_print_stats(cpu->loop_buffer);
+  }
+  if (cpu->prefetch)
+  {
+    prefetch_print_stats(cpu->prefetch);
+  }
+  if (cpu->mmio)
+  {
+    mmio_print_stats(cpu->mmio);
+  }
+  if (cpu->vpred)
+  {
+    vpred_print_stats(cpu->vpred);
+  }
+  if (cpu->steady)
+  {
+    printf("|    Extrapolated loops\t     |    %ld\n", cpu->steady->loops);
+    printf("|    Extrapolated iterations |    %ld\n", cpu->steady->iterations);
+    printf("|    Extrapolated cycles     |    %ld\n", cpu->steady->cycles);
+  }
+  if (cpu->memo)
+  {
+    APEX_Memo *memo = cpu->memo;
+    printf("|    Memo lookups\t     |    %ld\n", memo->lookups);
+    printf("|    Memo hits\t\t     |    %ld\n", memo->hits);
+    printf("|    Memo hit rate\t     |    %.2f%%\n",
+           memo->lookups ? 100.0 * memo->hits / memo->lookups : 0.0);
+    printf("|    Memo evictions\t     |    %ld\n", memo->evictions);
+    printf("|    Memo cycles\t     |    %ld\n", memo->cycles);
+    if (memo->verify_every)
+    {
+      printf("|    Memo verified hits\t     |    %ld\n", memo->verified);
+      printf("|    Memo verify failures    |    %ld\n", memo->verify_failures);
+    }
+  }
+  if (cpu->batch)
+  {
+    APEX_Batch *batch = cpu->batch;
+    printf("|    Batch lanes\t\t     |    %d\n", batch->lanes);
+    printf("|    Batch rounds\t     |    %d\n", batch->rounds);
+    printf("|    Lane cycles per second  |    %.0f\n",
+           batch->seconds > 0 ? batch->lane_cycles / batch->seconds : 0.0);
+  }
 }
 
 /*
- *  APEX CPU simulation loop
- *
- *  Note : You are free to edit this function according to your
- * 				 implementation
+ * A cycle of a busy stage: it keeps its latch and hands a bubble to the
+ * next stage, the stages before it are frozen
  */
-int APEX_cpu_run(APEX_CPU *cpu)
+VARIANT_FUNCTION void
+busy_cycle(APEX_CPU *cpu, const unsigned variant)
 {
+  int held = cpu->hold_stage;
+
+  cpu->busy_cycles[held]++;
+  insert_bubble(&cpu->stage[held + 1]);
 
-  if (cpu->isSimulate)
+  if (DEBUG_MESSAGES(cpu))
   {
-    ENABLE_DEBUG_MESSAGES = 0;
+    printf("%-15s: pc(%d) ", stage_names[held], cpu->stage[held].pc);
+    print_instruction(&cpu->stage[held]);
+    printf(" busy, %d cycles left\n", cpu->hold_until - cpu->clock);
   }
-  else
+}
+
+/*
+ * A busy stage with only canonical bubbles behind it repeats the same
+ * cycle until its operation completes. Moves the clock straight to the
+ * next event in that case.
+ */
+VARIANT_FUNCTION void
+skip_idle_cycles(APEX_CPU *cpu, const unsigned variant)
+{
+  CPU_Stage bubble;
+  int next = event_next_cycle(&cpu->events);
+
+  if (next > cpu->skip_until)
   {
-    ENABLE_DEBUG_MESSAGES = 1;
+    next = cpu->skip_until;
   }
 
-  while (1)
+  /* The last cycle within the limit is simulated */
+  if (cpu->cycles > 0 && next > cpu->cycles - 1)
   {
+    next = cpu->cycles - 1;
+  }
+  if (cpu->hold_stage < 0 || next <= cpu->clock ||
+      (MODEL(cpu, lsq) && !lsq_idle(cpu->lsq)))
+  {
+    return;
+  }
 
-    /* All the instructions committed, so exit */
-
-    if (isComplete)
+  insert_bubble(&bubble);
+  for (int i = cpu->hold_stage + 1; i < NUM_STAGES; ++i)
+  {
+    if (memcmp(&cpu->stage[i], &bubble, sizeof(bubble)) != 0)
     {
-      printf("(apex) >> Simulation Complete\n");
-      break;
+      return;
     }
+  }
 
-    if (isComplete == -1)
+  cpu->busy_cycles[cpu->hold_stage] += next - cpu->clock;
+  cpu->skipped_cycles += next - cpu->clock;
+  cpu->clock = next;
+}
+
+/* Body of APEX_cpu_step, instantiated once per variant */
+VARIANT_FUNCTION int
+step_variant(APEX_CPU *cpu, const unsigned variant)
+{
+  if (cpu->isComplete)
+  {
+    return cpu->isComplete;
+  }
+
+  /* Cycles are only extrapolated or memoized when nobody watches them */
+  if (MODEL(cpu, shadow) && cpu->isBranchOrJumpTaken && !DEBUG_MESSAGES(cpu))
+  {
+    int skipped = MODEL(cpu, steady) && steady_back_edge(cpu);
+    if (MODEL(cpu, memo))
     {
-      printf("(apex) >> Invalid Jump");
-      break;
+      memo_block_boundary(cpu, skipped);
     }
+  }
 
+  for (int t = 0; t < (MODEL(cpu, smt) ? cpu->smt->threads : 1); ++t)
+  {
+    if (MODEL(cpu, smt))
+    {
+      smt_switch(cpu, t);
+    }
     if (cpu->isBranchOrJumpTaken)
     {
       cpu->isBranchOrJumpTaken = 0;
       cpu->pc = cpu->branchPcValue;
     }
+  }
+
+  /* Cycles are only skipped when nobody watches them */
+  if (!DEBUG_MESSAGES(cpu))
+  {
+    skip_idle_cycles(cpu, variant);
+  }
+  event_expire(&cpu->events, cpu->clock);
+  if (MODEL(cpu, lsq))
+  {
+    lsq_begin_cycle(cpu);
+  }
+
+  if (DEBUG_MESSAGES(cpu))
+  {
+    printf("--------------------------------\n");
+    printf("Clock Cycle #: %d\n", cpu->clock);
+    printf("--------------------------------\n");
+  }
+
+  /* Stages run back to front, a busy stage freezes the ones before it */
+  for (int i = WB; i >= F; --i)
+  {
+    if (cpu->hold_stage == i && cpu->clock < cpu->hold_until)
+    {
+      busy_cycle(cpu, variant);
+      break;
+    }
+    if (MODEL(cpu, smt) && smt_enter_stage(cpu, i) < 0)
+    {
+      continue;
+    }
+    run_stage(cpu, i, variant);
+    if (MODEL(cpu, smt) && i == WB)
+    {
+      smt_writeback(cpu);
+    }
+    if (cpu->hold_stage == i)
+    {
+      break;
+    }
+  }
+  if (DEBUG_MESSAGES(cpu) && cpu->hold_stage >= 0)
+  {
+    for (int i = cpu->hold_stage - 1; i >= F; --i)
+    {
+      printf("%s : Stalled\n", stage_names[i]);
+    }
+  }
+  if (MODEL(cpu, lsq))
+  {
+    lsq_end_cycle(cpu);
+  }
+  cpu->clock++;
+
+  /* Whatever Writeback holds, bubbles of a busy stage included */
+  if (cpu->cycles > 0 && cpu->clock >= cpu->cycles && !cpu->isComplete)
+  {
+    cpu->isComplete = 1;
+  }
+  if (MODEL(cpu, digest))
+  {
+    digest_cycle(cpu);
+  }
+
+  if (MODEL(cpu, lsq) && cpu->isComplete > 0)
+  {
+    lsq_finish(cpu);
+  }
+
+  return cpu->isComplete;
+}
+
+/* Plain pipeline, for runs printing only the final state */
+static int
+step_plain(APEX_CPU *cpu)
+{
+  return step_variant(cpu, 0);
+}
+
+static int
+step_counted(APEX_CPU *cpu)
+{
+  return step_variant(cpu, VARIANT_COUNTERS);
+}
+
+static int
+step_early_branch(APEX_CPU *cpu)
+{
+  return step_variant(cpu, VARIANT_EARLY_BRANCH | VARIANT_COUNTERS);
+}
+
+static int
+step_traced(APEX_CPU *cpu)
+{
+  return step_variant(cpu, VARIANT_TRACE | VARIANT_EARLY_BRANCH | VARIANT_COUNTERS);
+}
+
+static int
+step_generic(APEX_CPU *cpu)
+{
+  return step_variant(cpu, VARIANT_ALL);
+}
+
+/* Variants from the fewest features to all of them */
+static const struct
+{
+  unsigned features;
+  int (*step)(APEX_CPU *cpu);
+} step_variants[] = {
+    {0, step_plain},
+    {VARIANT_COUNTERS, step_counted},
+    {VARIANT_EARLY_BRANCH | VARIANT_COUNTERS, step_early_branch},
+    {VARIANT_TRACE | VARIANT_EARLY_BRANCH | VARIANT_COUNTERS, step_traced},
+    {VARIANT_ALL, step_generic},
+};
+
+/* Features the settings and models of the CPU need from its variant */
+static unsigned
+required_features(const APEX_CPU *cpu)
+{
+  unsigned features = 0;
+
+  if (cpu->debug_messages)
+  {
+    features |= VARIANT_DISPLAY;
+  }
+  if (cpu->trace_in || cpu->trace_out)
+  {
+    features |= VARIANT_TRACE;
+  }
+  if (cpu->early_branch)
+  {
+    features |= VARIANT_EARLY_BRANCH;
+  }
+  if (cpu->lsq || cpu->smt || cpu->multicore || cpu->loop_buffer ||
+      cpu->prefetch || cpu->shadow || cpu->steady || cpu->memo || cpu->batch ||
+      cpu->debugger || cpu->digest || cpu->report || cpu->mmio ||
+      cpu->vpred)
+  {
+    features |= VARIANT_MODELS;
+  }
+  if (cpu->show_stats)
+  {
+    features |= VARIANT_COUNTERS;
+  }
+  return features;
+}
 
-    if (ENABLE_DEBUG_MESSAGES)
+/*
+ *  Simulates one clock cycle, or a run of cycles that are skipped,
+ *  extrapolated or memoized as a whole. Returns the completion status,
+ *  0 while the program runs.
+ */
+int APEX_cpu_step(APEX_CPU *cpu)
+{
+  if (!cpu->step)
+  {
+    unsigned features = required_features(cpu);
+    int v = 0;
+    while ((step_variants[v].features & features) != features)
     {
-      printf("--------------------------------\n");
-      printf("Clock Cycle #: %d\n", cpu->clock);
-      printf("--------------------------------\n");
+      v++;
     }
+    cpu->step = step_variants[v].step;
+  }
+  return cpu->step(cpu);
+}
+
+/*
+ *  APEX CPU simulation loop. Runs until the program completes or the
+ *  cycle limit is reached, without printing the final state.
+ *
+ *  Note : You are free to edit this function according to your
+ * 				 implementation
+ */
+int APEX_cpu_simulate(APEX_CPU *cpu)
+{
+  if (cpu->multicore)
+  {
+    return multicore_simulate(cpu->multicore);
+  }
+
+  while (!cpu->isComplete)
+  {
+    APEX_cpu_step(cpu);
+  }
+
+  return cpu->isComplete;
+}
+
+/*
+ *  Simulates the program and prints its final state
+ */
+int APEX_cpu_run(APEX_CPU *cpu)
+{
+  if (APEX_cpu_simulate(cpu) == -2)
+  {
+    printf("(apex) >> Trace does not match the program\n");
+  }
+  else
+  {
+    printf("(apex) >> Simulation Complete\n");
+  }
 
-    writeback(cpu);
-    memory2(cpu);
-    memory1(cpu);
-    execute2(cpu);
-    execute1(cpu);
-    decode(cpu);
-    fetch(cpu);
-    cpu->clock++;
+  if (cpu->batch)
+  {
+    batch_finish(cpu);
+  }
+  else if (cpu->trace_in)
+  {
+    printf("(apex) >> Trace replay : %d cycles, %ld instructions\n",
+           cpu->clock, cpu->trace_in->records);
+  }
+  else if (cpu->smt)
+  {
+    for (int t = 0; t < cpu->smt->threads; ++t)
+    {
+      smt_switch(cpu, t);
+      printf("(apex) >> Thread %d\n", t);
+      display(cpu);
+    }
+  }
+  else if (cpu->multicore)
+  {
+    for (int c = 0; c < cpu->multicore->cores; ++c)
+    {
+      printf("(apex) >> Core %d\n", c);
+      display(cpu->multicore->cpu[c]);
+    }
+  }
+  else if (cpu->report)
+  {
+    report_print(cpu->report, cpu);
+  }
+  else
+  {
+    display(cpu);
   }
 
-  display(cpu);
+  if (cpu->show_stats)
+  {
+    print_stats(cpu);
+  }
 
   return 0;
 }
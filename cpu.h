@@ -8,6 +8,8 @@
  *  Gaurav Kothari (gkothar1@binghamton.edu)
  *  State University of New York, Binghamton
  */
+#include "event.h"
+#include "image.h"
 
 enum
 {
@@ -21,10 +23,56 @@ enum
   NUM_STAGES
 };
 
+/* Operation codes, assigned by the assembler from the opcode mnemonic */
+enum
+{
+  OP_NONE,
+  OP_MOVC,
+  OP_STORE,
+  OP_STR,
+  OP_LOAD,
+  OP_LDR,
+  OP_ADD,
+  OP_ADDL,
+  OP_SUB,
+  OP_SUBL,
+  OP_MUL,
+  OP_AND,
+  OP_OR,
+  OP_EXOR,
+  OP_BZ,
+  OP_BNZ,
+  OP_JUMP,
+  OP_HALT,
+  OP_LL,
+  OP_SC,
+  OP_CPUID,
+  OP_VLOAD,
+  OP_VSTORE,
+  OP_VADD,
+  OP_VSUB,
+  OP_VMUL,
+  OP_LOOP,
+  OP_CALL,
+  OP_RET,
+  NUM_OPCODES
+};
+
+/* Vector registers V0 - V7 and the longest vector length */
+#define APEX_VECTOR_REGS 8
+#define APEX_MAX_VLEN 64
+#define APEX_DEFAULT_VLEN 4
+#define APEX_DEFAULT_VECTOR_LANES 4
+
+/* Entries of the return address stack */
+#define APEX_RAS_MAX_DEPTH 32
+#define APEX_RAS_DEFAULT_DEPTH 8
+
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
 {
-  char opcode[128]; // Operation Code
+  char opcode[16];  // Operation Code
+  int op;           // Operation Code number (OP_*)
   int rd;           // Destination Register Address
   int rs1;          // Source-1 Register Address
   int rs2;          // Source-2 Register Address
@@ -36,7 +84,8 @@ typedef struct APEX_Instruction
 typedef struct CPU_Stage
 {
   int pc;           // Program Counter
-  char opcode[128]; // Operation Code
+  char opcode[16];  // Operation Code
+  int op;           // Operation Code number (OP_*)
   int rs1;          // Source-1 Register Address
   int rs2;
   int rs3;         // Source-2 Register Address
@@ -50,6 +99,22 @@ typedef struct CPU_Stage
   int busy;        // Flag to indicate, stage is performing some action
   int stalled;     // Flag to indicate, stage is stalled
   int flush;
+  int taken;       // Branch or Jump redirected the fetch
+  int ready;       // Cycle the data of a load arrives in (store queue model)
+  int z_tag;       // Zero flag producer number given by Decode (early branches)
+  int resolved;    // Branch was resolved in Decode (early branches)
+  int thread;      // Hardware context of the instruction (SMT)
+  int vd;          // Vector registers written and read, rd is -1 for
+  int vs1;         // vector instructions (-1 if none)
+  int vs2;
+  int looped;      // Fetch went back to the start of the LOOP at this pc after it
+  int predicted;   // Fetch followed the branch back from the loop buffer
+  int value_predicted; // Load forwards a predicted value until Memory2
+  int prediction;      // The value
+  int next_pc;         // Pc Fetch went on with after this CALL or RET
+  int ras_top;         // Return address stack before Fetch passed this one,
+  int ras_entry;       // its depth and the address on top
+  int seq;             // Fetch order, copies Decode leaves behind share it
 } CPU_Stage;
 
 /* Model of APEX CPU */
@@ -71,12 +136,17 @@ typedef struct APEX_CPU
   /* Code Memory where instructions are stored */
   APEX_Instruction *code_memory;
   int code_memory_size;
+  APEX_Mapping code_image; // Set when code memory is a mapped program image
+  int owns_code;           // Code memory is released with the CPU
 
   /* Data Memory */
-  int data_memory[4000];
+  int *data_memory;
+  long data_memory_size;
+  APEX_Mapping data_image; // Set when data memory is a mapped data image
 
   /* Some stats */
   int ins_completed;
+  int fetch_seq; // Instructions Fetch passed to Decode
 
   int isBranchOrJumpTaken;
 
@@ -90,18 +160,178 @@ typedef struct APEX_CPU
 
   int isSimulate;
 
+  /* Print the pipeline contents every cycle (display mode) */
+  int debug_messages;
+
+  /* Nothing at all is printed while simulating */
+  int quiet;
+
+  /* Branch resolution state, zero flag and completion status (0 while running) */
+  int bnzcounter;
+  int zcounter;
+  int zFlag;
+  int isComplete;
+
+  /*
+   * Resolve BZ and BNZ in Decode. The zero flag is renamed to its youngest
+   * producer: Decode numbers ADD, SUB, ADDL, SUBL and MUL, and Execute2
+   * forwards the flag with the number it belongs to.
+   */
+  int early_branch;
+  int z_tag;        // Youngest producer passed by Decode
+  int z_done_tag;   // Youngest producer passed by Execute2
+  int z_done_value; // Its zero flag
+
+  /* Taken BZ and BNZ, the fetch slots they flushed and Decode cycles they waited */
+  int taken_branches;
+  int branch_flush_cycles;
+  int branch_stall_cycles;
+
+  /* Print simulation statistics after the final state */
+  int show_stats;
+
+  /* Latency in cycles of MUL in Execute1 and of data memory accesses in Memory1 */
+  int mul_latency;
+  int mem_latency;
+
+  /* Stage occupied by a multi-cycle operation (-1 if none) and the cycle it completes in */
+  int hold_stage;
+  int hold_until;
+
+  /* Completion of multi-cycle operations, the loop skips idle cycles up to the next one */
+  APEX_EventQueue events;
+
+  int busy_cycles[NUM_STAGES];
+  int skipped_cycles;
+
+  /* Cycles in which Decode waited for the data of a load */
+  int load_stall_cycles;
+  int load_stall_clock; // Last counted cycle + 1
+
+  /* Idle cycles are never skipped past this cycle */
+  int skip_until;
+
+  /* Pipeline variant simulating a cycle, picked by the first step after a reset */
+  int (*step)(struct APEX_CPU *cpu);
+
+  /* Committed instruction trace being recorded, if any */
+  struct APEX_TraceWriter *trace_out;
+
+  /* Trace driving the timing model instead of evaluating results, if any */
+  struct APEX_TraceReader *trace_in;
+
+  /* Functional executor shadowing the pipeline, if a fast path is enabled */
+  struct APEX_Shadow *shadow;
+
+  /* Steady-state loop extrapolation, if enabled */
+  struct APEX_Steady *steady;
+
+  /* Basic block timing cache, if enabled */
+  struct APEX_Memo *memo;
+
+  /* Data images run in lock-step with this one, if any */
+  struct APEX_Batch *batch;
+
+  /* Store queue and non-blocking loads, if enabled */
+  struct APEX_Lsq *lsq;
+
+  /* Hardware contexts sharing the pipeline, if enabled */
+  struct APEX_Smt *smt;
+
+  /* Address reserved by LL for the next SC (-1 if none) */
+  int reservation;
+
+  /* Cores sharing the data memory, if enabled, and the number of this one */
+  struct APEX_Multicore *multicore;
+  int core;
+
+  /*
+   * Vector registers, APEX_MAX_VLEN elements each of which instructions
+   * use the first vlen. Execute1 and Memory1 handle vector_lanes elements
+   * a cycle.
+   */
+  int *vregs;
+  int vlen;
+  int vector_lanes;
+  long vector_instructions;
+  long vector_elements;
+
+  /*
+   * Hardware loop started by the last LOOP Decode passed: Fetch goes back
+   * from loop_end to loop_start while more than one iteration remains
+   */
+  int loop_start;
+  int loop_end;
+  int loop_remaining;
+
+  /*
+   * Return address stack of the Fetch stage: a CALL pushes its return
+   * address and a RET goes on at the one it pops. Once ras_depth are in
+   * use a push overwrites the oldest one.
+   */
+  int ras[APEX_RAS_MAX_DEPTH];
+  int ras_depth;
+  int ras_top; // Pushes minus pops, the top entry is ras[(ras_top - 1) % ras_depth]
+  long ras_hits;      // RET went on at its return address
+  long ras_misses;    // RET flushed in Execute2, the stack was empty or wrong
+  long ras_overflows; // CALL pushed onto a full stack
+
+  /* Loop buffer of the Fetch stage, if enabled */
+  struct APEX_LoopBuffer *loop_buffer;
+
+  /* Data cache and prefetcher trained by Memory1, if enabled */
+  struct APEX_Prefetch *prefetch;
+
+  /* Memory mapped I/O device, if enabled */
+  struct APEX_Mmio *mmio;
+
+  /* Value predictor of loads, if enabled */
+  struct APEX_Vpred *vpred;
+
+  /* Debugger logging the cycles, if attached */
+  struct APEX_Debugger *debugger;
+
+  /* State digest being written, if any */
+  struct APEX_Digest *digest;
+
+  /* Changes to the initial state reported instead of the full state, if enabled */
+  struct APEX_Report *report;
+
 } APEX_CPU;
 
 APEX_Instruction *
 create_code_memory(const char *filename, int *size);
 
+int check_instruction(const APEX_Instruction *ins);
+
 APEX_CPU *
 APEX_cpu_init(const char *filename, const int command, const int cycles);
 
+APEX_CPU *
+APEX_cpu_create(APEX_Instruction *code_memory, int code_memory_size,
+                const int command, const int cycles);
+
+void APEX_cpu_reset(APEX_CPU *cpu);
+
 int APEX_cpu_run(APEX_CPU *cpu);
 
+int APEX_cpu_simulate(APEX_CPU *cpu);
+
+int APEX_cpu_step(APEX_CPU *cpu);
+
 void APEX_cpu_stop(APEX_CPU *cpu);
 
+void APEX_cpu_print_pipeline(APEX_CPU *cpu);
+
+void APEX_cpu_observe_store(APEX_CPU *cpu, int address, const int *values,
+                            int words);
+
+int APEX_cpu_load_data_image(APEX_CPU *cpu, const char *filename);
+
+int get_code_index(int pc);
+
+int stage_sources(const CPU_Stage *stage, int *regs);
+
 int fetch(APEX_CPU *cpu);
 
 int decode(APEX_CPU *cpu);
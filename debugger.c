@@ -0,0 +1,662 @@
+/*
+ *  debugger.c
+ *  Contains the interactive debugger with reverse execution
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debugger.h"
+
+/* Makes room for one more element in a growing array, returns -1 if out of memory */
+static int
+grow(void **array, int *capacity, int count, size_t size)
+{
+  if (count < *capacity)
+  {
+    return 0;
+  }
+
+  int larger = *capacity ? *capacity * 2 : 256;
+  void *moved = realloc(*array, larger * size);
+  if (!moved)
+  {
+    return -1;
+  }
+  *array = moved;
+  *capacity = larger;
+  return 0;
+}
+
+/* Words of data memory in page p */
+static int
+page_words(const APEX_Debugger *debugger, int p)
+{
+  long left = debugger->cpu->data_memory_size - (long)p * APEX_DEBUG_PAGE_WORDS;
+  return left < APEX_DEBUG_PAGE_WORDS ? (int)left : APEX_DEBUG_PAGE_WORDS;
+}
+
+/* Drops the first `count` pages of a snapshot, freeing the ones no other holds */
+static void
+release_pages(APEX_Page **pages, int count)
+{
+  for (int p = 0; p < count; ++p)
+  {
+    if (--pages[p]->refs == 0)
+    {
+      free(pages[p]);
+    }
+  }
+  free(pages);
+}
+
+/*
+ * Saves the state of the CPU. Pages no cycle wrote since the last snapshot
+ * are shared with it, the others are copied.
+ */
+static int
+take_snapshot(APEX_Debugger *debugger)
+{
+  APEX_CPU *cpu = debugger->cpu;
+
+  if (grow((void **)&debugger->snapshots, &debugger->snapshot_capacity,
+           debugger->snapshot_count, sizeof(APEX_Snapshot)) < 0)
+  {
+    return -1;
+  }
+
+  APEX_Snapshot *snapshot = &debugger->snapshots[debugger->snapshot_count];
+  const APEX_Snapshot *last =
+      debugger->snapshot_count ? snapshot - 1 : NULL;
+
+  snapshot->pages = malloc(debugger->pages * sizeof(APEX_Page *));
+  if (!snapshot->pages)
+  {
+    return -1;
+  }
+  for (int p = 0; p < debugger->pages; ++p)
+  {
+    if (last && !debugger->dirty[p])
+    {
+      snapshot->pages[p] = last->pages[p];
+      snapshot->pages[p]->refs++;
+      continue;
+    }
+
+    snapshot->pages[p] = malloc(sizeof(APEX_Page));
+    if (!snapshot->pages[p])
+    {
+      release_pages(snapshot->pages, p);
+      return -1;
+    }
+    snapshot->pages[p]->refs = 1;
+    memcpy(snapshot->pages[p]->words,
+           &cpu->data_memory[(long)p * APEX_DEBUG_PAGE_WORDS],
+           page_words(debugger, p) * sizeof(int));
+  }
+
+  snapshot->cpu = *cpu;
+  memcpy(snapshot->vregs, cpu->vregs, sizeof(snapshot->vregs));
+  if (cpu->loop_buffer)
+  {
+    snapshot->loop_buffer = *cpu->loop_buffer;
+  }
+  if (cpu->prefetch)
+  {
+    snapshot->prefetch = *cpu->prefetch;
+  }
+
+  memset(debugger->dirty, 0, debugger->pages);
+  debugger->snapshot_count++;
+  return 0;
+}
+
+/* Puts the CPU back in the state of snapshot s */
+static void
+restore_snapshot(APEX_Debugger *debugger, int s)
+{
+  APEX_CPU *cpu = debugger->cpu;
+  const APEX_Snapshot *snapshot = &debugger->snapshots[s];
+
+  /*
+   * The saved CPU points to the same memories, loop buffer and prefetcher.
+   * Snapshot 0 was taken before the debugger was attached.
+   */
+  *cpu = snapshot->cpu;
+  cpu->debugger = debugger;
+  memcpy(cpu->vregs, snapshot->vregs, sizeof(snapshot->vregs));
+  if (cpu->loop_buffer)
+  {
+    *cpu->loop_buffer = snapshot->loop_buffer;
+  }
+  if (cpu->prefetch)
+  {
+    *cpu->prefetch = snapshot->prefetch;
+  }
+  for (int p = 0; p < debugger->pages; ++p)
+  {
+    memcpy(&cpu->data_memory[(long)p * APEX_DEBUG_PAGE_WORDS],
+           snapshot->pages[p]->words, page_words(debugger, p) * sizeof(int));
+  }
+
+  memset(debugger->dirty, 0, debugger->pages);
+  debugger->cycle = s * debugger->interval;
+}
+
+/* Snapshot 0 is the state the CPU is in, before the first cycle */
+APEX_Debugger *
+debugger_create(APEX_CPU *cpu, int interval)
+{
+  APEX_Debugger *debugger = calloc(1, sizeof(*debugger));
+  if (!debugger)
+  {
+    return NULL;
+  }
+
+  debugger->cpu = cpu;
+  debugger->interval = interval;
+  debugger->pages = (cpu->data_memory_size + APEX_DEBUG_PAGE_WORDS - 1) /
+                    APEX_DEBUG_PAGE_WORDS;
+  debugger->dirty = calloc(debugger->pages, 1);
+  if (!debugger->dirty || take_snapshot(debugger) < 0)
+  {
+    debugger_destroy(debugger);
+    return NULL;
+  }
+  return debugger;
+}
+
+void debugger_destroy(APEX_Debugger *debugger)
+{
+  if (!debugger)
+  {
+    return;
+  }
+  for (int s = 0; s < debugger->snapshot_count; ++s)
+  {
+    release_pages(debugger->snapshots[s].pages, debugger->pages);
+  }
+  free(debugger->snapshots);
+  free(debugger->dirty);
+  free(debugger->log);
+  free(debugger->deltas);
+  free(debugger);
+}
+
+/*
+ * Called before `words` words of data memory from address are written.
+ * Marks their pages dirty and, while logging, keeps their old values; the
+ * new ones are read once the cycle is over.
+ */
+void debugger_store(APEX_Debugger *debugger, int address, int words)
+{
+  for (int i = 0; i < words; ++i)
+  {
+    debugger->dirty[(address + i) / APEX_DEBUG_PAGE_WORDS] = 1;
+    if (debugger->recording &&
+        grow((void **)&debugger->deltas, &debugger->delta_capacity,
+             debugger->delta_count, sizeof(APEX_Delta)) == 0)
+    {
+      APEX_Delta *delta = &debugger->deltas[debugger->delta_count++];
+      delta->where = address + i;
+      delta->old = debugger->cpu->data_memory[address + i];
+    }
+  }
+}
+
+/*
+ * Simulates one cycle. A cycle simulated the first time is logged, and
+ * reaching the next multiple of the interval takes a snapshot. Returns -1
+ * if out of memory.
+ */
+static int
+step(APEX_Debugger *debugger)
+{
+  APEX_CPU *cpu = debugger->cpu;
+  const CPU_Stage *completing = &cpu->stage[WB];
+  int regs[16];
+  int first = debugger->delta_count;
+
+  debugger->recording = debugger->cycle == debugger->log_count;
+  if (debugger->recording)
+  {
+    if (grow((void **)&debugger->log, &debugger->log_capacity,
+             debugger->log_count, sizeof(APEX_CycleLog)) < 0)
+    {
+      return -1;
+    }
+    debugger->log[debugger->log_count].pc =
+        completing->op != OP_NONE && !completing->busy && !completing->stalled
+            ? completing->pc
+            : -1;
+    memcpy(regs, cpu->regs, sizeof(regs));
+  }
+
+  /* One cycle at a time, idle ones are not skipped */
+  cpu->skip_until = cpu->clock;
+  APEX_cpu_step(cpu);
+  debugger->cycle++;
+
+  if (debugger->recording)
+  {
+    for (int i = first; i < debugger->delta_count; ++i)
+    {
+      debugger->deltas[i].value = cpu->data_memory[debugger->deltas[i].where];
+    }
+    for (int r = 0; r < 16; ++r)
+    {
+      if (regs[r] == cpu->regs[r])
+      {
+        continue;
+      }
+      if (grow((void **)&debugger->deltas, &debugger->delta_capacity,
+               debugger->delta_count, sizeof(APEX_Delta)) < 0)
+      {
+        return -1;
+      }
+      debugger->deltas[debugger->delta_count++] =
+          (APEX_Delta){-1 - r, regs[r], cpu->regs[r]};
+    }
+    debugger->log[debugger->log_count].first = first;
+    debugger->log[debugger->log_count].count = debugger->delta_count - first;
+    debugger->log_count++;
+    debugger->recording = 0;
+  }
+
+  if (debugger->cycle % debugger->interval == 0)
+  {
+    if (debugger->cycle / debugger->interval == debugger->snapshot_count)
+    {
+      return take_snapshot(debugger);
+    }
+    memset(debugger->dirty, 0, debugger->pages);
+  }
+  return 0;
+}
+
+/* Moves the CPU to the state after `cycle` cycles, or to completion before */
+static int
+go_to(APEX_Debugger *debugger, int cycle)
+{
+  if (cycle < debugger->cycle)
+  {
+    restore_snapshot(debugger, cycle / debugger->interval);
+  }
+  while (debugger->cycle < cycle && !debugger->cpu->isComplete)
+  {
+    if (step(debugger) < 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Prints the stop points cycle c hit, returns their number */
+static int
+report_hits(const APEX_Debugger *debugger, int c)
+{
+  const APEX_CycleLog *entry = &debugger->log[c];
+  int hits = 0;
+
+  for (int n = 0; n < debugger->point_count; ++n)
+  {
+    const APEX_StopPoint *point = &debugger->points[n];
+    if (point->kind == APEX_DEBUG_PC)
+    {
+      if (entry->pc == point->where)
+      {
+        printf("Breakpoint %d : pc(%d) completed in cycle %d\n", n + 1,
+               entry->pc, c);
+        hits++;
+      }
+      continue;
+    }
+
+    int where = point->kind == APEX_DEBUG_REG ? -1 - point->where
+                                              : point->where;
+    for (int i = entry->first; i < entry->first + entry->count; ++i)
+    {
+      const APEX_Delta *delta = &debugger->deltas[i];
+      if (delta->where != where || delta->old == delta->value)
+      {
+        continue;
+      }
+      if (point->kind == APEX_DEBUG_REG)
+      {
+        printf("Watchpoint %d : R%d %d -> %d in cycle %d\n", n + 1,
+               point->where, delta->old, delta->value, c);
+      }
+      else
+      {
+        printf("Watchpoint %d : MEM[%d] %d -> %d in cycle %d\n", n + 1,
+               point->where, delta->old, delta->value, c);
+      }
+      hits++;
+      break;
+    }
+  }
+  return hits;
+}
+
+/* Runs forward until a stop point hits or the program completes */
+static int
+continue_forward(APEX_Debugger *debugger)
+{
+  while (!debugger->cpu->isComplete)
+  {
+    if (step(debugger) < 0)
+    {
+      return -1;
+    }
+    if (debugger->point_count &&
+        report_hits(debugger, debugger->cycle - 1) > 0)
+    {
+      break;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Goes back to the state after the last cycle before the current one that
+ * hit a stop point, or to the start. Only the log is searched.
+ */
+static int
+continue_backward(APEX_Debugger *debugger)
+{
+  for (int c = debugger->cycle - 2; c >= 0 && debugger->point_count; --c)
+  {
+    if (report_hits(debugger, c) > 0)
+    {
+      return go_to(debugger, c + 1);
+    }
+  }
+  printf("Reached the start of the program\n");
+  return go_to(debugger, 0);
+}
+
+static void
+print_position(const APEX_Debugger *debugger)
+{
+  const APEX_CPU *cpu = debugger->cpu;
+
+  printf("(apex-db) %d cycles simulated, %d instructions completed, "
+         "fetching pc(%d)%s\n",
+         cpu->clock, cpu->ins_completed, cpu->pc,
+         cpu->isComplete ? ", program completed" : "");
+}
+
+static void
+print_points(const APEX_Debugger *debugger)
+{
+  for (int n = 0; n < debugger->point_count; ++n)
+  {
+    const APEX_StopPoint *point = &debugger->points[n];
+    if (point->kind == APEX_DEBUG_PC)
+    {
+      printf("%d : break pc(%d)\n", n + 1, point->where);
+    }
+    else if (point->kind == APEX_DEBUG_REG)
+    {
+      printf("%d : watch R%d\n", n + 1, point->where);
+    }
+    else
+    {
+      printf("%d : watch MEM[%d]\n", n + 1, point->where);
+    }
+  }
+
+  long shared = 0;
+  for (int s = 1; s < debugger->snapshot_count; ++s)
+  {
+    for (int p = 0; p < debugger->pages; ++p)
+    {
+      shared += debugger->snapshots[s].pages[p] ==
+                debugger->snapshots[s - 1].pages[p];
+    }
+  }
+  printf("Log : %d cycles, %d changes\n", debugger->log_count,
+         debugger->delta_count);
+  printf("Snapshots : %d every %d cycles, %ld of %ld pages shared\n",
+         debugger->snapshot_count, debugger->interval, shared,
+         (long)debugger->snapshot_count * debugger->pages);
+}
+
+static void
+print_help(void)
+{
+  printf("break <pc>          stop after the instruction at pc completes\n"
+         "watch R<n>          stop after a cycle that changes register n\n"
+         "watch <address>     stop after a cycle that changes the memory word\n"
+         "delete [<n>]        remove stop point n, or all of them\n"
+         "info                list stop points, the log and the snapshots\n"
+         "step [<n>]          simulate n cycles, 1 by default\n"
+         "continue            run until a stop point hits or the program completes\n"
+         "rstep [<n>]         go back n cycles, 1 by default\n"
+         "rcontinue           go back until a stop point hits or to the start\n"
+         "goto <cycle>        go to the state after that many cycles\n"
+         "regs                print the registers\n"
+         "mem <address> [<n>] print n memory words, 1 by default\n"
+         "pipeline            print the stage latches\n"
+         "quit\n");
+}
+
+static void
+add_point(APEX_Debugger *debugger, int kind, int where)
+{
+  if (debugger->point_count == APEX_DEBUG_POINTS)
+  {
+    printf("At most %d stop points\n", APEX_DEBUG_POINTS);
+    return;
+  }
+  debugger->points[debugger->point_count].kind = kind;
+  debugger->points[debugger->point_count].where = where;
+  debugger->point_count++;
+  printf("Stop point %d set\n", debugger->point_count);
+}
+
+static void
+watch(APEX_Debugger *debugger, const char *arg)
+{
+  int where;
+
+  if ((arg[0] == 'R' || arg[0] == 'r') && sscanf(arg + 1, "%d", &where) == 1)
+  {
+    if (where < 0 || where >= 16)
+    {
+      printf("No register R%d\n", where);
+      return;
+    }
+    add_point(debugger, APEX_DEBUG_REG, where);
+  }
+  else if (sscanf(arg, "%d", &where) == 1)
+  {
+    if (where < 0 || where >= debugger->cpu->data_memory_size)
+    {
+      printf("No memory address %d\n", where);
+      return;
+    }
+    add_point(debugger, APEX_DEBUG_MEM, where);
+  }
+  else
+  {
+    printf("Usage : watch R<n> | watch <address>\n");
+  }
+}
+
+static void
+delete_points(APEX_Debugger *debugger, int argc, int n)
+{
+  if (argc < 1)
+  {
+    debugger->point_count = 0;
+    printf("Stop points deleted\n");
+    return;
+  }
+  if (n < 1 || n > debugger->point_count)
+  {
+    printf("No stop point %d\n", n);
+    return;
+  }
+  memmove(&debugger->points[n - 1], &debugger->points[n],
+          (debugger->point_count - n) * sizeof(APEX_StopPoint));
+  debugger->point_count--;
+  printf("Stop point %d deleted\n", n);
+}
+
+static void
+print_registers(const APEX_CPU *cpu)
+{
+  for (int r = 0; r < 16; ++r)
+  {
+    printf("R%-2d = %-11d%s", r, cpu->regs[r], r % 4 == 3 ? "\n" : " ");
+  }
+}
+
+static void
+print_memory(const APEX_CPU *cpu, int address, int count)
+{
+  if (address < 0 || count < 1 ||
+      (long)address + count > cpu->data_memory_size)
+  {
+    printf("Addresses out of data memory\n");
+    return;
+  }
+  for (int i = address; i < address + count; ++i)
+  {
+    printf("MEM[%d] = %d\n", i, cpu->data_memory[i]);
+  }
+}
+
+/*
+ * Reads commands until quit or the end of the input. Returns -1 if the log
+ * or a snapshot ran out of memory.
+ */
+int debugger_run(APEX_Debugger *debugger, FILE *in)
+{
+  APEX_CPU *cpu = debugger->cpu;
+  char line[256];
+
+  print_position(debugger);
+  for (;;)
+  {
+    char command[32] = "";
+    char arg[64] = "";
+    int value;
+    int count = 1;
+    int status = 0;
+
+    printf("(apex-db) ");
+    fflush(stdout);
+    if (!fgets(line, sizeof(line), in))
+    {
+      printf("\n");
+      return 0;
+    }
+
+    int argc = sscanf(line, "%31s %63s %d", command, arg, &count) - 1;
+    if (argc < 0)
+    {
+      continue;
+    }
+    int has_value = argc >= 1 && sscanf(arg, "%d", &value) == 1;
+
+    if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0)
+    {
+      return 0;
+    }
+    else if (strcmp(command, "help") == 0)
+    {
+      print_help();
+    }
+    else if (strcmp(command, "break") == 0 || strcmp(command, "b") == 0)
+    {
+      if (has_value)
+      {
+        add_point(debugger, APEX_DEBUG_PC, value);
+      }
+      else
+      {
+        printf("Usage : break <pc>\n");
+      }
+    }
+    else if (strcmp(command, "watch") == 0 || strcmp(command, "w") == 0)
+    {
+      watch(debugger, arg);
+    }
+    else if (strcmp(command, "delete") == 0 || strcmp(command, "d") == 0)
+    {
+      delete_points(debugger, has_value, value);
+    }
+    else if (strcmp(command, "info") == 0 || strcmp(command, "i") == 0)
+    {
+      print_points(debugger);
+    }
+    else if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0)
+    {
+      status = go_to(debugger, debugger->cycle + (has_value ? value : 1));
+      print_position(debugger);
+    }
+    else if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0)
+    {
+      status = continue_forward(debugger);
+      print_position(debugger);
+    }
+    else if (strcmp(command, "rstep") == 0 || strcmp(command, "rs") == 0)
+    {
+      int back = debugger->cycle - (has_value ? value : 1);
+      status = go_to(debugger, back > 0 ? back : 0);
+      print_position(debugger);
+    }
+    else if (strcmp(command, "rcontinue") == 0 || strcmp(command, "rc") == 0)
+    {
+      status = continue_backward(debugger);
+      print_position(debugger);
+    }
+    else if (strcmp(command, "goto") == 0 || strcmp(command, "g") == 0)
+    {
+      if (has_value && value >= 0)
+      {
+        status = go_to(debugger, value);
+        print_position(debugger);
+      }
+      else
+      {
+        printf("Usage : goto <cycle>\n");
+      }
+    }
+    else if (strcmp(command, "regs") == 0 || strcmp(command, "r") == 0)
+    {
+      print_registers(cpu);
+    }
+    else if (strcmp(command, "mem") == 0 || strcmp(command, "m") == 0)
+    {
+      if (has_value)
+      {
+        print_memory(cpu, value, argc >= 2 ? count : 1);
+      }
+      else
+      {
+        printf("Usage : mem <address> [<n>]\n");
+      }
+    }
+    else if (strcmp(command, "pipeline") == 0 || strcmp(command, "p") == 0)
+    {
+      APEX_cpu_print_pipeline(cpu);
+    }
+    else
+    {
+      printf("Unknown command %s, try help\n", command);
+    }
+
+    if (status < 0)
+    {
+      fprintf(stderr, "APEX_Error : Out of memory for the debugger log\n");
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#ifndef _APEX_DEBUGGER_H_
+#define _APEX_DEBUGGER_H_
+/**
+ *  debugger.h
+ *  Contains the interactive debugger, which steps the pipeline forward
+ *  and backward. Breakpoints stop after an instruction at a pc completes
+ *  Writeback. Watchpoints stop after a cycle that changes a register or a
+ *  data memory word.
+ *
+ *  Every cycle simulated the first time gets a log entry. The entry holds
+ *  the pc completed and the registers and memory words changed, with their
+ *  old and new values. Every `interval` cycles the state of the CPU is
+ *  saved as a snapshot. Data memory is saved in pages, and a page written
+ *  in no cycle since the last snapshot is shared with it. A past cycle is
+ *  reached by restoring the snapshot before it and simulating forward, at
+ *  most `interval` cycles. Reverse continue searches the log and does not
+ *  simulate the cycles it passes.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+#include "loop.h"
+#include "prefetch.h"
+
+#define APEX_DEBUG_DEFAULT_INTERVAL 1000
+#define APEX_DEBUG_PAGE_WORDS 256
+#define APEX_DEBUG_POINTS 16
+
+/* Kinds of breakpoints and watchpoints */
+enum
+{
+  APEX_DEBUG_PC,
+  APEX_DEBUG_REG,
+  APEX_DEBUG_MEM,
+};
+
+typedef struct APEX_StopPoint
+{
+  int kind;
+  int where; // pc, register or memory address
+} APEX_StopPoint;
+
+/* Change in a cycle to a memory word (where >= 0) or register R(-1 - where) */
+typedef struct APEX_Delta
+{
+  int where;
+  int old;
+  int value;
+} APEX_Delta;
+
+/* Log entry of a cycle, its changes are deltas first to first + count - 1 */
+typedef struct APEX_CycleLog
+{
+  int pc; // Instruction completed by Writeback, -1 if none
+  int first;
+  int count;
+} APEX_CycleLog;
+
+/* Page of saved data memory, shared by the snapshots it did not change in */
+typedef struct APEX_Page
+{
+  int refs;
+  int words[APEX_DEBUG_PAGE_WORDS];
+} APEX_Page;
+
+typedef struct APEX_Snapshot
+{
+  APEX_CPU cpu;
+  int vregs[APEX_VECTOR_REGS * APEX_MAX_VLEN];
+  APEX_LoopBuffer loop_buffer;
+  APEX_Prefetch prefetch;
+  APEX_Page **pages;
+} APEX_Snapshot;
+
+typedef struct APEX_Debugger
+{
+  APEX_CPU *cpu;
+  int interval;
+  int cycle; // Cycles simulated up to the state the CPU is in
+
+  /* Snapshot i holds the state after i * interval cycles */
+  APEX_Snapshot *snapshots;
+  int snapshot_count;
+  int snapshot_capacity;
+
+  /* Pages of data memory, and the ones written since the last snapshot passed */
+  int pages;
+  unsigned char *dirty;
+
+  /* Log entry i describes cycle i; cycles past log_count were never simulated */
+  APEX_CycleLog *log;
+  int log_count;
+  int log_capacity;
+  APEX_Delta *deltas;
+  int delta_count;
+  int delta_capacity;
+  int recording; // The cycle being simulated is logged
+
+  APEX_StopPoint points[APEX_DEBUG_POINTS];
+  int point_count;
+} APEX_Debugger;
+
+APEX_Debugger *debugger_create(APEX_CPU *cpu, int interval);
+
+void debugger_destroy(APEX_Debugger *debugger);
+
+void debugger_store(APEX_Debugger *debugger, int address, int words);
+
+int debugger_run(APEX_Debugger *debugger, FILE *in);
+
+#endif
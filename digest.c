@@ -0,0 +1,297 @@
+/*
+ *  digest.c
+ *  Contains the state digest of a run and the comparison of two digests
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "digest.h"
+
+/* Finalizer of splitmix64 */
+static uint64_t
+mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static uint64_t
+word_hash(int address, int value)
+{
+  return mix(((uint64_t)(unsigned int)address << 32 | (unsigned int)value) +
+             0x9e3779b97f4a7c15ULL);
+}
+
+/* Adds a value to a hash that depends on the order of its values */
+static uint64_t
+fold(uint64_t hash, int value)
+{
+  return mix(hash + 0x9e3779b97f4a7c15ULL + (unsigned int)value);
+}
+
+/*
+ * Hash of the state the CPU is in. Empty latches hash alike whatever they
+ * were left with; results are only read from Execute2 on.
+ */
+static uint64_t
+state_hash(const APEX_Digest *digest, const APEX_CPU *cpu)
+{
+  uint64_t hash = digest->memory_hash;
+
+  hash = fold(hash, cpu->pc);
+  hash = fold(hash, cpu->zFlag);
+  for (int r = 0; r < 16; ++r)
+  {
+    hash = fold(hash, cpu->regs[r]);
+    hash = fold(hash, cpu->regs_valid[r] != 0);
+  }
+
+  for (int i = F; i < NUM_STAGES; ++i)
+  {
+    const CPU_Stage *stage = &cpu->stage[i];
+    if (stage->op == OP_NONE)
+    {
+      hash = fold(hash, -1);
+      continue;
+    }
+    hash = fold(hash, stage->pc);
+    hash = fold(hash, stage->op);
+    hash = fold(hash, stage->stalled);
+    hash = fold(hash, stage->busy);
+    if (i >= EX2)
+    {
+      hash = fold(hash, stage->buffer);
+      hash = fold(hash, stage->mem_address);
+    }
+  }
+
+  if (cpu->vector_instructions > 0)
+  {
+    for (int v = 0; v < APEX_VECTOR_REGS; ++v)
+    {
+      for (int i = 0; i < cpu->vlen; ++i)
+      {
+        hash = fold(hash, cpu->vregs[v * APEX_MAX_VLEN + i]);
+      }
+    }
+  }
+  return hash;
+}
+
+/*
+ * Creates a digest file for the run the CPU is about to start. Idle cycles
+ * are no longer skipped past the cycle of a record.
+ */
+APEX_Digest *
+digest_open(const char *filename, APEX_CPU *cpu, int interval)
+{
+  APEX_Digest *digest = malloc(sizeof(*digest));
+  if (!digest)
+  {
+    return NULL;
+  }
+
+  digest->fp = fopen(filename, "wb");
+  if (!digest->fp)
+  {
+    free(digest);
+    return NULL;
+  }
+
+  digest->header.magic = APEX_DIGEST_MAGIC;
+  digest->header.version = APEX_DIGEST_VERSION;
+  digest->header.interval = interval;
+  digest->header.records = 0;
+  digest->header.final_cycle = 0;
+  digest->header.code_memory_size = cpu->code_memory_size;
+  digest->header.final_hash = 0;
+  fwrite(&digest->header, sizeof(digest->header), 1, digest->fp);
+
+  digest->chain = 0;
+  digest->memory_hash = 0;
+  for (long i = 0; i < cpu->data_memory_size; ++i)
+  {
+    digest->memory_hash += word_hash(i, cpu->data_memory[i]);
+  }
+
+  digest->next_cycle = cpu->clock + interval;
+  cpu->skip_until = digest->next_cycle - 1;
+  return digest;
+}
+
+/* Called before `words` words of data memory from address take these values */
+void digest_store(APEX_Digest *digest, const APEX_CPU *cpu, int address,
+                  const int *values, int words)
+{
+  for (int i = 0; i < words; ++i)
+  {
+    digest->memory_hash += word_hash(address + i, values[i]) -
+                           word_hash(address + i, cpu->data_memory[address + i]);
+  }
+}
+
+/* Called after every cycle, writes a record once the interval is over */
+void digest_cycle(APEX_CPU *cpu)
+{
+  APEX_Digest *digest = cpu->digest;
+
+  if (cpu->clock < digest->next_cycle)
+  {
+    return;
+  }
+
+  digest->chain = mix(digest->chain ^ state_hash(digest, cpu));
+  fwrite(&digest->chain, sizeof(digest->chain), 1, digest->fp);
+  digest->header.records++;
+  digest->next_cycle += digest->header.interval;
+  cpu->skip_until = digest->next_cycle - 1;
+}
+
+/* Hashes the final state into the header and closes the file */
+void digest_close(APEX_Digest *digest, const APEX_CPU *cpu)
+{
+  if (!digest)
+  {
+    return;
+  }
+
+  digest->header.final_cycle = cpu->clock;
+  digest->header.final_hash = mix(digest->chain ^ state_hash(digest, cpu));
+  fseek(digest->fp, 0, SEEK_SET);
+  fwrite(&digest->header, sizeof(digest->header), 1, digest->fp);
+  fclose(digest->fp);
+  free(digest);
+}
+
+static FILE *
+open_digest(const char *filename, APEX_DigestHeader *header)
+{
+  FILE *fp = fopen(filename, "rb");
+
+  if (!fp)
+  {
+    fprintf(stderr, "APEX_Error : Unable to read digest %s\n", filename);
+    return NULL;
+  }
+  if (fread(header, sizeof(*header), 1, fp) != 1 ||
+      header->magic != APEX_DIGEST_MAGIC ||
+      header->version != APEX_DIGEST_VERSION)
+  {
+    fprintf(stderr, "APEX_Error : %s is not a digest\n", filename);
+    fclose(fp);
+    return NULL;
+  }
+  return fp;
+}
+
+static int
+read_record(FILE *fp, int record, uint64_t *hash)
+{
+  long offset = sizeof(APEX_DigestHeader) + (long)record * sizeof(*hash);
+
+  if (fseek(fp, offset, SEEK_SET) != 0 || fread(hash, sizeof(*hash), 1, fp) != 1)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Finds the first record the two digests differ in by bisection, reading
+ * about 2 log2(records) records. Records chain the ones before them, so
+ * once two records differ every later one does.
+ */
+static int
+compare_records(FILE *fa, const APEX_DigestHeader *a, FILE *fb,
+                const APEX_DigestHeader *b)
+{
+  int records = a->records < b->records ? a->records : b->records;
+  int low = 0;
+  int high = records;
+  int probes = 0;
+
+  if (a->interval != b->interval ||
+      a->code_memory_size != b->code_memory_size)
+  {
+    fprintf(stderr, "APEX_Error : The digests were recorded with different "
+                    "intervals or for different programs\n");
+    return -1;
+  }
+
+  while (low < high)
+  {
+    int middle = low + (high - low) / 2;
+    uint64_t ha, hb;
+    if (read_record(fa, middle, &ha) < 0 || read_record(fb, middle, &hb) < 0)
+    {
+      fprintf(stderr, "APEX_Error : Digest is truncated\n");
+      return -1;
+    }
+    probes++;
+    if (ha != hb)
+    {
+      high = middle;
+    }
+    else
+    {
+      low = middle + 1;
+    }
+  }
+
+  int status = 1;
+  if (low < records)
+  {
+    if (a->interval == 1)
+    {
+      printf("(apex) >> States first differ after %d cycles\n", low + 1);
+    }
+    else
+    {
+      printf("(apex) >> States first differ after %d to %d cycles, rerun "
+             "with --digest-interval=1 for the cycle\n",
+             low * a->interval + 1, (low + 1) * a->interval);
+    }
+  }
+  else if (a->final_cycle != b->final_cycle || a->final_hash != b->final_hash)
+  {
+    printf("(apex) >> States match for %d cycles, the runs end differently "
+           "(%d and %d cycles)\n",
+           records * a->interval, a->final_cycle, b->final_cycle);
+  }
+  else
+  {
+    printf("(apex) >> Digests match, %d cycles\n", a->final_cycle);
+    status = 0;
+  }
+  printf("(apex) >> %d of %d records compared\n", probes, records);
+  return status;
+}
+
+/* Returns 0 if the runs match, 1 if they differ and -1 on an error */
+int digest_compare(const char *first, const char *second)
+{
+  APEX_DigestHeader a, b;
+  FILE *fa = open_digest(first, &a);
+  if (!fa)
+  {
+    return -1;
+  }
+  FILE *fb = open_digest(second, &b);
+  if (!fb)
+  {
+    fclose(fa);
+    return -1;
+  }
+
+  int status = compare_records(fa, &a, fb, &b);
+  fclose(fa);
+  fclose(fb);
+  return status;
+}
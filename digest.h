@@ -0,0 +1,67 @@
+#ifndef _APEX_DIGEST_H_
+#define _APEX_DIGEST_H_
+/**
+ *  digest.h
+ *  Contains the state digest of a run, a 64-bit hash of the CPU state
+ *  written every `interval` cycles, and the comparison of two digests.
+ *
+ *  The hash covers the pc, the registers and their status, the zero flag,
+ *  the latches holding an instruction, the vector registers once a vector
+ *  instruction ran and the data memory. Memory is hashed word by word into
+ *  a sum that every store updates with the old and new value of the words
+ *  it writes, so a record does not read the memory.
+ *
+ *  Each record chains the state hash with the record before it, so two
+ *  runs whose states differed once differ in every later record even if
+ *  the states become alike again. A difference that comes and goes between
+ *  two records is not seen.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* "APXH" in little endian, data images are "APXD" */
+#define APEX_DIGEST_MAGIC 0x48585041
+#define APEX_DIGEST_VERSION 2
+
+/*
+ * On-disk header of a digest file, rewritten once the run is over. It is
+ * followed by `records` hashes; hash i chains the states after cycles
+ * interval to (i + 1) * interval.
+ */
+typedef struct APEX_DigestHeader
+{
+  unsigned int magic;
+  unsigned int version;
+  int interval;
+  int records;
+  int final_cycle; // Cycles the run took
+  int code_memory_size;
+  uint64_t final_hash; // Chain of the records and the state at the end
+} APEX_DigestHeader;
+
+typedef struct APEX_Digest
+{
+  FILE *fp;
+  APEX_DigestHeader header;
+  int next_cycle;       // Cycle the next record is written after
+  uint64_t memory_hash; // Sum of the hashes of all data memory words
+  uint64_t chain;       // Last record written
+} APEX_Digest;
+
+APEX_Digest *digest_open(const char *filename, APEX_CPU *cpu, int interval);
+
+void digest_store(APEX_Digest *digest, const APEX_CPU *cpu, int address,
+                  const int *values, int words);
+
+void digest_cycle(APEX_CPU *cpu);
+
+void digest_close(APEX_Digest *digest, const APEX_CPU *cpu);
+
+int digest_compare(const char *first, const char *second);
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  event.c
+ *  Contains the event queue used by the simulation loop
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "event.h"
+
+static void
+swap_events(APEX_Event *a, APEX_Event *b)
+{
+  APEX_Event tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/*
+ * Adds an event, returns -1 if the queue is full
+ */
+int event_schedule(APEX_EventQueue *queue, int cycle, int kind)
+{
+  if (queue->count == APEX_MAX_EVENTS)
+  {
+    return -1;
+  }
+
+  int i = queue->count++;
+  queue->heap[i].cycle = cycle;
+  queue->heap[i].kind = kind;
+
+  while (i > 0 && queue->heap[(i - 1) / 2].cycle > queue->heap[i].cycle)
+  {
+    swap_events(&queue->heap[(i - 1) / 2], &queue->heap[i]);
+    i = (i - 1) / 2;
+  }
+  return 0;
+}
+
+/*
+ * Cycle of the earliest pending event, or -1 if there is none
+ */
+int event_next_cycle(const APEX_EventQueue *queue)
+{
+  return queue->count ? queue->heap[0].cycle : -1;
+}
+
+/*
+ * Removes all events that happen at or before the given cycle
+ */
+void event_expire(APEX_EventQueue *queue, int clock)
+{
+  while (queue->count && queue->heap[0].cycle <= clock)
+  {
+    queue->heap[0] = queue->heap[--queue->count];
+
+    int i = 0;
+    while (1)
+    {
+      int smallest = i;
+      int left = 2 * i + 1;
+      int right = 2 * i + 2;
+      if (left < queue->count &&
+          queue->heap[left].cycle < queue->heap[smallest].cycle)
+      {
+        smallest = left;
+      }
+      if (right < queue->count &&
+          queue->heap[right].cycle < queue->heap[smallest].cycle)
+      {
+        smallest = right;
+      }
+      if (smallest == i)
+      {
+        break;
+      }
+      swap_events(&queue->heap[i], &queue->heap[smallest]);
+      i = smallest;
+    }
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef _APEX_EVENT_H_
+#define _APEX_EVENT_H_
+/**
+ *  event.h
+ *  Contains the queue of future pipeline events, used to skip cycles in
+ *  which no latch can change
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+
+#define APEX_MAX_EVENTS 16
+
+/* A scheduled event */
+typedef struct APEX_Event
+{
+  int cycle; // Clock cycle the event happens in
+  int kind;  // Stage whose multi-cycle operation completes
+} APEX_Event;
+
+/* Binary min-heap of events ordered by cycle */
+typedef struct APEX_EventQueue
+{
+  APEX_Event heap[APEX_MAX_EVENTS];
+  int count;
+} APEX_EventQueue;
+
+int event_schedule(APEX_EventQueue *queue, int cycle, int kind);
+
+int event_next_cycle(const APEX_EventQueue *queue);
+
+void event_expire(APEX_EventQueue *queue, int clock);
+
+#endif
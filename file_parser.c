@@ -1,7 +1,7 @@
 /*
  *  file_parser.c
- *  Contains functions to parse input file and create
- *  code memory, you can edit this file to add new instructions
+ *  Contains the assembler that parses the input file and creates
+ *  code memory, you can edit the opcode table to add new instructions
  *
  *  Author :
  *  Gaurav Kothari (gkothar1@binghamton.edu)
@@ -10,95 +10,801 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cpu.h"
 
+/* Errors reported before the assembler gives up on a file */
+#define MAX_ERRORS 20
+
+/* Operand kinds */
+enum
+{
+  OPND_REG,
+  OPND_IMM,
+  OPND_VREG
+};
+
+static const char *const operand_kinds[] = {
+    [OPND_REG] = "register",
+    [OPND_IMM] = "literal",
+    [OPND_VREG] = "vector register",
+};
+
+/* Operand layouts of the instruction formats */
+enum
+{
+  FMT_NONE,          // HALT
+  FMT_RD_IMM,        // MOVC,Rd,#imm and CALL,Rd,target
+  FMT_RS1_RS2_IMM,   // STORE,Rs1,Rs2,#imm
+  FMT_RS1_RS2_RS3,   // STR,Rs1,Rs2,Rs3
+  FMT_RD_RS1_RS2,    // ADD,Rd,Rs1,Rs2
+  FMT_RD_RS1_IMM,    // ADDL,Rd,Rs1,#imm
+  FMT_IMM,           // BZ,#imm
+  FMT_RS1_IMM,       // JUMP,Rs1,#imm and LOOP,Rs1,end
+  FMT_RD,            // CPUID,Rd
+  FMT_VD_RS1_IMM,    // VLOAD,Vd,Rs1,#imm and VSTORE,Vs,Rs1,#imm
+  FMT_VD_VS1_VS2,    // VADD,Vd,Vs1,Vs2
+  FMT_RS1            // RET,Rs1
+};
+
 /*
- * This function is related to parsing input file
+ * Opcode table
  *
- * Note : You are not supposed to edit this function
+ * Note : add new instructions here. `relative` marks instructions whose
+ *        label operand is resolved as an offset from their own pc.
  */
+static const struct
+{
+  const char *name;
+  int op;
+  int format;
+  int relative;
+} opcodes[] = {
+    {"MOVC", OP_MOVC, FMT_RD_IMM, 0},
+    {"STORE", OP_STORE, FMT_RS1_RS2_IMM, 0},
+    {"STR", OP_STR, FMT_RS1_RS2_RS3, 0},
+    {"LOAD", OP_LOAD, FMT_RD_RS1_IMM, 0},
+    {"LDR", OP_LDR, FMT_RD_RS1_RS2, 0},
+    {"ADD", OP_ADD, FMT_RD_RS1_RS2, 0},
+    {"ADDL", OP_ADDL, FMT_RD_RS1_IMM, 0},
+    {"SUB", OP_SUB, FMT_RD_RS1_RS2, 0},
+    {"SUBL", OP_SUBL, FMT_RD_RS1_IMM, 0},
+    {"MUL", OP_MUL, FMT_RD_RS1_RS2, 0},
+    {"AND", OP_AND, FMT_RD_RS1_RS2, 0},
+    {"OR", OP_OR, FMT_RD_RS1_RS2, 0},
+    {"EX-OR", OP_EXOR, FMT_RD_RS1_RS2, 0},
+    {"BZ", OP_BZ, FMT_IMM, 1},
+    {"BNZ", OP_BNZ, FMT_IMM, 1},
+    {"JUMP", OP_JUMP, FMT_RS1_IMM, 0},
+    {"HALT", OP_HALT, FMT_NONE, 0},
+    {"LL", OP_LL, FMT_RD_RS1_IMM, 0},
+    {"SC", OP_SC, FMT_RD_RS1_RS2, 0},
+    {"CPUID", OP_CPUID, FMT_RD, 0},
+    {"VLOAD", OP_VLOAD, FMT_VD_RS1_IMM, 0},
+    {"VSTORE", OP_VSTORE, FMT_VD_RS1_IMM, 0},
+    {"VADD", OP_VADD, FMT_VD_VS1_VS2, 0},
+    {"VSUB", OP_VSUB, FMT_VD_VS1_VS2, 0},
+    {"VMUL", OP_VMUL, FMT_VD_VS1_VS2, 0},
+    {"LOOP", OP_LOOP, FMT_RS1_IMM, 1},
+    {"CALL", OP_CALL, FMT_RD_IMM, 1},
+    {"RET", OP_RET, FMT_RS1, 0},
+};
+
+#define NUM_ENTRIES ((int)(sizeof(opcodes) / sizeof(opcodes[0])))
+
+/* Mnemonics packed into integers, so lookup is one compare per entry */
+static unsigned long long opcode_keys[NUM_ENTRIES];
+
+static unsigned long long
+pack_mnemonic(const char *name, int len)
+{
+  unsigned long long key = 0;
+  memcpy(&key, name, len);
+  return key;
+}
+
+/* Fills the keys once, programs may be loaded from several threads */
+static pthread_once_t opcode_keys_once = PTHREAD_ONCE_INIT;
+
+static void
+pack_opcode_keys(void)
+{
+  for (int i = 0; i < NUM_ENTRIES; ++i)
+  {
+    opcode_keys[i] = pack_mnemonic(opcodes[i].name, strlen(opcodes[i].name));
+  }
+}
+
+static int
+find_opcode(const char *name, int len)
+{
+  pthread_once(&opcode_keys_once, pack_opcode_keys);
+
+  if (len == 0 || len > (int)sizeof(unsigned long long))
+  {
+    return -1;
+  }
+
+  unsigned long long key = pack_mnemonic(name, len);
+  for (int i = 0; i < NUM_ENTRIES; ++i)
+  {
+    if (opcode_keys[i] == key)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Operand kinds expected by each format */
+static const struct
+{
+  int count;
+  int kind[3];
+} formats[] = {
+    [FMT_NONE] = {0, {0}},
+    [FMT_RD_IMM] = {2, {OPND_REG, OPND_IMM}},
+    [FMT_RS1_RS2_IMM] = {3, {OPND_REG, OPND_REG, OPND_IMM}},
+    [FMT_RS1_RS2_RS3] = {3, {OPND_REG, OPND_REG, OPND_REG}},
+    [FMT_RD_RS1_RS2] = {3, {OPND_REG, OPND_REG, OPND_REG}},
+    [FMT_RD_RS1_IMM] = {3, {OPND_REG, OPND_REG, OPND_IMM}},
+    [FMT_IMM] = {1, {OPND_IMM}},
+    [FMT_RS1_IMM] = {2, {OPND_REG, OPND_IMM}},
+    [FMT_RD] = {1, {OPND_REG}},
+    [FMT_VD_RS1_IMM] = {3, {OPND_VREG, OPND_REG, OPND_IMM}},
+    [FMT_VD_VS1_VS2] = {3, {OPND_VREG, OPND_VREG, OPND_VREG}},
+    [FMT_RS1] = {1, {OPND_REG}},
+};
+
+/* A parsed operand, label names point into the mapped source */
+typedef struct Operand
+{
+  int kind;
+  int value;
+  const char *label;
+  int label_len;
+  const char *at;
+} Operand;
+
+/* A label definition, kept in an open addressing hash table */
+typedef struct Label
+{
+  const char *name;
+  int len;
+  int pc;
+} Label;
+
+/* An immediate that names a label, patched once the whole file is read */
+typedef struct Fixup
+{
+  int index;
+  int relative;
+  const char *name;
+  int len;
+  int line;
+  int column;
+} Fixup;
+
+typedef struct Assembler
+{
+  const char *filename;
+  const char *cur;
+  const char *end;
+  const char *line_start;
+  int line;
+  int errors;
+
+  APEX_Instruction *code;
+  int size;
+  int capacity;
+
+  Label *labels;
+  int label_count;
+  int label_capacity; // Power of two
+
+  Fixup *fixups;
+  int fixup_count;
+  int fixup_capacity;
+} Assembler;
+
+static void
+vreport(Assembler *as, int line, int column, const char *fmt, va_list args)
+{
+  if (as->errors++ >= MAX_ERRORS)
+  {
+    return;
+  }
+  fprintf(stderr, "%s:%d:%d: error: ", as->filename, line, column);
+  vfprintf(stderr, fmt, args);
+  fprintf(stderr, "\n");
+}
+
+static void
+report(Assembler *as, int line, int column, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  vreport(as, line, column, fmt, args);
+  va_end(args);
+}
+
+/* Reports an error at a position on the current line */
+static void
+error_at(Assembler *as, const char *at, const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  vreport(as, as->line, (int)(at - as->line_start) + 1, fmt, args);
+  va_end(args);
+}
+
+/* Length of the operand or opcode text starting at `at`, for messages */
+static int
+token_len(Assembler *as, const char *at)
+{
+  const char *p = at;
+  while (p < as->end && *p != ',' && *p != '\n' && *p != ';' && *p != ' ' &&
+         *p != '\t' && *p != '\r')
+  {
+    p++;
+  }
+  return p > at ? (int)(p - at) : 1;
+}
+
+/* Grows an array to hold at least `need` elements, doubling each time */
+static int
+reserve(void **array, int *capacity, int need, size_t elem_size)
+{
+  if (need <= *capacity)
+  {
+    return 0;
+  }
+
+  int new_capacity = *capacity ? *capacity : 1024;
+  while (new_capacity < need)
+  {
+    new_capacity *= 2;
+  }
+
+  void *grown = realloc(*array, new_capacity * elem_size);
+  if (!grown)
+  {
+    return -1;
+  }
+  *array = grown;
+  *capacity = new_capacity;
+  return 0;
+}
+
+static unsigned int
+hash_name(const char *name, int len)
+{
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < len; ++i)
+  {
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return h;
+}
+
+static Label *
+find_label(Assembler *as, const char *name, int len)
+{
+  if (!as->label_capacity)
+  {
+    return NULL;
+  }
+
+  unsigned int mask = as->label_capacity - 1;
+  for (unsigned int i = hash_name(name, len) & mask;; i = (i + 1) & mask)
+  {
+    Label *label = &as->labels[i];
+    if (!label->name)
+    {
+      return NULL;
+    }
+    if (label->len == len && memcmp(label->name, name, len) == 0)
+    {
+      return label;
+    }
+  }
+}
+
 static int
-get_num_from_string(char* buffer)
+insert_label(Assembler *as, const char *name, int len, int pc)
 {
-  char str[16];
-  int j = 0;
-  for (int i = 1; buffer[i] != '\0'; ++i) {
-    str[j] = buffer[i];
-    j++;
+  /* Keep the table at most half full */
+  if ((as->label_count + 1) * 2 > as->label_capacity)
+  {
+    int capacity = as->label_capacity ? as->label_capacity * 2 : 256;
+    Label *table = calloc(capacity, sizeof(Label));
+    if (!table)
+    {
+      return -1;
+    }
+
+    for (int i = 0; i < as->label_capacity; ++i)
+    {
+      Label *old = &as->labels[i];
+      if (old->name)
+      {
+        unsigned int j = hash_name(old->name, old->len) & (capacity - 1);
+        while (table[j].name)
+        {
+          j = (j + 1) & (capacity - 1);
+        }
+        table[j] = *old;
+      }
+    }
+    free(as->labels);
+    as->labels = table;
+    as->label_capacity = capacity;
+  }
+
+  unsigned int mask = as->label_capacity - 1;
+  unsigned int i = hash_name(name, len) & mask;
+  while (as->labels[i].name)
+  {
+    i = (i + 1) & mask;
+  }
+  as->labels[i].name = name;
+  as->labels[i].len = len;
+  as->labels[i].pc = pc;
+  as->label_count++;
+  return 0;
+}
+
+static int
+is_ident_start(char c)
+{
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' ||
+         c == '.';
+}
+
+static int
+is_ident_char(char c)
+{
+  return is_ident_start(c) || (c >= '0' && c <= '9') || c == '-';
+}
+
+static void
+skip_blanks(Assembler *as)
+{
+  while (as->cur < as->end &&
+         (*as->cur == ' ' || *as->cur == '\t' || *as->cur == '\r'))
+  {
+    as->cur++;
+  }
+}
+
+/* End of the statement : newline, comment or end of file */
+static int
+at_line_end(Assembler *as)
+{
+  return as->cur >= as->end || *as->cur == '\n' || *as->cur == ';';
+}
+
+static void
+skip_line(Assembler *as)
+{
+  const char *nl = memchr(as->cur, '\n', as->end - as->cur);
+  as->cur = nl ? nl : as->end;
+}
+
+static int
+scan_ident(Assembler *as)
+{
+  const char *start = as->cur;
+  while (as->cur < as->end && is_ident_char(*as->cur))
+  {
+    as->cur++;
+  }
+  return (int)(as->cur - start);
+}
+
+/* Parses an optionally signed decimal or 0x hex number */
+static int
+scan_number(Assembler *as, int *value)
+{
+  const char *at = as->cur;
+  int negative = 0;
+  long long v = 0;
+  int base = 10;
+  int digits = 0;
+
+  if (as->cur < as->end && (*as->cur == '-' || *as->cur == '+'))
+  {
+    negative = *as->cur == '-';
+    as->cur++;
+  }
+  if (as->end - as->cur > 2 && as->cur[0] == '0' &&
+      (as->cur[1] == 'x' || as->cur[1] == 'X'))
+  {
+    base = 16;
+    as->cur += 2;
+  }
+
+  while (as->cur < as->end)
+  {
+    char c = *as->cur;
+    int d;
+    if (c >= '0' && c <= '9')
+    {
+      d = c - '0';
+    }
+    else if (base == 16 && c >= 'a' && c <= 'f')
+    {
+      d = c - 'a' + 10;
+    }
+    else if (base == 16 && c >= 'A' && c <= 'F')
+    {
+      d = c - 'A' + 10;
+    }
+    else
+    {
+      break;
+    }
+    v = v * base + d;
+    if (v > 0x80000000LL)
+    {
+      error_at(as, at, "number %.*s out of range", token_len(as, at), at);
+      return -1;
+    }
+    digits++;
+    as->cur++;
+  }
+
+  if (!digits)
+  {
+    error_at(as, at, "expected a number, found '%.*s'", token_len(as, at), at);
+    return -1;
+  }
+  if (!negative && v > 0x7fffffffLL)
+  {
+    error_at(as, at, "number %.*s out of range", token_len(as, at), at);
+    return -1;
+  }
+  *value = (int)(negative ? -v : v);
+  return 0;
+}
+
+static int
+parse_operand(Assembler *as, Operand *opnd)
+{
+  const char *at = as->cur;
+  char c = *as->cur;
+
+  opnd->at = at;
+  opnd->label = NULL;
+  opnd->value = 0;
+
+  /* Register : R0 - R15 */
+  if ((c == 'R' || c == 'r') && as->end - as->cur > 1 && as->cur[1] >= '0' &&
+      as->cur[1] <= '9')
+  {
+    as->cur++;
+    opnd->kind = OPND_REG;
+    if (scan_number(as, &opnd->value) < 0)
+    {
+      return -1;
+    }
+    if (opnd->value < 0 || opnd->value > 15 ||
+        (as->cur < as->end && is_ident_char(*as->cur)))
+    {
+      error_at(as, at, "invalid register %.*s", token_len(as, at), at);
+      return -1;
+    }
+    return 0;
+  }
+
+  /* Vector register : V0 - V7 */
+  if ((c == 'V' || c == 'v') && as->end - as->cur > 1 && as->cur[1] >= '0' &&
+      as->cur[1] <= '9')
+  {
+    as->cur++;
+    opnd->kind = OPND_VREG;
+    if (scan_number(as, &opnd->value) < 0)
+    {
+      return -1;
+    }
+    if (opnd->value < 0 || opnd->value >= APEX_VECTOR_REGS ||
+        (as->cur < as->end && is_ident_char(*as->cur)))
+    {
+      error_at(as, at, "invalid vector register %.*s", token_len(as, at), at);
+      return -1;
+    }
+    return 0;
+  }
+
+  /* Literal : #number, #label, number or label */
+  opnd->kind = OPND_IMM;
+  if (c == '#')
+  {
+    as->cur++;
+  }
+  if (as->cur < as->end && is_ident_start(*as->cur))
+  {
+    opnd->label = as->cur;
+    opnd->label_len = scan_ident(as);
+    return 0;
+  }
+  return scan_number(as, &opnd->value);
+}
+
+/* Instruction fields the operands of a format go into, in order */
+static void
+operand_fields(APEX_Instruction *ins, int format, int *fields[3])
+{
+  switch (format)
+  {
+  case FMT_RD_IMM:
+    fields[0] = &ins->rd;
+    fields[1] = &ins->imm;
+    break;
+  case FMT_RS1_RS2_IMM:
+    fields[0] = &ins->rs1;
+    fields[1] = &ins->rs2;
+    fields[2] = &ins->imm;
+    break;
+  case FMT_RS1_RS2_RS3:
+    fields[0] = &ins->rs1;
+    fields[1] = &ins->rs2;
+    fields[2] = &ins->rs3;
+    break;
+  case FMT_RD_RS1_RS2:
+  case FMT_VD_VS1_VS2:
+    fields[0] = &ins->rd;
+    fields[1] = &ins->rs1;
+    fields[2] = &ins->rs2;
+    break;
+  case FMT_RD_RS1_IMM:
+  case FMT_VD_RS1_IMM:
+    fields[0] = &ins->rd;
+    fields[1] = &ins->rs1;
+    fields[2] = &ins->imm;
+    break;
+  case FMT_IMM:
+    fields[0] = &ins->imm;
+    break;
+  case FMT_RS1_IMM:
+    fields[0] = &ins->rs1;
+    fields[1] = &ins->imm;
+    break;
+  case FMT_RD:
+    fields[0] = &ins->rd;
+    break;
+  case FMT_RS1:
+    fields[0] = &ins->rs1;
+    break;
   }
-  str[j] = '\0';
-  return atoi(str);
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : you can edit this function to add new instructions
+ * Assembles the statement at the current position, which holds an
+ * optional "label:" and an optional instruction
  */
 static void
-create_APEX_instruction(APEX_Instruction* ins, char* buffer)
+parse_statement(Assembler *as)
 {
-  char* token = strtok(buffer, ",");
-  int token_num = 0;
-  char tokens[6][128];
-  while (token != NULL) {
-    strcpy(tokens[token_num], token);
-    token_num++;
-    token = strtok(NULL, ",");
+  skip_blanks(as);
+  if (at_line_end(as))
+  {
+    return;
   }
 
-  strcpy(ins->opcode, tokens[0]);
+  const char *name = as->cur;
+  if (!is_ident_start(*name))
+  {
+    error_at(as, name, "unexpected '%.*s'", token_len(as, name), name);
+    skip_line(as);
+    return;
+  }
+
+  int len = scan_ident(as);
+  skip_blanks(as);
+
+  if (as->cur < as->end && *as->cur == ':')
+  {
+    as->cur++;
+    if (find_label(as, name, len))
+    {
+      error_at(as, name, "label %.*s is already defined", len, name);
+    }
+    else if (insert_label(as, name, len, 4000 + as->size * 4) < 0)
+    {
+      error_at(as, name, "out of memory defining %.*s", len, name);
+    }
 
-  if (strcmp(ins->opcode, "MOVC") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->imm = get_num_from_string(tokens[2]);
+    skip_blanks(as);
+    if (at_line_end(as))
+    {
+      return;
+    }
+    name = as->cur;
+    len = scan_ident(as);
+    skip_blanks(as);
   }
 
-  if (strcmp(ins->opcode, "STORE") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
+  int entry = find_opcode(name, len);
+  if (entry < 0)
+  {
+    error_at(as, name, "unknown opcode '%.*s'", token_len(as, name), name);
+    skip_line(as);
+    return;
   }
 
-  if (strcmp(ins->opcode, "ADD") == 0 || strcmp(ins->opcode, "SUB") == 0 || strcmp(ins->opcode, "MUL") == 0 || strcmp(ins->opcode, "LDR") == 0 || strcmp(ins->opcode, "AND") == 0
-  || strcmp(ins->opcode, "OR") == 0 || strcmp(ins->opcode, "EX-OR") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+  /* Operands, a trailing comma such as "HALT," is accepted */
+  Operand operands[4];
+  int count = 0;
+  while (as->cur < as->end && *as->cur == ',')
+  {
+    as->cur++;
+    skip_blanks(as);
+    if (at_line_end(as))
+    {
+      break;
+    }
+    if (count == 4)
+    {
+      error_at(as, as->cur, "too many operands for %.*s", len, name);
+      skip_line(as);
+      return;
+    }
+    if (parse_operand(as, &operands[count]) < 0)
+    {
+      skip_line(as);
+      return;
+    }
+    count++;
+    skip_blanks(as);
   }
 
-  if (strcmp(ins->opcode, "ADDL") == 0 || strcmp(ins->opcode, "SUBL") == 0 || strcmp(ins->opcode, "LOAD") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
+  if (!at_line_end(as))
+  {
+    error_at(as, as->cur, "expected ',' or end of line, found '%.*s'",
+             token_len(as, as->cur), as->cur);
+    skip_line(as);
+    return;
   }
 
-  if (strcmp(ins->opcode, "STR") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
-    ins->rs3 = get_num_from_string(tokens[3]);
+  int format = opcodes[entry].format;
+  if (count != formats[format].count)
+  {
+    report(as, as->line, (int)(name - as->line_start) + 1,
+           "%s takes %d operands, %d given", opcodes[entry].name,
+           formats[format].count, count);
+    return;
+  }
+  for (int i = 0; i < count; ++i)
+  {
+    if (operands[i].kind != formats[format].kind[i])
+    {
+      error_at(as, operands[i].at, "operand %.*s of %s should be a %s",
+               token_len(as, operands[i].at), operands[i].at,
+               opcodes[entry].name,
+               operand_kinds[formats[format].kind[i]]);
+      return;
+    }
   }
 
-  if (strcmp(ins->opcode, "BZ") == 0 || strcmp(ins->opcode, "BNZ") == 0) {
-    ins->imm = get_num_from_string(tokens[1]);
+  if (reserve((void **)&as->code, &as->capacity, as->size + 1,
+              sizeof(APEX_Instruction)) < 0)
+  {
+    error_at(as, name, "out of memory at %.*s", len, name);
+    return;
   }
 
-  if(strcmp(ins->opcode, "JUMP") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->imm = get_num_from_string(tokens[2]);
+  APEX_Instruction *ins = &as->code[as->size];
+  memset(ins, 0, sizeof(*ins));
+  memcpy(ins->opcode, name, len);
+  ins->op = opcodes[entry].op;
+
+  int *fields[3] = {NULL, NULL, NULL};
+  operand_fields(ins, format, fields);
+
+  for (int i = 0; i < count; ++i)
+  {
+    *fields[i] = operands[i].value;
+    if (operands[i].label)
+    {
+      if (reserve((void **)&as->fixups, &as->fixup_capacity,
+                  as->fixup_count + 1, sizeof(Fixup)) < 0)
+      {
+        error_at(as, name, "out of memory at %.*s", len, name);
+        return;
+      }
+      Fixup *fixup = &as->fixups[as->fixup_count++];
+      fixup->index = as->size;
+      fixup->relative = opcodes[entry].relative;
+      fixup->name = operands[i].label;
+      fixup->len = operands[i].label_len;
+      fixup->line = as->line;
+      fixup->column = (int)(operands[i].at - as->line_start) + 1;
+    }
   }
 
-  if(strcmp(ins->opcode, "HALT") == 0 || strcmp(ins->opcode, "HALT\n") == 0) {
-    strcpy(ins->opcode, "HALT");
+  as->size++;
+}
+
+/*
+ * Patches label operands. Relative ones become the offset from the
+ * instruction's own pc, the rest the absolute pc of the label.
+ */
+static void
+resolve_fixups(Assembler *as)
+{
+  for (int i = 0; i < as->fixup_count; ++i)
+  {
+    Fixup *fixup = &as->fixups[i];
+    Label *label = find_label(as, fixup->name, fixup->len);
+    if (!label)
+    {
+      report(as, fixup->line, fixup->column, "undefined label %.*s",
+             fixup->len, fixup->name);
+      continue;
+    }
+
+    APEX_Instruction *ins = &as->code[fixup->index];
+    ins->imm = fixup->relative ? label->pc - (4000 + fixup->index * 4)
+                               : label->pc;
+  }
+}
+
+/*
+ * Checks an instruction that was not assembled here, e.g. one of a program
+ * image: its mnemonic is terminated and names its op, and its registers
+ * can be indexed, the ones its format reads or writes as operands of their
+ * kind. Returns 0 if it is valid, -1 if not.
+ */
+int check_instruction(const APEX_Instruction *ins)
+{
+  const char *end = memchr(ins->opcode, '\0', sizeof(ins->opcode));
+  if (!end)
+  {
+    return -1;
+  }
+  int entry = find_opcode(ins->opcode, (int)(end - ins->opcode));
+  if (entry < 0 || opcodes[entry].op != ins->op)
+  {
+    return -1;
   }
 
+  APEX_Instruction copy = *ins;
+  int format = opcodes[entry].format;
+  int *fields[3] = {NULL, NULL, NULL};
+  int *registers[4] = {&copy.rd, &copy.rs1, &copy.rs2, &copy.rs3};
+  operand_fields(&copy, format, fields);
+
+  for (int r = 0; r < 4; ++r)
+  {
+    int low = -1;
+    int limit = 16;
+    for (int i = 0; i < formats[format].count; ++i)
+    {
+      if (fields[i] == registers[r] && formats[format].kind[i] != OPND_IMM)
+      {
+        low = 0;
+        limit = formats[format].kind[i] == OPND_VREG ? APEX_VECTOR_REGS : 16;
+      }
+    }
+    if (*registers[r] < low || *registers[r] >= limit)
+    {
+      return -1;
+    }
+  }
+  return 0;
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Assembles the input file in a single pass over a read-only mapping.
+ * Errors are reported as file:line:column, and no code memory is
+ * returned if there were any.
  */
 APEX_Instruction*
 create_code_memory(const char* filename, int* size)
@@ -107,40 +813,55 @@ create_code_memory(const char* filename, int* size)
     return NULL;
   }
 
-  FILE* fp = fopen(filename, "r");
-  if (!fp) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
     return NULL;
   }
 
-  char* line = NULL;
-  size_t len = 0;
-  size_t nread;
-  int code_memory_size = 0;
-
-  while ((nread = getline(&line, &len, fp)) != -1) {
-    code_memory_size++;
-  }
-  *size = code_memory_size;
-  if (!code_memory_size) {
-    fclose(fp);
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    *size = 0;
     return NULL;
   }
 
-  APEX_Instruction* code_memory =
-    malloc(sizeof(*code_memory) * code_memory_size);
-  if (!code_memory) {
-    fclose(fp);
+  const char* source = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (source == MAP_FAILED) {
     return NULL;
   }
+  madvise((void*)source, st.st_size, MADV_SEQUENTIAL);
 
-  rewind(fp);
-  int current_instruction = 0;
-  while ((nread = getline(&line, &len, fp)) != -1) {
-    create_APEX_instruction(&code_memory[current_instruction], line);
-    current_instruction++;
+  Assembler as;
+  memset(&as, 0, sizeof(as));
+  as.filename = filename;
+  as.cur = source;
+  as.end = source + st.st_size;
+
+  while (as.cur < as.end && as.errors < MAX_ERRORS) {
+    as.line++;
+    as.line_start = as.cur;
+    parse_statement(&as);
+    skip_line(&as);
+    if (as.cur < as.end) {
+      as.cur++;
+    }
+  }
+  resolve_fixups(&as);
+
+  munmap((void*)source, st.st_size);
+  free(as.labels);
+  free(as.fixups);
+
+  if (as.errors || !as.size) {
+    if (as.errors > MAX_ERRORS) {
+      fprintf(stderr, "%s: %d more errors\n", filename, as.errors - MAX_ERRORS);
+    }
+    free(as.code);
+    *size = 0;
+    return NULL;
   }
 
-  free(line);
-  fclose(fp);
-  return code_memory;
+  *size = as.size;
+  return as.code;
 }
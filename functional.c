@@ -0,0 +1,223 @@
+/*
+ *  functional.c
+ *  Contains the functional executor
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <string.h>
+
+#include "cpu.h"
+#include "functional.h"
+
+static int
+read_memory(APEX_FuncState *state, int address)
+{
+  /* The youngest pending store to the address wins */
+  for (int i = state->pending_count - 1; i >= 0; --i)
+  {
+    if (state->pending_address[i] == address)
+    {
+      return state->pending_value[i];
+    }
+  }
+  return state->memory[address];
+}
+
+static int
+write_memory(APEX_FuncState *state, int address, int value)
+{
+  if (!state->defer_stores)
+  {
+    state->memory[address] = value;
+    return 0;
+  }
+
+  if (state->pending_count == APEX_FUNC_PENDING)
+  {
+    return -1;
+  }
+  state->pending_address[state->pending_count] = address;
+  state->pending_value[state->pending_count] = value;
+  state->pending_count++;
+  return 0;
+}
+
+/*
+ * Executes the instruction at pc and fills in its record. Returns the
+ * pc of the next instruction, or -1 if the instruction accesses memory
+ * out of range, cannot be queued, is LL, SC, CPUID, LOOP, CALL, RET or
+ * a vector instruction.
+ */
+int functional_step(APEX_FuncState *state, const APEX_Instruction *ins,
+                    int pc, APEX_FuncRecord *record)
+{
+  int *regs = state->regs;
+
+  memset(record, 0, sizeof(*record));
+  record->pc = pc;
+  record->op = ins->op;
+  record->next_pc = pc + 4;
+
+  switch (ins->op)
+  {
+  case OP_STORE:
+  case OP_STR:
+    record->operand[0] = regs[ins->rs1];
+    record->operand[1] = regs[ins->rs2];
+    if (ins->op == OP_STR)
+    {
+      record->operand[2] = regs[ins->rs3];
+      record->address = record->operand[1] + record->operand[2];
+    }
+    else
+    {
+      record->address = record->operand[1] + ins->imm;
+    }
+    if (record->address < 0 || record->address >= state->memory_size)
+    {
+      return -1;
+    }
+    record->result = record->operand[0];
+    record->old = read_memory(state, record->address);
+    if (write_memory(state, record->address, record->result) < 0)
+    {
+      return -1;
+    }
+    return record->next_pc;
+
+  case OP_LOAD:
+  case OP_LDR:
+    record->operand[0] = regs[ins->rs1];
+    if (ins->op == OP_LDR)
+    {
+      record->operand[1] = regs[ins->rs2];
+      record->address = record->operand[0] + record->operand[1];
+    }
+    else
+    {
+      record->address = record->operand[0] + ins->imm;
+    }
+    if (record->address < 0 || record->address >= state->memory_size)
+    {
+      return -1;
+    }
+    record->result = read_memory(state, record->address);
+    break;
+
+  case OP_MOVC:
+    record->result = ins->imm;
+    break;
+
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_AND:
+  case OP_OR:
+  case OP_EXOR:
+    record->operand[0] = regs[ins->rs1];
+    record->operand[1] = regs[ins->rs2];
+    switch (ins->op)
+    {
+    case OP_ADD:
+      record->result = record->operand[0] + record->operand[1];
+      break;
+    case OP_SUB:
+      record->result = record->operand[0] - record->operand[1];
+      break;
+    case OP_MUL:
+      record->result = record->operand[0] * record->operand[1];
+      break;
+    case OP_AND:
+      record->result = record->operand[0] & record->operand[1];
+      break;
+    case OP_OR:
+      record->result = record->operand[0] | record->operand[1];
+      break;
+    default:
+      record->result = record->operand[0] ^ record->operand[1];
+      break;
+    }
+    break;
+
+  case OP_ADDL:
+  case OP_SUBL:
+    record->operand[0] = regs[ins->rs1];
+    record->result = ins->op == OP_ADDL ? record->operand[0] + ins->imm
+                                        : record->operand[0] - ins->imm;
+    break;
+
+  case OP_BZ:
+    if (state->zflag)
+    {
+      record->next_pc = pc + ins->imm;
+    }
+    return record->next_pc;
+
+  case OP_BNZ:
+    if (!state->zflag)
+    {
+      record->next_pc = pc + ins->imm;
+    }
+    return record->next_pc;
+
+  case OP_JUMP:
+    record->operand[0] = regs[ins->rs1];
+    record->next_pc = record->operand[0] + ins->imm;
+    return record->next_pc;
+
+  /* Reservations and core numbers belong to the pipeline */
+  case OP_LL:
+  case OP_SC:
+  case OP_CPUID:
+    return -1;
+
+  /* So do the vector registers and hardware loops */
+  case OP_VLOAD:
+  case OP_VSTORE:
+  case OP_VADD:
+  case OP_VSUB:
+  case OP_VMUL:
+  case OP_LOOP:
+    return -1;
+
+  /* And the return address stack deciding how long CALL and RET take */
+  case OP_CALL:
+  case OP_RET:
+    return -1;
+
+  default:
+    return record->next_pc;
+  }
+
+  /* Arithmetic results set the zero flag, logical ones and loads do not */
+  if (ins->op == OP_ADD || ins->op == OP_SUB || ins->op == OP_ADDL ||
+      ins->op == OP_SUBL || ins->op == OP_MUL)
+  {
+    state->zflag = record->result == 0;
+  }
+
+  record->old = regs[ins->rd];
+  regs[ins->rd] = record->result;
+  return record->next_pc;
+}
+
+/*
+ * Retires the oldest pending store once its memory write was performed.
+ * Returns -1 if that write is not the one the executor predicted.
+ */
+int functional_retire_store(APEX_FuncState *state, int address, int value)
+{
+  if (state->pending_count == 0 || state->pending_address[0] != address ||
+      state->pending_value[0] != value)
+  {
+    return -1;
+  }
+
+  state->pending_count--;
+  memmove(state->pending_address, state->pending_address + 1,
+          state->pending_count * sizeof(int));
+  memmove(state->pending_value, state->pending_value + 1,
+          state->pending_count * sizeof(int));
+  return 0;
+}
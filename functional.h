@@ -0,0 +1,54 @@
+#ifndef _APEX_FUNCTIONAL_H_
+#define _APEX_FUNCTIONAL_H_
+/**
+ *  functional.h
+ *  Contains the functional (instruction set level) executor. It runs
+ *  instructions one at a time in program order, without any timing.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+
+struct APEX_Instruction;
+
+/* Stores that can be executed ahead of the data memory they go to */
+#define APEX_FUNC_PENDING 8
+
+/* Effect of one executed instruction */
+typedef struct APEX_FuncRecord
+{
+  int pc;
+  int op;
+  int result;     // Value written to rd, or stored value
+  int operand[3]; // Source register values
+  int address;    // Data memory address of loads and stores
+  int old;        // Previous value of rd, or of the stored memory word
+  int next_pc;    // Program order successor
+} APEX_FuncRecord;
+
+/* Architectural state seen by the functional executor */
+typedef struct APEX_FuncState
+{
+  int regs[16];
+  int zflag;
+
+  int *memory;
+  long memory_size;
+
+  /*
+   * With defer_stores set, stores are queued here instead of written to
+   * memory, and loads look here first. The owner performs the memory
+   * writes and retires them in order.
+   */
+  int defer_stores;
+  int pending_address[APEX_FUNC_PENDING];
+  int pending_value[APEX_FUNC_PENDING];
+  int pending_count;
+} APEX_FuncState;
+
+int functional_step(APEX_FuncState *state, const struct APEX_Instruction *ins,
+                    int pc, APEX_FuncRecord *record);
+
+int functional_retire_store(APEX_FuncState *state, int address, int value);
+
+#endif
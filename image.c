@@ -0,0 +1,207 @@
+/*
+ *  image.c
+ *  Contains functions to map binary program and data memory images and
+ *  to write them out
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cpu.h"
+#include "image.h"
+
+/*
+ * Maps the whole file copy-on-write, so the simulator can modify the
+ * contents without touching the file
+ */
+static void *
+map_file(const char *filename, size_t *length)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    return NULL;
+  }
+
+  *length = st.st_size;
+  return base;
+}
+
+/*
+ * Checks the magic number, so text assembly and program images can be
+ * given in the same place on the command line
+ */
+int is_program_image(const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+  {
+    return 0;
+  }
+
+  unsigned int magic = 0;
+  size_t nread = fread(&magic, sizeof(magic), 1, fp);
+  fclose(fp);
+  return nread == 1 && magic == APEX_PROGRAM_MAGIC;
+}
+
+APEX_Instruction *
+load_program_image(const char *filename, int *size, APEX_Mapping *mapping)
+{
+  size_t length;
+  char *base = map_file(filename, &length);
+  if (!base)
+  {
+    return NULL;
+  }
+
+  APEX_ProgramHeader *header = (APEX_ProgramHeader *)base;
+  if (length < sizeof(*header) || header->magic != APEX_PROGRAM_MAGIC ||
+      header->version != APEX_IMAGE_VERSION ||
+      header->record_size != sizeof(APEX_Instruction) ||
+      length < sizeof(*header) + (size_t)header->count * sizeof(APEX_Instruction) ||
+      header->count == 0 || header->count > (INT_MAX - 4000) / 4)
+  {
+    fprintf(stderr, "APEX_Error : %s is not a valid program image\n",
+            filename);
+    munmap(base, length);
+    return NULL;
+  }
+
+  APEX_Instruction *code = (APEX_Instruction *)(base + sizeof(*header));
+  for (unsigned int i = 0; i < header->count; ++i)
+  {
+    if (check_instruction(&code[i]) < 0)
+    {
+      fprintf(stderr,
+              "APEX_Error : %s is not a valid program image, record %u\n",
+              filename, i);
+      munmap(base, length);
+      return NULL;
+    }
+  }
+
+  mapping->base = base;
+  mapping->length = length;
+  *size = header->count;
+  return code;
+}
+
+int write_program_image(const char *filename, const APEX_Instruction *code,
+                        int size)
+{
+  FILE *fp = fopen(filename, "wb");
+  if (!fp)
+  {
+    return -1;
+  }
+
+  APEX_ProgramHeader header;
+  header.magic = APEX_PROGRAM_MAGIC;
+  header.version = APEX_IMAGE_VERSION;
+  header.record_size = sizeof(APEX_Instruction);
+  header.count = size;
+
+  int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+           fwrite(code, sizeof(*code), size, fp) == (size_t)size;
+  return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+/*
+ * Returns data memory holding the image contents. Images of at least
+ * min_words words are used in place, smaller ones are copied into a
+ * zeroed min_words buffer (mapping->base is NULL then).
+ */
+int *
+load_data_image(const char *filename, int min_words, long *words,
+                APEX_Mapping *mapping)
+{
+  size_t length;
+  char *base = map_file(filename, &length);
+  if (!base)
+  {
+    return NULL;
+  }
+
+  APEX_DataHeader *header = (APEX_DataHeader *)base;
+  if (length < sizeof(*header) || header->magic != APEX_DATA_MAGIC ||
+      header->version != APEX_IMAGE_VERSION ||
+      (length - sizeof(*header)) / sizeof(int) < header->words)
+  {
+    fprintf(stderr, "APEX_Error : %s is not a valid data image\n", filename);
+    munmap(base, length);
+    return NULL;
+  }
+
+  int *contents = (int *)(base + sizeof(*header));
+  if (header->words >= (unsigned long long)min_words)
+  {
+    madvise(base, length, MADV_WILLNEED);
+    mapping->base = base;
+    mapping->length = length;
+    *words = header->words;
+    return contents;
+  }
+
+  int *memory = calloc(min_words, sizeof(int));
+  if (memory)
+  {
+    memcpy(memory, contents, header->words * sizeof(int));
+  }
+  munmap(base, length);
+  mapping->base = NULL;
+  mapping->length = 0;
+  *words = min_words;
+  return memory;
+}
+
+int write_data_image(const char *filename, const int *memory, long words)
+{
+  FILE *fp = fopen(filename, "wb");
+  if (!fp)
+  {
+    return -1;
+  }
+
+  APEX_DataHeader header;
+  header.magic = APEX_DATA_MAGIC;
+  header.version = APEX_IMAGE_VERSION;
+  header.words = words;
+
+  int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+           fwrite(memory, sizeof(int), words, fp) == (size_t)words;
+  return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+void release_mapping(APEX_Mapping *mapping)
+{
+  if (mapping->base)
+  {
+    munmap(mapping->base, mapping->length);
+    mapping->base = NULL;
+    mapping->length = 0;
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef _APEX_IMAGE_H_
+#define _APEX_IMAGE_H_
+/**
+ *  image.h
+ *  Contains the binary program and data memory image formats. Both are
+ *  mapped into memory and used in place, without a parse step.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+
+struct APEX_Instruction;
+
+/* "APXB" and "APXD" in little endian */
+#define APEX_PROGRAM_MAGIC 0x42585041
+#define APEX_DATA_MAGIC 0x44585041
+#define APEX_IMAGE_VERSION 1
+
+/*
+ * Program image : header followed by `count` APEX_Instruction records
+ * exactly as they are laid out in code memory
+ */
+typedef struct APEX_ProgramHeader
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int record_size; // sizeof(APEX_Instruction) of the writer
+  unsigned int count;       // Number of instructions
+} APEX_ProgramHeader;
+
+/*
+ * Data image : header followed by `words` data memory words, word i is
+ * loaded at data memory address i
+ */
+typedef struct APEX_DataHeader
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long words;
+} APEX_DataHeader;
+
+/* A file mapping backing code or data memory */
+typedef struct APEX_Mapping
+{
+  void *base;
+  size_t length;
+} APEX_Mapping;
+
+int is_program_image(const char *filename);
+
+struct APEX_Instruction *
+load_program_image(const char *filename, int *size, APEX_Mapping *mapping);
+
+int write_program_image(const char *filename,
+                        const struct APEX_Instruction *code, int size);
+
+int *
+load_data_image(const char *filename, int min_words, long *words,
+                APEX_Mapping *mapping);
+
+int write_data_image(const char *filename, const int *memory, long words);
+
+void release_mapping(APEX_Mapping *mapping);
+
+#endif
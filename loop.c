@@ -0,0 +1,85 @@
+/*
+ *  loop.c
+ *  Contains the loop buffer of the Fetch stage
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "loop.h"
+
+APEX_LoopBuffer *
+loop_buffer_create(int entries)
+{
+  APEX_LoopBuffer *buffer = calloc(1, sizeof(*buffer));
+  if (buffer)
+  {
+    buffer->entries = entries;
+    buffer->branch = -1;
+  }
+  return buffer;
+}
+
+void loop_buffer_destroy(APEX_LoopBuffer *buffer)
+{
+  free(buffer);
+}
+
+/* Pc Fetch continues at after the instruction at pc, -1 to go on in order */
+int loop_buffer_predict(const APEX_LoopBuffer *buffer, int pc)
+{
+  return pc == buffer->branch ? buffer->target : -1;
+}
+
+/* A taken backward branch replaces the captured loop if its body fits */
+void loop_buffer_capture(APEX_LoopBuffer *buffer, int branch, int target)
+{
+  if (target > branch || (branch - target) / 4 + 1 > buffer->entries ||
+      branch == buffer->branch)
+  {
+    return;
+  }
+  buffer->branch = branch;
+  buffer->target = target;
+  buffer->captures++;
+}
+
+/* One more iteration of the loop at pc went back without a flush */
+void loop_buffer_report(APEX_LoopBuffer *buffer, int pc, int saved_cycles)
+{
+  APEX_LoopReport *report = NULL;
+
+  for (int i = 0; i < buffer->report_count; ++i)
+  {
+    if (buffer->reports[i].pc == pc)
+    {
+      report = &buffer->reports[i];
+      break;
+    }
+  }
+  if (!report && buffer->report_count < APEX_LOOP_REPORTS)
+  {
+    report = &buffer->reports[buffer->report_count++];
+    report->pc = pc;
+  }
+  else if (!report)
+  {
+    report = &buffer->reports[APEX_LOOP_REPORTS - 1];
+  }
+  report->iterations++;
+  report->saved_cycles += saved_cycles;
+}
+
+void loop_buffer_print_stats(const APEX_LoopBuffer *buffer)
+{
+  printf("|    Loop buffer captures    |    %ld\n", buffer->captures);
+  printf("|    Loop buffer exits\t     |    %ld\n", buffer->exits);
+  for (int i = 0; i < buffer->report_count; ++i)
+  {
+    const APEX_LoopReport *report = &buffer->reports[i];
+    printf("|    Loop at pc(%d)\t     |    %ld iterations, %ld cycles saved\n",
+           report->pc, report->iterations, report->saved_cycles);
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef _APEX_LOOP_H_
+#define _APEX_LOOP_H_
+/**
+ *  loop.h
+ *  Contains the loop buffer of the Fetch stage. A backward BZ or BNZ taken
+ *  in Execute2 whose loop body fits the buffer is captured; from then on
+ *  Fetch replays the body from the buffer and follows the branch back to
+ *  its target, so the taken branch flushes nothing. The exit from the
+ *  loop flushes like a taken branch did before.
+ *
+ *  LOOP,Rs,end hides the branch entirely: Fetch goes back from the end of
+ *  the body by itself, Rs times. The loop buffer reports both kinds of
+ *  loops.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+#define APEX_LOOP_BUFFER_DEFAULT_ENTRIES 16
+
+/* Loops reported, more are counted together with the last one */
+#define APEX_LOOP_REPORTS 8
+
+typedef struct APEX_LoopReport
+{
+  int pc; // Backward branch or LOOP instruction
+  long iterations;
+  long saved_cycles;
+} APEX_LoopReport;
+
+typedef struct APEX_LoopBuffer
+{
+  int entries; // Instructions a captured body may have
+
+  /* Captured loop, branch is -1 while the buffer is empty */
+  int branch;
+  int target;
+
+  /* Statistics */
+  long captures;
+  long exits; // Replayed branches found not taken in the end
+  APEX_LoopReport reports[APEX_LOOP_REPORTS];
+  int report_count;
+} APEX_LoopBuffer;
+
+APEX_LoopBuffer *loop_buffer_create(int entries);
+
+void loop_buffer_destroy(APEX_LoopBuffer *buffer);
+
+int loop_buffer_predict(const APEX_LoopBuffer *buffer, int pc);
+
+void loop_buffer_capture(APEX_LoopBuffer *buffer, int branch, int target);
+
+void loop_buffer_report(APEX_LoopBuffer *buffer, int pc, int saved_cycles);
+
+void loop_buffer_print_stats(const APEX_LoopBuffer *buffer);
+
+#endif
@@ -0,0 +1,313 @@
+/*
+ *  lsq.c
+ *  Contains the store queue and non-blocking loads
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsq.h"
+
+APEX_Lsq *
+lsq_create(void)
+{
+  APEX_Lsq *lsq = malloc(sizeof(*lsq));
+  if (lsq)
+  {
+    lsq_reset(lsq);
+  }
+  return lsq;
+}
+
+/* Empty queue, free port and no outstanding loads */
+void lsq_reset(APEX_Lsq *lsq)
+{
+  memset(lsq, 0, sizeof(*lsq));
+  for (int i = 0; i < 16; ++i)
+  {
+    lsq->pending_ready[i] = -1;
+  }
+}
+
+void lsq_destroy(APEX_Lsq *lsq)
+{
+  free(lsq);
+}
+
+int lsq_full(const APEX_Lsq *lsq)
+{
+  return lsq->count == APEX_LSQ_ENTRIES;
+}
+
+/* Nothing happens in the background, so idle cycles can be skipped */
+int lsq_idle(const APEX_Lsq *lsq)
+{
+  if (lsq->count > 0)
+  {
+    return 0;
+  }
+  for (int i = 0; i < 16; ++i)
+  {
+    if (lsq->pending_ready[i] >= 0)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Cycles a store in Memory2 waits for a free entry. The head drains at
+ * the end of the first cycle the port is free in; the stages before
+ * Memory2 are frozen meanwhile, so no load takes the port first.
+ */
+int lsq_store_wait(const APEX_CPU *cpu)
+{
+  int drain = cpu->lsq->port_free > cpu->clock ? cpu->lsq->port_free
+                                               : cpu->clock;
+  return drain + 2 - cpu->clock;
+}
+
+static void
+drain_head(APEX_CPU *cpu)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+
+  APEX_cpu_observe_store(cpu, lsq->address[lsq->head],
+                         &lsq->value[lsq->head], 1);
+  cpu->data_memory[lsq->address[lsq->head]] = lsq->value[lsq->head];
+  lsq->head = (lsq->head + 1) % APEX_LSQ_ENTRIES;
+  lsq->count--;
+  lsq->drained_stores++;
+}
+
+void lsq_store(APEX_CPU *cpu, int address, int value)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+
+  if (lsq_full(lsq))
+  {
+    drain_head(cpu);
+  }
+
+  int tail = (lsq->head + lsq->count) % APEX_LSQ_ENTRIES;
+  lsq->address[tail] = address;
+  lsq->value[tail] = value;
+  lsq->count++;
+}
+
+/*
+ * Value of a load in Memory1 and the cycle it arrives in. Every older
+ * store has left Memory2, so the queue holds all of them that are not in
+ * memory yet.
+ */
+int lsq_load(APEX_CPU *cpu, int address, int *value)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+
+  for (int i = lsq->count - 1; i >= 0; --i)
+  {
+    int entry = (lsq->head + i) % APEX_LSQ_ENTRIES;
+    if (lsq->address[entry] == address)
+    {
+      *value = lsq->value[entry];
+      lsq->forwarded_loads++;
+      return cpu->clock;
+    }
+  }
+
+  int start = lsq->port_free > cpu->clock ? lsq->port_free : cpu->clock;
+  *value = cpu->data_memory[address];
+  lsq->port_free = start + cpu->mem_latency;
+  return start + cpu->mem_latency - 1;
+}
+
+/*
+ * Cycles a vector access in Memory1 takes. The queue drains ahead of it,
+ * then it holds the port for `latency` cycles. The stores are written
+ * now, nothing younger reaches memory before the access does.
+ */
+int lsq_vector_access(APEX_CPU *cpu, int latency)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+  int start = lsq->port_free > cpu->clock ? lsq->port_free : cpu->clock;
+
+  start += lsq->count * cpu->mem_latency;
+  while (lsq->count > 0)
+  {
+    drain_head(cpu);
+  }
+  lsq->port_free = start + latency;
+  return start + latency - cpu->clock;
+}
+
+static int
+is_load(const CPU_Stage *stage)
+{
+  return stage->op == OP_LOAD || stage->op == OP_LDR;
+}
+
+static int
+writes_register(const CPU_Stage *stage)
+{
+  switch (stage->op)
+  {
+  case OP_MOVC:
+  case OP_ADD:
+  case OP_ADDL:
+  case OP_SUB:
+  case OP_SUBL:
+  case OP_MUL:
+  case OP_AND:
+  case OP_OR:
+  case OP_EXOR:
+  case OP_LOAD:
+  case OP_LDR:
+  case OP_LL:
+  case OP_SC:
+  case OP_CPUID:
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Called for the instruction in Writeback. Returns 1 for a load whose
+ * data has not arrived, it is written later. Any other result supersedes
+ * an older load still outstanding to the same register.
+ */
+int lsq_writeback(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+
+  if (!writes_register(stage) || stage->rd < 0 || stage->rd >= 16)
+  {
+    return 0;
+  }
+  if (is_load(stage) && stage->ready >= cpu->clock)
+  {
+    lsq->pending_ready[stage->rd] = stage->ready;
+    lsq->pending_value[stage->rd] = stage->buffer;
+    lsq->deferred_loads++;
+    return 1;
+  }
+  lsq->pending_ready[stage->rd] = -1;
+  return 0;
+}
+
+/*
+ * An instruction in Decode waits while a register it reads is the
+ * destination of a load whose data has not arrived. The Memory1 latch
+ * holds the load Execute2 passed on, it has not accessed memory yet; a load
+ * Execute1 just passed on stalls its users like any other result there.
+ */
+int lsq_blocks(const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+  int waiting[16] = {0};
+  int regs[3];
+
+  for (int i = MEM1; i <= WB; ++i)
+  {
+    const CPU_Stage *load = &cpu->stage[i];
+    if (is_load(load) && load->rd >= 0 && load->rd < 16 &&
+        (i == MEM1 || load->ready >= cpu->clock))
+    {
+      waiting[load->rd] = 1;
+    }
+  }
+
+  int n = stage_sources(stage, regs);
+  for (int i = 0; i < n; ++i)
+  {
+    if (regs[i] >= 0 && regs[i] < 16 &&
+        (waiting[regs[i]] || cpu->lsq->pending_ready[regs[i]] >= 0))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Writes the data of loads arriving before this cycle. The register stays
+ * invalid while a younger instruction writing it is in the pipeline, its
+ * Writeback validates it.
+ */
+void lsq_begin_cycle(APEX_CPU *cpu)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+
+  for (int r = 0; r < 16; ++r)
+  {
+    if (lsq->pending_ready[r] >= 0 && lsq->pending_ready[r] < cpu->clock)
+    {
+      int younger = 0;
+      for (int i = EX1; i <= WB; ++i)
+      {
+        younger |= writes_register(&cpu->stage[i]) && cpu->stage[i].rd == r;
+      }
+      cpu->regs[r] = lsq->pending_value[r];
+      if (!younger)
+      {
+        cpu->regs_valid[r] = 16843009;
+      }
+      lsq->pending_ready[r] = -1;
+    }
+  }
+}
+
+/* The port drains the oldest store in a cycle no load used it in */
+void lsq_end_cycle(APEX_CPU *cpu)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+
+  if (lsq->count > 0 && lsq->port_free <= cpu->clock)
+  {
+    drain_head(cpu);
+    lsq->port_free = cpu->clock + cpu->mem_latency;
+  }
+}
+
+/*
+ * Once the program completed, outstanding loads and queued stores finish
+ * and their cycles are added. A run stopped by the cycle limit is left as
+ * it is, like the instructions still in the pipeline.
+ */
+void lsq_finish(APEX_CPU *cpu)
+{
+  APEX_Lsq *lsq = cpu->lsq;
+  int end = cpu->clock;
+
+  if (cpu->cycles > 0 && cpu->clock >= cpu->cycles)
+  {
+    return;
+  }
+
+  for (int r = 0; r < 16; ++r)
+  {
+    if (lsq->pending_ready[r] >= end)
+    {
+      end = lsq->pending_ready[r] + 1;
+    }
+  }
+
+  if (lsq->count > 0)
+  {
+    int start = lsq->port_free > cpu->clock ? lsq->port_free : cpu->clock;
+    int last = start + (lsq->count - 1) * cpu->mem_latency + cpu->mem_latency;
+    if (last > end)
+    {
+      end = last;
+    }
+    while (lsq->count > 0)
+    {
+      drain_head(cpu);
+    }
+  }
+
+  lsq->drain_cycles = end - cpu->clock;
+  cpu->clock = end;
+  lsq_begin_cycle(cpu);
+}
@@ -0,0 +1,70 @@
+#ifndef _APEX_LSQ_H_
+#define _APEX_LSQ_H_
+/**
+ *  lsq.h
+ *  Contains the store queue and non-blocking loads. Stores leave Memory2
+ *  into a queue that drains to data memory through the memory port in
+ *  the background. Loads search the queue for the youngest older store
+ *  to their address and take its value, otherwise they read memory
+ *  through the port without holding Memory1. A load whose data has not
+ *  arrived when it leaves Writeback completes later; only instructions
+ *  using its destination register wait for it.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+#define APEX_LSQ_ENTRIES 8
+
+typedef struct APEX_Lsq
+{
+  /* Stores waiting for the memory port, oldest first */
+  int address[APEX_LSQ_ENTRIES];
+  int value[APEX_LSQ_ENTRIES];
+  int head;
+  int count;
+
+  /* First cycle the data memory port is free */
+  int port_free;
+
+  /* Loads past Writeback, the cycle their data arrives in (-1 if none) */
+  int pending_ready[16];
+  int pending_value[16];
+
+  /* Statistics */
+  long forwarded_loads;
+  long deferred_loads;
+  long drained_stores;
+  int drain_cycles; // Cycles added after the last instruction to drain
+} APEX_Lsq;
+
+APEX_Lsq *lsq_create(void);
+
+void lsq_reset(APEX_Lsq *lsq);
+
+void lsq_destroy(APEX_Lsq *lsq);
+
+int lsq_full(const APEX_Lsq *lsq);
+
+int lsq_idle(const APEX_Lsq *lsq);
+
+int lsq_store_wait(const APEX_CPU *cpu);
+
+void lsq_store(APEX_CPU *cpu, int address, int value);
+
+int lsq_load(APEX_CPU *cpu, int address, int *value);
+
+int lsq_vector_access(APEX_CPU *cpu, int latency);
+
+int lsq_writeback(APEX_CPU *cpu, const CPU_Stage *stage);
+
+int lsq_blocks(const APEX_CPU *cpu, const CPU_Stage *stage);
+
+void lsq_begin_cycle(APEX_CPU *cpu);
+
+void lsq_end_cycle(APEX_CPU *cpu);
+
+void lsq_finish(APEX_CPU *cpu);
+
+#endif
@@ -8,8 +8,141 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "analyze.h"
+#include "batch.h"
 #include "cpu.h"
+#include "debugger.h"
+#include "digest.h"
+#include "image.h"
+#include "loop.h"
+#include "lsq.h"
+#include "memo.h"
+#include "mmio.h"
+#include "multicore.h"
+#include "prefetch.h"
+#include "report.h"
+#include "smt.h"
+#include "server.h"
+#include "shadow.h"
+#include "steady.h"
+#include "trace.h"
+#include "vpred.h"
+
+/* Returns the value of a "--name=value" option, or NULL if arg is not it */
+static const char*
+option_value(const char* arg, const char* name)
+{
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+    return arg + len + 1;
+  }
+  return NULL;
+}
+
+/* Runs of the program timed by --bench without a count */
+#define APEX_BENCH_DEFAULT_RUNS 5
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int
+compare_seconds(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Simulates the program runs times from the same initial state and prints
+ * the simulated cycles per second of the fastest and the median run
+ */
+static int
+bench(APEX_CPU* cpu, int runs)
+{
+  size_t bytes = cpu->data_memory_size * sizeof(int);
+  int* initial = malloc(bytes);
+  double* seconds = malloc(runs * sizeof(double));
+  if (!initial || !seconds) {
+    free(initial);
+    free(seconds);
+    return -1;
+  }
+  memcpy(initial, cpu->data_memory, bytes);
+
+  for (int i = 0; i < runs; ++i) {
+    if (i > 0) {
+      APEX_cpu_reset(cpu);
+      memcpy(cpu->data_memory, initial, bytes);
+    }
+    double start = now();
+    APEX_cpu_simulate(cpu);
+    seconds[i] = now() - start;
+  }
+
+  qsort(seconds, runs, sizeof(double), compare_seconds);
+  double best = seconds[0];
+  double median = runs % 2 ? seconds[runs / 2]
+                           : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+
+  printf("(apex) >> Benchmark : %d runs of %d cycles, %d instructions\n",
+         runs, cpu->clock, cpu->ins_completed);
+  printf("(apex) >> Simulated cycles per second : best %.0f, median %.0f\n",
+         best > 0 ? cpu->clock / best : 0.0,
+         median > 0 ? cpu->clock / median : 0.0);
+  printf("(apex) >> Host seconds per run : best %.6f, median %.6f\n", best,
+         median);
+
+  free(initial);
+  free(seconds);
+  return 0;
+}
+
+/* Returns 1 if the program has an instruction with the opcode */
+static int
+uses_opcode(const APEX_CPU* cpu, int op)
+{
+  for (int i = 0; i < cpu->code_memory_size; ++i) {
+    if (cpu->code_memory[i].op == op) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* ./apex_sim --serve=<socket> [--workers=<n>] [--cache=<programs>] */
+static int
+serve(int argc, char const* argv[])
+{
+  const char* socket_path = option_value(argv[1], "--serve");
+  int workers = APEX_SERVER_DEFAULT_WORKERS;
+  int cache_entries = APEX_SERVER_DEFAULT_CACHE;
+
+  for (int i = 2; i < argc; ++i) {
+    const char* value;
+    if ((value = option_value(argv[i], "--workers"))) {
+      workers = atoi(value);
+    } else if ((value = option_value(argv[i], "--cache"))) {
+      cache_entries = atoi(value);
+    } else {
+      fprintf(stderr, "APEX_Error : Unknown server option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (workers < 1 || cache_entries < 1) {
+    fprintf(stderr, "APEX_Error : --workers and --cache must be positive\n");
+    return 1;
+  }
+  return server_run(socket_path, workers, cache_entries) < 0 ? 1 : 0;
+}
 
 int
 main(int argc, char const* argv[])
@@ -17,14 +150,229 @@ main(int argc, char const* argv[])
 
   int isSimulate = 0;
   int cycles = 0;
+  int show_stats = 0;
+  const char* trace_record = NULL;
+  const char* trace_replay = NULL;
+  const char* data_image = NULL;
+  const char* emit_image = NULL;
+  int mul_latency = 1;
+  int mem_latency = 1;
+  int extrapolate = 0;
+  int memo_entries = 0;
+  int memo_verify = 0;
+  const char* batch_list = NULL;
+  const char* batch_out = NULL;
+  int lsq = 0;
+  int early_branch = 0;
+  int smt_threads = 0;
+  int smt_policy = APEX_SMT_ROUND_ROBIN;
+  int cores = 0;
+  int host_threads = 1;
+  int quantum = APEX_DEFAULT_QUANTUM;
+  int miss_latency = APEX_DEFAULT_MISS_LATENCY;
+  int vlen = APEX_DEFAULT_VLEN;
+  int vector_lanes = APEX_DEFAULT_VECTOR_LANES;
+  int loop_entries = 0;
+  int prefetcher = -1;
+  int prefetch_degree = 1;
+  int prefetch_distance = 1;
+  int debug = 0;
+  int snapshot_interval = APEX_DEBUG_DEFAULT_INTERVAL;
+  const char* digest_file = NULL;
+  int digest_interval = 1;
+  int report_diff = 0;
+  const char* dump_file = NULL;
+  int bench_runs = 0;
+  const char* mmio_in = NULL;
+  const char* mmio_out = NULL;
+  int mmio_latency = APEX_MMIO_DEFAULT_LATENCY;
+  int analyze = 0;
+  int analysis_interval = APEX_ANALYSIS_DEFAULT_INTERVAL;
+  const char* analysis_out = NULL;
+  int value_predictor = -1;
+  int ras_depth = APEX_RAS_DEFAULT_DEPTH;
+
+  if (argc >= 2 && option_value(argv[1], "--serve")) {
+    return serve(argc, argv);
+  }
+
+  /* ./apex_sim --digest-compare=<digest> <digest> */
+  if (argc == 3 && option_value(argv[1], "--digest-compare")) {
+    int status = digest_compare(option_value(argv[1], "--digest-compare"),
+                                argv[2]);
+    return status < 0 ? 2 : status;
+  }
 
-  if (argc != 4) {
-    fprintf(stderr, "APEX_Help : Usage %s <input_file>\n", argv[0]);
+  if (argc < 4) {
+    fprintf(stderr,
+            "APEX_Help : Usage %s <input_file> "
+            "<simulate|display|debug|analyze> "
+            "<cycles> "
+            "[--stats] [--trace-record=<file>] [--trace-replay=<file>] "
+            "[--data-image=<file>] [--emit-image=<file>] "
+            "[--mul-latency=<cycles>] [--mem-latency=<cycles>] "
+            "[--extrapolate] [--memo[=<entries>]] [--memo-verify=<hits>] "
+            "[--batch=<list>] [--batch-out=<prefix>] [--lsq] "
+            "[--early-branch] [--smt=<threads>] [--smt-policy=<rr|icount>] "
+            "[--cores=<n>] [--host-threads=<n>] [--quantum=<cycles>] "
+            "[--miss-latency=<cycles>] [--vlen=<n>] [--vector-lanes=<n>] "
+            "[--loop-buffer[=<entries>]] "
+            "[--prefetch=<none|next-line|stride|stream>] "
+            "[--prefetch-degree=<n>] [--prefetch-distance=<n>] "
+            "[--snapshot-interval=<cycles>] [--digest=<file>] "
+            "[--digest-interval=<cycles>] [--report=<full|diff>] "
+            "[--dump=<file>] [--bench[=<runs>]] [--mmio-in=<file>] "
+            "[--mmio-out=<file>] [--mmio-latency=<cycles>] "
+            "[--analysis-interval=<instructions>] [--analysis-out=<file>] "
+            "[--value-predict=<last|stride>] [--ras-depth=<n>]\n"
+            "           %s --serve=<socket> [--workers=<n>] [--cache=<n>]\n"
+            "           %s --digest-compare=<digest> <digest>\n",
+            argv[0], argv[0], argv[0]);
     exit(1);
   }
 
+  for (int i = 4; i < argc; ++i) {
+    const char* value;
+    if (strcmp(argv[i], "--stats") == 0) {
+      show_stats = 1;
+    } else if ((value = option_value(argv[i], "--trace-record"))) {
+      trace_record = value;
+    } else if ((value = option_value(argv[i], "--trace-replay"))) {
+      trace_replay = value;
+    } else if ((value = option_value(argv[i], "--data-image"))) {
+      data_image = value;
+    } else if ((value = option_value(argv[i], "--emit-image"))) {
+      emit_image = value;
+    } else if (strcmp(argv[i], "--extrapolate") == 0) {
+      extrapolate = 1;
+    } else if (strcmp(argv[i], "--memo") == 0) {
+      memo_entries = APEX_MEMO_DEFAULT_ENTRIES;
+    } else if ((value = option_value(argv[i], "--memo"))) {
+      memo_entries = atoi(value);
+    } else if ((value = option_value(argv[i], "--memo-verify"))) {
+      memo_verify = atoi(value);
+    } else if ((value = option_value(argv[i], "--batch"))) {
+      batch_list = value;
+    } else if ((value = option_value(argv[i], "--batch-out"))) {
+      batch_out = value;
+    } else if (strcmp(argv[i], "--lsq") == 0) {
+      lsq = 1;
+    } else if (strcmp(argv[i], "--early-branch") == 0) {
+      early_branch = 1;
+    } else if ((value = option_value(argv[i], "--smt"))) {
+      smt_threads = atoi(value);
+    } else if ((value = option_value(argv[i], "--smt-policy"))) {
+      if (strcmp(value, "rr") == 0) {
+        smt_policy = APEX_SMT_ROUND_ROBIN;
+      } else if (strcmp(value, "icount") == 0) {
+        smt_policy = APEX_SMT_ICOUNT;
+      } else {
+        fprintf(stderr, "APEX_Error : Unknown fetch policy %s\n", value);
+        exit(1);
+      }
+    } else if ((value = option_value(argv[i], "--cores"))) {
+      cores = atoi(value);
+    } else if ((value = option_value(argv[i], "--host-threads"))) {
+      host_threads = atoi(value);
+    } else if ((value = option_value(argv[i], "--quantum"))) {
+      quantum = atoi(value);
+    } else if ((value = option_value(argv[i], "--miss-latency"))) {
+      miss_latency = atoi(value);
+    } else if ((value = option_value(argv[i], "--vlen"))) {
+      vlen = atoi(value);
+    } else if ((value = option_value(argv[i], "--vector-lanes"))) {
+      vector_lanes = atoi(value);
+    } else if (strcmp(argv[i], "--loop-buffer") == 0) {
+      loop_entries = APEX_LOOP_BUFFER_DEFAULT_ENTRIES;
+    } else if ((value = option_value(argv[i], "--loop-buffer"))) {
+      loop_entries = atoi(value);
+      if (loop_entries < 1) {
+        fprintf(stderr, "APEX_Error : --loop-buffer takes at least 1 entry\n");
+        exit(1);
+      }
+    } else if ((value = option_value(argv[i], "--prefetch"))) {
+      if (strcmp(value, "none") == 0) {
+        prefetcher = APEX_PREFETCH_NONE;
+      } else if (strcmp(value, "next-line") == 0) {
+        prefetcher = APEX_PREFETCH_NEXT_LINE;
+      } else if (strcmp(value, "stride") == 0) {
+        prefetcher = APEX_PREFETCH_STRIDE;
+      } else if (strcmp(value, "stream") == 0) {
+        prefetcher = APEX_PREFETCH_STREAM;
+      } else {
+        fprintf(stderr, "APEX_Error : Unknown prefetcher %s\n", value);
+        exit(1);
+      }
+    } else if ((value = option_value(argv[i], "--prefetch-degree"))) {
+      prefetch_degree = atoi(value);
+    } else if ((value = option_value(argv[i], "--prefetch-distance"))) {
+      prefetch_distance = atoi(value);
+    } else if ((value = option_value(argv[i], "--snapshot-interval"))) {
+      snapshot_interval = atoi(value);
+    } else if ((value = option_value(argv[i], "--digest"))) {
+      digest_file = value;
+    } else if ((value = option_value(argv[i], "--digest-interval"))) {
+      digest_interval = atoi(value);
+    } else if ((value = option_value(argv[i], "--report"))) {
+      if (strcmp(value, "full") == 0) {
+        report_diff = 0;
+      } else if (strcmp(value, "diff") == 0) {
+        report_diff = 1;
+      } else {
+        fprintf(stderr, "APEX_Error : Unknown report %s\n", value);
+        exit(1);
+      }
+    } else if ((value = option_value(argv[i], "--dump"))) {
+      dump_file = value;
+    } else if (strcmp(argv[i], "--bench") == 0) {
+      bench_runs = APEX_BENCH_DEFAULT_RUNS;
+    } else if ((value = option_value(argv[i], "--bench"))) {
+      bench_runs = atoi(value);
+      if (bench_runs < 1) {
+        fprintf(stderr, "APEX_Error : --bench takes at least 1 run\n");
+        exit(1);
+      }
+    } else if ((value = option_value(argv[i], "--mmio-in"))) {
+      mmio_in = value;
+    } else if ((value = option_value(argv[i], "--mmio-out"))) {
+      mmio_out = value;
+    } else if ((value = option_value(argv[i], "--mmio-latency"))) {
+      mmio_latency = atoi(value);
+    } else if ((value = option_value(argv[i], "--analysis-interval"))) {
+      analysis_interval = atoi(value);
+    } else if ((value = option_value(argv[i], "--analysis-out"))) {
+      analysis_out = value;
+    } else if ((value = option_value(argv[i], "--value-predict"))) {
+      if (strcmp(value, "last") == 0) {
+        value_predictor = APEX_VPRED_LAST;
+      } else if (strcmp(value, "stride") == 0) {
+        value_predictor = APEX_VPRED_STRIDE;
+      } else {
+        fprintf(stderr, "APEX_Error : Unknown value predictor %s\n", value);
+        exit(1);
+      }
+    } else if ((value = option_value(argv[i], "--ras-depth"))) {
+      ras_depth = atoi(value);
+    } else if ((value = option_value(argv[i], "--mul-latency"))) {
+      mul_latency = atoi(value);
+    } else if ((value = option_value(argv[i], "--mem-latency"))) {
+      mem_latency = atoi(value);
+    } else {
+      fprintf(stderr, "APEX_Error : Unknown option %s\n", argv[i]);
+      exit(1);
+    }
+  }
+
   if(strcmp(argv[2], "simulate") == 0) {
     isSimulate = 1;
+  } else if (strcmp(argv[2], "debug") == 0) {
+    /* The debugger prints the state when asked, not every cycle */
+    isSimulate = 1;
+    debug = 1;
+  } else if (strcmp(argv[2], "analyze") == 0) {
+    /* <cycles> limits the instructions analyzed */
+    isSimulate = 1;
+    analyze = 1;
   } else {
     isSimulate = 0;
   }
@@ -37,7 +385,387 @@ main(int argc, char const* argv[])
     exit(1);
   }
 
+  cpu->show_stats = show_stats;
+  cpu->mul_latency = mul_latency > 1 ? mul_latency : 1;
+  cpu->mem_latency = mem_latency > 1 ? mem_latency : 1;
+
+  if (vlen < 1 || vlen > APEX_MAX_VLEN || vector_lanes < 1 ||
+      vector_lanes > APEX_MAX_VLEN) {
+    fprintf(stderr, "APEX_Error : --vlen and --vector-lanes take 1 to %d "
+                    "elements\n", APEX_MAX_VLEN);
+    exit(1);
+  }
+  cpu->vlen = vlen;
+  cpu->vector_lanes = vector_lanes;
+
+  if (ras_depth < 0 || ras_depth > APEX_RAS_MAX_DEPTH) {
+    fprintf(stderr, "APEX_Error : --ras-depth takes 0 to %d entries\n",
+            APEX_RAS_MAX_DEPTH);
+    exit(1);
+  }
+  cpu->ras_depth = ras_depth;
+
+  /* Precompile the program into an image that later runs map in place */
+  if (emit_image) {
+    if (write_program_image(emit_image, cpu->code_memory,
+                            cpu->code_memory_size) < 0) {
+      fprintf(stderr, "APEX_Error : Unable to write image %s\n", emit_image);
+      exit(1);
+    }
+    APEX_cpu_stop(cpu);
+    return 0;
+  }
+
+  if (data_image && APEX_cpu_load_data_image(cpu, data_image) < 0) {
+    fprintf(stderr, "APEX_Error : Unable to load data image %s\n", data_image);
+    exit(1);
+  }
+
+  /* The analysis runs the program functionally, without the timing models */
+  if (analyze && (trace_record || trace_replay || batch_list || smt_threads ||
+                  cores || mmio_in || mmio_out || digest_file || report_diff ||
+                  dump_file || bench_runs)) {
+    fprintf(stderr, "APEX_Error : analyze cannot be used with traces, --batch, "
+                    "--smt, --cores, --mmio-in, --mmio-out, --digest, "
+                    "--report, --dump or --bench\n");
+    exit(1);
+  }
+
+  if (analyze) {
+    if (analysis_interval < 1) {
+      fprintf(stderr, "APEX_Error : --analysis-interval must be positive\n");
+      exit(1);
+    }
+    FILE* out = analysis_out ? fopen(analysis_out, "w") : stdout;
+    APEX_Analysis* analysis = analysis_create(cpu, analysis_interval);
+    if (!out || !analysis) {
+      fprintf(stderr, "APEX_Error : Unable to analyze the program\n");
+      exit(1);
+    }
+    analysis_run(analysis, cpu, cycles);
+    analysis_write_json(analysis, cpu, argv[1], out);
+    if (out != stdout && fclose(out) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to write %s\n", analysis_out);
+      exit(1);
+    }
+    analysis_destroy(analysis);
+    APEX_cpu_stop(cpu);
+    return 0;
+  }
+
+  /* A trace has no register values, the count of a LOOP is not known */
+  if ((trace_record || trace_replay) && uses_opcode(cpu, OP_LOOP)) {
+    fprintf(stderr, "APEX_Error : Traces cannot be used with programs using "
+                    "LOOP\n");
+    exit(1);
+  }
+
+  if (trace_record) {
+    cpu->trace_out = trace_writer_open(trace_record, cpu->code_memory_size);
+    if (!cpu->trace_out) {
+      fprintf(stderr, "APEX_Error : Unable to create trace %s\n", trace_record);
+      exit(1);
+    }
+  }
+
+  if (trace_replay) {
+    cpu->trace_in = trace_reader_open(trace_replay);
+    if (!cpu->trace_in) {
+      fprintf(stderr, "APEX_Error : Unable to read trace %s\n", trace_replay);
+      exit(1);
+    }
+    if (cpu->trace_in->header.code_memory_size != cpu->code_memory_size) {
+      fprintf(stderr, "APEX_Error : Trace %s was recorded for another program\n",
+              trace_replay);
+      exit(1);
+    }
+  }
+
+  /* Lanes follow the instructions the pipeline executes, none are skipped */
+  if (batch_list && (data_image || trace_record || trace_replay ||
+                     extrapolate || memo_entries > 0)) {
+    fprintf(stderr, "APEX_Error : --batch cannot be used with --data-image, "
+                    "traces, --extrapolate or --memo\n");
+    exit(1);
+  }
+
+  if (batch_list) {
+    cpu->batch = batch_create(cpu, batch_list);
+    if (!cpu->batch) {
+      fprintf(stderr, "APEX_Error : Unable to load batch %s\n", batch_list);
+      exit(1);
+    }
+    cpu->batch->out_prefix = batch_out;
+  }
+
+  /* The shadow checks evaluated results, a replayed trace has none */
+  if (extrapolate || memo_entries > 0 || batch_list) {
+    if (trace_record || trace_replay) {
+      fprintf(stderr, "APEX_Error : --extrapolate and --memo cannot be used "
+                      "with traces\n");
+      exit(1);
+    }
+    cpu->shadow = shadow_create(cpu);
+    if (!cpu->shadow) {
+      fprintf(stderr, "APEX_Error : Unable to shadow the pipeline\n");
+      exit(1);
+    }
+  }
+
+  if (extrapolate) {
+    cpu->steady = steady_create();
+    if (!cpu->steady) {
+      fprintf(stderr, "APEX_Error : Unable to enable extrapolation\n");
+      exit(1);
+    }
+  }
+
+  if (memo_entries > 0) {
+    cpu->memo = memo_create(memo_entries, memo_verify > 0 ? memo_verify : 0);
+    if (!cpu->memo) {
+      fprintf(stderr, "APEX_Error : Unable to enable the memo cache\n");
+      exit(1);
+    }
+  }
+
+  /* The fast paths and traces assume the in-order memory stages */
+  if (lsq && (trace_replay || extrapolate || memo_entries > 0 || batch_list)) {
+    fprintf(stderr, "APEX_Error : --lsq cannot be used with --trace-replay, "
+                    "--extrapolate, --memo or --batch\n");
+    exit(1);
+  }
+
+  if (lsq) {
+    cpu->lsq = lsq_create();
+    if (!cpu->lsq) {
+      fprintf(stderr, "APEX_Error : Unable to enable the store queue\n");
+      exit(1);
+    }
+  }
+
+  /* Replayed and fast-forwarded runs resolve branches in Execute2 */
+  if (early_branch && (trace_replay || extrapolate || memo_entries > 0 ||
+                       batch_list)) {
+    fprintf(stderr, "APEX_Error : --early-branch cannot be used with "
+                    "--trace-replay, --extrapolate, --memo or --batch\n");
+    exit(1);
+  }
+  cpu->early_branch = early_branch;
+
+  /* The other models keep one architectural state */
+  if (smt_threads && (trace_record || trace_replay || extrapolate ||
+                      memo_entries > 0 || batch_list || lsq || early_branch)) {
+    fprintf(stderr, "APEX_Error : --smt cannot be used with traces, "
+                    "--extrapolate, --memo, --batch, --lsq or --early-branch\n");
+    exit(1);
+  }
+
+  if (smt_threads) {
+    if (smt_threads < 2 || smt_threads > APEX_SMT_MAX_THREADS) {
+      fprintf(stderr, "APEX_Error : --smt takes 2 to %d threads\n",
+              APEX_SMT_MAX_THREADS);
+      exit(1);
+    }
+    cpu->smt = smt_create(cpu, smt_threads, smt_policy);
+    if (!cpu->smt) {
+      fprintf(stderr, "APEX_Error : Unable to create the hardware contexts\n");
+      exit(1);
+    }
+  }
+
+  /* Only the pipeline goes through the caches */
+  if (cores && (trace_record || trace_replay || extrapolate ||
+                memo_entries > 0 || batch_list || lsq || smt_threads)) {
+    fprintf(stderr, "APEX_Error : --cores cannot be used with traces, "
+                    "--extrapolate, --memo, --batch, --lsq or --smt\n");
+    exit(1);
+  }
+
+  if (cores) {
+    if (cores < 1 || cores > APEX_MAX_CORES || host_threads < 1 ||
+        quantum < 1 || miss_latency < 0) {
+      fprintf(stderr, "APEX_Error : --cores takes 1 to %d cores, "
+                      "--host-threads and --quantum must be positive\n",
+              APEX_MAX_CORES);
+      exit(1);
+    }
+    cpu->multicore = multicore_create(cpu, cores, host_threads, quantum,
+                                      miss_latency);
+    if (!cpu->multicore) {
+      fprintf(stderr, "APEX_Error : Unable to create the cores\n");
+      exit(1);
+    }
+  }
+
+  /* The fast paths and the other models do not go through the front end */
+  if (loop_entries && (extrapolate || memo_entries > 0 || batch_list ||
+                       smt_threads || cores)) {
+    fprintf(stderr, "APEX_Error : --loop-buffer cannot be used with "
+                    "--extrapolate, --memo, --batch, --smt or --cores\n");
+    exit(1);
+  }
+
+  if (loop_entries) {
+    cpu->loop_buffer = loop_buffer_create(loop_entries);
+    if (!cpu->loop_buffer) {
+      fprintf(stderr, "APEX_Error : Unable to enable the loop buffer\n");
+      exit(1);
+    }
+  }
+
+  /* The data cache sits in front of the one in-order memory port */
+  if (prefetcher >= 0 && (trace_replay || extrapolate || memo_entries > 0 ||
+                          batch_list || lsq || smt_threads || cores)) {
+    fprintf(stderr, "APEX_Error : --prefetch cannot be used with "
+                    "--trace-replay, --extrapolate, --memo, --batch, --lsq, "
+                    "--smt or --cores\n");
+    exit(1);
+  }
+
+  if (prefetcher >= 0) {
+    if (prefetch_degree < 1 || prefetch_distance < 1 || miss_latency < 0) {
+      fprintf(stderr, "APEX_Error : --prefetch-degree and --prefetch-distance "
+                      "must be positive\n");
+      exit(1);
+    }
+    cpu->prefetch = prefetch_create(prefetcher, prefetch_degree,
+                                    prefetch_distance, miss_latency,
+                                    cpu->data_memory_size);
+    if (!cpu->prefetch) {
+      fprintf(stderr, "APEX_Error : Unable to enable the prefetcher\n");
+      exit(1);
+    }
+  }
+
+  /* Every cycle is simulated, by one state */
+  if (digest_file && (extrapolate || memo_entries > 0 || batch_list ||
+                      smt_threads || cores || debug)) {
+    fprintf(stderr, "APEX_Error : --digest cannot be used with --extrapolate, "
+                    "--memo, --batch, --smt, --cores or debug\n");
+    exit(1);
+  }
+
+  if (digest_file) {
+    if (digest_interval < 1) {
+      fprintf(stderr, "APEX_Error : --digest-interval must be positive\n");
+      exit(1);
+    }
+    cpu->digest = digest_open(digest_file, cpu, digest_interval);
+    if (!cpu->digest) {
+      fprintf(stderr, "APEX_Error : Unable to create digest %s\n", digest_file);
+      exit(1);
+    }
+  }
+
+  /* The other models report several states */
+  if ((report_diff || dump_file) && (batch_list || smt_threads || cores ||
+                                     debug)) {
+    fprintf(stderr, "APEX_Error : --report and --dump cannot be used with "
+                    "--batch, --smt, --cores or debug\n");
+    exit(1);
+  }
+
+  if (report_diff) {
+    cpu->report = report_create(cpu);
+    if (!cpu->report) {
+      fprintf(stderr, "APEX_Error : Unable to track the changed state\n");
+      exit(1);
+    }
+  }
+
+  /* Device accesses happen once, in Memory2, in program order */
+  if ((mmio_in || mmio_out) && (trace_replay || extrapolate ||
+                                memo_entries > 0 || batch_list || lsq ||
+                                smt_threads || cores || debug)) {
+    fprintf(stderr, "APEX_Error : --mmio-in and --mmio-out cannot be used with "
+                    "--trace-replay, --extrapolate, --memo, --batch, --lsq, "
+                    "--smt, --cores or debug\n");
+    exit(1);
+  }
+
+  if (mmio_in || mmio_out) {
+    if (mmio_latency < 1) {
+      fprintf(stderr, "APEX_Error : --mmio-latency must be positive\n");
+      exit(1);
+    }
+    cpu->mmio = mmio_create(mmio_in, mmio_out, mmio_latency);
+    if (!cpu->mmio) {
+      exit(1);
+    }
+  }
+
+  /* Loads forward predictions from the one in-order memory port */
+  if (value_predictor >= 0 && (trace_record || trace_replay || extrapolate ||
+                               memo_entries > 0 || batch_list || lsq ||
+                               early_branch || smt_threads || cores ||
+                               loop_entries || debug)) {
+    fprintf(stderr, "APEX_Error : --value-predict cannot be used with traces, "
+                    "--extrapolate, --memo, --batch, --lsq, --early-branch, "
+                    "--smt, --cores, --loop-buffer or debug\n");
+    exit(1);
+  }
+
+  if (value_predictor >= 0) {
+    cpu->vpred = vpred_create(value_predictor);
+    if (!cpu->vpred) {
+      fprintf(stderr, "APEX_Error : Unable to enable the value predictor\n");
+      exit(1);
+    }
+  }
+
+  /* Each run starts over from a reset pipeline, the other models keep state */
+  if (bench_runs && (!isSimulate || debug || trace_record || trace_replay ||
+                     extrapolate || memo_entries > 0 || batch_list ||
+                     smt_threads || cores || loop_entries || digest_file ||
+                     report_diff || dump_file)) {
+    fprintf(stderr, "APEX_Error : --bench runs in simulate mode and cannot be "
+                    "used with traces, --extrapolate, --memo, --batch, --smt, "
+                    "--cores, --loop-buffer, --digest, --report or --dump\n");
+    exit(1);
+  }
+
+  if (bench_runs) {
+    cpu->quiet = 1;
+    if (bench(cpu, bench_runs) < 0) {
+      fprintf(stderr, "APEX_Error : Unable to run the benchmark\n");
+      exit(1);
+    }
+    APEX_cpu_stop(cpu);
+    return 0;
+  }
+
+  /* Cycles are simulated one at a time and state is restored by value */
+  if (debug && (trace_record || trace_replay || extrapolate ||
+                memo_entries > 0 || batch_list || lsq || smt_threads ||
+                cores)) {
+    fprintf(stderr, "APEX_Error : debug cannot be used with traces, "
+                    "--extrapolate, --memo, --batch, --lsq, --smt or "
+                    "--cores\n");
+    exit(1);
+  }
+
+  if (debug) {
+    if (snapshot_interval < 1) {
+      fprintf(stderr, "APEX_Error : --snapshot-interval must be positive\n");
+      exit(1);
+    }
+    cpu->quiet = 1;
+    cpu->debugger = debugger_create(cpu, snapshot_interval);
+    if (!cpu->debugger) {
+      fprintf(stderr, "APEX_Error : Unable to start the debugger\n");
+      exit(1);
+    }
+    int status = debugger_run(cpu->debugger, stdin);
+    APEX_cpu_stop(cpu);
+    return status < 0 ? 1 : 0;
+  }
+
   APEX_cpu_run(cpu);
+  if (dump_file && write_data_image(dump_file, cpu->data_memory,
+                                    cpu->data_memory_size) < 0) {
+    fprintf(stderr, "APEX_Error : Unable to write image %s\n", dump_file);
+    exit(1);
+  }
   APEX_cpu_stop(cpu);
   return 0;
-}
\ No newline at end of file
+}
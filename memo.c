@@ -0,0 +1,508 @@
+/*
+ *  memo.c
+ *  Contains the basic block timing cache
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "memo.h"
+
+/* Index of branchPcValue, the first instruction of the next block */
+#define CONTROL_TARGET (NUM_STAGES * 15 + 3)
+
+APEX_Memo *
+memo_create(int capacity, int verify_every)
+{
+  if (capacity < 1)
+  {
+    return NULL;
+  }
+
+  APEX_Memo *memo = calloc(1, sizeof(*memo));
+  if (!memo)
+  {
+    return NULL;
+  }
+
+  int buckets = 1;
+  while (buckets < 2 * capacity)
+  {
+    buckets <<= 1;
+  }
+
+  memo->entries = calloc(capacity, sizeof(APEX_MemoEntry));
+  memo->buckets = malloc(buckets * sizeof(int));
+  if (!memo->entries || !memo->buckets)
+  {
+    memo_destroy(memo);
+    return NULL;
+  }
+  memset(memo->buckets, -1, buckets * sizeof(int));
+
+  memo->capacity = capacity;
+  memo->bucket_mask = buckets - 1;
+  memo->lru_head = -1;
+  memo->lru_tail = -1;
+  memo->verify_entry = -1;
+  memo->verify_every = verify_every;
+  return memo;
+}
+
+void memo_destroy(APEX_Memo *memo)
+{
+  if (memo)
+  {
+    free(memo->entries);
+    free(memo->buckets);
+    free(memo->records);
+    free(memo->expected_memory);
+    free(memo);
+  }
+}
+
+/* FNV-1a over the words of the control state */
+static unsigned long long
+hash_control(const int *control)
+{
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+
+  for (int i = 0; i < APEX_SHADOW_CONTROL; ++i)
+  {
+    hash = (hash ^ (unsigned)control[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/*
+ * Key of the state a block is entered in: the control state, and which
+ * registers, forwarded values and the zero flag hold another value than
+ * the shadow, because a write is still in flight or forwarding has not
+ * caught up with it
+ */
+static unsigned long long
+hash_state(APEX_CPU *cpu, const int *control)
+{
+  const APEX_FuncState *state = &cpu->shadow->state;
+  unsigned long long shape = cpu->zFlag != state->zflag;
+
+  for (int r = 0; r < 16; ++r)
+  {
+    shape = shape << 2 | (cpu->regs[r] != state->regs[r]) << 1 |
+            (cpu->forwardedValues[r] != state->regs[r]);
+  }
+  return (hash_control(control) ^ shape) * 0x100000001b3ULL;
+}
+
+static int *
+bucket_of(APEX_Memo *memo, int pc, unsigned long long hash)
+{
+  return &memo->buckets[(hash ^ (unsigned)pc) & memo->bucket_mask];
+}
+
+static int
+find_entry(APEX_Memo *memo, int pc, unsigned long long hash)
+{
+  for (int i = *bucket_of(memo, pc, hash); i >= 0; i = memo->entries[i].chain)
+  {
+    if (memo->entries[i].pc == pc && memo->entries[i].hash == hash)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void
+lru_unlink(APEX_Memo *memo, int i)
+{
+  APEX_MemoEntry *entry = &memo->entries[i];
+
+  if (entry->prev >= 0)
+  {
+    memo->entries[entry->prev].next = entry->next;
+  }
+  else
+  {
+    memo->lru_head = entry->next;
+  }
+  if (entry->next >= 0)
+  {
+    memo->entries[entry->next].prev = entry->prev;
+  }
+  else
+  {
+    memo->lru_tail = entry->prev;
+  }
+}
+
+static void
+lru_push_front(APEX_Memo *memo, int i)
+{
+  APEX_MemoEntry *entry = &memo->entries[i];
+
+  entry->prev = -1;
+  entry->next = memo->lru_head;
+  if (memo->lru_head >= 0)
+  {
+    memo->entries[memo->lru_head].prev = i;
+  }
+  memo->lru_head = i;
+  if (memo->lru_tail < 0)
+  {
+    memo->lru_tail = i;
+  }
+}
+
+static void
+touch_entry(APEX_Memo *memo, int i)
+{
+  if (memo->lru_head != i)
+  {
+    lru_unlink(memo, i);
+    lru_push_front(memo, i);
+  }
+}
+
+static void
+remove_entry(APEX_Memo *memo, int i)
+{
+  APEX_MemoEntry *entry = &memo->entries[i];
+  int *link = bucket_of(memo, entry->pc, entry->hash);
+
+  while (*link != i)
+  {
+    link = &memo->entries[*link].chain;
+  }
+  *link = entry->chain;
+  lru_unlink(memo, i);
+
+  /* Keep the used entries packed at the front of the array */
+  int last = --memo->count;
+  if (i != last)
+  {
+    APEX_MemoEntry *moved = &memo->entries[last];
+    link = bucket_of(memo, moved->pc, moved->hash);
+    while (*link != last)
+    {
+      link = &memo->entries[*link].chain;
+    }
+    *link = i;
+    if (moved->prev >= 0)
+    {
+      memo->entries[moved->prev].next = i;
+    }
+    else
+    {
+      memo->lru_head = i;
+    }
+    if (moved->next >= 0)
+    {
+      memo->entries[moved->next].prev = i;
+    }
+    else
+    {
+      memo->lru_tail = i;
+    }
+    *entry = *moved;
+  }
+
+  if (memo->verify_entry == last)
+  {
+    memo->verify_entry = i;
+  }
+  else if (memo->verify_entry == i)
+  {
+    memo->verify_entry = -1;
+  }
+}
+
+static int
+insert_entry(APEX_Memo *memo, int pc, unsigned long long hash)
+{
+  if (memo->count == memo->capacity)
+  {
+    remove_entry(memo, memo->lru_tail);
+    memo->evictions++;
+  }
+
+  int i = memo->count++;
+  APEX_MemoEntry *entry = &memo->entries[i];
+  int *bucket = bucket_of(memo, pc, hash);
+
+  memset(entry, 0, sizeof(*entry));
+  entry->pc = pc;
+  entry->hash = hash;
+  entry->chain = *bucket;
+  *bucket = i;
+  lru_push_front(memo, i);
+  return i;
+}
+
+static void
+open_block(APEX_CPU *cpu, unsigned long long hash)
+{
+  APEX_Memo *memo = cpu->memo;
+
+  memo->open = 1;
+  memo->open_pc = cpu->branchPcValue;
+  memo->open_hash = hash;
+  memo->open_clock = cpu->clock;
+  shadow_counters(cpu, memo->open_counters);
+  memo->open_executed = cpu->shadow->executed;
+  memo->open_branches = cpu->shadow->branches;
+}
+
+/* Ends the block simulated since the last redirect and stores what it did */
+static void
+close_block(APEX_CPU *cpu, const int *control)
+{
+  APEX_Memo *memo = cpu->memo;
+  APEX_Observation exit;
+  int counters[APEX_SHADOW_COUNTERS];
+  int delta[APEX_SHADOW_COUNTERS];
+  int cost = cpu->clock - memo->open_clock;
+  int length = (int)(cpu->shadow->executed - memo->open_executed);
+
+  shadow_counters(cpu, counters);
+  for (int c = 0; c < APEX_SHADOW_COUNTERS; ++c)
+  {
+    delta[c] = counters[c] - memo->open_counters[c];
+  }
+  shadow_observe(cpu, &exit);
+
+  int i = find_entry(memo, memo->open_pc, memo->open_hash);
+  APEX_MemoEntry *entry = i >= 0 ? &memo->entries[i] : NULL;
+  int same = entry && entry->length == length && entry->cost == cost &&
+             memcmp(entry->counter_delta, delta, sizeof(delta)) == 0 &&
+             memcmp(entry->exit_control, control,
+                    sizeof(entry->exit_control)) == 0;
+
+  if (entry && entry->confirmed)
+  {
+    return;
+  }
+
+  if (entry && same)
+  {
+    const APEX_Observation *observations[2] = {&entry->first, &exit};
+    if (shadow_bind(observations, 2, entry->binding) == 0)
+    {
+      entry->confirmed = 1;
+      return;
+    }
+  }
+
+  if (!entry)
+  {
+    entry = &memo->entries[insert_entry(memo, memo->open_pc, memo->open_hash)];
+  }
+  entry->length = length;
+  entry->cost = cost;
+  memcpy(entry->counter_delta, delta, sizeof(delta));
+  memcpy(entry->exit_control, control, sizeof(entry->exit_control));
+  entry->first = exit;
+}
+
+/*
+ * Executes the block of an entry functionally. Returns 0 if the block
+ * takes another path this time, nothing is executed then.
+ */
+static int
+run_block(APEX_CPU *cpu, const APEX_MemoEntry *entry, APEX_ShadowMark *mark)
+{
+  APEX_Memo *memo = cpu->memo;
+
+  if (entry->length > memo->records_capacity)
+  {
+    APEX_FuncRecord *records =
+        realloc(memo->records, entry->length * sizeof(*records));
+    if (!records)
+    {
+      return 0;
+    }
+    memo->records = records;
+    memo->records_capacity = entry->length;
+  }
+
+  shadow_mark(cpu->shadow, mark);
+  int count = shadow_run(cpu, entry->pc, entry->length, memo->records);
+
+  /* Only the last instruction may leave the straight-line path */
+  int path = count == entry->length &&
+             cpu->shadow->branches - mark->branches == 1 &&
+             memo->records[count - 1].next_pc ==
+                 entry->exit_control[CONTROL_TARGET];
+  if (!path)
+  {
+    shadow_rollback(cpu->shadow, mark, memo->records, count);
+  }
+  return path;
+}
+
+/* Moves the pipeline to the end of a block run_block executed */
+static void
+leave_block(APEX_CPU *cpu, const APEX_MemoEntry *entry)
+{
+  shadow_advance(cpu, entry->cost, entry->counter_delta, 1);
+  shadow_restore_control(cpu, entry->exit_control);
+  shadow_apply(cpu, entry->binding, entry->first.slots);
+}
+
+/* Skips a block that follows the path of its entry */
+static int
+apply_entry(APEX_CPU *cpu, const APEX_MemoEntry *entry)
+{
+  APEX_ShadowMark mark;
+
+  if (!run_block(cpu, entry, &mark))
+  {
+    return 0;
+  }
+  leave_block(cpu, entry);
+  return 1;
+}
+
+/*
+ * Skips the block of a sampled hit, keeps the state that leaves and
+ * undoes it. The pipeline then simulates the block and check_sample
+ * compares the state it ends in.
+ */
+static int
+sample_entry(APEX_CPU *cpu, int i)
+{
+  APEX_Memo *memo = cpu->memo;
+  const APEX_MemoEntry *entry = &memo->entries[i];
+  size_t bytes = cpu->data_memory_size * sizeof(int);
+  APEX_CPU before = *cpu;
+  APEX_ShadowMark mark;
+
+  if (!memo->expected_memory && !(memo->expected_memory = malloc(bytes)))
+  {
+    return 0;
+  }
+  if (!run_block(cpu, entry, &mark))
+  {
+    return 0;
+  }
+
+  leave_block(cpu, entry);
+  memo->expected = *cpu;
+  memcpy(memo->expected_memory, cpu->data_memory, bytes);
+  shadow_rollback(cpu->shadow, &mark, memo->records, entry->length);
+  *cpu = before;
+  memo->verify_entry = i;
+  return 1;
+}
+
+/*
+ * Called at the end of the block of a sampled hit. Registers, memory,
+ * latches, forwarded values, statistics and the clock have to be what
+ * skipping the block gave, or the entry is dropped.
+ */
+static void
+check_sample(APEX_CPU *cpu)
+{
+  APEX_Memo *memo = cpu->memo;
+  APEX_CPU *expected = &memo->expected;
+  int control[2][APEX_SHADOW_CONTROL];
+  int counters[2][APEX_SHADOW_COUNTERS];
+  APEX_Observation state[2];
+
+  shadow_capture_control(cpu, control[0]);
+  shadow_capture_control(expected, control[1]);
+  shadow_counters(cpu, counters[0]);
+  shadow_counters(expected, counters[1]);
+  shadow_observe(cpu, &state[0]);
+  shadow_observe(expected, &state[1]);
+
+  if (cpu->clock == expected->clock &&
+      memcmp(control[0], control[1], sizeof(control[0])) == 0 &&
+      memcmp(counters[0], counters[1], sizeof(counters[0])) == 0 &&
+      memcmp(state[0].slots, state[1].slots, sizeof(state[0].slots)) == 0 &&
+      memcmp(cpu->data_memory, memo->expected_memory,
+             cpu->data_memory_size * sizeof(int)) == 0)
+  {
+    memo->verified++;
+  }
+  else
+  {
+    memo->verify_failures++;
+    remove_entry(memo, memo->verify_entry);
+  }
+  memo->verify_entry = -1;
+}
+
+/*
+ * Called at the start of a cycle in which fetch is redirected, which
+ * ends one block and starts the next. Blocks with a confirmed entry
+ * are skipped for as long as they hit. With discard set, the cycles
+ * since the last redirect were not all simulated and are not stored.
+ */
+void memo_block_boundary(APEX_CPU *cpu, int discard)
+{
+  APEX_Memo *memo = cpu->memo;
+  int control[APEX_SHADOW_CONTROL];
+
+  if (cpu->shadow->broken)
+  {
+    return;
+  }
+
+  shadow_capture_control(cpu, control);
+
+  if (memo->verify_entry >= 0 && !discard)
+  {
+    check_sample(cpu);
+  }
+  memo->verify_entry = -1;
+
+  /* The stores of a block have to be done by its end */
+  if (memo->open && !discard && !shadow_stores_in_flight(cpu->shadow) &&
+      cpu->shadow->branches - memo->open_branches == 1)
+  {
+    close_block(cpu, control);
+  }
+  memo->open = 0;
+
+  /* The exit state of a hit is the entry state of the next block */
+  unsigned long long hash = hash_state(cpu, control);
+  while (!shadow_stores_in_flight(cpu->shadow))
+  {
+    int i = find_entry(memo, cpu->branchPcValue, hash);
+    APEX_MemoEntry *entry = i >= 0 ? &memo->entries[i] : NULL;
+
+    memo->lookups++;
+    if (!entry || !entry->confirmed ||
+        (cpu->cycles > 0 && cpu->clock + entry->cost > cpu->cycles - 1))
+    {
+      break;
+    }
+
+    /* A sampled hit is simulated in detail and checked when it ends */
+    if (memo->verify_every && memo->hits_since_verify + 1 >= memo->verify_every)
+    {
+      if (sample_entry(cpu, i))
+      {
+        memo->hits_since_verify = 0;
+        touch_entry(memo, i);
+      }
+      break;
+    }
+
+    if (!apply_entry(cpu, entry))
+    {
+      break;
+    }
+    memo->hits_since_verify++;
+    touch_entry(memo, i);
+    memo->hits++;
+    memo->cycles += entry->cost;
+    shadow_capture_control(cpu, control);
+    hash = hash_state(cpu, control);
+  }
+
+  open_block(cpu, hash);
+}
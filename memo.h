@@ -0,0 +1,85 @@
+#ifndef _APEX_MEMO_H_
+#define _APEX_MEMO_H_
+/**
+ *  memo.h
+ *  Contains the basic block timing cache. A block runs from one fetch
+ *  redirect to the next. Its cycle cost and exit pipeline state are
+ *  remembered per entry state, and a block entered again in the same
+ *  state is executed functionally instead of simulated.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "shadow.h"
+
+#define APEX_MEMO_DEFAULT_ENTRIES 1024
+
+/* A block and the pipeline state it was entered in */
+typedef struct APEX_MemoEntry
+{
+  /* Key */
+  int pc;                  // First instruction of the block
+  unsigned long long hash; // Hash of the control and forwarding state at entry
+
+  /* Effect of the block */
+  int length; // Instructions executed
+  int cost;   // Cycles
+  int counter_delta[APEX_SHADOW_COUNTERS];
+  int exit_control[APEX_SHADOW_CONTROL];
+  int binding[APEX_SHADOW_SLOTS];
+  APEX_Observation first; // First exit seen, confirmed by the second one
+  int confirmed;
+
+  /* Hash chain and LRU list links, -1 terminated */
+  int chain;
+  int prev;
+  int next;
+} APEX_MemoEntry;
+
+typedef struct APEX_Memo
+{
+  APEX_MemoEntry *entries;
+  int capacity;
+  int count;
+  int *buckets;
+  int bucket_mask;
+  int lru_head; // Most recently used
+  int lru_tail; // Least recently used, evicted first
+
+  /* Block simulated since the last redirect */
+  int open;
+  int open_pc;
+  unsigned long long open_hash;
+  int open_clock;
+  int open_counters[APEX_SHADOW_COUNTERS];
+  long open_executed;
+  long open_branches;
+  int verify_entry; // Entry of the sampled hit the open block checks, or -1
+
+  /* State the sampled hit left at the end of its block */
+  APEX_CPU expected;
+  int *expected_memory;
+
+  /* Simulate every verify_every-th hit in the pipeline as well, 0 never */
+  int verify_every;
+  int hits_since_verify;
+
+  APEX_FuncRecord *records;
+  int records_capacity;
+
+  /* Statistics */
+  long lookups;
+  long hits;
+  long evictions;
+  long verified;
+  long verify_failures;
+  long cycles;
+} APEX_Memo;
+
+APEX_Memo *memo_create(int capacity, int verify_every);
+
+void memo_destroy(APEX_Memo *memo);
+
+void memo_block_boundary(APEX_CPU *cpu, int discard);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ *  mmio.c
+ *  Contains the memory mapped I/O device
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mmio.h"
+
+/* Input words read between two drops of the pages behind them, 1 MB */
+#define APEX_MMIO_RELEASE_WORDS (1 << 18)
+
+/* Buffer of the output file */
+#define APEX_MMIO_OUTPUT_BUFFER (1 << 20)
+
+/* Maps the input read-only; an empty file has no words and no mapping */
+static int
+map_input(APEX_Mmio *mmio, const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  size_t words = st.st_size / sizeof(int);
+  if (words == 0)
+  {
+    close(fd);
+    return 0;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    return -1;
+  }
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+  mmio->input.base = base;
+  mmio->input.length = st.st_size;
+  mmio->in_words = base;
+  mmio->in_count = words;
+  return 0;
+}
+
+APEX_Mmio *
+mmio_create(const char *input, const char *output, int latency)
+{
+  APEX_Mmio *mmio = calloc(1, sizeof(*mmio));
+  if (!mmio)
+  {
+    return NULL;
+  }
+  mmio->latency = latency;
+
+  if (input && map_input(mmio, input) < 0)
+  {
+    fprintf(stderr, "APEX_Error : Unable to read MMIO input %s\n", input);
+    mmio_destroy(mmio);
+    return NULL;
+  }
+
+  if (output)
+  {
+    mmio->output = fopen(output, "wb");
+    if (!mmio->output)
+    {
+      fprintf(stderr, "APEX_Error : Unable to create MMIO output %s\n",
+              output);
+      mmio_destroy(mmio);
+      return NULL;
+    }
+    setvbuf(mmio->output, NULL, _IOFBF, APEX_MMIO_OUTPUT_BUFFER);
+    mmio->output_name = output;
+  }
+  return mmio;
+}
+
+void mmio_destroy(APEX_Mmio *mmio)
+{
+  if (!mmio)
+  {
+    return;
+  }
+
+  if (mmio->input.base)
+  {
+    munmap(mmio->input.base, mmio->input.length);
+  }
+  if (mmio->output && fclose(mmio->output) != 0)
+  {
+    fprintf(stderr, "APEX_Error : Unable to write MMIO output %s\n",
+            mmio->output_name);
+  }
+  free(mmio);
+}
+
+/* Back to the first input word and an empty output file */
+void mmio_reset(APEX_Mmio *mmio)
+{
+  mmio->in_next = 0;
+  mmio->in_released = 0;
+  if (mmio->output)
+  {
+    fflush(mmio->output);
+    if (ftruncate(fileno(mmio->output), 0) < 0)
+    {
+      fprintf(stderr, "APEX_Error : Unable to truncate MMIO output %s\n",
+              mmio->output_name);
+    }
+    rewind(mmio->output);
+  }
+
+  mmio->loads = 0;
+  mmio->stores = 0;
+  mmio->words_read = 0;
+  mmio->words_written = 0;
+}
+
+/*
+ * Pages of the input behind the next word are not read again until a
+ * reset, so they are dropped from memory; after a reset they are read
+ * back from the file.
+ */
+static void
+release_input(APEX_Mmio *mmio)
+{
+  if (mmio->in_next - mmio->in_released < APEX_MMIO_RELEASE_WORDS)
+  {
+    return;
+  }
+  madvise((char *)mmio->input.base + mmio->in_released * sizeof(int),
+          APEX_MMIO_RELEASE_WORDS * sizeof(int), MADV_DONTNEED);
+  mmio->in_released += APEX_MMIO_RELEASE_WORDS;
+}
+
+int mmio_read(APEX_Mmio *mmio, int address)
+{
+  int value;
+
+  mmio->loads++;
+  switch (address)
+  {
+  case APEX_MMIO_IN_DATA:
+    if (mmio->in_next == mmio->in_count)
+    {
+      return 0;
+    }
+    value = mmio->in_words[mmio->in_next++];
+    mmio->words_read++;
+    release_input(mmio);
+    return value;
+  case APEX_MMIO_IN_STATUS:
+    return mmio->in_next < mmio->in_count;
+  default:
+    return 0;
+  }
+}
+
+void mmio_write(APEX_Mmio *mmio, int address, int value)
+{
+  mmio->stores++;
+  if (address == APEX_MMIO_OUT_DATA && mmio->output)
+  {
+    fwrite(&value, sizeof(value), 1, mmio->output);
+    mmio->words_written++;
+  }
+}
+
+void mmio_print_stats(const APEX_Mmio *mmio)
+{
+  printf("|    MMIO accesses\t     |    %ld loads, %ld stores\n", mmio->loads,
+         mmio->stores);
+  printf("|    MMIO words\t\t     |    %ld read of %zu, %ld written\n",
+         mmio->words_read, mmio->in_count, mmio->words_written);
+}
@@ -0,0 +1,72 @@
+#ifndef _APEX_MMIO_H_
+#define _APEX_MMIO_H_
+/**
+ *  mmio.h
+ *  Contains the device of memory mapped I/O. Data memory addresses from
+ *  APEX_MMIO_BASE on are its registers, accessed in Memory2:
+ *
+ *  IN_DATA loads the next word of the input file, 0 past its end.
+ *  IN_STATUS loads 1 while the input file has words left, 0 after.
+ *  OUT_DATA stores append the word to the output file.
+ *
+ *  Other addresses of the region load 0 and ignore stores. A vector load
+ *  or store moves all its elements through the register at its address.
+ *  Files are raw 32-bit words in host byte order. The input is mapped and
+ *  read in place and the pages read are dropped as it goes, so inputs of
+ *  any size stream through without being loaded into data memory; the
+ *  output is written through a buffer. Device accesses are uncached and
+ *  take `latency` cycles in Memory1 instead of the memory latency.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+#include "image.h"
+
+#define APEX_MMIO_BASE 0x40000000
+#define APEX_MMIO_IN_DATA (APEX_MMIO_BASE + 0)
+#define APEX_MMIO_IN_STATUS (APEX_MMIO_BASE + 1)
+#define APEX_MMIO_OUT_DATA (APEX_MMIO_BASE + 2)
+
+#define APEX_MMIO_DEFAULT_LATENCY 20
+
+/* Address in the device region */
+#define APEX_IS_MMIO(address) ((address) >= APEX_MMIO_BASE)
+
+typedef struct APEX_Mmio
+{
+  int latency;
+
+  /* Input words, none if there is no input file */
+  APEX_Mapping input;
+  const int *in_words;
+  size_t in_count;
+  size_t in_next;     // Word IN_DATA loads next
+  size_t in_released; // Words before this one were dropped from memory
+
+  /* Output file, NULL if none */
+  FILE *output;
+  const char *output_name;
+
+  /* Statistics */
+  long loads;
+  long stores;
+  long words_read;
+  long words_written;
+} APEX_Mmio;
+
+APEX_Mmio *mmio_create(const char *input, const char *output, int latency);
+
+void mmio_destroy(APEX_Mmio *mmio);
+
+void mmio_reset(APEX_Mmio *mmio);
+
+int mmio_read(APEX_Mmio *mmio, int address);
+
+void mmio_write(APEX_Mmio *mmio, int address, int value);
+
+void mmio_print_stats(const APEX_Mmio *mmio);
+
+#endif
@@ -0,0 +1,596 @@
+/*
+ *  multicore.c
+ *  Contains the multi-core model with MESI coherent L1 data caches
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "multicore.h"
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Gives the cpu cores - 1 more cores running its program on its data
+ * memory. Display mode runs them on one host thread.
+ */
+APEX_Multicore *
+multicore_create(APEX_CPU *cpu, int cores, int host_threads, int quantum,
+                 int miss_latency)
+{
+  APEX_Multicore *multicore = calloc(1, sizeof(*multicore));
+  if (!multicore)
+  {
+    return NULL;
+  }
+
+  multicore->cores = cores;
+  multicore->host_threads = cpu->debug_messages ? 1 : host_threads;
+  multicore->quantum = quantum;
+  multicore->miss_latency = miss_latency;
+  pthread_mutex_init(&multicore->bus, NULL);
+  pthread_cond_init(&multicore->stepped, NULL);
+
+  multicore->cpu[0] = cpu;
+  cpu->multicore = multicore;
+  cpu->core = 0;
+
+  for (int c = 1; c < cores; ++c)
+  {
+    APEX_CPU *core = APEX_cpu_create(cpu->code_memory, cpu->code_memory_size,
+                                     1, cpu->cycles);
+    if (!core)
+    {
+      multicore_destroy(multicore);
+      cpu->multicore = NULL;
+      return NULL;
+    }
+    core->isSimulate = cpu->isSimulate;
+    core->debug_messages = cpu->debug_messages;
+    core->quiet = cpu->quiet;
+    core->mul_latency = cpu->mul_latency;
+    core->mem_latency = cpu->mem_latency;
+    core->vlen = cpu->vlen;
+    core->vector_lanes = cpu->vector_lanes;
+    core->ras_depth = cpu->ras_depth;
+    core->early_branch = cpu->early_branch;
+
+    free(core->data_memory);
+    core->data_memory = cpu->data_memory;
+    core->data_memory_size = cpu->data_memory_size;
+    core->multicore = multicore;
+    core->core = c;
+    multicore->cpu[c] = core;
+  }
+  return multicore;
+}
+
+/* The data memory stays with core 0 */
+void multicore_destroy(APEX_Multicore *multicore)
+{
+  if (!multicore)
+  {
+    return;
+  }
+  for (int c = 1; c < multicore->cores; ++c)
+  {
+    APEX_CPU *core = multicore->cpu[c];
+    if (core)
+    {
+      core->data_memory = NULL;
+      core->multicore = NULL;
+      APEX_cpu_stop(core);
+    }
+  }
+  pthread_mutex_destroy(&multicore->bus);
+  pthread_cond_destroy(&multicore->stepped);
+  free(multicore);
+}
+
+/* A reservation is lost with the line it is in */
+static void
+drop_reservation(APEX_CPU *cpu, int line)
+{
+  if (cpu->reservation >= 0 && cpu->reservation / APEX_L1_LINE_WORDS == line)
+  {
+    cpu->reservation = -1;
+  }
+}
+
+static void
+evict(APEX_Multicore *multicore, int core, int entry)
+{
+  APEX_L1 *l1 = &multicore->l1[core];
+
+  if (l1->state[entry] == MESI_MODIFIED)
+  {
+    l1->writebacks++;
+  }
+  if (l1->state[entry] != MESI_INVALID)
+  {
+    drop_reservation(multicore->cpu[core], l1->tag[entry]);
+  }
+  l1->state[entry] = MESI_INVALID;
+}
+
+/*
+ * Gets the line into the L1 of the core in a state it can be read or, for
+ * a write, written in. Returns 1 if that took a bus transaction. The other
+ * caches snoop it: a read turns their copies Shared, a write invalidates
+ * them. A Modified copy supplies the data either way. Called with the bus
+ * locked; hits are only counted for the access that is timed.
+ */
+static int
+transaction(APEX_Multicore *multicore, int core, int line, int write,
+            int timed)
+{
+  APEX_L1 *l1 = &multicore->l1[core];
+  int entry = line % APEX_L1_LINES;
+  int present = l1->state[entry] != MESI_INVALID && l1->tag[entry] == line;
+
+  if (present && (!write || l1->state[entry] != MESI_SHARED))
+  {
+    if (write)
+    {
+      l1->state[entry] = MESI_MODIFIED;
+    }
+    l1->hits += timed;
+    return 0;
+  }
+
+  if (present)
+  {
+    l1->upgrades++;
+  }
+  else
+  {
+    l1->misses++;
+    evict(multicore, core, entry);
+  }
+
+  int shared = 0;
+  for (int c = 0; c < multicore->cores; ++c)
+  {
+    APEX_L1 *other = &multicore->l1[c];
+    if (c == core || other->state[entry] == MESI_INVALID ||
+        other->tag[entry] != line)
+    {
+      continue;
+    }
+    if (other->state[entry] == MESI_MODIFIED)
+    {
+      other->interventions++;
+    }
+    if (write)
+    {
+      other->state[entry] = MESI_INVALID;
+      other->invalidations++;
+      drop_reservation(multicore->cpu[c], line);
+    }
+    else
+    {
+      other->state[entry] = MESI_SHARED;
+      shared = 1;
+    }
+  }
+
+  l1->tag[entry] = line;
+  l1->state[entry] = write ? MESI_MODIFIED
+                           : shared ? MESI_SHARED : MESI_EXCLUSIVE;
+  multicore->transactions++;
+  return 1;
+}
+
+/* Cycles of an access by the core, with the bus locked */
+static int
+timed_access(APEX_CPU *cpu, int address, int write)
+{
+  APEX_Multicore *multicore = cpu->multicore;
+  int latency = cpu->mem_latency;
+
+  if (transaction(multicore, cpu->core, address / APEX_L1_LINE_WORDS, write,
+                  1))
+  {
+    int start = multicore->bus_free > cpu->clock ? multicore->bus_free
+                                                 : cpu->clock;
+    multicore->bus_free = start + multicore->miss_latency;
+    multicore->bus_wait_cycles += start - cpu->clock;
+    latency += start - cpu->clock + multicore->miss_latency;
+  }
+  return latency;
+}
+
+/*
+ * Called by Memory1 when an access starts, returns the cycles it takes. A
+ * transaction waits for the bus and holds it for the miss latency.
+ */
+int multicore_access(APEX_CPU *cpu, int address, int write)
+{
+  pthread_mutex_lock(&cpu->multicore->bus);
+  int latency = timed_access(cpu, address, write);
+  pthread_mutex_unlock(&cpu->multicore->bus);
+  return latency;
+}
+
+/*
+ * Cycles the lines of `words` words from `address` add to an access. Their
+ * transactions follow each other on the bus, the last one ends it.
+ */
+int multicore_access_range(APEX_CPU *cpu, int address, int words, int write)
+{
+  int extra = 0;
+
+  pthread_mutex_lock(&cpu->multicore->bus);
+  for (int line = address / APEX_L1_LINE_WORDS;
+       line <= (address + words - 1) / APEX_L1_LINE_WORDS; ++line)
+  {
+    int latency = timed_access(cpu, line * APEX_L1_LINE_WORDS, write);
+    if (latency - cpu->mem_latency > extra)
+    {
+      extra = latency - cpu->mem_latency;
+    }
+  }
+  pthread_mutex_unlock(&cpu->multicore->bus);
+  return extra;
+}
+
+/*
+ * Memory2 performs the access. Another core may have taken the line since
+ * Memory1, it is then fetched again without adding cycles.
+ */
+int multicore_read(APEX_CPU *cpu, int address)
+{
+  APEX_Multicore *multicore = cpu->multicore;
+
+  pthread_mutex_lock(&multicore->bus);
+  transaction(multicore, cpu->core, address / APEX_L1_LINE_WORDS, 0, 0);
+  int value = cpu->data_memory[address];
+  pthread_mutex_unlock(&multicore->bus);
+  return value;
+}
+
+void multicore_write(APEX_CPU *cpu, int address, int value)
+{
+  APEX_Multicore *multicore = cpu->multicore;
+
+  pthread_mutex_lock(&multicore->bus);
+  transaction(multicore, cpu->core, address / APEX_L1_LINE_WORDS, 1, 0);
+  cpu->data_memory[address] = value;
+  pthread_mutex_unlock(&multicore->bus);
+}
+
+int multicore_load_linked(APEX_CPU *cpu, int address)
+{
+  APEX_Multicore *multicore = cpu->multicore;
+
+  pthread_mutex_lock(&multicore->bus);
+  transaction(multicore, cpu->core, address / APEX_L1_LINE_WORDS, 0, 0);
+  int value = cpu->data_memory[address];
+  cpu->reservation = address;
+  pthread_mutex_unlock(&multicore->bus);
+  return value;
+}
+
+/*
+ * Called by Memory1 in place of multicore_access(). The SC is performed as
+ * it gets the line, so no other core takes it while Memory1 waits for the
+ * bus. One that lost its reservation fails without a transaction and
+ * leaves the line to the core that won. Returns 1 if the store was done.
+ */
+int multicore_store_conditional(APEX_CPU *cpu, int address, int value,
+                                int *latency)
+{
+  APEX_Multicore *multicore = cpu->multicore;
+  int stored = 0;
+
+  pthread_mutex_lock(&multicore->bus);
+  *latency = cpu->mem_latency;
+  if (cpu->reservation == address)
+  {
+    *latency = timed_access(cpu, address, 1);
+    cpu->data_memory[address] = value;
+    stored = 1;
+    multicore->sc_successes++;
+  }
+  else
+  {
+    multicore->sc_failures++;
+  }
+  cpu->reservation = -1;
+  pthread_mutex_unlock(&multicore->bus);
+  return stored;
+}
+
+/* The next cycle of the core may access the data memory in Memory1 or 2 */
+static int
+uses_memory(const APEX_CPU *cpu)
+{
+  for (int i = MEM1; i <= MEM2; ++i)
+  {
+    switch (cpu->stage[i].op)
+    {
+    case OP_LOAD:
+    case OP_LDR:
+    case OP_STORE:
+    case OP_STR:
+    case OP_LL:
+    case OP_SC:
+    case OP_VLOAD:
+    case OP_VSTORE:
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * A core may step into a cycle that uses the data memory once every core
+ * numbered below it is past that cycle and every other one has reached
+ * it, with the bus locked if there is more than one host thread
+ */
+static int
+has_turn(const APEX_Multicore *multicore, int core)
+{
+  int clock = multicore->clock[core];
+
+  for (int c = 0; c < multicore->cores; ++c)
+  {
+    if (c < core ? multicore->clock[c] <= clock
+                 : multicore->clock[c] < clock)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* The turn state is only shared with other host threads if there are any */
+static void
+lock_turns(APEX_Multicore *multicore)
+{
+  if (multicore->host_threads > 1)
+  {
+    pthread_mutex_lock(&multicore->bus);
+  }
+}
+
+static void
+unlock_turns(APEX_Multicore *multicore)
+{
+  if (multicore->host_threads > 1)
+  {
+    if (multicore->waiting)
+    {
+      pthread_cond_broadcast(&multicore->stepped);
+    }
+    pthread_mutex_unlock(&multicore->bus);
+  }
+}
+
+/*
+ * Runs the cores of a host thread up to the end of the quantum, a cycle of
+ * each in turn. One that has to wait for cores of other host threads to
+ * catch up lets the others of its thread go on.
+ */
+static void
+run_quantum(APEX_Multicore *multicore, int worker)
+{
+  for (;;)
+  {
+    int running = 0;
+    int stepped = 0;
+
+    lock_turns(multicore);
+    long progress = multicore->progress;
+    unlock_turns(multicore);
+
+    for (int c = worker; c < multicore->cores; c += multicore->host_threads)
+    {
+      APEX_CPU *cpu = multicore->cpu[c];
+      if (cpu->isComplete || cpu->clock >= multicore->until)
+      {
+        continue;
+      }
+      running = 1;
+
+      /* Idle cycles are not skipped into the next quantum or past an access */
+      cpu->skip_until = multicore->until;
+      if (uses_memory(cpu))
+      {
+        lock_turns(multicore);
+        int turn = has_turn(multicore, c);
+        unlock_turns(multicore);
+        if (!turn)
+        {
+          continue;
+        }
+        cpu->skip_until = cpu->clock;
+      }
+
+      if (cpu->debug_messages)
+      {
+        printf("(apex) >> Core %d\n", c);
+      }
+      APEX_cpu_step(cpu);
+      stepped = 1;
+
+      lock_turns(multicore);
+      multicore->clock[c] = cpu->isComplete ? INT_MAX : cpu->clock;
+      multicore->progress++;
+      unlock_turns(multicore);
+    }
+
+    if (!running)
+    {
+      return;
+    }
+
+    /* Only cores of other host threads can hold these back */
+    if (!stepped)
+    {
+      pthread_mutex_lock(&multicore->bus);
+      multicore->waiting++;
+      while (multicore->progress == progress)
+      {
+        pthread_cond_wait(&multicore->stepped, &multicore->bus);
+      }
+      multicore->waiting--;
+      pthread_mutex_unlock(&multicore->bus);
+    }
+  }
+}
+
+/* Moves on to the next quantum, returns 0 once every core completed */
+static int
+next_quantum(APEX_Multicore *multicore)
+{
+  for (int c = 0; c < multicore->cores; ++c)
+  {
+    if (!multicore->cpu[c]->isComplete)
+    {
+      multicore->until += multicore->quantum;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+typedef struct Worker
+{
+  APEX_Multicore *multicore;
+  int index;
+} Worker;
+
+static void *
+worker_main(void *arg)
+{
+  Worker *worker = arg;
+  APEX_Multicore *multicore = worker->multicore;
+
+  /* Waits until every host thread was started */
+  pthread_mutex_lock(&multicore->bus);
+  pthread_mutex_unlock(&multicore->bus);
+
+  do
+  {
+    run_quantum(multicore, worker->index);
+    if (pthread_barrier_wait(&multicore->barrier) ==
+        PTHREAD_BARRIER_SERIAL_THREAD)
+    {
+      multicore->running = next_quantum(multicore);
+    }
+    pthread_barrier_wait(&multicore->barrier);
+  } while (multicore->running);
+  return NULL;
+}
+
+/*
+ * Runs all cores until each one completed. Host thread i simulates the
+ * cores i, i + host_threads, ... The calling thread is host thread 0.
+ */
+int multicore_simulate(APEX_Multicore *multicore)
+{
+  int threads = multicore->host_threads;
+  pthread_t thread[APEX_MAX_CORES];
+  Worker worker[APEX_MAX_CORES];
+  double start = now();
+
+  if (threads > multicore->cores)
+  {
+    threads = multicore->host_threads = multicore->cores;
+  }
+  multicore->until = multicore->quantum;
+  multicore->running = 1;
+  for (int c = 0; c < multicore->cores; ++c)
+  {
+    APEX_CPU *cpu = multicore->cpu[c];
+    multicore->clock[c] = cpu->isComplete ? INT_MAX : cpu->clock;
+  }
+
+  if (threads <= 1)
+  {
+    do
+    {
+      run_quantum(multicore, 0);
+    } while (next_quantum(multicore));
+  }
+  else
+  {
+    /* Fewer threads share the cores if not all of them start */
+    int started = 1;
+    pthread_mutex_lock(&multicore->bus);
+    for (int t = 0; t < threads; ++t)
+    {
+      worker[t].multicore = multicore;
+      worker[t].index = t;
+    }
+    for (int t = 1; t < threads; ++t)
+    {
+      if (pthread_create(&thread[t], NULL, worker_main, &worker[t]) != 0)
+      {
+        break;
+      }
+      started++;
+    }
+    multicore->host_threads = started;
+    pthread_barrier_init(&multicore->barrier, NULL, started);
+    pthread_mutex_unlock(&multicore->bus);
+
+    worker_main(&worker[0]);
+    for (int t = 1; t < started; ++t)
+    {
+      pthread_join(thread[t], NULL);
+    }
+    pthread_barrier_destroy(&multicore->barrier);
+  }
+
+  multicore->seconds = now() - start;
+  return multicore->cpu[0]->isComplete;
+}
+
+void multicore_print_stats(const APEX_Multicore *multicore)
+{
+  int cycles = 0;
+  long instructions = 0;
+
+  for (int c = 0; c < multicore->cores; ++c)
+  {
+    const APEX_CPU *cpu = multicore->cpu[c];
+    const APEX_L1 *l1 = &multicore->l1[c];
+
+    printf("|    Core %d\t\t     |    %d cycles, %d instructions\n", c,
+           cpu->clock, cpu->ins_completed);
+    printf("|    Core %d L1\t\t     |    %ld hits, %ld misses, %ld upgrades\n",
+           c, l1->hits, l1->misses, l1->upgrades);
+    printf("|    Core %d coherence\t     |    %ld invalidated, %ld supplied, "
+           "%ld written back\n",
+           c, l1->invalidations, l1->interventions, l1->writebacks);
+    if (cpu->clock > cycles)
+    {
+      cycles = cpu->clock;
+    }
+    instructions += cpu->ins_completed;
+  }
+
+  printf("|    Parallel cycles\t     |    %d\n", cycles);
+  printf("|    Combined IPC\t     |    %.3f\n",
+         cycles ? (double)instructions / cycles : 0.0);
+  printf("|    Bus transactions\t     |    %ld\n", multicore->transactions);
+  printf("|    Bus wait cycles\t     |    %ld\n", multicore->bus_wait_cycles);
+  printf("|    SC succeeded\t     |    %ld\n", multicore->sc_successes);
+  printf("|    SC failed\t\t     |    %ld\n", multicore->sc_failures);
+  printf("|    Host threads\t     |    %d (quantum %d cycles)\n",
+         multicore->host_threads, multicore->quantum);
+  printf("|    Host seconds\t     |    %.3f\n", multicore->seconds);
+}
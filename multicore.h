@@ -0,0 +1,113 @@
+#ifndef _APEX_MULTICORE_H_
+#define _APEX_MULTICORE_H_
+/**
+ *  multicore.h
+ *  Contains the multi-core model. Every core runs the program on its own
+ *  pipeline and registers over one shared data memory, reached through a
+ *  private L1 data cache. The caches are kept coherent with MESI by
+ *  snooping a bus that carries one transaction at a time. LL reserves an
+ *  address for the SC after it, which fails once another core took the
+ *  line for writing. CPUID gives each core its number.
+ *
+ *  The cores can be simulated on several host threads. They run a quantum
+ *  of cycles each and meet at a barrier before the next one, so no core
+ *  gets further than a quantum ahead of another. Cycles that may reach the
+ *  data memory take turns in simulated time, ordered by cycle and core
+ *  number, so neither the quantum nor the host threads change the result.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <pthread.h>
+
+#include "cpu.h"
+
+#define APEX_MAX_CORES 16
+
+/* Direct mapped L1 data cache */
+#define APEX_L1_LINES 64
+#define APEX_L1_LINE_WORDS 4
+
+#define APEX_DEFAULT_QUANTUM 100
+#define APEX_DEFAULT_MISS_LATENCY 10
+
+/* MESI states of a cache line */
+enum
+{
+  MESI_INVALID,
+  MESI_SHARED,
+  MESI_EXCLUSIVE,
+  MESI_MODIFIED
+};
+
+typedef struct APEX_L1
+{
+  int tag[APEX_L1_LINES]; // Memory line held by each entry
+  unsigned char state[APEX_L1_LINES];
+
+  /* Statistics */
+  long hits;
+  long misses;
+  long upgrades;      // Shared lines written, the other copies invalidated
+  long invalidations; // Lines other cores took for writing
+  long interventions; // Modified lines supplied to other cores
+  long writebacks;    // Modified lines evicted
+} APEX_L1;
+
+typedef struct APEX_Multicore
+{
+  int cores;
+  APEX_CPU *cpu[APEX_MAX_CORES]; // Core 0 is the cpu the model was created on
+  APEX_L1 l1[APEX_MAX_CORES];
+
+  /* The bus, it also orders the data memory accesses of the cores */
+  pthread_mutex_t bus;
+  int bus_free;     // First cycle no transaction holds the bus
+  int miss_latency; // Cycles of a transaction
+  long transactions;
+  long bus_wait_cycles;
+  long sc_successes;
+  long sc_failures;
+
+  /* Host threads and the cycles cores run between barriers */
+  int host_threads;
+  int quantum;
+  int until; // End of the current quantum
+  int running;
+  pthread_barrier_t barrier;
+  double seconds;
+
+  /*
+   * Cycle each core steps next, INT_MAX once it completed, guarded by the
+   * bus lock. A host thread none of whose cores may step waits for
+   * progress, the number of steps taken so far, to change.
+   */
+  int clock[APEX_MAX_CORES];
+  long progress;
+  int waiting;
+  pthread_cond_t stepped;
+} APEX_Multicore;
+
+APEX_Multicore *multicore_create(APEX_CPU *cpu, int cores, int host_threads,
+                                 int quantum, int miss_latency);
+
+void multicore_destroy(APEX_Multicore *multicore);
+
+int multicore_access(APEX_CPU *cpu, int address, int write);
+
+int multicore_access_range(APEX_CPU *cpu, int address, int words, int write);
+
+int multicore_read(APEX_CPU *cpu, int address);
+
+void multicore_write(APEX_CPU *cpu, int address, int value);
+
+int multicore_load_linked(APEX_CPU *cpu, int address);
+
+int multicore_store_conditional(APEX_CPU *cpu, int address, int value,
+                                int *latency);
+
+int multicore_simulate(APEX_Multicore *multicore);
+
+void multicore_print_stats(const APEX_Multicore *multicore);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ *  prefetch.c
+ *  Contains the data cache and the prefetchers
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+APEX_Prefetch *
+prefetch_create(int kind, int degree, int distance, int miss_latency,
+                int memory_size)
+{
+  APEX_Prefetch *prefetch = malloc(sizeof(*prefetch));
+  if (!prefetch)
+  {
+    return NULL;
+  }
+
+  prefetch->kind = kind;
+  prefetch->degree = degree;
+  prefetch->distance = distance;
+  prefetch->miss_latency = miss_latency;
+  prefetch->lines = (memory_size + APEX_DCACHE_LINE_WORDS - 1) /
+                    APEX_DCACHE_LINE_WORDS;
+  prefetch_reset(prefetch);
+  return prefetch;
+}
+
+void prefetch_destroy(APEX_Prefetch *prefetch)
+{
+  free(prefetch);
+}
+
+/* Empty cache, tables and buffers; the settings are kept */
+void prefetch_reset(APEX_Prefetch *prefetch)
+{
+  size_t settings = offsetof(APEX_Prefetch, tag);
+
+  memset((char *)prefetch + settings, 0, sizeof(*prefetch) - settings);
+  for (int i = 0; i < APEX_DCACHE_LINES; ++i)
+  {
+    prefetch->tag[i] = -1;
+  }
+  for (int i = 0; i < APEX_STRIDE_ENTRIES; ++i)
+  {
+    prefetch->stride[i].pc = -1;
+  }
+}
+
+/* Prefetches a line into the cache unless it is there or on its way */
+static void
+issue(APEX_Prefetch *prefetch, int line, int clock)
+{
+  int entry = line % APEX_DCACHE_LINES;
+
+  if (line < 0 || line >= prefetch->lines || prefetch->tag[entry] == line)
+  {
+    return;
+  }
+  prefetch->unused += prefetch->prefetched[entry];
+  prefetch->tag[entry] = line;
+  prefetch->ready[entry] = clock + prefetch->miss_latency;
+  prefetch->prefetched[entry] = 1;
+  prefetch->issued++;
+}
+
+/* Prefetches lines into a stream buffer until it holds degree of them */
+static void
+fill_stream(APEX_Prefetch *prefetch, APEX_StreamBuffer *buffer, int clock)
+{
+  int depth = prefetch->degree < APEX_STREAM_DEPTH ? prefetch->degree
+                                                   : APEX_STREAM_DEPTH;
+
+  while (buffer->count < depth && buffer->next < prefetch->lines)
+  {
+    int line = buffer->next++;
+    if (prefetch->tag[line % APEX_DCACHE_LINES] == line)
+    {
+      continue;
+    }
+    buffer->line[buffer->count] = line;
+    buffer->ready[buffer->count] = clock + prefetch->miss_latency;
+    buffer->count++;
+    prefetch->issued++;
+  }
+}
+
+/* An access used a prefetched line, waiting `wait` cycles for it */
+static void
+count_useful(APEX_Prefetch *prefetch, int wait)
+{
+  prefetch->useful++;
+  prefetch->late += wait > 0;
+  prefetch->hidden_cycles += prefetch->miss_latency - wait;
+}
+
+/*
+ * Takes a line found in a stream buffer into the cache. The lines ahead of
+ * it in the buffer were skipped and are dropped. Returns the cycles the
+ * access waits, -1 if no buffer holds the line.
+ */
+static int
+take_from_stream(APEX_Prefetch *prefetch, int line, int clock)
+{
+  for (int b = 0; b < APEX_STREAM_BUFFERS; ++b)
+  {
+    APEX_StreamBuffer *buffer = &prefetch->stream[b];
+    for (int i = 0; i < buffer->count; ++i)
+    {
+      if (buffer->line[i] != line)
+      {
+        continue;
+      }
+
+      int entry = line % APEX_DCACHE_LINES;
+      int wait = buffer->ready[i] > clock ? buffer->ready[i] - clock : 0;
+      prefetch->unused += i + prefetch->prefetched[entry];
+      prefetch->tag[entry] = line;
+      prefetch->ready[entry] = clock + wait;
+      prefetch->prefetched[entry] = 0;
+
+      buffer->count -= i + 1;
+      memmove(buffer->line, buffer->line + i + 1, buffer->count * sizeof(int));
+      memmove(buffer->ready, buffer->ready + i + 1, buffer->count * sizeof(int));
+      buffer->used = clock;
+      fill_stream(prefetch, buffer, clock);
+      count_useful(prefetch, wait);
+      return wait;
+    }
+  }
+  return -1;
+}
+
+/* A miss no buffer covered restarts the least recently used one after it */
+static void
+allocate_stream(APEX_Prefetch *prefetch, int line, int clock)
+{
+  APEX_StreamBuffer *buffer = &prefetch->stream[0];
+
+  for (int b = 1; b < APEX_STREAM_BUFFERS; ++b)
+  {
+    if (prefetch->stream[b].used < buffer->used)
+    {
+      buffer = &prefetch->stream[b];
+    }
+  }
+  prefetch->unused += buffer->count;
+  buffer->count = 0;
+  buffer->next = line + prefetch->distance;
+  buffer->used = clock;
+  fill_stream(prefetch, buffer, clock);
+}
+
+/*
+ * Once the stride of the instruction at pc repeated, fetches degree lines
+ * from distance strides ahead. Strides shorter than a line step whole
+ * lines in their direction instead, so the lines ahead are other lines.
+ */
+static void
+train_stride(APEX_Prefetch *prefetch, int pc, int address, int clock)
+{
+  APEX_StrideEntry *entry = &prefetch->stride[(pc / 4) % APEX_STRIDE_ENTRIES];
+
+  if (entry->pc != pc)
+  {
+    entry->pc = pc;
+    entry->last_address = address;
+    entry->stride = 0;
+    entry->confidence = 0;
+    return;
+  }
+
+  int stride = address - entry->last_address;
+  entry->last_address = address;
+  if (stride != entry->stride || stride == 0)
+  {
+    entry->stride = stride;
+    entry->confidence = 0;
+    return;
+  }
+  if (entry->confidence < 3)
+  {
+    entry->confidence++;
+  }
+
+  for (int k = 0; k < prefetch->degree; ++k)
+  {
+    int ahead = prefetch->distance + k;
+    if (stride >= APEX_DCACHE_LINE_WORDS || stride <= -APEX_DCACHE_LINE_WORDS)
+    {
+      issue(prefetch, (address + stride * ahead) / APEX_DCACHE_LINE_WORDS,
+            clock);
+    }
+    else
+    {
+      issue(prefetch,
+            address / APEX_DCACHE_LINE_WORDS + (stride > 0 ? ahead : -ahead),
+            clock);
+    }
+  }
+}
+
+/*
+ * Cycles one line of an access waits, 0 on a hit. Sets *trigger when
+ * next-line prefetching goes on after this line.
+ */
+static int
+access_line(APEX_Prefetch *prefetch, int line, int clock, int *trigger)
+{
+  int entry = line % APEX_DCACHE_LINES;
+  int wait;
+
+  prefetch->accesses++;
+  if (prefetch->tag[entry] == line)
+  {
+    wait = prefetch->ready[entry] > clock ? prefetch->ready[entry] - clock : 0;
+    if (prefetch->prefetched[entry])
+    {
+      prefetch->prefetched[entry] = 0;
+      count_useful(prefetch, wait);
+      *trigger = 1;
+    }
+    else
+    {
+      prefetch->hits++;
+    }
+    prefetch->stall_cycles += wait;
+    return wait;
+  }
+
+  wait = take_from_stream(prefetch, line, clock);
+  if (wait >= 0)
+  {
+    prefetch->stall_cycles += wait;
+    return wait;
+  }
+
+  prefetch->misses++;
+  prefetch->stall_cycles += prefetch->miss_latency;
+  prefetch->unused += prefetch->prefetched[entry];
+  prefetch->tag[entry] = line;
+  prefetch->ready[entry] = clock + prefetch->miss_latency;
+  prefetch->prefetched[entry] = 0;
+  *trigger = 1;
+  if (prefetch->kind == APEX_PREFETCH_STREAM)
+  {
+    allocate_stream(prefetch, line, clock);
+  }
+  return prefetch->miss_latency;
+}
+
+/*
+ * Cycles an access of `words` words from address by the instruction at pc,
+ * starting in this clock, waits for its lines beyond the memory latency.
+ * The lines are requested together; the access trains the prefetcher.
+ */
+int prefetch_access(APEX_Prefetch *prefetch, int pc, int address, int words,
+                    int clock)
+{
+  int first = address / APEX_DCACHE_LINE_WORDS;
+  int last = (address + words - 1) / APEX_DCACHE_LINE_WORDS;
+  int wait = 0;
+
+  for (int line = first; line <= last; ++line)
+  {
+    int trigger = 0;
+    int line_wait = access_line(prefetch, line, clock, &trigger);
+    if (line_wait > wait)
+    {
+      wait = line_wait;
+    }
+    if (trigger && prefetch->kind == APEX_PREFETCH_NEXT_LINE)
+    {
+      for (int k = 0; k < prefetch->degree; ++k)
+      {
+        issue(prefetch, line + prefetch->distance + k, clock);
+      }
+    }
+  }
+
+  if (prefetch->kind == APEX_PREFETCH_STRIDE)
+  {
+    train_stride(prefetch, pc, address, clock);
+  }
+  return wait;
+}
+
+void prefetch_print_stats(const APEX_Prefetch *prefetch)
+{
+  static const char *names[] = {"none", "next-line", "stride", "stream"};
+  long unused = prefetch->unused;
+
+  /* Lines still waiting for a use count as unused */
+  for (int i = 0; i < APEX_DCACHE_LINES; ++i)
+  {
+    unused += prefetch->prefetched[i];
+  }
+  for (int b = 0; b < APEX_STREAM_BUFFERS; ++b)
+  {
+    unused += prefetch->stream[b].count;
+  }
+
+  printf("|    Prefetcher\t\t     |    %s, degree %d, distance %d\n",
+         names[prefetch->kind], prefetch->degree, prefetch->distance);
+  printf("|    Data cache\t\t     |    %ld accesses, %ld hits, %ld misses\n",
+         prefetch->accesses, prefetch->hits, prefetch->misses);
+  printf("|    Prefetches\t\t     |    %ld issued, %ld useful, %ld late, "
+         "%ld unused\n",
+         prefetch->issued, prefetch->useful, prefetch->late, unused);
+  printf("|    Prefetch accuracy\t     |    %.1f%%\n",
+         prefetch->issued ? 100.0 * prefetch->useful / prefetch->issued : 0.0);
+  printf("|    Prefetch coverage\t     |    %.1f%%\n",
+         prefetch->useful + prefetch->misses
+             ? 100.0 * prefetch->useful / (prefetch->useful + prefetch->misses)
+             : 0.0);
+  printf("|    Prefetch timeliness     |    %.1f%%\n",
+         prefetch->useful
+             ? 100.0 * (prefetch->useful - prefetch->late) / prefetch->useful
+             : 0.0);
+  printf("|    Memory stall cycles     |    %ld\n", prefetch->stall_cycles);
+  printf("|    Stall cycles hidden     |    %ld (%.1f%%)\n",
+         prefetch->hidden_cycles,
+         prefetch->hidden_cycles + prefetch->stall_cycles
+             ? 100.0 * prefetch->hidden_cycles /
+                   (prefetch->hidden_cycles + prefetch->stall_cycles)
+             : 0.0);
+}
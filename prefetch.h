@@ -0,0 +1,102 @@
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+/**
+ *  prefetch.h
+ *  Contains the data cache of the single-core pipeline and the prefetchers
+ *  trained by Memory1. An access that misses waits miss_latency cycles
+ *  more for its line. The prefetchers see every access and fetch the
+ *  lines they expect next ahead of time:
+ *
+ *  next-line fetches the lines after a missed line, or after a prefetched
+ *  line on its first use, into the cache.
+ *  stride keeps the last address and stride of the instructions at each
+ *  pc and, once a stride repeated, fetches the lines that far ahead.
+ *  stream allocates a stream buffer at each miss that no buffer covers;
+ *  the buffer holds the lines after the missed one. A line is moved into
+ *  the cache once an access finds it in a buffer, which then fetches the
+ *  next one, so streams do not evict lines before they are used.
+ *
+ *  Degree is the number of lines fetched for each trigger, distance how
+ *  far ahead the first one is, in lines or in strides. A line is fetched
+ *  once at a time; prefetches are not limited by a bus.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Direct mapped data cache */
+#define APEX_DCACHE_LINES 64
+#define APEX_DCACHE_LINE_WORDS 4
+
+#define APEX_STRIDE_ENTRIES 16
+#define APEX_STREAM_BUFFERS 4
+#define APEX_STREAM_DEPTH 8
+
+/* Prefetchers */
+enum
+{
+  APEX_PREFETCH_NONE,
+  APEX_PREFETCH_NEXT_LINE,
+  APEX_PREFETCH_STRIDE,
+  APEX_PREFETCH_STREAM,
+};
+
+typedef struct APEX_StrideEntry
+{
+  int pc;
+  int last_address;
+  int stride;
+  int confidence; // Times in a row the stride repeated, up to 3
+} APEX_StrideEntry;
+
+typedef struct APEX_StreamBuffer
+{
+  int line[APEX_STREAM_DEPTH]; // Oldest first
+  int ready[APEX_STREAM_DEPTH]; // Cycle each line arrives in
+  int count;
+  int next; // Line fetched next
+  int used; // Clock of the last hit, for replacement
+} APEX_StreamBuffer;
+
+typedef struct APEX_Prefetch
+{
+  int kind;
+  int degree;
+  int distance;
+  int miss_latency;
+  int lines; // Lines the data memory has
+
+  /* Cache lines, tag -1 while empty */
+  int tag[APEX_DCACHE_LINES];
+  int ready[APEX_DCACHE_LINES]; // Cycle the line arrives in
+  unsigned char prefetched[APEX_DCACHE_LINES]; // Not used since prefetched
+
+  APEX_StrideEntry stride[APEX_STRIDE_ENTRIES];
+  APEX_StreamBuffer stream[APEX_STREAM_BUFFERS];
+
+  /* Statistics */
+  long accesses;
+  long hits;
+  long misses; // Neither in the cache nor prefetched
+  long issued;
+  long useful; // Prefetched lines an access used
+  long late;   // Of those, the ones the access had to wait for
+  long unused; // Prefetched lines evicted or dropped before any use
+  long stall_cycles;  // Cycles accesses waited for lines
+  long hidden_cycles; // Cycles of misses prefetches saved
+} APEX_Prefetch;
+
+APEX_Prefetch *prefetch_create(int kind, int degree, int distance,
+                               int miss_latency, int memory_size);
+
+void prefetch_destroy(APEX_Prefetch *prefetch);
+
+void prefetch_reset(APEX_Prefetch *prefetch);
+
+int prefetch_access(APEX_Prefetch *prefetch, int pc, int address, int words,
+                    int clock);
+
+void prefetch_print_stats(const APEX_Prefetch *prefetch);
+
+#endif
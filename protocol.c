@@ -0,0 +1,81 @@
+/*
+ *  protocol.c
+ *  Contains helpers shared by the simulation server and its client
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+/* FNV-1a over the bytes of the file, its content address */
+int protocol_hash_file(const char *filename, unsigned long long *hash)
+{
+  unsigned char buffer[65536];
+  size_t n;
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+  {
+    return -1;
+  }
+
+  *hash = 0xcbf29ce484222325ULL;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+  {
+    for (size_t i = 0; i < n; ++i)
+    {
+      *hash = (*hash ^ buffer[i]) * 0x100000001b3ULL;
+    }
+  }
+
+  int result = ferror(fp) ? -1 : 0;
+  fclose(fp);
+  return result;
+}
+
+int protocol_read(int fd, void *buffer, size_t length)
+{
+  char *p = buffer;
+
+  while (length > 0)
+  {
+    ssize_t n = read(fd, p, length);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return -1;
+    }
+    p += n;
+    length -= n;
+  }
+  return 0;
+}
+
+/* A peer that went away is an error, not a SIGPIPE */
+int protocol_write(int fd, const void *buffer, size_t length)
+{
+  const char *p = buffer;
+
+  while (length > 0)
+  {
+    ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return -1;
+    }
+    p += n;
+    length -= n;
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef _APEX_PROTOCOL_H_
+#define _APEX_PROTOCOL_H_
+/**
+ *  protocol.h
+ *  Contains the binary request and result messages exchanged with the
+ *  simulation server over its Unix domain socket. A connection carries
+ *  any number of requests, each answered by one result in order.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+
+/* "APXQ" and "APXR" in little endian */
+#define APEX_REQUEST_MAGIC 0x51585041
+#define APEX_RESULT_MAGIC 0x52585041
+#define APEX_PROTOCOL_VERSION 2
+
+/* Request flags */
+#define APEX_REQUEST_HASH 1 // program_hash names a cached program
+#define APEX_REQUEST_PATH 2 // A program path follows the header
+#define APEX_REQUEST_STATS 4 // Count branch and load stall statistics
+
+/* Result status besides the APEX_* run status of apex.h */
+#define APEX_RESULT_UNKNOWN_PROGRAM -10 // Hash not cached and no path given
+#define APEX_RESULT_BAD_PROGRAM -11     // Program could not be loaded
+#define APEX_RESULT_BAD_REQUEST -12     // Malformed request or unsupported mode
+#define APEX_RESULT_NO_MEMORY -13
+
+/*
+ * Request : header followed by `path_length` bytes of program path (no
+ * terminator) and `data_words` words of initial data memory
+ */
+typedef struct APEX_Request
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int flags;
+  int simulate; // Only simulate mode runs on the server
+  int cycles;   // Cycle limit, 0 to run to completion
+  int mul_latency;
+  int mem_latency;
+  unsigned int result_words; // Data memory words returned, from address 0
+  unsigned long long program_hash;
+  unsigned int path_length;
+  unsigned int data_words;
+} APEX_Request;
+
+/* Result : header followed by `memory_words` data memory words */
+typedef struct APEX_Result
+{
+  unsigned int magic;
+  int status;
+  unsigned long long program_hash; // Hash of the program that ran
+  int cycles;
+  int instructions;
+  int mul_busy_cycles;
+  int mem_busy_cycles;
+  int skipped_cycles;
+  int load_stall_cycles;
+  int taken_branches;
+  int branch_flush_cycles;
+  int branch_stall_cycles;
+  unsigned int regs_valid; // Bit r set when register r is valid
+  int regs[16];
+  unsigned int memory_words;
+} APEX_Result;
+
+/* Content address of a program file */
+int protocol_hash_file(const char *filename, unsigned long long *hash);
+
+/* Whole message transfers, -1 on error or end of stream */
+int protocol_read(int fd, void *buffer, size_t length);
+
+int protocol_write(int fd, const void *buffer, size_t length);
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ *  report.c
+ *  Contains the final state report of the changes a run made
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "report.h"
+
+/* Saves the registers and vector registers the run starts with */
+APEX_Report *
+report_create(const APEX_CPU *cpu)
+{
+  APEX_Report *report = calloc(1, sizeof(*report));
+  if (!report)
+  {
+    return NULL;
+  }
+
+  report->pages = (cpu->data_memory_size + APEX_REPORT_PAGE_WORDS - 1) /
+                  APEX_REPORT_PAGE_WORDS;
+  report->initial = calloc(report->pages, sizeof(int *));
+  report->written = malloc(report->pages * sizeof(int));
+  if (!report->initial || !report->written)
+  {
+    report_destroy(report);
+    return NULL;
+  }
+
+  memcpy(report->regs, cpu->regs, sizeof(report->regs));
+  memcpy(report->vregs, cpu->vregs, sizeof(report->vregs));
+  return report;
+}
+
+void report_destroy(APEX_Report *report)
+{
+  if (!report)
+  {
+    return;
+  }
+  for (int i = 0; i < report->written_count; ++i)
+  {
+    free(report->initial[report->written[i]]);
+  }
+  free(report->initial);
+  free(report->written);
+  free(report);
+}
+
+/* Words of data memory in page p */
+static int
+page_words(const APEX_CPU *cpu, int p)
+{
+  long left = cpu->data_memory_size - (long)p * APEX_REPORT_PAGE_WORDS;
+  return left < APEX_REPORT_PAGE_WORDS ? (int)left : APEX_REPORT_PAGE_WORDS;
+}
+
+/*
+ * Called before `words` words of data memory from address are written,
+ * saves the pages they are in if this is their first store. A page that
+ * cannot be saved is compared with zeroes.
+ */
+void report_store(APEX_Report *report, const APEX_CPU *cpu, int address,
+                  int words)
+{
+  int first = address / APEX_REPORT_PAGE_WORDS;
+  int last = (address + words - 1) / APEX_REPORT_PAGE_WORDS;
+
+  for (int p = first; p <= last; ++p)
+  {
+    if (report->initial[p])
+    {
+      continue;
+    }
+    int n = page_words(cpu, p);
+    report->initial[p] = calloc(APEX_REPORT_PAGE_WORDS, sizeof(int));
+    if (!report->initial[p])
+    {
+      continue;
+    }
+    memcpy(report->initial[p], &cpu->data_memory[(long)p * APEX_REPORT_PAGE_WORDS],
+           n * sizeof(int));
+    report->written[report->written_count++] = p;
+  }
+}
+
+static int
+compare_pages(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+/* Prints the registers and memory words that differ from the start */
+void report_print(APEX_Report *report, const APEX_CPU *cpu)
+{
+  printf("=============== CHANGED ARCHITECTURAL REGISTERS ==========\n");
+  for (int i = 0; i < 16; i++)
+  {
+    if (cpu->regs[i] != report->regs[i])
+    {
+      printf("|    REG[%d]\t     |    %d -> %d\n", i, report->regs[i],
+             cpu->regs[i]);
+    }
+  }
+
+  printf("============== CHANGED DATA MEMORY =============\n");
+  qsort(report->written, report->written_count, sizeof(int), compare_pages);
+  for (int i = 0; i < report->written_count; ++i)
+  {
+    int p = report->written[i];
+    const int *memory = &cpu->data_memory[(long)p * APEX_REPORT_PAGE_WORDS];
+    for (int w = 0; w < page_words(cpu, p); ++w)
+    {
+      if (memory[w] != report->initial[p][w])
+      {
+        printf("|    MEM[%ld]\t     |    %d -> %d\n",
+               (long)p * APEX_REPORT_PAGE_WORDS + w, report->initial[p][w],
+               memory[w]);
+      }
+    }
+  }
+
+  if (cpu->vector_instructions > 0)
+  {
+    printf("============== CHANGED VECTOR REGISTERS =============\n");
+    for (int v = 0; v < APEX_VECTOR_REGS; v++)
+    {
+      for (int i = 0; i < cpu->vlen; i++)
+      {
+        int at = v * APEX_MAX_VLEN + i;
+        if (cpu->vregs[at] != report->vregs[at])
+        {
+          printf("|    VREG[%d][%d]\t     |    %d -> %d\n", v, i,
+                 report->vregs[at], cpu->vregs[at]);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef _APEX_REPORT_H_
+#define _APEX_REPORT_H_
+/**
+ *  report.h
+ *  Contains the final state report of the changes a run made. Data memory
+ *  is tracked in pages: the first store to a page saves what the page held
+ *  at the start, so the report only compares the pages that were written.
+ *  Registers and vector registers are compared with their values at the
+ *  start.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+#define APEX_REPORT_PAGE_WORDS 256
+
+typedef struct APEX_Report
+{
+  int regs[16];
+  int vregs[APEX_VECTOR_REGS * APEX_MAX_VLEN];
+
+  /* Contents of each page at the start, NULL while nothing wrote the page */
+  int **initial;
+  int pages;
+
+  /* Pages written, in the order of their first store */
+  int *written;
+  int written_count;
+} APEX_Report;
+
+APEX_Report *report_create(const APEX_CPU *cpu);
+
+void report_destroy(APEX_Report *report);
+
+void report_store(APEX_Report *report, const APEX_CPU *cpu, int address,
+                  int words);
+
+void report_print(APEX_Report *report, const APEX_CPU *cpu);
+
+#endif
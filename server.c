@@ -0,0 +1,458 @@
+/*
+ *  server.c
+ *  Contains the simulation server and its program cache
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "protocol.h"
+#include "server.h"
+
+/* Requests larger than this are rejected */
+#define MAX_PATH_LENGTH 4096
+#define MAX_DATA_WORDS (1 << 26)
+
+static volatile sig_atomic_t stopping;
+
+static void
+stop_serving(int signal)
+{
+  (void)signal;
+  stopping = 1;
+}
+
+static APEX_CachedProgram *
+find_program(APEX_Server *server, unsigned long long hash)
+{
+  for (int i = 0; i < server->cache_count; ++i)
+  {
+    if (server->cache[i].hash == hash)
+    {
+      return &server->cache[i];
+    }
+  }
+  return NULL;
+}
+
+/* Takes a cached program for a run, with the lock held */
+static APEX_Program *
+use_program(APEX_Server *server, APEX_CachedProgram *entry)
+{
+  entry->users++;
+  entry->used = ++server->uses;
+  server->cache_hits++;
+  return entry->program;
+}
+
+/*
+ * Adds a freshly loaded program, with the lock held. The least recently
+ * used idle entry makes room once the cache is full; if every entry is in
+ * use the cache grows instead.
+ */
+static APEX_Program *
+insert_program(APEX_Server *server, unsigned long long hash,
+               APEX_Program *program)
+{
+  APEX_CachedProgram *entry = NULL;
+
+  if (server->cache_count == server->cache_capacity)
+  {
+    for (int i = 0; i < server->cache_count; ++i)
+    {
+      APEX_CachedProgram *candidate = &server->cache[i];
+      if (candidate->users == 0 && (!entry || candidate->used < entry->used))
+      {
+        entry = candidate;
+      }
+    }
+    if (entry)
+    {
+      apex_program_free(entry->program);
+    }
+    else
+    {
+      int capacity = server->cache_capacity * 2;
+      APEX_CachedProgram *cache = realloc(server->cache,
+                                          capacity * sizeof(*cache));
+      if (!cache)
+      {
+        return NULL;
+      }
+      server->cache = cache;
+      server->cache_capacity = capacity;
+    }
+  }
+  if (!entry)
+  {
+    entry = &server->cache[server->cache_count++];
+  }
+
+  entry->hash = hash;
+  entry->program = program;
+  entry->users = 1;
+  entry->used = ++server->uses;
+  return program;
+}
+
+/*
+ * Finds the program of a request: by hash alone while it is cached,
+ * otherwise by hashing and, on a miss, parsing the file at its path
+ */
+static APEX_Program *
+acquire_program(APEX_Server *server, const APEX_Request *request,
+                const char *path, unsigned long long *hash, int *status)
+{
+  APEX_CachedProgram *entry;
+  APEX_Program *program = NULL;
+
+  pthread_mutex_lock(&server->lock);
+  if ((request->flags & APEX_REQUEST_HASH) &&
+      (entry = find_program(server, request->program_hash)))
+  {
+    *hash = entry->hash;
+    program = use_program(server, entry);
+  }
+  pthread_mutex_unlock(&server->lock);
+  if (program)
+  {
+    return program;
+  }
+
+  if (!(request->flags & APEX_REQUEST_PATH))
+  {
+    *status = APEX_RESULT_UNKNOWN_PROGRAM;
+    return NULL;
+  }
+  if (protocol_hash_file(path, hash) < 0)
+  {
+    *status = APEX_RESULT_BAD_PROGRAM;
+    return NULL;
+  }
+
+  pthread_mutex_lock(&server->lock);
+  if ((entry = find_program(server, *hash)))
+  {
+    program = use_program(server, entry);
+  }
+  pthread_mutex_unlock(&server->lock);
+  if (program)
+  {
+    return program;
+  }
+
+  APEX_Program *loaded = apex_program_load(path);
+  if (!loaded)
+  {
+    *status = APEX_RESULT_BAD_PROGRAM;
+    return NULL;
+  }
+
+  /* Another worker may have loaded the same program meanwhile */
+  pthread_mutex_lock(&server->lock);
+  if ((entry = find_program(server, *hash)))
+  {
+    program = use_program(server, entry);
+  }
+  else
+  {
+    program = insert_program(server, *hash, loaded);
+  }
+  pthread_mutex_unlock(&server->lock);
+
+  if (program != loaded)
+  {
+    apex_program_free(loaded);
+  }
+  if (!program)
+  {
+    *status = APEX_RESULT_NO_MEMORY;
+  }
+  return program;
+}
+
+static void
+release_program(APEX_Server *server, unsigned long long hash)
+{
+  pthread_mutex_lock(&server->lock);
+  APEX_CachedProgram *entry = find_program(server, hash);
+  if (entry)
+  {
+    entry->users--;
+  }
+  pthread_mutex_unlock(&server->lock);
+}
+
+/* Runs one request, the result memory words are returned in *memory */
+static void
+run_request(APEX_Server *server, const APEX_Request *request,
+            const char *path, const int *data, APEX_Result *result,
+            int **memory)
+{
+  unsigned long long hash = 0;
+  int status = APEX_RESULT_BAD_REQUEST;
+
+  memset(result, 0, sizeof(*result));
+  result->magic = APEX_RESULT_MAGIC;
+  *memory = NULL;
+
+  /* Display mode prints every cycle, it only runs in apex_sim itself */
+  APEX_Program *program = request->simulate
+                              ? acquire_program(server, request, path,
+                                                &hash, &status)
+                              : NULL;
+  if (!program)
+  {
+    result->status = status;
+    return;
+  }
+  result->program_hash = hash;
+
+  APEX_CPU *cpu = apex_create(program, request->cycles);
+  if (!cpu || apex_load_memory(cpu, data, request->data_words) < 0)
+  {
+    apex_destroy(cpu);
+    release_program(server, hash);
+    result->status = APEX_RESULT_NO_MEMORY;
+    return;
+  }
+  apex_set_latency(cpu, request->mul_latency, request->mem_latency);
+  cpu->show_stats = (request->flags & APEX_REQUEST_STATS) != 0;
+
+  result->status = apex_run(cpu);
+  result->cycles = cpu->clock;
+  result->instructions = cpu->ins_completed;
+  result->mul_busy_cycles = cpu->busy_cycles[EX1];
+  result->mem_busy_cycles = cpu->busy_cycles[MEM1];
+  result->skipped_cycles = cpu->skipped_cycles;
+  result->load_stall_cycles = cpu->load_stall_cycles;
+  result->taken_branches = cpu->taken_branches;
+  result->branch_flush_cycles = cpu->branch_flush_cycles;
+  result->branch_stall_cycles = cpu->branch_stall_cycles;
+  for (int i = 0; i < 16; ++i)
+  {
+    result->regs[i] = cpu->regs[i];
+    result->regs_valid |= (cpu->regs_valid[i] != 0) << i;
+  }
+
+  long words = request->result_words;
+  if (words > cpu->data_memory_size)
+  {
+    words = cpu->data_memory_size;
+  }
+  *memory = malloc(words * sizeof(int) + 1);
+  if (*memory)
+  {
+    memcpy(*memory, cpu->data_memory, words * sizeof(int));
+    result->memory_words = words;
+  }
+
+  apex_destroy(cpu);
+  release_program(server, hash);
+}
+
+/* Answers the requests of one connection until the client closes it */
+static void
+serve_connection(APEX_Server *server, int fd)
+{
+  APEX_Request request;
+  APEX_Result result;
+  char path[MAX_PATH_LENGTH + 1];
+
+  while (protocol_read(fd, &request, sizeof(request)) == 0)
+  {
+    if (request.magic != APEX_REQUEST_MAGIC ||
+        request.version != APEX_PROTOCOL_VERSION ||
+        request.path_length > MAX_PATH_LENGTH ||
+        request.data_words > MAX_DATA_WORDS)
+    {
+      memset(&result, 0, sizeof(result));
+      result.magic = APEX_RESULT_MAGIC;
+      result.status = APEX_RESULT_BAD_REQUEST;
+      protocol_write(fd, &result, sizeof(result));
+      return;
+    }
+
+    int *data = malloc(request.data_words * sizeof(int) + 1);
+    if (!data ||
+        protocol_read(fd, path, request.path_length) < 0 ||
+        protocol_read(fd, data, request.data_words * sizeof(int)) < 0)
+    {
+      free(data);
+      return;
+    }
+    path[request.path_length] = '\0';
+
+    int *memory;
+    run_request(server, &request, path, data, &result, &memory);
+    free(data);
+
+    pthread_mutex_lock(&server->lock);
+    server->requests++;
+    pthread_mutex_unlock(&server->lock);
+
+    int failed = protocol_write(fd, &result, sizeof(result)) < 0 ||
+                 protocol_write(fd, memory,
+                                result.memory_words * sizeof(int)) < 0;
+    free(memory);
+    if (failed)
+    {
+      return;
+    }
+  }
+}
+
+static void *
+worker(void *arg)
+{
+  APEX_Server *server = arg;
+
+  while (1)
+  {
+    pthread_mutex_lock(&server->lock);
+    while (server->queue_count == 0)
+    {
+      pthread_cond_wait(&server->ready, &server->lock);
+    }
+    int fd = server->queue[server->queue_head];
+    server->queue_head = (server->queue_head + 1) % server->queue_capacity;
+    server->queue_count--;
+    pthread_mutex_unlock(&server->lock);
+
+    serve_connection(server, fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+/* Hands a connection to the workers, refused while the queue is full */
+static void
+enqueue(APEX_Server *server, int fd)
+{
+  pthread_mutex_lock(&server->lock);
+  if (server->queue_count == server->queue_capacity)
+  {
+    pthread_mutex_unlock(&server->lock);
+    close(fd);
+    return;
+  }
+  int tail = (server->queue_head + server->queue_count) %
+             server->queue_capacity;
+  server->queue[tail] = fd;
+  server->queue_count++;
+  pthread_cond_signal(&server->ready);
+  pthread_mutex_unlock(&server->lock);
+}
+
+static int
+open_socket(const char *socket_path)
+{
+  struct sockaddr_un address;
+
+  if (strlen(socket_path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "APEX_Error : Socket path %s is too long\n", socket_path);
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  /* A socket file left behind by a previous server is replaced */
+  unlink(socket_path);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(fd, APEX_SERVER_BACKLOG) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int server_run(const char *socket_path, int workers, int cache_entries)
+{
+  APEX_Server server;
+  struct sigaction action;
+
+  memset(&server, 0, sizeof(server));
+  server.queue_capacity = workers * APEX_SERVER_BACKLOG;
+  server.queue = calloc(server.queue_capacity, sizeof(int));
+  server.cache_capacity = cache_entries;
+  server.cache = calloc(server.cache_capacity, sizeof(*server.cache));
+  if (!server.queue || !server.cache)
+  {
+    free(server.queue);
+    free(server.cache);
+    return -1;
+  }
+  pthread_mutex_init(&server.lock, NULL);
+  pthread_cond_init(&server.ready, NULL);
+
+  server.listen_fd = open_socket(socket_path);
+  if (server.listen_fd < 0)
+  {
+    fprintf(stderr, "APEX_Error : Unable to listen on %s\n", socket_path);
+    free(server.queue);
+    free(server.cache);
+    return -1;
+  }
+
+  /* No SA_RESTART, so a signal interrupts accept() */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop_serving;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  for (int i = 0; i < workers; ++i)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker, &server) != 0)
+    {
+      fprintf(stderr, "APEX_Error : Unable to start worker %d\n", i);
+      stopping = 1;
+      break;
+    }
+    pthread_detach(thread);
+  }
+
+  fprintf(stderr, "APEX_Server : Listening on %s with %d workers\n",
+          socket_path, workers);
+  while (!stopping)
+  {
+    int fd = accept(server.listen_fd, NULL, NULL);
+    if (fd >= 0)
+    {
+      enqueue(&server, fd);
+    }
+    else if (errno != EINTR && errno != ECONNABORTED)
+    {
+      break;
+    }
+  }
+
+  close(server.listen_fd);
+  unlink(socket_path);
+
+  /* Workers are detached, in-flight runs end with the process */
+  pthread_mutex_lock(&server.lock);
+  fprintf(stderr, "APEX_Server : %ld requests, %ld program cache hits, "
+                  "%d programs cached\n",
+          server.requests, server.cache_hits, server.cache_count);
+  pthread_mutex_unlock(&server.lock);
+  return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef _APEX_SERVER_H_
+#define _APEX_SERVER_H_
+/**
+ *  server.h
+ *  Contains the simulation server. It listens on a Unix domain socket,
+ *  runs the requests of protocol.h on a pool of worker threads and keeps
+ *  parsed programs in a cache addressed by the hash of their contents,
+ *  so repeated runs of a program are not parsed again.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <pthread.h>
+
+#include "apex.h"
+
+#define APEX_SERVER_DEFAULT_WORKERS 4
+#define APEX_SERVER_DEFAULT_CACHE 256
+#define APEX_SERVER_BACKLOG 64
+
+/* A parsed program and the runs using it */
+typedef struct APEX_CachedProgram
+{
+  unsigned long long hash;
+  APEX_Program *program;
+  int users;          // Runs in progress, the entry is not evicted while > 0
+  unsigned long used; // Last use, the least recently used entry is evicted
+} APEX_CachedProgram;
+
+typedef struct APEX_Server
+{
+  int listen_fd;
+
+  /* Accepted connections waiting for a worker */
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  int *queue;
+  int queue_capacity;
+  int queue_head;
+  int queue_count;
+
+  /* Program cache, guarded by lock */
+  APEX_CachedProgram *cache;
+  int cache_capacity;
+  int cache_count;
+  unsigned long uses;
+
+  /* Statistics, guarded by lock */
+  long requests;
+  long cache_hits;
+} APEX_Server;
+
+/* Serves requests on the socket until SIGINT or SIGTERM */
+int server_run(const char *socket_path, int workers, int cache_entries);
+
+#endif
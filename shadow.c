@@ -0,0 +1,536 @@
+/*
+ *  shadow.c
+ *  Contains the functional shadow of the pipeline and the capture of
+ *  pipeline state
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "shadow.h"
+
+#define BIND_NONE -2
+
+APEX_Shadow *
+shadow_create(APEX_CPU *cpu)
+{
+  APEX_Shadow *shadow = calloc(1, sizeof(*shadow));
+  if (!shadow)
+  {
+    return NULL;
+  }
+
+  memcpy(shadow->state.regs, cpu->regs, sizeof(shadow->state.regs));
+  shadow->state.zflag = cpu->zFlag;
+  shadow->state.memory = cpu->data_memory;
+  shadow->state.memory_size = cpu->data_memory_size;
+  shadow->state.defer_stores = 1;
+  shadow->expected_pc = cpu->pc;
+  return shadow;
+}
+
+void shadow_destroy(APEX_Shadow *shadow)
+{
+  free(shadow);
+}
+
+const APEX_Instruction *
+shadow_instruction(APEX_CPU *cpu, int pc)
+{
+  int index = (pc - 4000) / 4;
+  if (pc < 4000 || pc % 4 || index >= cpu->code_memory_size)
+  {
+    return NULL;
+  }
+  return &cpu->code_memory[index];
+}
+
+static void
+push_record(APEX_Shadow *shadow, const APEX_FuncRecord *record)
+{
+  shadow->ring[shadow->ring_head] = *record;
+  shadow->ring_head = (shadow->ring_head + 1) % APEX_SHADOW_RING;
+  shadow->executed++;
+  shadow->branches += record->next_pc != record->pc + 4;
+}
+
+/* Results of a record and of the pipeline latch it was executed for agree */
+static int
+agrees(const APEX_Instruction *ins, const APEX_FuncRecord *record,
+       const CPU_Stage *stage)
+{
+  switch (ins->op)
+  {
+  case OP_LOAD:
+  case OP_LDR:
+    return record->address == stage->buffer;
+  case OP_STORE:
+  case OP_STR:
+    return record->result == stage->rs1_value;
+  case OP_BZ:
+  case OP_BNZ:
+  case OP_JUMP:
+    return (record->next_pc != stage->pc + 4) == stage->taken;
+  case OP_HALT:
+    return 1;
+  default:
+    return record->result == stage->buffer;
+  }
+}
+
+/*
+ * Called for every instruction leaving Execute2. Runs it on the
+ * functional executor and checks that both agree on what it does.
+ */
+void shadow_execute(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+  APEX_Shadow *shadow = cpu->shadow;
+  const APEX_Instruction *ins = shadow_instruction(cpu, stage->pc);
+  APEX_FuncRecord record;
+
+  if (shadow->broken)
+  {
+    return;
+  }
+
+  /*
+   * A stalled Decode/RF leaves its instruction in Execute1 as well, so the
+   * same instruction can leave Execute2 twice in a row. The copy has to
+   * repeat the results of the first one.
+   */
+  const APEX_FuncRecord *last =
+      &shadow->ring[(shadow->ring_head + APEX_SHADOW_RING - 1) %
+                    APEX_SHADOW_RING];
+  if (ins && stage->pc != shadow->expected_pc && shadow->executed &&
+      stage->pc == last->pc)
+  {
+    if (!agrees(ins, last, stage))
+    {
+      shadow->broken = 1;
+    }
+    else if (ins->op == OP_STORE || ins->op == OP_STR)
+    {
+      shadow->duplicate_stores++;
+    }
+    return;
+  }
+
+  if (!ins || stage->pc != shadow->expected_pc ||
+      functional_step(&shadow->state, ins, stage->pc, &record) < 0 ||
+      !agrees(ins, &record, stage))
+  {
+    shadow->broken = 1;
+    return;
+  }
+
+  push_record(shadow, &record);
+  shadow->expected_pc = record.next_pc;
+}
+
+/*
+ * Called when Memory2 writes data memory, retires the matching store of
+ * the shadow
+ */
+void shadow_store(APEX_CPU *cpu, int address, int value)
+{
+  APEX_Shadow *shadow = cpu->shadow;
+
+  if (shadow->broken)
+  {
+    return;
+  }
+
+  /* A repeated store writes what the one before it wrote */
+  if (shadow->duplicate_stores && address == shadow->last_store_address &&
+      value == shadow->last_store_value)
+  {
+    shadow->duplicate_stores--;
+    return;
+  }
+
+  if (functional_retire_store(&shadow->state, address, value) < 0)
+  {
+    shadow->broken = 1;
+    return;
+  }
+  shadow->last_store_address = address;
+  shadow->last_store_value = value;
+}
+
+/* Stores executed by the shadow that the pipeline has not written yet */
+int shadow_stores_in_flight(const APEX_Shadow *shadow)
+{
+  return shadow->state.pending_count + shadow->duplicate_stores;
+}
+
+/*
+ * Executes count instructions from pc in place of the pipeline, stores
+ * go straight to data memory. Returns how many were executed, which is
+ * less than count if one of them failed.
+ */
+int shadow_run(APEX_CPU *cpu, int pc, int count, APEX_FuncRecord *records)
+{
+  APEX_Shadow *shadow = cpu->shadow;
+  int executed = 0;
+
+  shadow->state.defer_stores = 0;
+  while (executed < count)
+  {
+    const APEX_Instruction *ins = shadow_instruction(cpu, pc);
+    if (!ins || functional_step(&shadow->state, ins, pc, &records[executed]) < 0)
+    {
+      break;
+    }
+    push_record(shadow, &records[executed]);
+    pc = records[executed++].next_pc;
+  }
+  shadow->state.defer_stores = 1;
+  shadow->expected_pc = pc;
+  return executed;
+}
+
+void shadow_mark(const APEX_Shadow *shadow, APEX_ShadowMark *mark)
+{
+  memcpy(mark->regs, shadow->state.regs, sizeof(mark->regs));
+  mark->zflag = shadow->state.zflag;
+  memcpy(mark->ring, shadow->ring, sizeof(mark->ring));
+  mark->ring_head = shadow->ring_head;
+  mark->expected_pc = shadow->expected_pc;
+  mark->executed = shadow->executed;
+  mark->branches = shadow->branches;
+}
+
+/* Undoes the records executed by shadow_run since the mark */
+void shadow_rollback(APEX_Shadow *shadow, const APEX_ShadowMark *mark,
+                     const APEX_FuncRecord *records, int count)
+{
+  while (count--)
+  {
+    if (records[count].op == OP_STORE || records[count].op == OP_STR)
+    {
+      shadow->state.memory[records[count].address] = records[count].old;
+    }
+  }
+
+  memcpy(shadow->state.regs, mark->regs, sizeof(mark->regs));
+  shadow->state.zflag = mark->zflag;
+  memcpy(shadow->ring, mark->ring, sizeof(mark->ring));
+  shadow->ring_head = mark->ring_head;
+  shadow->expected_pc = mark->expected_pc;
+  shadow->executed = mark->executed;
+  shadow->branches = mark->branches;
+}
+
+/*
+ * Control part of the pipeline state. Cycle numbers are stored relative
+ * to the clock so that states reached at different times compare equal.
+ */
+void shadow_capture_control(APEX_CPU *cpu, int *control)
+{
+  int n = 0;
+
+  memset(control, 0, sizeof(int) * APEX_SHADOW_CONTROL);
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    const CPU_Stage *stage = &cpu->stage[i];
+    control[n++] = stage->pc;
+    memcpy(&control[n], stage->opcode, sizeof(stage->opcode));
+    n += sizeof(stage->opcode) / sizeof(int);
+    control[n++] = stage->op;
+    control[n++] = stage->rd;
+    control[n++] = stage->rs1;
+    control[n++] = stage->rs2;
+    control[n++] = stage->rs3;
+    control[n++] = stage->imm;
+    control[n++] = stage->busy;
+    control[n++] = stage->stalled;
+    control[n++] = stage->flush;
+    control[n++] = stage->taken;
+  }
+
+  control[n++] = cpu->pc;
+  control[n++] = cpu->isBranchOrJumpTaken;
+  control[n++] = cpu->isForwarded;
+  control[n++] = cpu->branchPcValue;
+  for (int i = 0; i < 16; ++i)
+  {
+    control[n++] = cpu->regs_valid[i];
+  }
+  control[n++] = cpu->zcounter;
+  control[n++] = cpu->bnzcounter;
+  control[n++] = cpu->hold_stage;
+  control[n++] = cpu->hold_stage >= 0 ? cpu->hold_until - cpu->clock : 0;
+
+  /* The heap layout is deterministic, so it compares as it is */
+  control[n++] = cpu->events.count;
+  for (int i = 0; i < cpu->events.count; ++i)
+  {
+    control[n++] = cpu->events.heap[i].cycle - cpu->clock;
+    control[n++] = cpu->events.heap[i].kind;
+  }
+}
+
+/* Inverse of shadow_capture_control at the current clock */
+void shadow_restore_control(APEX_CPU *cpu, const int *control)
+{
+  int n = 0;
+
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    CPU_Stage *stage = &cpu->stage[i];
+    stage->pc = control[n++];
+    memcpy(stage->opcode, &control[n], sizeof(stage->opcode));
+    n += sizeof(stage->opcode) / sizeof(int);
+    stage->op = control[n++];
+    stage->rd = control[n++];
+    stage->rs1 = control[n++];
+    stage->rs2 = control[n++];
+    stage->rs3 = control[n++];
+    stage->imm = control[n++];
+    stage->busy = control[n++];
+    stage->stalled = control[n++];
+    stage->flush = control[n++];
+    stage->taken = control[n++];
+  }
+
+  cpu->pc = control[n++];
+  cpu->isBranchOrJumpTaken = control[n++];
+  cpu->isForwarded = control[n++];
+  cpu->branchPcValue = control[n++];
+  for (int i = 0; i < 16; ++i)
+  {
+    cpu->regs_valid[i] = control[n++];
+  }
+  cpu->zcounter = control[n++];
+  cpu->bnzcounter = control[n++];
+  cpu->hold_stage = control[n++];
+  cpu->hold_until = cpu->clock + control[n++];
+
+  cpu->events.count = control[n++];
+  for (int i = 0; i < cpu->events.count; ++i)
+  {
+    cpu->events.heap[i].cycle = cpu->clock + control[n++];
+    cpu->events.heap[i].kind = control[n++];
+  }
+}
+
+void shadow_counters(APEX_CPU *cpu, int *counters)
+{
+  counters[0] = cpu->ins_completed;
+  counters[1] = cpu->skipped_cycles;
+  counters[2] = cpu->load_stall_cycles;
+  counters[3] = cpu->taken_branches;
+  counters[4] = cpu->branch_flush_cycles;
+  counters[5] = cpu->branch_stall_cycles;
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    counters[6 + i] = cpu->busy_cycles[i];
+  }
+}
+
+/*
+ * Moves the clock forward by `times` spans of `cycles` cycles that were
+ * not simulated, each adding counter_delta to the statistics
+ */
+void shadow_advance(APEX_CPU *cpu, int cycles, const int *counter_delta,
+                    long times)
+{
+  int shift = (int)(cycles * times);
+
+  cpu->clock += shift;
+  cpu->ins_completed += times * counter_delta[0];
+  cpu->skipped_cycles += times * counter_delta[1];
+  cpu->load_stall_cycles += times * counter_delta[2];
+  cpu->taken_branches += times * counter_delta[3];
+  cpu->branch_flush_cycles += times * counter_delta[4];
+  cpu->branch_stall_cycles += times * counter_delta[5];
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    cpu->busy_cycles[i] += times * counter_delta[6 + i];
+  }
+  if (cpu->hold_stage >= 0)
+  {
+    cpu->hold_until += shift;
+  }
+  for (int i = 0; i < cpu->events.count; ++i)
+  {
+    cpu->events.heap[i].cycle += shift;
+  }
+}
+
+/* Value slots in a fixed order, pc tells which latch a slot is in */
+static int *
+slot_address(APEX_CPU *cpu, int slot, int *pc)
+{
+  *pc = 0;
+  if (slot < NUM_STAGES * 5)
+  {
+    CPU_Stage *stage = &cpu->stage[slot / 5];
+    int *fields[5] = {&stage->rs1_value, &stage->rs2_value, &stage->rs3_value,
+                      &stage->buffer, &stage->mem_address};
+    *pc = stage->pc;
+    return fields[slot % 5];
+  }
+
+  slot -= NUM_STAGES * 5;
+  if (slot < 16)
+  {
+    return &cpu->regs[slot];
+  }
+
+  slot -= 16;
+  if (slot < 16)
+  {
+    return &cpu->forwardedValues[slot];
+  }
+  return &cpu->zFlag;
+}
+
+static void
+gather_sources(const APEX_Shadow *shadow, int *sources, int *source_pc)
+{
+  int n = 0;
+
+  for (int age = 0; age < APEX_SHADOW_RING; ++age)
+  {
+    const APEX_FuncRecord *record =
+        &shadow->ring[(shadow->ring_head + 2 * APEX_SHADOW_RING - 1 - age) %
+                      APEX_SHADOW_RING];
+    int values[APEX_SHADOW_RECORD_VALUES] = {
+        record->result, record->operand[0], record->operand[1],
+        record->operand[2], record->address, record->old,
+        record->result == 0};
+
+    for (int i = 0; i < APEX_SHADOW_RECORD_VALUES; ++i)
+    {
+      source_pc[n] = record->pc;
+      sources[n++] = values[i];
+    }
+  }
+
+  for (int i = 0; i < 16; ++i)
+  {
+    source_pc[n] = 0;
+    sources[n++] = shadow->state.regs[i];
+  }
+  source_pc[n] = 0;
+  sources[n++] = shadow->state.zflag;
+}
+
+void shadow_observe(APEX_CPU *cpu, APEX_Observation *observation)
+{
+  for (int i = 0; i < APEX_SHADOW_SLOTS; ++i)
+  {
+    observation->slots[i] = *slot_address(cpu, i, &observation->slot_pc[i]);
+  }
+  gather_sources(cpu->shadow, observation->sources, observation->source_pc);
+}
+
+static int
+source_matches(const APEX_Observation *const *observations, int count,
+               int slot, int source)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    if (observations[i]->slots[slot] != observations[i]->sources[source])
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Shadow value a register, forwarded value or zero flag slot mirrors */
+static int
+register_source(int slot)
+{
+  int reg = slot - NUM_STAGES * 5;
+  int first = APEX_SHADOW_RING * APEX_SHADOW_RECORD_VALUES;
+
+  if (reg < 0)
+  {
+    return -1;
+  }
+  return reg < 32 ? first + reg % 16 : first + 16;
+}
+
+/*
+ * Finds where every slot takes its value from, given observations of
+ * the same control state. A latch value prefers the record of the
+ * instruction in that latch and a register the same shadow register,
+ * a value that is loop invariant in the observations would otherwise
+ * be kept as it is. Other unchanging values are kept, anything else
+ * has to follow one of the sources. Returns -1 if a slot follows none
+ * of them.
+ */
+int shadow_bind(const APEX_Observation *const *observations, int count,
+                int *binding)
+{
+  const APEX_Observation *last = observations[count - 1];
+
+  for (int slot = 0; slot < APEX_SHADOW_SLOTS; ++slot)
+  {
+    int constant = 1;
+    binding[slot] = BIND_NONE;
+
+    for (int i = 0; i < count - 1; ++i)
+    {
+      constant &= observations[i]->slots[slot] == last->slots[slot];
+    }
+
+    if (last->slot_pc[slot])
+    {
+      for (int s = 0; s < APEX_SHADOW_SOURCES; ++s)
+      {
+        if (last->source_pc[s] == last->slot_pc[slot] &&
+            source_matches(observations, count, slot, s))
+        {
+          binding[slot] = s;
+          break;
+        }
+      }
+    }
+
+    int source = register_source(slot);
+    if (source >= 0 && source_matches(observations, count, slot, source))
+    {
+      binding[slot] = source;
+    }
+
+    if (binding[slot] == BIND_NONE && constant)
+    {
+      binding[slot] = APEX_BIND_CONSTANT;
+    }
+
+    for (int s = 0; binding[slot] == BIND_NONE && s < APEX_SHADOW_SOURCES; ++s)
+    {
+      if (source_matches(observations, count, slot, s))
+      {
+        binding[slot] = s;
+      }
+    }
+
+    if (binding[slot] == BIND_NONE)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Rebuilds the value slots from the current shadow values */
+void shadow_apply(APEX_CPU *cpu, const int *binding, const int *constants)
+{
+  int sources[APEX_SHADOW_SOURCES];
+  int source_pc[APEX_SHADOW_SOURCES];
+  int pc;
+
+  gather_sources(cpu->shadow, sources, source_pc);
+  for (int i = 0; i < APEX_SHADOW_SLOTS; ++i)
+  {
+    *slot_address(cpu, i, &pc) =
+        binding[i] == APEX_BIND_CONSTANT ? constants[i] : sources[binding[i]];
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef _APEX_SHADOW_H_
+#define _APEX_SHADOW_H_
+/**
+ *  shadow.h
+ *  Contains the functional shadow of the pipeline and the capture of
+ *  pipeline state, shared by the techniques that skip simulated cycles.
+ *
+ *  Pipeline state is split into control, which decides the timing of
+ *  the following cycles, and value slots, which are rebuilt from the
+ *  values the shadow computed.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+#include "functional.h"
+
+/* Most recently executed instructions whose values can sit in the pipeline */
+#define APEX_SHADOW_RING 8
+#define APEX_SHADOW_RECORD_VALUES 7
+
+/* Latch fields and CPU state that decide the timing of the next cycles */
+#define APEX_SHADOW_CONTROL (NUM_STAGES * 15 + 28 + 2 * APEX_MAX_EVENTS)
+
+/* Latch values, registers, forwarded values and the zero flag */
+#define APEX_SHADOW_SLOTS (NUM_STAGES * 5 + 16 + 16 + 1)
+
+/* Values the slots are rebuilt from: records, registers and the zero flag */
+#define APEX_SHADOW_SOURCES \
+  (APEX_SHADOW_RING * APEX_SHADOW_RECORD_VALUES + 16 + 1)
+
+/* Statistics counters that skipped cycles have to advance */
+#define APEX_SHADOW_COUNTERS (NUM_STAGES + 6)
+
+/* Slot binding that keeps the value the slot was observed with */
+#define APEX_BIND_CONSTANT -1
+
+/* Functional executor shadowing every instruction that leaves Execute2 */
+typedef struct APEX_Shadow
+{
+  APEX_FuncState state;
+  APEX_FuncRecord ring[APEX_SHADOW_RING];
+  int ring_head;
+  int expected_pc;
+  long executed; // Instructions executed
+  long branches; // Taken branches and jumps executed
+  int broken;    // The pipeline and the shadow disagreed, stop skipping
+
+  /* Stores that left Execute2 twice, the copy writes memory again */
+  int duplicate_stores;
+  int last_store_address;
+  int last_store_value;
+} APEX_Shadow;
+
+/* Shadow state to return to when functional execution is undone */
+typedef struct APEX_ShadowMark
+{
+  int regs[16];
+  int zflag;
+  APEX_FuncRecord ring[APEX_SHADOW_RING];
+  int ring_head;
+  int expected_pc;
+  long executed;
+  long branches;
+} APEX_ShadowMark;
+
+/* Value slots of the pipeline and the shadow values at one point */
+typedef struct APEX_Observation
+{
+  int slots[APEX_SHADOW_SLOTS];
+  int slot_pc[APEX_SHADOW_SLOTS]; // PC of the latch holding the slot, or 0
+  int sources[APEX_SHADOW_SOURCES];
+  int source_pc[APEX_SHADOW_SOURCES];
+} APEX_Observation;
+
+APEX_Shadow *shadow_create(APEX_CPU *cpu);
+
+void shadow_destroy(APEX_Shadow *shadow);
+
+void shadow_execute(APEX_CPU *cpu, const CPU_Stage *stage);
+
+void shadow_store(APEX_CPU *cpu, int address, int value);
+
+int shadow_stores_in_flight(const APEX_Shadow *shadow);
+
+const APEX_Instruction *shadow_instruction(APEX_CPU *cpu, int pc);
+
+int shadow_run(APEX_CPU *cpu, int pc, int count, APEX_FuncRecord *records);
+
+void shadow_mark(const APEX_Shadow *shadow, APEX_ShadowMark *mark);
+
+void shadow_rollback(APEX_Shadow *shadow, const APEX_ShadowMark *mark,
+                     const APEX_FuncRecord *records, int count);
+
+void shadow_capture_control(APEX_CPU *cpu, int *control);
+
+void shadow_restore_control(APEX_CPU *cpu, const int *control);
+
+void shadow_counters(APEX_CPU *cpu, int *counters);
+
+void shadow_advance(APEX_CPU *cpu, int cycles, const int *counter_delta,
+                    long times);
+
+void shadow_observe(APEX_CPU *cpu, APEX_Observation *observation);
+
+int shadow_bind(const APEX_Observation *const *observations, int count,
+                int *binding);
+
+void shadow_apply(APEX_CPU *cpu, const int *binding, const int *constants);
+
+#endif
@@ -0,0 +1,386 @@
+/*
+ *  smt.c
+ *  Contains simultaneous multithreading
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smt.h"
+
+static void
+save_context(const APEX_CPU *cpu, APEX_Context *context)
+{
+  context->pc = cpu->pc;
+  memcpy(context->regs, cpu->regs, sizeof(context->regs));
+  memcpy(context->regs_valid, cpu->regs_valid, sizeof(context->regs_valid));
+  memcpy(context->forwardedValues, cpu->forwardedValues,
+         sizeof(context->forwardedValues));
+  context->data_memory = cpu->data_memory;
+  context->isBranchOrJumpTaken = cpu->isBranchOrJumpTaken;
+  context->branchPcValue = cpu->branchPcValue;
+  context->isForwarded = cpu->isForwarded;
+  context->zFlag = cpu->zFlag;
+  context->zcounter = cpu->zcounter;
+  context->bnzcounter = cpu->bnzcounter;
+  context->reservation = cpu->reservation;
+  context->vregs = cpu->vregs;
+  context->loop_start = cpu->loop_start;
+  context->loop_end = cpu->loop_end;
+  context->loop_remaining = cpu->loop_remaining;
+  memcpy(context->ras, cpu->ras, sizeof(context->ras));
+  context->ras_top = cpu->ras_top;
+}
+
+static void
+load_context(APEX_CPU *cpu, const APEX_Context *context)
+{
+  cpu->pc = context->pc;
+  memcpy(cpu->regs, context->regs, sizeof(context->regs));
+  memcpy(cpu->regs_valid, context->regs_valid, sizeof(context->regs_valid));
+  memcpy(cpu->forwardedValues, context->forwardedValues,
+         sizeof(context->forwardedValues));
+  cpu->data_memory = context->data_memory;
+  cpu->isBranchOrJumpTaken = context->isBranchOrJumpTaken;
+  cpu->branchPcValue = context->branchPcValue;
+  cpu->isForwarded = context->isForwarded;
+  cpu->zFlag = context->zFlag;
+  cpu->zcounter = context->zcounter;
+  cpu->bnzcounter = context->bnzcounter;
+  cpu->reservation = context->reservation;
+  cpu->vregs = context->vregs;
+  cpu->loop_start = context->loop_start;
+  cpu->loop_end = context->loop_end;
+  cpu->loop_remaining = context->loop_remaining;
+  memcpy(cpu->ras, context->ras, sizeof(context->ras));
+  cpu->ras_top = context->ras_top;
+}
+
+/*
+ * Gives the cpu `threads` contexts in the state it is in now. Each one
+ * gets its own copy of the data memory and vector registers.
+ */
+APEX_Smt *
+smt_create(APEX_CPU *cpu, int threads, int policy)
+{
+  size_t bytes = cpu->data_memory_size * sizeof(int);
+  APEX_Smt *smt = calloc(1, sizeof(*smt));
+  if (!smt)
+  {
+    return NULL;
+  }
+
+  smt->threads = threads;
+  smt->policy = policy;
+  smt->last_fetched = threads - 1;
+  smt->initial_memory = malloc(bytes);
+  if (!smt->initial_memory)
+  {
+    smt_destroy(smt);
+    return NULL;
+  }
+  memcpy(smt->initial_memory, cpu->data_memory, bytes);
+
+  save_context(cpu, &smt->context[0]);
+  for (int t = 1; t < threads; ++t)
+  {
+    smt->context[t] = smt->context[0];
+    smt->context[t].data_memory = malloc(bytes);
+    if (!smt->context[t].data_memory)
+    {
+      smt_destroy(smt);
+      return NULL;
+    }
+    memcpy(smt->context[t].data_memory, cpu->data_memory, bytes);
+
+    smt->context[t].vregs = malloc(APEX_VECTOR_REGS * APEX_MAX_VLEN * sizeof(int));
+    if (!smt->context[t].vregs)
+    {
+      smt_destroy(smt);
+      return NULL;
+    }
+    memcpy(smt->context[t].vregs, cpu->vregs,
+           APEX_VECTOR_REGS * APEX_MAX_VLEN * sizeof(int));
+  }
+  return smt;
+}
+
+/* Context 0 has to be in the cpu, its memories belong to the cpu */
+void smt_destroy(APEX_Smt *smt)
+{
+  if (!smt)
+  {
+    return;
+  }
+  for (int t = 1; t < smt->threads; ++t)
+  {
+    free(smt->context[t].data_memory);
+    free(smt->context[t].vregs);
+  }
+  free(smt->initial_memory);
+  free(smt);
+}
+
+void smt_switch(APEX_CPU *cpu, int thread)
+{
+  APEX_Smt *smt = cpu->smt;
+
+  if (thread != smt->active)
+  {
+    save_context(cpu, &smt->context[smt->active]);
+    load_context(cpu, &smt->context[thread]);
+    smt->active = thread;
+  }
+}
+
+/* Instructions of a context in Decode waiting and in Execute1 to Memory2 */
+static int
+in_flight(const APEX_CPU *cpu, int thread)
+{
+  int count = 0;
+
+  for (int i = DRF; i <= MEM2; ++i)
+  {
+    const CPU_Stage *stage = &cpu->stage[i];
+    if (stage->thread == thread && stage->op != OP_NONE &&
+        (i != DRF || stage->stalled))
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+/* Context Fetch works for this cycle, -1 if none can fetch */
+static int
+pick_thread(APEX_CPU *cpu)
+{
+  APEX_Smt *smt = cpu->smt;
+  int best = -1;
+  int best_count = INT_MAX;
+
+  save_context(cpu, &smt->context[smt->active]);
+  for (int k = 1; k <= smt->threads; ++k)
+  {
+    int t = (smt->last_fetched + k) % smt->threads;
+    const APEX_Context *context = &smt->context[t];
+
+    /* A context being redirected fetches again from the next cycle */
+    if (context->fetch_done || context->done_cycle ||
+        context->isBranchOrJumpTaken)
+    {
+      continue;
+    }
+    if (smt->policy == APEX_SMT_ROUND_ROBIN)
+    {
+      return t;
+    }
+
+    int count = in_flight(cpu, t);
+    if (count < best_count)
+    {
+      best = t;
+      best_count = count;
+    }
+  }
+  return best;
+}
+
+/*
+ * Puts the context of the instruction a stage works on into the cpu.
+ * Fetch picks one by the policy; returns -1 when no context can fetch,
+ * Decode then gets an empty slot and Fetch does not run.
+ */
+int smt_enter_stage(APEX_CPU *cpu, int stage_index)
+{
+  APEX_Smt *smt = cpu->smt;
+  CPU_Stage *fetch = &cpu->stage[F];
+
+  if (stage_index != F || fetch->stalled)
+  {
+    smt_switch(cpu, cpu->stage[stage_index].thread);
+    return 0;
+  }
+
+  int thread = pick_thread(cpu);
+  if (thread < 0)
+  {
+    memset(fetch, 0, sizeof(*fetch));
+    fetch->rd = -1;
+    cpu->stage[DRF] = *fetch;
+    if (cpu->debug_messages)
+    {
+      printf("%-15s EMPTY\n", "Fetch");
+    }
+    return -1;
+  }
+
+  smt_switch(cpu, thread);
+  fetch->thread = thread;
+  smt->last_fetched = thread;
+  return 0;
+}
+
+/* The active context fetches nothing more */
+void smt_stop_fetch(APEX_CPU *cpu)
+{
+  cpu->smt->context[cpu->smt->active].fetch_done = 1;
+}
+
+/* An instruction of `thread` in Execute2 to Memory2 writes register rd */
+static int
+writer_in_flight(const APEX_CPU *cpu, int thread, int rd)
+{
+  for (int i = EX2; i <= MEM2; ++i)
+  {
+    if (cpu->stage[i].thread == thread && cpu->stage[i].rd == rd)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Empties the Fetch, Decode and Execute1 latches holding `thread`, called
+ * from Execute2. The instruction in Execute1 passed Decode, the register
+ * it invalidated is valid again unless an older one still writes it. A
+ * HALT or the end of code reached on the wrong path stopped fetching too.
+ */
+void smt_squash(APEX_CPU *cpu, int thread)
+{
+  CPU_Stage *decoded = &cpu->stage[EX1];
+  APEX_Context *context = &cpu->smt->context[thread];
+
+  if (!context->done_cycle)
+  {
+    context->fetch_done = 0;
+  }
+
+  if (decoded->thread == thread && decoded->op != OP_NONE &&
+      decoded->rd >= 0 && decoded->rd < 16 &&
+      !writer_in_flight(cpu, thread, decoded->rd))
+  {
+    cpu->regs_valid[decoded->rd] = 16843009;
+  }
+
+  for (int i = F; i <= EX1; ++i)
+  {
+    CPU_Stage *stage = &cpu->stage[i];
+    if (stage->thread == thread)
+    {
+      memset(stage, 0, sizeof(*stage));
+      stage->thread = thread;
+      stage->rd = -1;
+    }
+  }
+}
+
+/*
+ * Called after Writeback. A context completes at its HALT, or at its last
+ * instruction other than a RET without a cycle limit; the run completes
+ * with the last context or at the cycle limit.
+ */
+void smt_writeback(APEX_CPU *cpu)
+{
+  APEX_Smt *smt = cpu->smt;
+  CPU_Stage *stage = &cpu->stage[WB];
+  APEX_Context *context = &smt->context[stage->thread];
+
+  if (stage->busy || stage->stalled)
+  {
+    return;
+  }
+  /* Copies of an instruction Decode left behind pass Writeback again */
+  if (stage->op != OP_NONE && stage->seq > context->counted_seq)
+  {
+    context->instructions++;
+    context->counted_seq = stage->seq;
+  }
+  if (cpu->isComplete != 1)
+  {
+    return;
+  }
+
+  if (stage->op == OP_HALT ||
+      (cpu->cycles == 0 && stage->op != OP_RET &&
+       stage->pc == ((cpu->code_memory_size * 4) + 4000) - 4))
+  {
+    context->done_cycle = cpu->clock + 1;
+    context->fetch_done = 1;
+  }
+
+  cpu->isComplete = cpu->cycles > 0 && cpu->clock == cpu->cycles - 1;
+  for (int t = 0; t < smt->threads && !cpu->isComplete; ++t)
+  {
+    if (!smt->context[t].done_cycle)
+    {
+      return;
+    }
+  }
+  cpu->isComplete = 1;
+}
+
+/* Cycles the program takes on its own, with the data memory it started with */
+static int
+single_thread_cycles(const APEX_CPU *cpu)
+{
+  APEX_CPU *solo = APEX_cpu_create(cpu->code_memory, cpu->code_memory_size,
+                                   1, cpu->cycles);
+  if (!solo)
+  {
+    return 0;
+  }
+  solo->mul_latency = cpu->mul_latency;
+  solo->mem_latency = cpu->mem_latency;
+  solo->vlen = cpu->vlen;
+  solo->vector_lanes = cpu->vector_lanes;
+  solo->quiet = 1;
+
+  if (cpu->data_memory_size > solo->data_memory_size)
+  {
+    int *memory = calloc(cpu->data_memory_size, sizeof(int));
+    if (!memory)
+    {
+      APEX_cpu_stop(solo);
+      return 0;
+    }
+    free(solo->data_memory);
+    solo->data_memory = memory;
+    solo->data_memory_size = cpu->data_memory_size;
+  }
+  memcpy(solo->data_memory, cpu->smt->initial_memory,
+         cpu->data_memory_size * sizeof(int));
+
+  APEX_cpu_simulate(solo);
+  int cycles = solo->clock;
+  APEX_cpu_stop(solo);
+  return cycles;
+}
+
+void smt_print_stats(APEX_CPU *cpu)
+{
+  APEX_Smt *smt = cpu->smt;
+  long instructions = 0;
+
+  for (int t = 0; t < smt->threads; ++t)
+  {
+    const APEX_Context *context = &smt->context[t];
+    int cycles = context->done_cycle ? context->done_cycle : cpu->clock;
+    printf("|    Thread %d IPC\t     |    %.3f (%d instructions, %d cycles)\n",
+           t, cycles ? (double)context->instructions / cycles : 0.0,
+           context->instructions, cycles);
+    instructions += context->instructions;
+  }
+  printf("|    Combined IPC\t     |    %.3f\n",
+         cpu->clock ? (double)instructions / cpu->clock : 0.0);
+
+  int solo = single_thread_cycles(cpu);
+  printf("|    Single-thread cycles    |    %d\n", solo);
+  printf("|    Throughput gain\t     |    %.2fx\n",
+         cpu->clock ? (double)smt->threads * solo / cpu->clock : 0.0);
+}
@@ -0,0 +1,82 @@
+#ifndef _APEX_SMT_H_
+#define _APEX_SMT_H_
+/**
+ *  smt.h
+ *  Contains simultaneous multithreading. Several hardware contexts run
+ *  the program on the one pipeline, each with its own PC, registers,
+ *  forwarding values, flags and data memory. Fetch picks a context every
+ *  cycle and latches carry the context of their instruction, so a stage
+ *  works on the state of the instruction it holds and a taken branch only
+ *  flushes its own context.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+#define APEX_SMT_MAX_THREADS 4
+
+/* Fetch policies */
+enum
+{
+  APEX_SMT_ROUND_ROBIN,
+  APEX_SMT_ICOUNT, // Context with the fewest instructions in the pipeline
+};
+
+/* Architectural state of a context while another one is in APEX_CPU */
+typedef struct APEX_Context
+{
+  int pc;
+  int regs[16];
+  int regs_valid[16];
+  int forwardedValues[16];
+  int *data_memory;
+  int isBranchOrJumpTaken;
+  int branchPcValue;
+  int isForwarded;
+  int zFlag;
+  int zcounter;
+  int bnzcounter;
+  int reservation;
+  int *vregs;
+  int loop_start;
+  int loop_end;
+  int loop_remaining;
+  int ras[APEX_RAS_MAX_DEPTH];
+  int ras_top;
+
+  int fetch_done;   // HALT decoded or the end of code memory fetched
+  int done_cycle;   // Cycles the context took, 0 while it runs
+  int instructions; // Instructions it completed
+  int counted_seq;  // Fetch order of the last one counted
+} APEX_Context;
+
+typedef struct APEX_Smt
+{
+  int threads;
+  int policy;
+  APEX_Context context[APEX_SMT_MAX_THREADS];
+  int active;       // Context whose state is in APEX_CPU
+  int last_fetched; // Round robin starts after it
+
+  /* Data memory at the start, for the single-thread reference run */
+  int *initial_memory;
+} APEX_Smt;
+
+APEX_Smt *smt_create(APEX_CPU *cpu, int threads, int policy);
+
+void smt_destroy(APEX_Smt *smt);
+
+void smt_switch(APEX_CPU *cpu, int thread);
+
+int smt_enter_stage(APEX_CPU *cpu, int stage_index);
+
+void smt_stop_fetch(APEX_CPU *cpu);
+
+void smt_squash(APEX_CPU *cpu, int thread);
+
+void smt_writeback(APEX_CPU *cpu);
+
+void smt_print_stats(APEX_CPU *cpu);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ *  steady.c
+ *  Contains the steady-state loop extrapolation
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "steady.h"
+
+APEX_Steady *
+steady_create(void)
+{
+  return calloc(1, sizeof(APEX_Steady));
+}
+
+void steady_destroy(APEX_Steady *steady)
+{
+  if (steady)
+  {
+    free(steady->iteration);
+    free(steady);
+  }
+}
+
+/* Loop body must not contain control flow other than its back-edge */
+static int
+is_straight_line(APEX_CPU *cpu, int target, int branch_pc)
+{
+  for (int pc = target; pc < branch_pc; pc += 4)
+  {
+    const APEX_Instruction *ins = shadow_instruction(cpu, pc);
+    if (!ins || ins->op == OP_BZ || ins->op == OP_BNZ ||
+        ins->op == OP_JUMP || ins->op == OP_HALT)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void
+record_sync(APEX_CPU *cpu, APEX_SteadySync *sync)
+{
+  shadow_capture_control(cpu, sync->control);
+  shadow_observe(cpu, &sync->values);
+  shadow_counters(cpu, sync->counters);
+  sync->clock = cpu->clock;
+  sync->branches = cpu->shadow->branches;
+}
+
+/*
+ * The last APEX_STEADY_CONFIRM back-edges repeat the same pipeline state,
+ * take the same number of cycles and have no other taken branch between
+ * them
+ */
+static int
+is_periodic(const APEX_Steady *steady)
+{
+  const APEX_SteadySync *h = steady->history;
+
+  for (int i = 1; i < APEX_STEADY_CONFIRM; ++i)
+  {
+    if (memcmp(h[i].control, h[0].control, sizeof(h[0].control)) != 0 ||
+        h[i].branches - h[i - 1].branches != 1 ||
+        h[i].clock - h[i - 1].clock != h[1].clock - h[0].clock)
+    {
+      return 0;
+    }
+    for (int c = 0; c < APEX_SHADOW_COUNTERS; ++c)
+    {
+      if (h[i].counters[c] - h[i - 1].counters[c] !=
+          h[1].counters[c] - h[0].counters[c])
+      {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+ * Executes one loop iteration functionally. Returns 1 if its back-edge
+ * is taken again; otherwise the iteration is undone and 0 is returned.
+ */
+static int
+run_iteration(APEX_CPU *cpu)
+{
+  APEX_Steady *steady = cpu->steady;
+  APEX_ShadowMark mark;
+
+  shadow_mark(cpu->shadow, &mark);
+  int count = shadow_run(cpu, steady->loop_target, steady->loop_length,
+                         steady->iteration);
+
+  if (count == steady->loop_length &&
+      steady->iteration[count - 1].next_pc == steady->loop_target)
+  {
+    return 1;
+  }
+
+  /* The exit iteration is left to the pipeline */
+  shadow_rollback(cpu->shadow, &mark, steady->iteration, count);
+  return 0;
+}
+
+/*
+ * Skips the iterations that follow the confirmed period. The pipeline
+ * is left in the state it has at the back-edge of the last skipped
+ * iteration, with the values of that iteration.
+ */
+static int
+extrapolate(APEX_CPU *cpu, const int *binding)
+{
+  APEX_Steady *steady = cpu->steady;
+  const APEX_SteadySync *h = steady->history;
+  int period = h[1].clock - h[0].clock;
+  int delta[APEX_SHADOW_COUNTERS];
+  long limit = (INT_MAX - cpu->clock) / period - 1;
+  long skipped = 0;
+
+  /* Leave at least one iteration to reach the cycle limit in the pipeline */
+  if (cpu->cycles > 0)
+  {
+    limit = (cpu->cycles - 1 - cpu->clock) / period - 1;
+  }
+
+  while (skipped < limit && run_iteration(cpu))
+  {
+    skipped++;
+  }
+
+  if (!skipped)
+  {
+    return 0;
+  }
+
+  for (int c = 0; c < APEX_SHADOW_COUNTERS; ++c)
+  {
+    delta[c] = h[1].counters[c] - h[0].counters[c];
+  }
+  shadow_apply(cpu, binding, h[APEX_STEADY_CONFIRM - 1].values.slots);
+  shadow_advance(cpu, period, delta, skipped);
+
+  steady->iterations += skipped;
+  steady->cycles += skipped * period;
+  steady->loops++;
+  return 1;
+}
+
+/*
+ * Called at the start of a cycle in which fetch is redirected. If the
+ * redirect is the backward branch of a loop, records the state and
+ * extrapolates once it repeats. Returns 1 if cycles were skipped.
+ */
+int steady_back_edge(APEX_CPU *cpu)
+{
+  APEX_Steady *steady = cpu->steady;
+  const CPU_Stage *branch = &cpu->stage[MEM1];
+  const APEX_Observation *observations[APEX_STEADY_CONFIRM];
+  int binding[APEX_SHADOW_SLOTS];
+
+  if (cpu->shadow->broken || !branch->taken || branch->imm >= 0 ||
+      (branch->op != OP_BZ && branch->op != OP_BNZ))
+  {
+    return 0;
+  }
+
+  if (branch->pc != steady->loop_pc)
+  {
+    steady->loop_pc = branch->pc;
+    steady->loop_target = branch->pc + branch->imm;
+    steady->loop_ok = is_straight_line(cpu, steady->loop_target, branch->pc);
+    steady->syncs = 0;
+
+    steady->loop_length = (steady->loop_pc - steady->loop_target) / 4 + 1;
+    if (steady->loop_ok && steady->loop_length > steady->iteration_capacity)
+    {
+      APEX_FuncRecord *iteration = realloc(
+          steady->iteration, steady->loop_length * sizeof(*iteration));
+      steady->loop_ok = iteration != NULL;
+      if (iteration)
+      {
+        steady->iteration = iteration;
+        steady->iteration_capacity = steady->loop_length;
+      }
+    }
+  }
+
+  /* Stores still in flight are not part of the extrapolated state */
+  if (!steady->loop_ok || shadow_stores_in_flight(cpu->shadow))
+  {
+    steady->syncs = 0;
+    return 0;
+  }
+
+  if (steady->syncs == APEX_STEADY_CONFIRM)
+  {
+    memmove(steady->history, steady->history + 1,
+            sizeof(APEX_SteadySync) * (APEX_STEADY_CONFIRM - 1));
+    steady->syncs--;
+  }
+  record_sync(cpu, &steady->history[steady->syncs++]);
+
+  if (steady->syncs < APEX_STEADY_CONFIRM || !is_periodic(steady))
+  {
+    return 0;
+  }
+
+  for (int i = 0; i < APEX_STEADY_CONFIRM; ++i)
+  {
+    observations[i] = &steady->history[i].values;
+  }
+  if (shadow_bind(observations, APEX_STEADY_CONFIRM, binding) < 0)
+  {
+    return 0;
+  }
+
+  steady->syncs = 0;
+  return extrapolate(cpu, binding);
+}
@@ -0,0 +1,54 @@
+#ifndef _APEX_STEADY_H_
+#define _APEX_STEADY_H_
+/**
+ *  steady.h
+ *  Contains the steady-state loop extrapolation. Once a loop back-edge
+ *  sees the same pipeline state a few times in a row, the remaining
+ *  iterations are executed functionally and their cycles are added
+ *  without simulating them.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "shadow.h"
+
+/* Back-edges with the same pipeline state needed before extrapolating */
+#define APEX_STEADY_CONFIRM 3
+
+/* CPU state at one back-edge of the loop */
+typedef struct APEX_SteadySync
+{
+  int control[APEX_SHADOW_CONTROL];
+  APEX_Observation values;
+  int clock;
+  int counters[APEX_SHADOW_COUNTERS];
+  long branches;
+} APEX_SteadySync;
+
+typedef struct APEX_Steady
+{
+  /* Loop being watched */
+  int loop_pc;     // PC of its backward branch
+  int loop_target; // PC of its first instruction
+  int loop_ok;     // Body is straight-line code
+  int loop_length; // Instructions in one iteration
+  APEX_SteadySync history[APEX_STEADY_CONFIRM];
+  int syncs;
+
+  /* Records of the iteration being executed, used to undo the exit one */
+  APEX_FuncRecord *iteration;
+  int iteration_capacity;
+
+  /* Statistics */
+  long loops;
+  long iterations;
+  long cycles;
+} APEX_Steady;
+
+APEX_Steady *steady_create(void);
+
+void steady_destroy(APEX_Steady *steady);
+
+int steady_back_edge(APEX_CPU *cpu);
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ *  trace.c
+ *  Contains functions to record the committed instruction stream and to
+ *  stream it back for trace-driven timing simulation
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/* Consumed trace pages are dropped in chunks of this size while replaying */
+#define TRACE_RELEASE_CHUNK (64 << 20)
+
+static void
+flush_writer(APEX_TraceWriter *writer)
+{
+  if (writer->used)
+  {
+    fwrite(writer->buffer, 1, writer->used, writer->fp);
+    writer->used = 0;
+  }
+}
+
+static void
+put_varint(APEX_TraceWriter *writer, int value)
+{
+  /* Zig-zag so that small negative deltas stay small */
+  unsigned int v = ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+
+  while (v >= 0x80)
+  {
+    writer->buffer[writer->used++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  writer->buffer[writer->used++] = (unsigned char)v;
+}
+
+static int
+get_varint(APEX_TraceReader *reader, int *value)
+{
+  unsigned int v = 0;
+  int shift = 0;
+
+  while (reader->offset < reader->length && shift < 35)
+  {
+    unsigned char byte = reader->base[reader->offset++];
+    v |= (unsigned int)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+    {
+      *value = (int)(v >> 1) ^ -(int)(v & 1);
+      return 1;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+/*
+ * Creates a trace file and writes its header
+ */
+APEX_TraceWriter *
+trace_writer_open(const char *filename, int code_memory_size)
+{
+  APEX_TraceWriter *writer = malloc(sizeof(*writer));
+  if (!writer)
+  {
+    return NULL;
+  }
+
+  writer->fp = fopen(filename, "wb");
+  if (!writer->fp)
+  {
+    free(writer);
+    return NULL;
+  }
+
+  APEX_TraceHeader header;
+  header.magic = APEX_TRACE_MAGIC;
+  header.version = APEX_TRACE_VERSION;
+  header.start_pc = 4000;
+  header.code_memory_size = code_memory_size;
+  fwrite(&header, sizeof(header), 1, writer->fp);
+
+  writer->used = 0;
+  writer->last_pc = header.start_pc - 4;
+  writer->last_mem = 0;
+  writer->records = 0;
+  return writer;
+}
+
+/*
+ * Appends one committed instruction to the trace
+ */
+void trace_write(APEX_TraceWriter *writer, const APEX_TraceRecord *record)
+{
+  /* Flag byte plus two worst case varints */
+  if (writer->used + 11 > sizeof(writer->buffer))
+  {
+    flush_writer(writer);
+  }
+
+  unsigned char flags = 0;
+  if (record->taken)
+  {
+    flags |= APEX_TRACE_TAKEN;
+  }
+  if (record->has_mem)
+  {
+    flags |= APEX_TRACE_MEM;
+  }
+  if (record->pc != writer->last_pc + 4)
+  {
+    flags |= APEX_TRACE_PC;
+  }
+
+  writer->buffer[writer->used++] = flags;
+  if (flags & APEX_TRACE_PC)
+  {
+    put_varint(writer, record->pc - (writer->last_pc + 4));
+  }
+  if (flags & APEX_TRACE_MEM)
+  {
+    put_varint(writer, record->mem_address - writer->last_mem);
+    writer->last_mem = record->mem_address;
+  }
+
+  writer->last_pc = record->pc;
+  writer->records++;
+}
+
+void trace_writer_close(APEX_TraceWriter *writer)
+{
+  if (!writer)
+  {
+    return;
+  }
+  flush_writer(writer);
+  fclose(writer->fp);
+  free(writer);
+}
+
+static int
+decode_record(APEX_TraceReader *reader, APEX_TraceRecord *record)
+{
+  if (reader->offset >= reader->length)
+  {
+    return 0;
+  }
+
+  unsigned char flags = reader->base[reader->offset++];
+  int delta = 0;
+
+  record->pc = reader->last_pc + 4;
+  if (flags & APEX_TRACE_PC)
+  {
+    if (!get_varint(reader, &delta))
+    {
+      return 0;
+    }
+    record->pc += delta;
+  }
+
+  record->taken = (flags & APEX_TRACE_TAKEN) != 0;
+  record->has_mem = (flags & APEX_TRACE_MEM) != 0;
+  record->mem_address = 0;
+  if (record->has_mem)
+  {
+    if (!get_varint(reader, &delta))
+    {
+      return 0;
+    }
+    reader->last_mem += delta;
+    record->mem_address = reader->last_mem;
+  }
+
+  reader->last_pc = record->pc;
+  return 1;
+}
+
+/*
+ * Maps a trace file for sequential replay
+ */
+APEX_TraceReader *
+trace_reader_open(const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(APEX_TraceHeader))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    return NULL;
+  }
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+  APEX_TraceReader *reader = malloc(sizeof(*reader));
+  if (!reader)
+  {
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  memcpy(&reader->header, base, sizeof(APEX_TraceHeader));
+  if (reader->header.magic != APEX_TRACE_MAGIC ||
+      reader->header.version != APEX_TRACE_VERSION)
+  {
+    munmap(base, st.st_size);
+    free(reader);
+    return NULL;
+  }
+
+  reader->base = base;
+  reader->length = st.st_size;
+  reader->offset = sizeof(APEX_TraceHeader);
+  reader->released = 0;
+  reader->last_pc = reader->header.start_pc - 4;
+  reader->last_mem = 0;
+  reader->records = 0;
+  reader->has_next = decode_record(reader, &reader->next);
+  return reader;
+}
+
+/*
+ * Returns the next committed instruction, the one after it stays
+ * available in reader->next
+ */
+int trace_read(APEX_TraceReader *reader, APEX_TraceRecord *record)
+{
+  if (!reader->has_next)
+  {
+    return 0;
+  }
+
+  *record = reader->next;
+  reader->has_next = decode_record(reader, &reader->next);
+  reader->records++;
+
+  /* Hand fully consumed pages back so long traces do not fill memory */
+  if (reader->offset - reader->released >= 2 * TRACE_RELEASE_CHUNK)
+  {
+    madvise((void *)(reader->base + reader->released), TRACE_RELEASE_CHUNK,
+            MADV_DONTNEED);
+    reader->released += TRACE_RELEASE_CHUNK;
+  }
+  return 1;
+}
+
+void trace_reader_close(APEX_TraceReader *reader)
+{
+  if (!reader)
+  {
+    return;
+  }
+  munmap((void *)reader->base, reader->length);
+  free(reader);
+}
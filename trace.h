@@ -0,0 +1,90 @@
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+/**
+ *  trace.h
+ *  Contains the committed instruction trace format used to record a run
+ *  and replay it through the pipeline timing model
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+/* "APXT" in little endian */
+#define APEX_TRACE_MAGIC 0x54585041
+#define APEX_TRACE_VERSION 1
+
+/*
+ * Every committed instruction is one record. The first byte holds the
+ * flags below, followed by zig-zag varints for the fields that are not
+ * implied by the previous record:
+ *
+ *   APEX_TRACE_PC    pc - (previous pc + 4)
+ *   APEX_TRACE_MEM   mem_address - previous mem_address
+ *
+ * A straight-line instruction without a memory access costs one byte.
+ */
+#define APEX_TRACE_TAKEN 0x01
+#define APEX_TRACE_MEM 0x02
+#define APEX_TRACE_PC 0x04
+
+/* On-disk header of a trace file */
+typedef struct APEX_TraceHeader
+{
+  unsigned int magic;
+  unsigned int version;
+  int start_pc;         // PC of the first committed instruction
+  int code_memory_size; // Instructions in the program that was traced
+} APEX_TraceHeader;
+
+/* One decoded trace record */
+typedef struct APEX_TraceRecord
+{
+  int pc;          // Program Counter of the committed instruction
+  int taken;       // Branch or Jump redirected the fetch
+  int has_mem;     // Instruction accessed data memory
+  int mem_address; // Effective data memory address
+} APEX_TraceRecord;
+
+/* Buffered trace writer */
+typedef struct APEX_TraceWriter
+{
+  FILE *fp;
+  unsigned char buffer[1 << 16];
+  size_t used;
+  int last_pc;
+  int last_mem;
+  long records;
+} APEX_TraceWriter;
+
+/* Streaming trace reader over a read-only mapping of the trace file */
+typedef struct APEX_TraceReader
+{
+  const unsigned char *base;
+  size_t length;
+  size_t offset;
+  size_t released; // Bytes already handed back to the kernel
+  int last_pc;
+  int last_mem;
+  int has_next;
+  APEX_TraceRecord next; // One record look-ahead, used for Jump targets
+  APEX_TraceHeader header;
+  long records;
+} APEX_TraceReader;
+
+APEX_TraceWriter *
+trace_writer_open(const char *filename, int code_memory_size);
+
+void trace_write(APEX_TraceWriter *writer, const APEX_TraceRecord *record);
+
+void trace_writer_close(APEX_TraceWriter *writer);
+
+APEX_TraceReader *
+trace_reader_open(const char *filename);
+
+int trace_read(APEX_TraceReader *reader, APEX_TraceRecord *record);
+
+void trace_reader_close(APEX_TraceReader *reader);
+
+#endif
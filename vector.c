@@ -0,0 +1,111 @@
+/*
+ *  vector.c
+ *  Contains the host kernels of the vector instructions
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "vector.h"
+
+/*
+ * Elements wrap around like the 32 bit registers of the SIMD units, the
+ * kernels handle whole host vectors and finish the rest one by one. The
+ * destination may be one of the sources.
+ */
+
+#if defined(__SSE2__) && !defined(__SSE4_1__)
+/* Low 32 bits of the products, SSE2 multiplies the even elements only */
+static __m128i
+mullo_epi32(__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+#elif defined(__SSE4_1__)
+#define mullo_epi32 _mm_mullo_epi32
+#endif
+
+void vector_add(int *dest, const int *a, const int *b, int n)
+{
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_add_epi32(x, y));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_add_epi32(x, y));
+  }
+#endif
+  for (; i < n; ++i)
+  {
+    dest[i] = (int)((unsigned)a[i] + (unsigned)b[i]);
+  }
+}
+
+void vector_sub(int *dest, const int *a, const int *b, int n)
+{
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_sub_epi32(x, y));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_sub_epi32(x, y));
+  }
+#endif
+  for (; i < n; ++i)
+  {
+    dest[i] = (int)((unsigned)a[i] - (unsigned)b[i]);
+  }
+}
+
+void vector_mul(int *dest, const int *a, const int *b, int n)
+{
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_mullo_epi32(x, y));
+  }
+#endif
+#if defined(__SSE2__)
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(dest + i), mullo_epi32(x, y));
+  }
+#endif
+  for (; i < n; ++i)
+  {
+    dest[i] = (int)((unsigned)a[i] * (unsigned)b[i]);
+  }
+}
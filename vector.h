@@ -0,0 +1,20 @@
+#ifndef _APEX_VECTOR_H_
+#define _APEX_VECTOR_H_
+/**
+ *  vector.h
+ *  Contains the host kernels of the vector instructions. They work on a
+ *  whole vector register at once with the SIMD instructions the simulator
+ *  was compiled for, so a vector instruction costs the host a few
+ *  instructions rather than one per element.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+
+void vector_add(int *dest, const int *a, const int *b, int n);
+
+void vector_sub(int *dest, const int *a, const int *b, int n);
+
+void vector_mul(int *dest, const int *a, const int *b, int n);
+
+#endif
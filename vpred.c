@@ -0,0 +1,141 @@
+/*
+ *  vpred.c
+ *  Contains the load value predictor
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vpred.h"
+
+APEX_Vpred *
+vpred_create(int kind)
+{
+  APEX_Vpred *vpred = malloc(sizeof(*vpred));
+  if (!vpred)
+  {
+    return NULL;
+  }
+
+  vpred->kind = kind;
+  vpred_reset(vpred);
+  return vpred;
+}
+
+void vpred_destroy(APEX_Vpred *vpred)
+{
+  free(vpred);
+}
+
+/* Empty table and statistics; the kind is kept */
+void vpred_reset(APEX_Vpred *vpred)
+{
+  size_t settings = offsetof(APEX_Vpred, entry);
+
+  memset((char *)vpred + settings, 0, sizeof(*vpred) - settings);
+  for (int i = 0; i < APEX_VPRED_ENTRIES; ++i)
+  {
+    vpred->entry[i].pc = -1;
+  }
+}
+
+static APEX_VpredEntry *
+entry_of(const APEX_Vpred *vpred, int pc)
+{
+  return (APEX_VpredEntry *)&vpred->entry[(pc / 4) % APEX_VPRED_ENTRIES];
+}
+
+static int
+predict(const APEX_Vpred *vpred, const APEX_VpredEntry *entry)
+{
+  return vpred->kind == APEX_VPRED_STRIDE ? entry->last + entry->stride
+                                          : entry->last;
+}
+
+/* Returns 1 and the value if the load at pc is predicted */
+int vpred_lookup(const APEX_Vpred *vpred, int pc, int *value)
+{
+  const APEX_VpredEntry *entry = entry_of(vpred, pc);
+
+  if (entry->pc != pc || entry->confidence < APEX_VPRED_CONFIDENT)
+  {
+    return 0;
+  }
+  *value = predict(vpred, entry);
+  return 1;
+}
+
+/*
+ * Trains the entry of the load at pc with the value it loaded. Returns 1
+ * if the load forwarded a prediction and it was wrong.
+ */
+int vpred_train(APEX_Vpred *vpred, int pc, int value, int predicted,
+                int prediction)
+{
+  APEX_VpredEntry *entry = entry_of(vpred, pc);
+
+  vpred->loads++;
+  if (predicted)
+  {
+    vpred->predicted++;
+    vpred->correct += prediction == value;
+  }
+
+  if (entry->pc != pc)
+  {
+    entry->pc = pc;
+    entry->last = value;
+    entry->stride = 0;
+    entry->confidence = 0;
+    return predicted && prediction != value;
+  }
+
+  if (predict(vpred, entry) == value)
+  {
+    if (entry->confidence < APEX_VPRED_MAX_CONFIDENCE)
+    {
+      entry->confidence++;
+    }
+  }
+  else
+  {
+    entry->confidence = 0;
+  }
+  entry->stride = value - entry->last;
+  entry->last = value;
+  return predicted && prediction != value;
+}
+
+/* A predicted load left Decode running in this cycle */
+void vpred_count_avoided(APEX_Vpred *vpred, int clock)
+{
+  if (vpred->avoided_clock != clock + 1)
+  {
+    vpred->stall_cycles_avoided++;
+    vpred->avoided_clock = clock + 1;
+  }
+}
+
+void vpred_print_stats(const APEX_Vpred *vpred)
+{
+  static const char *names[] = {"last", "stride"};
+
+  printf("|    Value predictor\t     |    %s\n", names[vpred->kind]);
+  printf("|    Predicted loads\t     |    %ld of %ld, %ld correct\n",
+         vpred->predicted, vpred->loads, vpred->correct);
+  printf("|    Prediction coverage     |    %.1f%%\n",
+         vpred->loads ? 100.0 * vpred->predicted / vpred->loads : 0.0);
+  printf("|    Prediction accuracy     |    %.1f%%\n",
+         vpred->predicted ? 100.0 * vpred->correct / vpred->predicted : 0.0);
+  printf("|    Value flushes\t     |    %ld, %ld instructions squashed\n",
+         vpred->flushes, vpred->squashed);
+  printf("|    Load stall cycles saved |    %ld\n",
+         vpred->stall_cycles_avoided);
+  printf("|    Value flush cycles\t     |    %ld\n", vpred->flush_cycles);
+  printf("|    Net cycles saved\t     |    %ld\n",
+         vpred->stall_cycles_avoided - vpred->flush_cycles);
+}
@@ -0,0 +1,73 @@
+#ifndef _APEX_VPRED_H_
+#define _APEX_VPRED_H_
+/**
+ *  vpred.h
+ *  Contains the load value predictor. A LOAD or LDR whose pc has a
+ *  confident entry forwards the predicted value from Execute2 and Memory1
+ *  like an ALU result, instead of freezing Fetch and Decode until Memory2
+ *  has its data. Memory2 trains the entry with the loaded value and, if
+ *  the prediction was wrong, squashes the instructions from the oldest one
+ *  that read the load's register on; the older ones go on.
+ *
+ *  last predicts the value the load loaded the last time.
+ *  stride predicts that value plus the difference between the last two.
+ *
+ *  An entry is confident once its prediction was right twice in a row.
+ *
+ *  Swaroop Gowdra Shanthakumar (sgowdra1@binghamton.edu)
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Direct mapped table, indexed by pc */
+#define APEX_VPRED_ENTRIES 64
+#define APEX_VPRED_CONFIDENT 2
+#define APEX_VPRED_MAX_CONFIDENCE 3
+
+/* Predictors */
+enum
+{
+  APEX_VPRED_LAST,
+  APEX_VPRED_STRIDE,
+};
+
+typedef struct APEX_VpredEntry
+{
+  int pc; // -1 while empty
+  int last;
+  int stride;
+  int confidence; // Right predictions in a row, up to APEX_VPRED_MAX_CONFIDENCE
+} APEX_VpredEntry;
+
+typedef struct APEX_Vpred
+{
+  int kind;
+  APEX_VpredEntry entry[APEX_VPRED_ENTRIES];
+
+  /* Statistics */
+  long loads;      // Loads Memory2 trained on
+  long predicted;  // Of those, the ones that forwarded a prediction
+  long correct;
+  long flushes;    // Wrong predictions an instruction had read
+  long squashed;   // Instructions they squashed
+  long stall_cycles_avoided; // Cycles a predicted load did not freeze Decode
+  long flush_cycles;         // Fetch slots the flushes squashed
+  int avoided_clock;         // Last counted cycle + 1
+} APEX_Vpred;
+
+APEX_Vpred *vpred_create(int kind);
+
+void vpred_destroy(APEX_Vpred *vpred);
+
+void vpred_reset(APEX_Vpred *vpred);
+
+int vpred_lookup(const APEX_Vpred *vpred, int pc, int *value);
+
+int vpred_train(APEX_Vpred *vpred, int pc, int value, int predicted,
+                int prediction);
+
+void vpred_count_avoided(APEX_Vpred *vpred, int clock);
+
+void vpred_print_stats(const APEX_Vpred *vpred);
+
+#endif
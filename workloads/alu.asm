@@ -0,0 +1,19 @@
+; Integer arithmetic: a dependent chain of every ALU operation, with a
+; flag-setting SUBL closing each iteration. 400000 iterations.
+MOVC,R0,#400000
+MOVC,R1,#1
+MOVC,R2,#3
+MOVC,R3,#7
+MOVC,R4,#0
+loop:
+ADD,R4,R4,R2
+MUL,R5,R4,R3
+SUB,R6,R5,R4
+AND,R7,R6,R3
+OR,R8,R7,R2
+EX-OR,R9,R8,R4
+ADD,R2,R9,R1
+ADDL,R3,R3,#2
+SUBL,R0,R0,#1
+BNZ,loop
+HALT
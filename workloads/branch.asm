@@ -0,0 +1,27 @@
+; Data dependent branches: over 250000 values of a linear congruential
+; sequence, counts the odd ones and those with bits 2 and 3 clear into MEM[1] and MEM[2].
+MOVC,R0,#250000
+MOVC,R1,#12345
+MOVC,R2,#1103
+MOVC,R3,#1
+MOVC,R4,#0
+MOVC,R5,#0
+MOVC,R8,#12
+next:
+MUL,R1,R1,R2
+ADDL,R1,R1,#12345
+AND,R6,R1,R3
+ADDL,R6,R6,#0
+BZ,even
+ADDL,R4,R4,#1
+even:
+AND,R7,R1,R8
+ADDL,R7,R7,#0
+BNZ,skip
+ADDL,R5,R5,#1
+skip:
+SUBL,R0,R0,#1
+BNZ,next
+STORE,R4,R3,#0
+STORE,R5,R3,#1
+HALT
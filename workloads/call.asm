@@ -0,0 +1,25 @@
+; Subroutine calls: 100000 iterations each call a subroutine that calls a
+; leaf for the next value and one adding it into R1, stored into MEM[1].
+; Return addresses are passed in R15 and R14.
+; expect MEM[1] 12742480
+MOVC,R9,#100000
+MOVC,R1,#0
+MOVC,R2,#1
+MOVC,R5,#255
+loop:
+CALL,R15,step
+SUBL,R9,R9,#1
+BNZ,loop
+STORE,R1,R2,#0
+HALT
+step:
+CALL,R14,next
+CALL,R14,accumulate
+RET,R15
+next:
+AND,R3,R9,R5
+EX-OR,R3,R3,R2
+RET,R14
+accumulate:
+ADD,R1,R1,R3
+RET,R14
@@ -0,0 +1,16 @@
+; Hardware loops: an outer counted loop runs a LOOP body of arithmetic and
+; a store 500 times per pass, 1000 passes.
+MOVC,R10,#1000
+MOVC,R3,#1
+pass:
+MOVC,R1,#500
+MOVC,R2,#0
+MOVC,R6,#0
+LOOP,R1,#20
+ADD,R2,R2,R3
+ADD,R6,R6,R2
+MUL,R7,R6,R3
+STORE,R7,R2,#0
+SUBL,R10,R10,#1
+BNZ,pass
+HALT
@@ -0,0 +1,27 @@
+; Loads and stores: fills a 1000 word array, then 200 passes each sum it
+; into R5 and add it into a second array right after it.
+; expect REG[3] 199800
+; expect REG[5] 99900000
+MOVC,R0,#0
+MOVC,R1,#1000
+init:
+STORE,R0,R0,#0
+ADDL,R0,R0,#1
+SUBL,R1,R1,#1
+BNZ,init
+MOVC,R10,#200
+pass:
+MOVC,R0,#0
+MOVC,R1,#1000
+sum:
+LOAD,R2,R0,#0
+ADD,R5,R5,R2
+LOAD,R3,R0,#1000
+ADD,R3,R3,R2
+STORE,R3,R0,#1000
+ADDL,R0,R0,#1
+SUBL,R1,R1,#1
+BNZ,sum
+SUBL,R10,R10,#1
+BNZ,pass
+HALT
@@ -0,0 +1,17 @@
+; Nested loops: 1000 passes of an inner loop counting R0 down from 100,
+; adding the pass and the inner count into R5, stored into MEM[1].
+; expect MEM[1] 55100000
+MOVC,R1,#1000
+MOVC,R5,#0
+MOVC,R6,#1
+outer:
+MOVC,R0,#100
+inner:
+ADD,R5,R5,R1
+ADD,R5,R5,R0
+SUBL,R0,R0,#1
+BNZ,inner
+SUBL,R1,R1,#1
+BNZ,outer
+STORE,R5,R6,#0
+HALT
@@ -0,0 +1,26 @@
+; Recursion: 20000 times a function calls itself 6 deep, pushing its
+; return address on a stack in memory and loading it back one instruction
+; before it returns. Every return counts into R5, stored into MEM[1].
+; expect MEM[1] 120000
+MOVC,R9,#20000
+MOVC,R5,#0
+MOVC,R6,#1
+again:
+MOVC,R13,#100
+MOVC,R2,#6
+CALL,R15,rec
+SUBL,R9,R9,#1
+BNZ,again
+STORE,R5,R6,#0
+HALT
+rec:
+STORE,R15,R13,#0
+ADDL,R13,R13,#1
+SUBL,R2,R2,#1
+BZ,base
+CALL,R15,rec
+base:
+SUBL,R13,R13,#1
+LOAD,R15,R13,#0
+ADDL,R5,R5,#1
+RET,R15
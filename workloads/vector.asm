@@ -0,0 +1,33 @@
+; Vector kernel: c = a * b + a - b over two 32 element arrays, 4 elements
+; an instruction, 25000 times.
+MOVC,R0,#0
+MOVC,R1,#32
+MOVC,R2,#1
+init:
+STORE,R0,R0,#0
+ADD,R5,R0,R0
+ADDL,R5,R5,#1
+STORE,R5,R0,#32
+ADDL,R0,R0,#1
+SUBL,R1,R1,#1
+BNZ,init
+MOVC,R0,#0
+MOVC,R1,#8
+MOVC,R2,#1
+MOVC,R3,#4
+MOVC,R10,#25000
+kernel:
+VLOAD,V1,R0,#0
+VLOAD,V2,R0,#32
+VMUL,V3,V1,V2
+VADD,V3,V3,V1
+VSUB,V3,V3,V2
+VSTORE,V3,R0,#64
+ADD,R0,R0,R3
+SUB,R1,R1,R2
+BNZ,kernel
+MOVC,R0,#0
+MOVC,R1,#8
+SUBL,R10,R10,#1
+BNZ,kernel
+HALT